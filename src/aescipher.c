@@ -0,0 +1,341 @@
+/*
+ * File: aescipher.c
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "aescipher.h"
+#include "log.h"
+#include "buffer.h"
+
+/* Select the hardware implementation for the CPU (compiled per function, the CPU is checked when creating a cipher) */
+#if !defined(AES_CIPHER_TABLE_ONLY) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define	AES_CIPHER_AESNI
+#include <wmmintrin.h>
+#elif !defined(AES_CIPHER_TABLE_ONLY) && defined(__GNUC__) && defined(__aarch64__)
+#define	AES_CIPHER_ARMV8
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/* Values for AES-128 */
+#define	AES_ROUND_COUNT			10
+#define	AES_ROUND_KEY_WORDS		(4 * (AES_ROUND_COUNT + 1))
+
+/* Type definition for the AES cipher */
+struct AESCipherStruct {
+	uint32_t roundKeyWords[AES_ROUND_KEY_WORDS];		/* Big endian words (used by the table-based implementation) */
+	uint8_t roundKeys[4 * AES_ROUND_KEY_WORDS];		/* Same round keys as bytes (used by the AES instructions) */
+	uint8_t iv[AES_IV_SIZE];
+	void (*encryptBlocks)(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t blockCount);
+	const char *implementation;
+};
+
+/* Logging component name */
+static const char *LOG_COMPONENT_NAME = "aescipher.c";
+
+/* Substitution box and round table (the other three round tables are rotations of it), calculated once */
+static uint8_t aesSubstitutionBox[256];
+static uint32_t aesRoundTable[256];
+static bool isTableInitialized = false;
+
+/* Declare internal functions */
+static void aesCipherInitializeTables(void);
+static void aesCipherExpandKey(AESCipher *aesCipher, const uint8_t *key);
+static void aesCipherEncryptBlocksTable(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t blockCount);
+#ifdef AES_CIPHER_AESNI
+static void aesCipherEncryptBlocksAESNI(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t blockCount) __attribute__((target("aes,sse2")));
+#endif
+#ifdef AES_CIPHER_ARMV8
+static void aesCipherEncryptBlocksARMv8(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t blockCount) __attribute__((target("+crypto")));
+#endif
+static uint8_t aesCipherMultiplyByTwo(uint8_t value);
+static uint8_t aesCipherRotateByte(uint8_t value, int count);
+static uint32_t aesCipherRotateWord(uint32_t value, int count);
+static uint32_t aesCipherReadWord(const uint8_t *buffer);
+static void aesCipherWriteWord(uint8_t *buffer, uint32_t value);
+
+AESCipher *aesCipherCreate(const uint8_t *key, const uint8_t *iv) {
+	AESCipher *aesCipher;
+
+	/* Create AES cipher structure */
+	if(!bufferAllocate(&aesCipher, sizeof(AESCipher), "AES cipher")) {
+		return NULL;
+	}
+
+	/* Initialize structure */
+	aesCipherInitializeTables();
+	aesCipherExpandKey(aesCipher, key);
+	memcpy(aesCipher->iv, iv, AES_IV_SIZE);
+
+	/* Use the AES instructions if the CPU has them */
+	aesCipher->encryptBlocks = aesCipherEncryptBlocksTable;
+	aesCipher->implementation = "table";
+#ifdef AES_CIPHER_AESNI
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("aes")) {
+		aesCipher->encryptBlocks = aesCipherEncryptBlocksAESNI;
+		aesCipher->implementation = "AES-NI";
+	}
+#endif
+#ifdef AES_CIPHER_ARMV8
+	if((getauxval(AT_HWCAP) & HWCAP_AES) != 0) {
+		aesCipher->encryptBlocks = aesCipherEncryptBlocksARMv8;
+		aesCipher->implementation = "ARMv8";
+	}
+#endif
+	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Created AES cipher using %s implementation", aesCipher->implementation);
+
+	return aesCipher;
+}
+
+void aesCipherEncrypt(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t size) {
+	size_t encryptedSize;
+
+	/* Encrypt whole blocks and copy the remaining bytes (if any) as is */
+	encryptedSize = size - size % AES_BLOCK_SIZE;
+	aesCipher->encryptBlocks(aesCipher, input, output, encryptedSize / AES_BLOCK_SIZE);
+	if(encryptedSize < size && input != output) {
+		memcpy(output + encryptedSize, input + encryptedSize, size - encryptedSize);
+	}
+}
+
+const char *aesCipherGetImplementation(AESCipher *aesCipher) {
+	return aesCipher->implementation;
+}
+
+void aesCipherInitializeTables(void) {
+	uint8_t power;
+	uint8_t inverse;
+	uint8_t value;
+	uint8_t doubleValue;
+	int index;
+
+	if(isTableInitialized) {
+		return;
+	}
+
+	/* Walk through all powers of generator 3 and their inverses in GF(2^8) and apply the affine transformation */
+	power = 1;
+	inverse = 1;
+	do {
+		power = power ^ aesCipherMultiplyByTwo(power);
+		inverse ^= (uint8_t)(inverse << 1);
+		inverse ^= (uint8_t)(inverse << 2);
+		inverse ^= (uint8_t)(inverse << 4);
+		if((inverse & 0x80) != 0) {
+			inverse ^= 0x09;
+		}
+		aesSubstitutionBox[power] = inverse ^ aesCipherRotateByte(inverse, 1) ^ aesCipherRotateByte(inverse, 2) ^ aesCipherRotateByte(inverse, 3) ^ aesCipherRotateByte(inverse, 4) ^ 0x63;
+	} while(power != 1);
+	aesSubstitutionBox[0] = 0x63;	/* 0 has no inverse */
+
+	/* Round table combines SubBytes and MixColumns for the first row (bytes 2s, s, s, 3s) */
+	for(index = 0; index < 256; index++) {
+		value = aesSubstitutionBox[index];
+		doubleValue = aesCipherMultiplyByTwo(value);
+		aesRoundTable[index] = ((uint32_t)doubleValue << 24) | ((uint32_t)value << 16) | ((uint32_t)value << 8) | (uint32_t)(doubleValue ^ value);
+	}
+
+	isTableInitialized = true;
+}
+
+void aesCipherExpandKey(AESCipher *aesCipher, const uint8_t *key) {
+	uint32_t *words;
+	uint32_t word;
+	uint8_t roundConstant;
+	int index;
+
+	/* Expand key into round keys (FIPS-197 KeyExpansion for a 128 bit key) */
+	words = aesCipher->roundKeyWords;
+	for(index = 0; index < 4; index++) {
+		words[index] = aesCipherReadWord(key + 4 * index);
+	}
+	roundConstant = 0x01;
+	for(index = 4; index < AES_ROUND_KEY_WORDS; index++) {
+		word = words[index - 1];
+		if(index % 4 == 0) {
+			word = aesCipherRotateWord(word, 24);
+			word = ((uint32_t)aesSubstitutionBox[word >> 24] << 24) | ((uint32_t)aesSubstitutionBox[(word >> 16) & 0xff] << 16) | ((uint32_t)aesSubstitutionBox[(word >> 8) & 0xff] << 8) | (uint32_t)aesSubstitutionBox[word & 0xff];
+			word ^= (uint32_t)roundConstant << 24;
+			roundConstant = aesCipherMultiplyByTwo(roundConstant);
+		}
+		words[index] = words[index - 4] ^ word;
+	}
+
+	/* Keep round keys as bytes as well */
+	for(index = 0; index < AES_ROUND_KEY_WORDS; index++) {
+		aesCipherWriteWord(aesCipher->roundKeys + 4 * index, words[index]);
+	}
+}
+
+void aesCipherEncryptBlocksTable(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t blockCount) {
+	const uint32_t *roundKey;
+	uint32_t state[4];
+	uint32_t next[4];
+	uint32_t chain[4];
+	int round;
+	int index;
+
+	/* Chain starts with the initialization vector */
+	for(index = 0; index < 4; index++) {
+		chain[index] = aesCipherReadWord(aesCipher->iv + 4 * index);
+	}
+
+	while(blockCount > 0) {
+
+		/* Combine block with previous cipher block and first round key */
+		roundKey = aesCipher->roundKeyWords;
+		for(index = 0; index < 4; index++) {
+			state[index] = aesCipherReadWord(input + 4 * index) ^ chain[index] ^ roundKey[index];
+		}
+
+		/* Full rounds (SubBytes, ShiftRows, MixColumns and AddRoundKey using the round table) */
+		for(round = 1; round < AES_ROUND_COUNT; round++) {
+			roundKey += 4;
+			for(index = 0; index < 4; index++) {
+				next[index] = aesRoundTable[state[index] >> 24] ^
+					aesCipherRotateWord(aesRoundTable[(state[(index + 1) & 3] >> 16) & 0xff], 8) ^
+					aesCipherRotateWord(aesRoundTable[(state[(index + 2) & 3] >> 8) & 0xff], 16) ^
+					aesCipherRotateWord(aesRoundTable[state[(index + 3) & 3] & 0xff], 24) ^
+					roundKey[index];
+			}
+			memcpy(state, next, sizeof(state));
+		}
+
+		/* Final round (no MixColumns) */
+		roundKey += 4;
+		for(index = 0; index < 4; index++) {
+			chain[index] = (((uint32_t)aesSubstitutionBox[state[index] >> 24] << 24) |
+				((uint32_t)aesSubstitutionBox[(state[(index + 1) & 3] >> 16) & 0xff] << 16) |
+				((uint32_t)aesSubstitutionBox[(state[(index + 2) & 3] >> 8) & 0xff] << 8) |
+				(uint32_t)aesSubstitutionBox[state[(index + 3) & 3] & 0xff]) ^
+				roundKey[index];
+		}
+		for(index = 0; index < 4; index++) {
+			aesCipherWriteWord(output + 4 * index, chain[index]);
+		}
+
+		input += AES_BLOCK_SIZE;
+		output += AES_BLOCK_SIZE;
+		blockCount--;
+	}
+}
+
+#ifdef AES_CIPHER_AESNI
+void aesCipherEncryptBlocksAESNI(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t blockCount) {
+	__m128i roundKeys[AES_ROUND_COUNT + 1];
+	__m128i block;
+	int round;
+
+	/* Load round keys into registers once */
+	for(round = 0; round <= AES_ROUND_COUNT; round++) {
+		roundKeys[round] = _mm_loadu_si128((const __m128i *)(aesCipher->roundKeys + AES_BLOCK_SIZE * round));
+	}
+
+	/* Encrypt blocks in CBC mode (every block depends on the previous one) */
+	block = _mm_loadu_si128((const __m128i *)aesCipher->iv);
+	while(blockCount > 0) {
+		block = _mm_xor_si128(block, _mm_loadu_si128((const __m128i *)input));
+		block = _mm_xor_si128(block, roundKeys[0]);
+		for(round = 1; round < AES_ROUND_COUNT; round++) {
+			block = _mm_aesenc_si128(block, roundKeys[round]);
+		}
+		block = _mm_aesenclast_si128(block, roundKeys[AES_ROUND_COUNT]);
+		_mm_storeu_si128((__m128i *)output, block);
+
+		input += AES_BLOCK_SIZE;
+		output += AES_BLOCK_SIZE;
+		blockCount--;
+	}
+}
+#endif	/* AES_CIPHER_AESNI */
+
+#ifdef AES_CIPHER_ARMV8
+void aesCipherEncryptBlocksARMv8(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t blockCount) {
+	uint8x16_t roundKeys[AES_ROUND_COUNT + 1];
+	uint8x16_t block;
+	int round;
+
+	/* Load round keys into registers once */
+	for(round = 0; round <= AES_ROUND_COUNT; round++) {
+		roundKeys[round] = vld1q_u8(aesCipher->roundKeys + AES_BLOCK_SIZE * round);
+	}
+
+	/* Encrypt blocks in CBC mode (AESE includes AddRoundKey, so the last round key is added separately) */
+	block = vld1q_u8(aesCipher->iv);
+	while(blockCount > 0) {
+		block = veorq_u8(block, vld1q_u8(input));
+		for(round = 0; round < AES_ROUND_COUNT - 1; round++) {
+			block = vaesmcq_u8(vaeseq_u8(block, roundKeys[round]));
+		}
+		block = vaeseq_u8(block, roundKeys[AES_ROUND_COUNT - 1]);
+		block = veorq_u8(block, roundKeys[AES_ROUND_COUNT]);
+		vst1q_u8(output, block);
+
+		input += AES_BLOCK_SIZE;
+		output += AES_BLOCK_SIZE;
+		blockCount--;
+	}
+}
+#endif	/* AES_CIPHER_ARMV8 */
+
+uint8_t aesCipherMultiplyByTwo(uint8_t value) {
+	/* Multiply in GF(2^8) modulo the AES polynomial x^8 + x^4 + x^3 + x + 1 */
+	return (uint8_t)((value << 1) ^ ((value & 0x80) != 0 ? 0x1b : 0x00));
+}
+
+uint8_t aesCipherRotateByte(uint8_t value, int count) {
+	return (uint8_t)((value << count) | (value >> (8 - count)));
+}
+
+uint32_t aesCipherRotateWord(uint32_t value, int count) {
+	/* Rotate right */
+	return (value >> count) | (value << (32 - count));
+}
+
+uint32_t aesCipherReadWord(const uint8_t *buffer) {
+	/* Read value in big endian byte order */
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+void aesCipherWriteWord(uint8_t *buffer, uint32_t value) {
+	/* Write value in big endian byte order */
+	buffer[0] = (uint8_t)(value >> 24);
+	buffer[1] = (uint8_t)(value >> 16);
+	buffer[2] = (uint8_t)(value >> 8);
+	buffer[3] = (uint8_t)value;
+}
+
+bool aesCipherClose(AESCipher **aesCipher) {
+	bool result;
+
+	/* Clear key material before freeing */
+	result = true;
+	if(*aesCipher != NULL) {
+		memset(*aesCipher, 0, sizeof(AESCipher));
+		if(!bufferFree(aesCipher)) {
+			result = false;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,85 @@
+/*
+ * File: aescipher.h
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef	__AESCIPHER_H__
+#define	__AESCIPHER_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* Sizes of key, initialization vector and block (AES-128) */
+#define	AES_KEY_SIZE		16
+#define	AES_IV_SIZE		16
+#define	AES_BLOCK_SIZE		16
+
+/* Type definition for AESCipher */
+typedef struct AESCipherStruct AESCipher;
+
+/*
+ * Function: aesCipherCreate
+ * Parameters:
+ *	key - key (AES_KEY_SIZE bytes)
+ *	iv - initialization vector (AES_IV_SIZE bytes)
+ * Returns: AESCipher structure
+ *
+ * Remarks:
+ * The round keys are expanded once here. The AES instructions of the CPU (AES-NI or ARMv8 Cryptography Extension) are
+ * used when available, otherwise a table-based implementation is used. Define AES_CIPHER_TABLE_ONLY when compiling
+ * to leave out the hardware implementations (for compilers without the intrinsics).
+ */
+AESCipher *aesCipherCreate(const uint8_t *key, const uint8_t *iv);
+
+/*
+ * Function: aesCipherEncrypt
+ * Parameters:
+ *	aesCipher - already created AES Cipher (as returned by aesCipherCreate)
+ *	input - buffer containing the data to encrypt
+ *	output - buffer to write the encrypted data to (at least size bytes, may be the same as input)
+ *	size - size (in bytes) of the data
+ *
+ * Remarks:
+ * The data is encrypted in CBC mode, starting from the initialization vector on every call (as AirTunes encrypts every
+ * audio packet on its own). Only whole blocks are encrypted, the remaining bytes (less than AES_BLOCK_SIZE) are copied
+ * as is. No memory is allocated.
+ */
+void aesCipherEncrypt(AESCipher *aesCipher, const uint8_t *input, uint8_t *output, size_t size);
+
+/*
+ * Function: aesCipherGetImplementation
+ * Parameters:
+ *	aesCipher - already created AES Cipher (as returned by aesCipherCreate)
+ * Returns: name of the implementation used for encrypting ("AES-NI", "ARMv8" or "table")
+ */
+const char *aesCipherGetImplementation(AESCipher *aesCipher);
+
+/*
+ * Function: aesCipherClose
+ * Parameters:
+ *	aesCipher - already created AES Cipher (as returned by aesCipherCreate)
+ * Returns: a boolean specifying if the AES Cipher is closed successfully
+ *
+ * Remarks:
+ * The key material is cleared. This function will make the AES Cipher pointer NULL, so a closed cipher cannot be reused.
+ */
+bool aesCipherClose(AESCipher **aesCipher);
+
+#endif	/* __AESCIPHER_H__ */
@@ -0,0 +1,517 @@
+/*
+ * File: eventloop.c
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "eventloop.h"
+#include "log.h"
+#include "buffer.h"
+
+/* Maximum number of events handled per iteration */
+#define	MAX_EVENT_LOOP_EVENTS		32
+#define	UNUSED_DESCRIPTOR		-1
+
+/* Latency of handling timers is counted in buckets of EVENT_LOOP_LATENCY_RESOLUTION microseconds (last bucket counts all larger ones) */
+#define	LATENCY_BUCKET_COUNT		1000
+#define	ONE_SECOND_IN_NANO_SECONDS	1000000000LL
+
+/* Type definition for a registered descriptor */
+typedef struct EventLoopRegistrationStruct {
+	int descriptor;
+	EventLoopHandler handler;
+	void *context;
+	bool isRemoved;				/* Removed, but not freed yet (events might still be pending) */
+	struct EventLoopRegistrationStruct *next;
+} EventLoopRegistration;
+
+/* Type definition for the event loop */
+struct EventLoopStruct {
+	int pollDescriptor;
+	int wakeupDescriptor;
+	EventLoopHandler wakeupHandler;
+	void *wakeupContext;
+	bool isRunning;
+	EventLoopRegistration *registrations;
+	EventLoopTimer *timers;
+	uint32_t latencyCounts[LATENCY_BUCKET_COUNT];
+	uint32_t latencyCount;
+	uint32_t maxLatency;			/* In microseconds */
+};
+
+/* Type definition for a timer */
+struct EventLoopTimerStruct {
+	EventLoop *eventLoop;
+	int descriptor;
+	EventLoopHandler handler;
+	void *context;
+	bool isSet;
+	struct timespec expireTime;		/* Time the timer expires (or was set, if expired already) */
+	struct EventLoopTimerStruct *next;
+};
+
+/* Logging component name */
+static const char *LOG_COMPONENT_NAME = "eventloop.c";
+
+/* Declare internal functions */
+static EventLoopRegistration *eventLoopFindRegistration(EventLoop *eventLoop, int descriptor);
+static void eventLoopFreeRemovedRegistrations(EventLoop *eventLoop);
+static void eventLoopHandleWakeup(void *context, uint32_t events);
+static void eventLoopHandleTimer(void *context, uint32_t events);
+static uint32_t eventLoopGetPollEvents(uint32_t events);
+static uint32_t eventLoopGetLatencyPercentile(EventLoop *eventLoop, uint32_t percentile);
+
+EventLoop *eventLoopCreate(EventLoopHandler wakeupHandler, void *context) {
+	EventLoop *eventLoop;
+
+	/* Create event loop structure */
+	if(!bufferAllocate(&eventLoop, sizeof(EventLoop), "event loop")) {
+		return NULL;
+	}
+
+	/* Initialize structure */
+	eventLoop->wakeupDescriptor = UNUSED_DESCRIPTOR;
+	eventLoop->wakeupHandler = wakeupHandler;
+	eventLoop->wakeupContext = context;
+	eventLoop->isRunning = false;
+	eventLoop->registrations = NULL;
+	eventLoop->timers = NULL;
+	memset(eventLoop->latencyCounts, 0, sizeof(eventLoop->latencyCounts));
+	eventLoop->latencyCount = 0;
+	eventLoop->maxLatency = 0;
+
+	/* Create poll descriptor and descriptor for waking up the event loop */
+	eventLoop->pollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+	if(eventLoop->pollDescriptor == -1) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create poll descriptor for event loop (errno = %d)", errno);
+		eventLoop->pollDescriptor = UNUSED_DESCRIPTOR;
+		eventLoopClose(&eventLoop);
+		return NULL;
+	}
+	eventLoop->wakeupDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(eventLoop->wakeupDescriptor == -1) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create wakeup descriptor for event loop (errno = %d)", errno);
+		eventLoop->wakeupDescriptor = UNUSED_DESCRIPTOR;
+		eventLoopClose(&eventLoop);
+		return NULL;
+	}
+	if(!eventLoopAddDescriptor(eventLoop, eventLoop->wakeupDescriptor, EVENT_LOOP_READ, eventLoopHandleWakeup, eventLoop)) {
+		eventLoopClose(&eventLoop);
+		return NULL;
+	}
+
+	return eventLoop;
+}
+
+bool eventLoopAddDescriptor(EventLoop *eventLoop, int descriptor, uint32_t events, EventLoopHandler handler, void *context) {
+	EventLoopRegistration *registration;
+	struct epoll_event pollEvent;
+
+	/* Validate input */
+	if(eventLoopFindRegistration(eventLoop, descriptor) != NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Descriptor %d is already added to event loop", descriptor);
+		return false;
+	}
+
+	/* Create registration */
+	if(!bufferAllocate(&registration, sizeof(EventLoopRegistration), "event loop registration")) {
+		return false;
+	}
+	registration->descriptor = descriptor;
+	registration->handler = handler;
+	registration->context = context;
+	registration->isRemoved = false;
+
+	/* Add descriptor to poll descriptor (the registration is answered with every event) */
+	memset(&pollEvent, 0, sizeof(struct epoll_event));
+	pollEvent.events = eventLoopGetPollEvents(events);
+	pollEvent.data.ptr = registration;
+	if(epoll_ctl(eventLoop->pollDescriptor, EPOLL_CTL_ADD, descriptor, &pollEvent) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot add descriptor %d to event loop (errno = %d)", descriptor, errno);
+		bufferFree(&registration);
+		return false;
+	}
+	registration->next = eventLoop->registrations;
+	eventLoop->registrations = registration;
+
+	return true;
+}
+
+bool eventLoopModifyDescriptor(EventLoop *eventLoop, int descriptor, uint32_t events) {
+	EventLoopRegistration *registration;
+	struct epoll_event pollEvent;
+
+	/* Find registration */
+	registration = eventLoopFindRegistration(eventLoop, descriptor);
+	if(registration == NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Descriptor %d is not added to event loop (cannot modify events)", descriptor);
+		return false;
+	}
+
+	/* Modify events */
+	memset(&pollEvent, 0, sizeof(struct epoll_event));
+	pollEvent.events = eventLoopGetPollEvents(events);
+	pollEvent.data.ptr = registration;
+	if(epoll_ctl(eventLoop->pollDescriptor, EPOLL_CTL_MOD, descriptor, &pollEvent) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot modify events of descriptor %d in event loop (errno = %d)", descriptor, errno);
+		return false;
+	}
+
+	return true;
+}
+
+bool eventLoopRemoveDescriptor(EventLoop *eventLoop, int descriptor) {
+	EventLoopRegistration *registration;
+	bool result;
+
+	/* Find registration */
+	registration = eventLoopFindRegistration(eventLoop, descriptor);
+	if(registration == NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Descriptor %d is not added to event loop (cannot remove it)", descriptor);
+		return false;
+	}
+
+	/* Remove descriptor (registration is freed after current iteration, since events for it might still be pending) */
+	result = true;
+	if(epoll_ctl(eventLoop->pollDescriptor, EPOLL_CTL_DEL, descriptor, NULL) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot remove descriptor %d from event loop (errno = %d)", descriptor, errno);
+		result = false;
+	}
+	registration->isRemoved = true;
+	if(!eventLoop->isRunning) {
+		eventLoopFreeRemovedRegistrations(eventLoop);
+	}
+
+	return result;
+}
+
+EventLoopRegistration *eventLoopFindRegistration(EventLoop *eventLoop, int descriptor) {
+	EventLoopRegistration *registration;
+
+	registration = eventLoop->registrations;
+	while(registration != NULL && (registration->descriptor != descriptor || registration->isRemoved)) {
+		registration = registration->next;
+	}
+
+	return registration;
+}
+
+void eventLoopFreeRemovedRegistrations(EventLoop *eventLoop) {
+	EventLoopRegistration **registration;
+	EventLoopRegistration *removedRegistration;
+
+	registration = &eventLoop->registrations;
+	while(*registration != NULL) {
+		if((*registration)->isRemoved) {
+			removedRegistration = *registration;
+			*registration = removedRegistration->next;
+			bufferFree(&removedRegistration);
+		} else {
+			registration = &(*registration)->next;
+		}
+	}
+}
+
+EventLoopTimer *eventLoopAddTimer(EventLoop *eventLoop, EventLoopHandler handler, void *context) {
+	EventLoopTimer *eventLoopTimer;
+
+	/* Create timer structure */
+	if(!bufferAllocate(&eventLoopTimer, sizeof(EventLoopTimer), "event loop timer")) {
+		return NULL;
+	}
+	eventLoopTimer->eventLoop = eventLoop;
+	eventLoopTimer->handler = handler;
+	eventLoopTimer->context = context;
+	eventLoopTimer->isSet = false;
+
+	/* Create timer descriptor (on same clock as used for timing audio packets) */
+	eventLoopTimer->descriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(eventLoopTimer->descriptor == -1) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create timer descriptor for event loop (errno = %d)", errno);
+		bufferFree(&eventLoopTimer);
+		return NULL;
+	}
+	if(!eventLoopAddDescriptor(eventLoop, eventLoopTimer->descriptor, EVENT_LOOP_READ, eventLoopHandleTimer, eventLoopTimer)) {
+		close(eventLoopTimer->descriptor);
+		bufferFree(&eventLoopTimer);
+		return NULL;
+	}
+	eventLoopTimer->next = eventLoop->timers;
+	eventLoop->timers = eventLoopTimer;
+
+	return eventLoopTimer;
+}
+
+bool eventLoopSetTimer(EventLoopTimer *eventLoopTimer, const struct timespec *expireTime) {
+	struct itimerspec timerValue;
+	struct timespec currentTime;
+
+	/* Set absolute expire time (a zero value disarms the timer, so an expire time of 0 is not possible) */
+	memset(&timerValue, 0, sizeof(struct itimerspec));
+	if(expireTime != NULL) {
+		timerValue.it_value.tv_sec = expireTime->tv_sec;
+		timerValue.it_value.tv_nsec = expireTime->tv_nsec;
+		if(timerValue.it_value.tv_sec == 0 && timerValue.it_value.tv_nsec == 0) {
+			timerValue.it_value.tv_nsec = 1;
+		}
+
+		/* Keep time of expiring for measuring the latency (an expire time in the past expires right away) */
+		eventLoopTimer->expireTime.tv_sec = expireTime->tv_sec;
+		eventLoopTimer->expireTime.tv_nsec = expireTime->tv_nsec;
+		if(clock_gettime(CLOCK_MONOTONIC, &currentTime) == 0 && (currentTime.tv_sec > expireTime->tv_sec || (currentTime.tv_sec == expireTime->tv_sec && currentTime.tv_nsec > expireTime->tv_nsec))) {
+			eventLoopTimer->expireTime.tv_sec = currentTime.tv_sec;
+			eventLoopTimer->expireTime.tv_nsec = currentTime.tv_nsec;
+		}
+	}
+	if(timerfd_settime(eventLoopTimer->descriptor, TFD_TIMER_ABSTIME, &timerValue, NULL) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set timer of event loop (errno = %d)", errno);
+		return false;
+	}
+	eventLoopTimer->isSet = expireTime != NULL;
+
+	return true;
+}
+
+bool eventLoopIsTimerSet(EventLoopTimer *eventLoopTimer) {
+	return eventLoopTimer->isSet;
+}
+
+bool eventLoopRemoveTimer(EventLoopTimer **eventLoopTimer) {
+	EventLoopTimer **timer;
+	bool result;
+
+	/* Close all opened/allocated resource. Continu if a failure occurs, but remember failure for final result. */
+	result = true;
+	if(*eventLoopTimer != NULL) {
+		timer = &(*eventLoopTimer)->eventLoop->timers;
+		while(*timer != NULL && *timer != *eventLoopTimer) {
+			timer = &(*timer)->next;
+		}
+		if(*timer != NULL) {
+			*timer = (*eventLoopTimer)->next;
+		}
+		if(!eventLoopRemoveDescriptor((*eventLoopTimer)->eventLoop, (*eventLoopTimer)->descriptor)) {
+			result = false;
+		}
+		if(close((*eventLoopTimer)->descriptor) != 0) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot close timer descriptor of event loop (errno = %d)", errno);
+			result = false;
+		}
+		if(!bufferFree(eventLoopTimer)) {
+			result = false;
+		}
+	}
+
+	return result;
+}
+
+bool eventLoopRun(EventLoop *eventLoop) {
+	struct epoll_event pollEvents[MAX_EVENT_LOOP_EVENTS];
+	EventLoopRegistration *registration;
+	uint32_t events;
+	int eventCount;
+	int index;
+
+	/* Handle events until stopped */
+	eventLoop->isRunning = true;
+	while(eventLoop->isRunning) {
+		eventCount = epoll_wait(eventLoop->pollDescriptor, pollEvents, MAX_EVENT_LOOP_EVENTS, -1);
+		if(eventCount == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot wait for events in event loop (errno = %d)", errno);
+			eventLoop->isRunning = false;
+			return false;
+		}
+
+		/* Call handlers (skip registrations removed by an earlier handler in this iteration) */
+		for(index = 0; index < eventCount; index++) {
+			registration = (EventLoopRegistration *)pollEvents[index].data.ptr;
+			if(registration->isRemoved) {
+				continue;
+			}
+			events = 0;
+			if((pollEvents[index].events & EPOLLIN) != 0) {
+				events |= EVENT_LOOP_READ;
+			}
+			if((pollEvents[index].events & EPOLLOUT) != 0) {
+				events |= EVENT_LOOP_WRITE;
+			}
+			if((pollEvents[index].events & (EPOLLERR | EPOLLHUP)) != 0) {
+				events |= EVENT_LOOP_ERROR;
+			}
+			registration->handler(registration->context, events);
+		}
+		eventLoopFreeRemovedRegistrations(eventLoop);
+	}
+
+	return true;
+}
+
+void eventLoopStop(EventLoop *eventLoop) {
+	eventLoop->isRunning = false;
+}
+
+void eventLoopWakeup(EventLoop *eventLoop) {
+	uint64_t value;
+
+	/* Only use async-signal-safe functions here */
+	value = 1;
+	if(write(eventLoop->wakeupDescriptor, &value, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		/* Counter overflow (EAGAIN) means a wakeup is pending already */
+	}
+}
+
+void eventLoopHandleWakeup(void *context, uint32_t events) {
+	EventLoop *eventLoop;
+	uint64_t value;
+
+	/* Reset counter (multiple wakeups are handled at once) */
+	eventLoop = (EventLoop *)context;
+	if(read(eventLoop->wakeupDescriptor, &value, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		return;
+	}
+	if(eventLoop->wakeupHandler != NULL) {
+		eventLoop->wakeupHandler(eventLoop->wakeupContext, EVENT_LOOP_WAKEUP);
+	}
+}
+
+void eventLoopHandleTimer(void *context, uint32_t events) {
+	EventLoopTimer *eventLoopTimer;
+	EventLoop *eventLoop;
+	struct timespec currentTime;
+	int64_t latency;
+	uint64_t expireCount;
+
+	/* Read expire count (fails if the timer is set again after it expired, then the event is outdated) */
+	eventLoopTimer = (EventLoopTimer *)context;
+	if(read(eventLoopTimer->descriptor, &expireCount, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		return;
+	}
+	eventLoopTimer->isSet = false;
+
+	/* Count time between expiring and handling the timer (shows how fast the thread running the event loop is scheduled) */
+	eventLoop = eventLoopTimer->eventLoop;
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) == 0) {
+		latency = ((int64_t)(currentTime.tv_sec - eventLoopTimer->expireTime.tv_sec) * ONE_SECOND_IN_NANO_SECONDS + (currentTime.tv_nsec - eventLoopTimer->expireTime.tv_nsec)) / 1000;
+		if(latency < 0) {
+			latency = 0;
+		}
+		if(latency > UINT32_MAX) {
+			latency = UINT32_MAX;
+		}
+		eventLoop->latencyCounts[latency / EVENT_LOOP_LATENCY_RESOLUTION < LATENCY_BUCKET_COUNT ? latency / EVENT_LOOP_LATENCY_RESOLUTION : LATENCY_BUCKET_COUNT - 1]++;
+		eventLoop->latencyCount++;
+		if(latency > eventLoop->maxLatency) {
+			eventLoop->maxLatency = (uint32_t)latency;
+		}
+	}
+	eventLoopTimer->handler(eventLoopTimer->context, EVENT_LOOP_TIMER);
+}
+
+void eventLoopGetTimerLatency(EventLoop *eventLoop, EventLoopLatency *latency) {
+	latency->count = eventLoop->latencyCount;
+	latency->median = eventLoopGetLatencyPercentile(eventLoop, 50);
+	latency->percentile90 = eventLoopGetLatencyPercentile(eventLoop, 90);
+	latency->percentile99 = eventLoopGetLatencyPercentile(eventLoop, 99);
+	latency->max = eventLoop->maxLatency;
+}
+
+uint32_t eventLoopGetLatencyPercentile(EventLoop *eventLoop, uint32_t percentile) {
+	uint64_t count;
+	uint32_t index;
+
+	/* Find bucket containing the percentile and answer its upper bound (at most the maximum) */
+	if(eventLoop->latencyCount == 0) {
+		return 0;
+	}
+	count = 0;
+	index = 0;
+	while(index < LATENCY_BUCKET_COUNT - 1) {
+		count += eventLoop->latencyCounts[index];
+		if(count * 100 >= (uint64_t)eventLoop->latencyCount * percentile) {
+			break;
+		}
+		index++;
+	}
+
+	return (index + 1) * EVENT_LOOP_LATENCY_RESOLUTION < eventLoop->maxLatency ? (index + 1) * EVENT_LOOP_LATENCY_RESOLUTION : eventLoop->maxLatency;
+}
+
+uint32_t eventLoopGetPollEvents(uint32_t events) {
+	uint32_t pollEvents;
+
+	pollEvents = 0;
+	if((events & EVENT_LOOP_READ) != 0) {
+		pollEvents |= EPOLLIN;
+	}
+	if((events & EVENT_LOOP_WRITE) != 0) {
+		pollEvents |= EPOLLOUT;
+	}
+
+	return pollEvents;
+}
+
+bool eventLoopClose(EventLoop **eventLoop) {
+	EventLoopTimer *eventLoopTimer;
+	EventLoopRegistration *registration;
+	bool result;
+
+	/* Close all opened/allocated resource. Continu if a failure occurs, but remember failure for final result. */
+	result = true;
+	if(*eventLoop != NULL) {
+		while((*eventLoop)->timers != NULL) {
+			eventLoopTimer = (*eventLoop)->timers;
+			if(!eventLoopRemoveTimer(&eventLoopTimer)) {
+				result = false;
+			}
+		}
+		while((*eventLoop)->registrations != NULL) {
+			registration = (*eventLoop)->registrations;
+			(*eventLoop)->registrations = registration->next;
+			if(!bufferFree(&registration)) {
+				result = false;
+			}
+		}
+		if((*eventLoop)->wakeupDescriptor != UNUSED_DESCRIPTOR) {
+			if(close((*eventLoop)->wakeupDescriptor) != 0) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot close wakeup descriptor of event loop (errno = %d)", errno);
+				result = false;
+			}
+		}
+		if((*eventLoop)->pollDescriptor != UNUSED_DESCRIPTOR) {
+			if(close((*eventLoop)->pollDescriptor) != 0) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot close poll descriptor of event loop (errno = %d)", errno);
+				result = false;
+			}
+		}
+		if(!bufferFree(eventLoop)) {
+			result = false;
+		}
+	}
+
+	return result;
+}
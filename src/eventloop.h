@@ -0,0 +1,207 @@
+/*
+ * File: eventloop.h
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef	__EVENTLOOP_H__
+#define	__EVENTLOOP_H__
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+/* Type definition for EventLoop and EventLoopTimer */
+typedef struct EventLoopStruct EventLoop;
+typedef struct EventLoopTimerStruct EventLoopTimer;
+
+/* Events (combined as bit mask) */
+#define	EVENT_LOOP_READ		0x01
+#define	EVENT_LOOP_WRITE	0x02
+#define	EVENT_LOOP_ERROR	0x04	/* Error or hang up, always reported (no need to register for it) */
+#define	EVENT_LOOP_TIMER	0x08	/* Timer expired */
+#define	EVENT_LOOP_WAKEUP	0x10	/* Event loop is woken up (see eventLoopWakeup) */
+
+/* Resolution (in microseconds) of the latency of handling timers */
+#define	EVENT_LOOP_LATENCY_RESOLUTION	10
+
+/* Type definition for the latency of handling timers (all in microseconds) */
+typedef struct {
+	uint32_t count;			/* Number of timers handled */
+	uint32_t median;
+	uint32_t percentile90;
+	uint32_t percentile99;
+	uint32_t max;
+} EventLoopLatency;
+
+/* Type definition for event handlers */
+typedef void (*EventLoopHandler)(void *context, uint32_t events);
+
+/*
+ * Function: eventLoopCreate
+ * Parameters:
+ *	wakeupHandler - handler called (from within the event loop) after the event loop is woken up (might be NULL)
+ *	context - context passed to the wakeup handler
+ * Returns: EventLoop structure
+ *
+ * Remarks:
+ * An event loop waits for descriptors becoming readable or writable and for timers to expire and calls the handler
+ * registered for it. All handlers are called from the thread running the event loop (see eventLoopRun), so a single
+ * thread can serve many connections. Handlers should not block.
+ */
+EventLoop *eventLoopCreate(EventLoopHandler wakeupHandler, void *context);
+
+/*
+ * Function: eventLoopAddDescriptor
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ *	descriptor - (file) descriptor to wait for
+ *	events - events (EVENT_LOOP_READ and/or EVENT_LOOP_WRITE) to wait for (might be 0)
+ *	handler - handler called when any of the events occur
+ *	context - context passed to the handler
+ * Returns: a boolean specifying if the descriptor is added successfully
+ *
+ * Remarks:
+ * The events are level triggered, so the handler is called again as long as the descriptor is readable or writable.
+ */
+bool eventLoopAddDescriptor(EventLoop *eventLoop, int descriptor, uint32_t events, EventLoopHandler handler, void *context);
+
+/*
+ * Function: eventLoopModifyDescriptor
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ *	descriptor - (file) descriptor already added (see eventLoopAddDescriptor)
+ *	events - events (EVENT_LOOP_READ and/or EVENT_LOOP_WRITE) to wait for from now on (might be 0)
+ * Returns: a boolean specifying if the events are modified successfully
+ */
+bool eventLoopModifyDescriptor(EventLoop *eventLoop, int descriptor, uint32_t events);
+
+/*
+ * Function: eventLoopRemoveDescriptor
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ *	descriptor - (file) descriptor already added (see eventLoopAddDescriptor)
+ * Returns: a boolean specifying if the descriptor is removed successfully
+ *
+ * Remarks:
+ * A descriptor should be removed before it is closed. Its handler will not be called anymore, even if events for it
+ * are pending in the current iteration of the event loop.
+ */
+bool eventLoopRemoveDescriptor(EventLoop *eventLoop, int descriptor);
+
+/*
+ * Function: eventLoopAddTimer
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ *	handler - handler called when the timer expires
+ *	context - context passed to the handler
+ * Returns: EventLoopTimer structure
+ *
+ * Remarks:
+ * The timer is created disarmed, use eventLoopSetTimer to arm it.
+ */
+EventLoopTimer *eventLoopAddTimer(EventLoop *eventLoop, EventLoopHandler handler, void *context);
+
+/*
+ * Function: eventLoopSetTimer
+ * Parameters:
+ *	eventLoopTimer - already added Event Loop Timer (as returned by eventLoopAddTimer)
+ *	expireTime - absolute time (CLOCK_MONOTONIC) at which the timer expires (NULL to disarm the timer)
+ * Returns: a boolean specifying if the timer is set successfully
+ *
+ * Remarks:
+ * The timer expires once. An expire time in the past makes the timer expire immediately.
+ */
+bool eventLoopSetTimer(EventLoopTimer *eventLoopTimer, const struct timespec *expireTime);
+
+/*
+ * Function: eventLoopIsTimerSet
+ * Parameters:
+ *	eventLoopTimer - already added Event Loop Timer (as returned by eventLoopAddTimer)
+ * Returns: a boolean specifying if the timer is armed (and did not expire yet)
+ */
+bool eventLoopIsTimerSet(EventLoopTimer *eventLoopTimer);
+
+/*
+ * Function: eventLoopRemoveTimer
+ * Parameters:
+ *	eventLoopTimer - already added Event Loop Timer (as returned by eventLoopAddTimer)
+ * Returns: a boolean specifying if the timer is removed successfully
+ *
+ * Remarks:
+ * This function will make the Event Loop Timer pointer NULL, so a removed timer cannot be reused.
+ */
+bool eventLoopRemoveTimer(EventLoopTimer **eventLoopTimer);
+
+/*
+ * Function: eventLoopGetTimerLatency
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ *	latency - latency of handling the timers expired so far
+ *
+ * Remarks:
+ * The latency is the time between a timer expiring and its handler being called, so it shows how fast the thread
+ * running the event loop gets scheduled. The percentiles are rounded up to EVENT_LOOP_LATENCY_RESOLUTION microseconds.
+ */
+void eventLoopGetTimerLatency(EventLoop *eventLoop, EventLoopLatency *latency);
+
+/*
+ * Function: eventLoopRun
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ * Returns: a boolean specifying if the event loop ended successfully
+ *
+ * Remarks:
+ * Waits for events and calls their handlers until the event loop is stopped (see eventLoopStop).
+ */
+bool eventLoopRun(EventLoop *eventLoop);
+
+/*
+ * Function: eventLoopStop
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ *
+ * Remarks:
+ * Should be called from within a handler. The event loop stops after the handlers of the current iteration are called.
+ */
+void eventLoopStop(EventLoop *eventLoop);
+
+/*
+ * Function: eventLoopWakeup
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ *
+ * Remarks:
+ * Makes the event loop call its wakeup handler (see eventLoopCreate). Can be called from any thread and from within
+ * a signal handler, so other threads can hand over work to the thread running the event loop.
+ */
+void eventLoopWakeup(EventLoop *eventLoop);
+
+/*
+ * Function: eventLoopClose
+ * Parameters:
+ *	eventLoop - already created Event Loop (as returned by eventLoopCreate)
+ * Returns: a boolean specifying if the event loop is closed successfully
+ *
+ * Remarks:
+ * All timers still present are removed. Descriptors still present are not closed (they are owned by the caller).
+ * This function will make the Event Loop pointer NULL, so a closed event loop cannot be reused.
+ */
+bool eventLoopClose(EventLoop **eventLoop);
+
+#endif	/* __EVENTLOOP_H__ */
@@ -5,43 +5,86 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <signal.h>
-#include "raopclient.h"
+#include <sched.h>
+#include "raopgroup.h"
+#include "rtspclient.h"
+#include "network.h"
 #include "log.h"
 #include "buffer.h"
 
 static const char *LOG_COMPONENT_NAME = "light-play.c";
 
-/* Local variable */
-static RAOPClient *raopClient = NULL;
+/* Maximum number of files played one after another */
+#define	MAX_FILE_COUNT			64
+#define	SEEK_STEP_SECONDS		10
+#define	VOLUME_STEP			1.0f
+#define	REAL_TIME_DEFAULT_PRIORITY	10
+
+/* Maximum time a device may take to accept a connection when probing the devices (unreachable devices are skipped) */
+#define	DEVICE_PROBE_TIMEOUT_MILLISECONDS	1500
+
+/* Local variables */
+static RAOPGroup *raopGroup = NULL;
+static volatile sig_atomic_t isStopRequested = 0;
 
 /* Internal functions */
 static void printUsage(const char *appName, const char *printFormat, ...);
 static void signalHandler(int signalNumber);
+static M4AFile *openM4AFile(const char *fileName);
 
 
 int main(int argc, char** argv) {
 	M4AFile *m4aFile;
-	char *url;
+	M4AFile *nextM4AFile;
+	bool isNextQueued;
+	bool isFirstFile;
+	char *urls[MAX_GROUP_DEVICES];
+	int32_t latencyOffsets[MAX_GROUP_DEVICES];
+	NetworkProbeResult probeResults[MAX_GROUP_DEVICES];
+	int urlCount;
 	char *password;
 	char *portName;
 	char *fileName;
+	char *fileNames[MAX_FILE_COUNT];
+	int fileCount;
 	LogLevel logLevel;
 	char *logFileName;
+	char *authenticationFileName;
 	struct timespec playingOffset;
+	RTPTransport transport;
+	char *transportName;
+	int32_t volumeInterval;
+	bool isRecoveryEnabled;
+	bool isEncrypted;
+	char *schedulingName;
+	int schedulingPolicy;
+	int schedulingPriority;
+	int cpu;
 	char *ptr;
+	int result;
 	int i;
+	int j;
 
 	/* Initialize */
 	logSetLogLevel(LOG_LEVEL_WARNING);
 	logSetFile(stderr);
-	url = NULL;
+	urlCount = 0;
 	password = NULL;
 	portName = "5000";
 	fileName = NULL;
+	fileCount = 1;	/* First entry is reserved for <filename> */
 	logLevel = LOG_LEVEL_WARNING;
 	logFileName = NULL;
+	authenticationFileName = NULL;
 	playingOffset.tv_sec = 0;
 	playingOffset.tv_nsec = 0;
+	transport = RTP_TRANSPORT_TCP;
+	volumeInterval = -1;	/* Use default */
+	isRecoveryEnabled = false;
+	isEncrypted = false;
+	schedulingPolicy = SCHED_OTHER;	/* No real-time mode */
+	schedulingPriority = REAL_TIME_DEFAULT_PRIORITY;
+	cpu = -1;
 
 	/* Parse command line arguments */
 	i = 1;
@@ -123,6 +166,39 @@ int main(int argc, char** argv) {
 						logFileName = &argv[i][2];
 					}
 				break;
+				case 'k':
+					/* Keep authentication of devices in file */
+					if(argv[i][2] == '\0') {
+						if(i + 1 < argc) {
+							i++;
+							authenticationFileName = argv[i];
+						} else {
+							printUsage(argv[0], "Parameter value for 'k' not specified.");
+							return 1;
+						}
+					} else {
+						authenticationFileName = &argv[i][2];
+					}
+				break;
+				case 'a':
+					/* Add file to play after the previous file */
+					if(fileCount == MAX_FILE_COUNT) {
+						printUsage(argv[0], "Too many files specified (maximum %d).", MAX_FILE_COUNT);
+						return 1;
+					}
+					if(argv[i][2] == '\0') {
+						if(i + 1 < argc) {
+							i++;
+							fileNames[fileCount] = argv[i];
+						} else {
+							printUsage(argv[0], "Parameter value for 'a' not specified.");
+							return 1;
+						}
+					} else {
+						fileNames[fileCount] = &argv[i][2];
+					}
+					fileCount++;
+				break;
 				case 'o':
 					/* Set offset in file from where to start playing */
 					if(argv[i][2] == '\0') {
@@ -141,6 +217,96 @@ int main(int argc, char** argv) {
 						return 1;
 					}
 				break;
+				case 't':
+					/* Set transport for audio packets */
+					if(argv[i][2] == '\0') {
+						if(i + 1 < argc) {
+							i++;
+							transportName = argv[i];
+						} else {
+							printUsage(argv[0], "Parameter value for 't' not specified.");
+							return 1;
+						}
+					} else {
+						transportName = &argv[i][2];
+					}
+					if(strcmp(transportName, "tcp") == 0) {
+						transport = RTP_TRANSPORT_TCP;
+					} else if(strcmp(transportName, "udp") == 0) {
+						transport = RTP_TRANSPORT_UDP;
+					} else {
+						printUsage(argv[0], "Unknown transport '%s' for option 't'.", transportName);
+						return 1;
+					}
+				break;
+				case 'r':
+					/* Reconnect devices which lose their connection */
+					if(argv[i][2] != '\0') {
+						printUsage(argv[0], "Additional character(s) '%s' after option 'r'.", &argv[i][2]);
+						return 1;
+					}
+					isRecoveryEnabled = true;
+				break;
+				case 'e':
+					/* Encrypt audio */
+					if(argv[i][2] != '\0') {
+						printUsage(argv[0], "Additional character(s) '%s' after option 'e'.", &argv[i][2]);
+						return 1;
+					}
+					isEncrypted = true;
+				break;
+				case 's':
+					/* Set real-time mode: <policy>[:<priority>][@<cpu>] */
+					if(argv[i][2] == '\0') {
+						if(i + 1 < argc) {
+							i++;
+							schedulingName = argv[i];
+						} else {
+							printUsage(argv[0], "Parameter value for 's' not specified.");
+							return 1;
+						}
+					} else {
+						schedulingName = &argv[i][2];
+					}
+					if(strncmp(schedulingName, "fifo", 4) == 0) {
+						schedulingPolicy = SCHED_FIFO;
+						ptr = schedulingName + 4;
+					} else if(strncmp(schedulingName, "rr", 2) == 0) {
+						schedulingPolicy = SCHED_RR;
+						ptr = schedulingName + 2;
+					} else {
+						printUsage(argv[0], "Unknown scheduling policy '%s' for option 's'.", schedulingName);
+						return 1;
+					}
+					if(*ptr == ':') {
+						schedulingPriority = (int)strtol(ptr + 1, &ptr, 10);
+					}
+					if(*ptr == '@') {
+						cpu = (int)strtol(ptr + 1, &ptr, 10);
+					}
+					if(*ptr != '\0') {
+						printUsage(argv[0], "Additional character(s) '%s' after scheduling value 's'.", ptr);
+						return 1;
+					}
+				break;
+				case 'i':
+					/* Set minimum interval between volume changes */
+					if(argv[i][2] == '\0') {
+						if(i + 1 < argc) {
+							i++;
+							volumeInterval = (int32_t)strtoul(argv[i], &ptr, 10);
+						} else {
+							printUsage(argv[0], "Parameter value for 'i' not specified.");
+							return 1;
+						}
+					} else {
+						volumeInterval = (int32_t)strtoul(&argv[i][2], &ptr, 10);
+					}
+					if(*ptr != '\0') {
+						printUsage(argv[0], "Additional character(s) '%s' after interval value 'i'.", ptr);
+						return 1;
+					}
+				break;
 				default:
 					printUsage(argv[0], "Unknown parameter '%s' specified.", argv[i]);
 				return 1;
@@ -148,27 +314,32 @@ int main(int argc, char** argv) {
 		} else {
 			/* If argument starts with a '-' it must be a filename */
 			if(argv[i][0] == '-') {
-				if(url == NULL) {
+				if(urlCount == 0 && fileName == NULL) {
 					printUsage(argv[0], "Unknown parameter specified '%s'.", argv[i]);
 					return 1;
 				}
-				fileName = &argv[i][1];	/* A filename starting with a '-' */
-			} else {
-				if(url == NULL) {
-					url = argv[i];
-				} else if(fileName == NULL) {
-					fileName = argv[i];
-				} else {
+			}
+
+			/* Last parameter is the filename, all parameters before it are urls */
+			if(fileName != NULL) {
+				if(urlCount == MAX_GROUP_DEVICES) {
 					printUsage(argv[0], "Too many parameters specified (first unknown '%s').", argv[i]);
 					return 1;
 				}
+				urls[urlCount] = fileName;
+				urlCount++;
+			}
+			if(argv[i][0] == '-') {
+				fileName = &argv[i][1];	/* A filename starting with a '-' */
+			} else {
+				fileName = argv[i];
 			}
 		}
 		i++;
 	}
 
 	/* Check parameters */
-	if(url == NULL) {
+	if(urlCount == 0) {
 		if(fileName == NULL) {
 			printUsage(argv[0], "Required parameters <url> and <filename> not specified.");
 		} else {
@@ -177,6 +348,25 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
+	/* Split latency offset from urls */
+	for(i = 0; i < urlCount; i++) {
+		latencyOffsets[i] = 0;
+		ptr = strrchr(urls[i], '@');
+		if(ptr != NULL) {
+			*ptr = '\0';
+			ptr++;
+			latencyOffsets[i] = (int32_t)strtol(ptr, &ptr, 10);
+			if(*ptr != '\0') {
+				printUsage(argv[0], "Additional character(s) '%s' after latency offset of url '%s'.", ptr, urls[i]);
+				return 1;
+			}
+			if(transport != RTP_TRANSPORT_UDP) {
+				printUsage(argv[0], "Latency offset of url '%s' needs the udp transport (specify '-t udp').", urls[i]);
+				return 1;
+			}
+		}
+	}
+
 	/* Set logging level and file */
 	logSetLogLevel(logLevel);
 	if(logFileName != NULL) {
@@ -187,41 +377,148 @@ int main(int argc, char** argv) {
 	if(signal(SIGINT, signalHandler) == SIG_ERR) {
 		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot set signal handler for SIGINT (continuing)");
 	}
+	if(signal(SIGUSR1, signalHandler) == SIG_ERR) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot set signal handler for SIGUSR1 (continuing without pause/resume)");
+	}
+	if(signal(SIGUSR2, signalHandler) == SIG_ERR) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot set signal handler for SIGUSR2 (continuing without seeking)");
+	}
+	if(signal(SIGRTMIN, signalHandler) == SIG_ERR || signal(SIGRTMIN + 1, signalHandler) == SIG_ERR) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot set signal handler for SIGRTMIN (continuing without volume control)");
+	}
 
-	/* Describe what is passed as argument */
-	logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Going to play file '%s' on url '%s:%s'", fileName, url, portName);
+	/* Read authentication of devices from earlier runs (to send credentials right away) */
+	if(authenticationFileName != NULL && !rtspClientLoadAuthentications(authenticationFileName)) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot read authentication file '%s' (continuing without it)", authenticationFileName);
+	}
 
-	/* Open M4AFile */
-	m4aFile = m4aFileOpen(fileName);
-	if(m4aFile == NULL) {
-		return 1;
+	/* Probe all devices at once (an unreachable device is skipped without waiting for its connection to time out) */
+	if(!networkProbeHosts((const char **)urls, urlCount, portName, DEVICE_PROBE_TIMEOUT_MILLISECONDS, probeResults)) {
+		for(i = 0; i < urlCount; i++) {
+			probeResults[i].isReachable = true;	/* Let connecting decide */
+		}
 	}
-	if(!m4aFileParse(m4aFile)) {
-		return 1;
+	for(i = 0; i < urlCount; i++) {
+		if(probeResults[i].isReachable) {
+			logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Url '%s:%s' is reachable (connected in %" PRIu32 " us)", urls[i], portName, probeResults[i].connectTime);
+		} else {
+			logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Url '%s:%s' is not reachable. Skipping it.", urls[i], portName);
+		}
 	}
 
-	/* Open RAOP client */
-	raopClient = raopClientOpenConnection(url, portName, password);
-	if(raopClient == NULL) {
-		m4aFileClose(&m4aFile);
+	/* Open RAOP group (with a RAOP client per url, the file is read once for all of them) */
+	raopGroup = raopGroupCreate();
+	if(raopGroup == NULL) {
 		return 1;
 	}
+	for(i = 0; i < urlCount; i++) {
+		if(probeResults[i].isReachable && !raopGroupAddDevice(raopGroup, urls[i], portName, password, latencyOffsets[i])) {
+			logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot connect to url '%s:%s'. Skipping it.", urls[i], portName);
+		}
+	}
+	raopGroupSetTransport(raopGroup, transport);
+	raopGroupSetEncryption(raopGroup, isEncrypted);
+	raopGroupSetRecovery(raopGroup, isRecoveryEnabled);
+	if(schedulingPolicy != SCHED_OTHER && !raopGroupSetRealTime(raopGroup, schedulingPolicy, schedulingPriority, cpu)) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot set real-time mode (continuing without it)");
+	}
+	if(volumeInterval >= 0) {
+		raopGroupSetVolumeInterval(raopGroup, (uint32_t)volumeInterval);
+	}
 
-	/* Play M4AFile */
-	if(!raopClientPlayM4AFile(raopClient, m4aFile, &playingOffset)) {
-		raopClientCloseConnection(&raopClient);
-		m4aFileClose(&m4aFile);
-		return 1;
+	/* Describe what is passed as argument */
+	for(i = 0; i < urlCount; i++) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Going to play on url '%s:%s'", urls[i], portName);
+	}
+
+	/* Play files one after another (the sessions with the devices are kept in between). The next file is opened
+	 * while the current file plays, so the group can continue with it without a gap. */
+	fileNames[0] = fileName;
+	m4aFile = NULL;
+	nextM4AFile = NULL;
+	isNextQueued = false;
+	result = 0;
+	j = 0;
+	while(!isStopRequested) {
+
+		/* Start playing the next file if the group is not playing (anymore) */
+		if(!raopGroupIsPlaying(raopGroup)) {
+			if(nextM4AFile == NULL) {
+				if(j == fileCount) {
+					break;
+				}
+				nextM4AFile = openM4AFile(fileNames[j]);
+				j++;
+				if(nextM4AFile == NULL) {
+					result = 1;
+					continue;	/* Skip file */
+				}
+			}
+			isFirstFile = m4aFile == NULL && j == 1;
+			if(m4aFile != NULL && !m4aFileClose(&m4aFile)) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Failed to close m4aFile");
+				result = 1;
+			}
+			m4aFile = nextM4AFile;
+			nextM4AFile = NULL;
+			isNextQueued = false;
+
+			/* Play M4AFile (offset only applies to first file) */
+			if(!raopGroupPlayM4AFile(raopGroup, m4aFile, isFirstFile ? &playingOffset : NULL)) {
+				result = 1;
+				break;
+			}
+		}
+
+		/* Open next file while current file plays and try to queue it (if its audio format differs it is played after the current file) */
+		if(nextM4AFile == NULL && j < fileCount) {
+			nextM4AFile = openM4AFile(fileNames[j]);
+			j++;
+			if(nextM4AFile == NULL) {
+				result = 1;
+			} else {
+				isNextQueued = raopGroupQueueM4AFile(raopGroup, nextM4AFile);
+			}
+		}
+
+		/* Wait until file is played, group continued with queued file or playing is stopped */
+		if(!raopGroupWait(raopGroup)) {
+			result = 1;
+			break;
+		}
+
+		/* Close file if group continued with the queued file (audio of the previous file is read completely) */
+		if(isNextQueued && !raopGroupIsM4AFileQueued(raopGroup)) {
+			if(!m4aFileClose(&m4aFile)) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Failed to close m4aFile");
+				result = 1;
+			}
+			m4aFile = nextM4AFile;
+			nextM4AFile = NULL;
+			isNextQueued = false;
+		}
 	}
 
-	/* Wait for file to finish playing */
-	raopClientWait(raopClient);
+	/* End sessions and close RAOP group */
+	raopGroupEndSessions(raopGroup);
+	raopGroupClose(&raopGroup);
+
+	/* Keep authentication of devices for next run */
+	if(authenticationFileName != NULL && !rtspClientSaveAuthentications(authenticationFileName)) {
+		result = 1;
+	}
 
-	/* Close RAOP client and M4AFile */
-	raopClientCloseConnection(&raopClient);
-	if(!m4aFileClose(&m4aFile)) {
+	/* Close M4AFiles */
+	if(m4aFile != NULL && !m4aFileClose(&m4aFile)) {
 		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Failed to close m4aFile");
-		return 1;
+		result = 1;
+	}
+	if(nextM4AFile != NULL && !m4aFileClose(&nextM4AFile)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Failed to close m4aFile");
+		result = 1;
+	}
+	if(result != 0) {
+		return result;
 	}
 
 	/* Check if all open buffers are closed */
@@ -254,7 +551,7 @@ void printUsage(const char *appName, const char *printFormat, ...) {
 	}
 
 	/* Print usage */
-	fprintf(stderr, "Usage: %s [-?hcpvlo] <url> <filename>\n\n" \
+	fprintf(stderr, "Usage: %s [-?hcpvlkoatirse] <url>[@<ms>] [<url>[@<ms>] ...] <filename>\n\n" \
 			"    -? | -h          Print this usage message\n" \
 			"    -c[ ]<password>  Set password for using AirPort Express\n" \
 			"    -p[ ]<portname>  Set name/number of AirTunes port (default: 5000)\n"
@@ -264,7 +561,16 @@ void printUsage(const char *appName, const char *printFormat, ...) {
 			"                         i: errors, warnings and info\n"
                         "                         d: all (includes debug info)\n"
 			"    -l[ ]<filename>  Set logging to specified file\n"
-			"    -o[ ]<offset>    Set offset (in seconds) from begin of file where to start playing\n", shortAppName);
+			"    -k[ ]<filename>  Keep authentication of devices in specified file (password is sent right away next time)\n" \
+			"    -o[ ]<offset>    Set offset (in seconds) from begin of file where to start playing\n" \
+			"    -a[ ]<filename>  Add file to play after <filename> (can be repeated, played without gap if audio format matches)\n" \
+			"    -t[ ]<transport> Set transport for audio: tcp or udp (default: tcp)\n" \
+			"    -i[ ]<ms>        Set minimum interval (in milliseconds) between volume changes (default: 200)\n" \
+			"    -r               Reconnect devices which lose their connection and resume playing on them\n" \
+			"    -s[ ]<policy>[:<priority>][@<cpu>]\n" \
+			"                     Send audio in real-time mode: fifo or rr (default priority: 10, pinned to cpu if specified)\n" \
+			"    -e               Encrypt audio (AES, using the AES instructions of the CPU if available)\n" \
+			"    <url>@<ms>       Set latency offset (in milliseconds) for device, positive plays later (udp only)\n", shortAppName);
 
 	/* Print additional message if present */
 	if(printFormat != NULL) {
@@ -280,15 +586,58 @@ void printUsage(const char *appName, const char *printFormat, ...) {
 void signalHandler(int signalNumber) {
 	struct timespec progress;
 
-	if(signalNumber == SIGINT) {
+	if(signalNumber == SIGINT && raopGroup != NULL) {
 
 		/* Check how far playing has come */
-		if(raopClientGetProgress(raopClient, &progress)) {
+		if(raopGroupGetProgress(raopGroup, &progress)) {
 			logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Progress so far: %" PRIu32 " seconds", (uint32_t)(progress.tv_sec));
 		}
 
 		/* Stop playing audio */
 		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Stop playing before end of file on user request."); 
-		raopClientStopPlaying(raopClient);
+		isStopRequested = 1;
+		raopGroupStopPlaying(raopGroup);
+	} else if(signalNumber == SIGUSR1 && raopGroup != NULL) {
+
+		/* Toggle pause/resume */
+		if(raopGroupIsPaused(raopGroup)) {
+			raopGroupResumePlaying(raopGroup);
+		} else {
+			raopGroupPausePlaying(raopGroup);
+		}
+	} else if(signalNumber == SIGUSR2 && raopGroup != NULL) {
+
+		/* Skip forward */
+		if(raopGroupGetProgress(raopGroup, &progress)) {
+			progress.tv_sec += SEEK_STEP_SECONDS;
+			raopGroupSeekPlaying(raopGroup, &progress);
+		}
+	} else if(signalNumber == SIGRTMIN && raopGroup != NULL) {
+
+		/* Volume up (sent without waiting, rapid changes are coalesced) */
+		raopGroupSetVolume(raopGroup, raopGroupGetVolume(raopGroup) + VOLUME_STEP);
+	} else if(signalNumber == SIGRTMIN + 1 && raopGroup != NULL) {
+
+		/* Volume down (idem) */
+		raopGroupSetVolume(raopGroup, raopGroupGetVolume(raopGroup) - VOLUME_STEP);
+	}
+}
+
+M4AFile *openM4AFile(const char *fileName) {
+	M4AFile *m4aFile;
+
+	/* Open and parse M4AFile (so its samples can be read directly) */
+	logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Going to play file '%s'", fileName);
+	m4aFile = m4aFileOpen(fileName);
+	if(m4aFile == NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open file '%s'. Skipping it.", fileName);
+		return NULL;
 	}
+	if(!m4aFileParse(m4aFile)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot parse file '%s'. Skipping it.", fileName);
+		m4aFileClose(&m4aFile);
+		return NULL;
+	}
+
+	return m4aFile;
 }
@@ -31,6 +31,7 @@
 /* Constants */
 #define	UNUSED_OFFSET			0xffffffff
 #define	DEFAULT_FRAMES_PER_PACKET	4096
+#define	SEEK_INDEX_INTERVAL		32	/* Number of samples between entries of the seek index */
 #define	ONE_SECOND_IN_NANO_SECONDS	1000000000L
 
 /* Some macros for handling long integer string values in MP4 format and a printf macro in an 'inttypes.h' style. */
@@ -72,6 +73,8 @@ struct M4AFileStruct {
 	uint32_t samplesCount;		/* Number of samples */
 	uint32_t totalSampleSize;	/* Total size (in bytes) of all samples */
 	uint32_t largestSampleSize;	/* Size (in bytes) of the largest sample */
+	uint32_t *seekIndex;		/* Size (in bytes) of all samples before every SEEK_INDEX_INTERVAL-th sample */
+	uint32_t seekIndexCount;	/* Number of entries in seek index */
 	uint32_t timescale;		/* As number of samples per second */
 	uint32_t duration;		/* In timescale units */
 	M4AFileEncoding encoding;	/* Encoding format of the data */
@@ -323,22 +326,28 @@ uint32_t m4aFileGetLargestSampleSize(M4AFile *m4aFile) {
 bool m4aFileSetSampleOffset(M4AFile *m4aFile, struct timespec *timeOffset) {
 	uint32_t sampleOffset;
 	uint32_t sampleSize;
+	uint32_t indexEntry;
 
 	/* Calculate at which sample to start */
-	sampleOffset = m4aFile->timescale * timeOffset->tv_sec / DEFAULT_FRAMES_PER_PACKET;
+	sampleOffset = (uint32_t)(((uint64_t)m4aFile->timescale * timeOffset->tv_sec + (uint64_t)m4aFile->timescale * timeOffset->tv_nsec / ONE_SECOND_IN_NANO_SECONDS) / DEFAULT_FRAMES_PER_PACKET);
 	if(sampleOffset >= m4aFile->samplesCount) {
 		return false;
 	}
 
-	/* Start at first sample */
-	if(fseek(m4aFile->sizeStream, m4aFile->sizeOffset, SEEK_SET) != 0) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set sample offset value % for size stream (errno = %d)" PRIu32, sampleOffset, errno);
+	/* Start at nearest sample (at or before the requested one) in the seek index, or at the first sample if no index is present */
+	indexEntry = sampleOffset / SEEK_INDEX_INTERVAL;
+	if(indexEntry >= m4aFile->seekIndexCount) {
+		indexEntry = 0;
+	}
+	if(fseek(m4aFile->sizeStream, m4aFile->sizeOffset + indexEntry * SEEK_INDEX_INTERVAL * 4, SEEK_SET) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set sample offset value %" PRIu32 " for size stream (errno = %d)", sampleOffset, errno);
 		return false;
 	}
-	if(fseek(m4aFile->dataStream, m4aFile->dataOffset, SEEK_SET) != 0) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set sample offset value % for data stream (errno = %d)" PRIu32, sampleOffset, errno);
+	if(fseek(m4aFile->dataStream, m4aFile->dataOffset + (indexEntry > 0 ? m4aFile->seekIndex[indexEntry] : 0), SEEK_SET) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set sample offset value %" PRIu32 " for data stream (errno = %d)", sampleOffset, errno);
 		return false;
 	}
+	sampleOffset -= indexEntry * SEEK_INDEX_INTERVAL;
 
 	/* Iterate samples until at correct position */
 	while(sampleOffset > 0) {
@@ -404,6 +413,11 @@ bool m4aFileClose(M4AFile **m4aFile) {
 				result = false;
 			}
 		}
+		if((*m4aFile)->seekIndex != NULL) {
+			if(!bufferFree(&(*m4aFile)->seekIndex)) {
+				result = false;
+			}
+		}
 		if(!bufferFree(m4aFile)) {
 			result = false;
 		}
@@ -421,6 +435,8 @@ void m4aFileInitialize(M4AFile *m4aFile) {
 	m4aFile->sizeOffset = UNUSED_OFFSET;
 	m4aFile->totalSize = 0;
 	m4aFile->largestSampleSize = 0;
+	m4aFile->seekIndex = NULL;
+	m4aFile->seekIndexCount = 0;
 	m4aFile->timescale = 0;
 	m4aFile->duration = 0;
 	m4aFile->encoding = ENCODING_UNKNOWN;
@@ -791,6 +807,17 @@ uint32_t mp4BoxParseSampleSizes(M4AFile *m4aFile, uint32_t boxType, uint32_t box
 		return 0;
 	}
 
+	/* Create seek index (so setting a sample offset does not need to read all preceding sample sizes) */
+	if(m4aFile->seekIndex != NULL) {
+		bufferFree(&m4aFile->seekIndex);
+	}
+	m4aFile->seekIndexCount = (samplesCount + SEEK_INDEX_INTERVAL - 1) / SEEK_INDEX_INTERVAL;
+	if(m4aFile->seekIndexCount > 0 && !bufferAllocate(&m4aFile->seekIndex, m4aFile->seekIndexCount * sizeof(uint32_t), "seek index")) {
+		m4aFile->seekIndexCount = 0;
+		m4aFile->status = M4AFILE_ERROR;
+		return 0;
+	}
+
 	/* Read all sample sizes and store largest size */
 	totalSampleSize = 0;
 	largestSampleSize = 0;
@@ -798,6 +825,9 @@ uint32_t mp4BoxParseSampleSizes(M4AFile *m4aFile, uint32_t boxType, uint32_t box
 		if(!m4aFileReadUnsignedLong(m4aFile, boxType, &sampleSize)) {
 			return 0;
 		}
+		if(i % SEEK_INDEX_INTERVAL == 0) {
+			m4aFile->seekIndex[i / SEEK_INDEX_INTERVAL] = totalSampleSize;
+		}
 		totalSampleSize += sampleSize;
 		if(largestSampleSize < sampleSize) {
 			largestSampleSize = sampleSize;
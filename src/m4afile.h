@@ -139,6 +139,9 @@ uint32_t m4aFileGetLargestSampleSize(M4AFile *m4aFile);
  *	m4aFile - already open M4A file (as returned by m4aFileOpen) which is parsed (by m4aFileParse)
  *	timeOffset - offset (in seconds and nanoseconds) where 'getM4AFileNextSample' will begin providing samples
  * Returns: a boolean specifying if setting the offset of the M4A file is successful
+ *
+ * Remarks:
+ * Uses the seek index created while parsing, so only a few sample sizes are read (can be used while playing).
  */
 bool m4aFileSetSampleOffset(M4AFile *m4aFile, struct timespec *timeOffset);
 
@@ -21,19 +21,43 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
+#include <linux/sockios.h>
 #include "network.h"
 #include "log.h"
 #include "buffer.h"
 
 #define UNUSED_SOCKET_DESCRIPTOR	-1
 
+/* Do not raise SIGPIPE when a peer has closed its connection (the send will fail with EPIPE instead) */
+#ifdef MSG_NOSIGNAL
+#define	NETWORK_SEND_FLAGS		MSG_NOSIGNAL
+#else
+#define	NETWORK_SEND_FLAGS		0
+#endif
+
+/* Maximum time a (blocking style) send may wait for a non-writable connection before the peer is considered stalled */
+#define	NETWORK_SEND_TIMEOUT_MILLISECONDS	250
+
+/* Connecting (TCP) races the addresses of a host: a next address is tried when the previous one did not connect within the
+ * attempt delay (alternating IPv6 and IPv4), the first connection made is used. An offline host fails after the timeout. */
+#define	NETWORK_CONNECT_ATTEMPT_DELAY_MILLISECONDS	250
+#define	NETWORK_CONNECT_TIMEOUT_MILLISECONDS		3000
+#define	NETWORK_MAX_CONNECT_ATTEMPTS			8
+
 /* Type definition for the network connection */
 struct NetworkConnectionStruct {
 	int socketDescriptor;
@@ -49,10 +73,17 @@ struct NetworkConnectionStruct {
 static const char *LOG_COMPONENT_NAME = "network.c";
 
 static bool networkGetAddressInfo(const char *hostName, const char *portName, NetworkConnectionType connectionType, struct addrinfo **addressInfo);
-static bool networkCopyAddressInfo(NetworkConnection *networkConnection, const char *hostName, const char *portName);
+static struct addrinfo *networkConnectRacing(NetworkConnection *networkConnection, const char *hostName, struct addrinfo *addressInfoResult);
+static int networkOrderAddresses(struct addrinfo *addressInfoResult, struct addrinfo **addressInfos);
+static long networkGetRemainingMilliseconds(struct timespec *deadline);
+static void networkSetDeadline(struct timespec *deadline, int timeoutMilliseconds);
+static bool networkCopyAddressInfo(NetworkConnection *networkConnection, struct sockaddr *remoteAddress, socklen_t remoteAddressSize);
 static bool networkCopySocketAddress(struct sockaddr **destinationAddress, socklen_t *destinationAddressSize, struct sockaddr *sourceAddress, socklen_t sourceAddressSize);
 static bool networkGetAddressName(struct sockaddr *address, char *addressName, int maxAddressNameSize);
 static bool networkReceiveMessageInternal(NetworkConnection *networkConnection, uint8_t *messageBuffer, size_t maxMessageSize, size_t *messageSize, int flags);
+static NetworkSendResult networkSendMessagePartsInternal(NetworkConnection *networkConnection, struct iovec *messageParts, int partCount, int timeoutMilliseconds, size_t *sentSize);
+static bool networkWaitForWritable(NetworkConnection *networkConnection, struct timespec *deadline);
+static bool networkSetNonBlocking(NetworkConnection *networkConnection);
 static bool networkCloseSocket(NetworkConnection *networkConnection);
 
 NetworkConnection *networkOpenConnection(const char *hostName, const char *portName, NetworkConnectionType connectionType, bool makeClient) {
@@ -73,15 +104,28 @@ NetworkConnection *networkOpenConnection(const char *hostName, const char *portN
 	networkConnection->remoteAddress = NULL;
 	networkConnection->remoteAddressSize = 0;
 
-	/* Get address info for creating socket (for server-mode do not supply a hostname) */
-	if(!networkGetAddressInfo(makeClient ? hostName : NULL, portName, connectionType, &addressInfoResult)) {
+	/* Get address info for creating socket (for server-mode the hostname is the local address to bind to or NULL for any) */
+	if(!networkGetAddressInfo(hostName, portName, connectionType, &addressInfoResult)) {
 		networkCloseConnection(&networkConnection);
 		return NULL;
 	}
 
-	/* Open the socket connection and if successful connect or bind to it */
+	/* Connect a TCP client to the first address which answers (without waiting on an unreachable address first) */
+	if(makeClient && connectionType == TCP_CONNECTION) {
+		addressInfo = networkConnectRacing(networkConnection, hostName, addressInfoResult);
+		if(addressInfo != NULL) {
+			if(networkCopyAddressInfo(networkConnection, addressInfo->ai_addr, addressInfo->ai_addrlen)) {
+				networkConnection->isClient = true;
+			} else {
+				addressInfo = NULL;
+			}
+		}
+
+	/* Open the socket connection and if successful connect or bind to it (connecting UDP does not wait) */
 	/* This will try the different addresses in the linked list part of the result addressInfoResult */
-	addressInfo = addressInfoResult;
+	} else {
+		addressInfo = addressInfoResult;
+	}
 	while(addressInfo != NULL && networkConnection->socketDescriptor == UNUSED_SOCKET_DESCRIPTOR) {
 		networkConnection->socketDescriptor = socket(addressInfo->ai_family, addressInfo->ai_socktype, addressInfo->ai_protocol);
 		if(networkConnection->socketDescriptor != -1) {
@@ -91,8 +135,8 @@ NetworkConnection *networkOpenConnection(const char *hostName, const char *portN
 				connectResult = bind(networkConnection->socketDescriptor, addressInfo->ai_addr, addressInfo->ai_addrlen);
 			}
 			if(connectResult == 0) {
-				/* Keep address information of local and remote side */
-				if(networkCopyAddressInfo(networkConnection, hostName, portName)) {
+				/* Keep address information of local and remote side (all further communication is non-blocking) */
+				if(networkSetNonBlocking(networkConnection) && networkCopyAddressInfo(networkConnection, addressInfo->ai_addr, addressInfo->ai_addrlen)) {
 					networkConnection->isClient = makeClient;
 				} else {
 					networkCloseSocket(networkConnection);
@@ -124,6 +168,338 @@ NetworkConnection *networkOpenConnection(const char *hostName, const char *portN
 	return networkConnection;
 }
 
+struct addrinfo *networkConnectRacing(NetworkConnection *networkConnection, const char *hostName, struct addrinfo *addressInfoResult) {
+	struct addrinfo *addressInfos[NETWORK_MAX_CONNECT_ATTEMPTS];
+	struct addrinfo *attemptAddressInfos[NETWORK_MAX_CONNECT_ATTEMPTS];
+	struct pollfd pollDescriptors[NETWORK_MAX_CONNECT_ATTEMPTS];
+	struct timespec deadline;
+	struct timespec nextAttemptTime;
+	struct addrinfo *connectedAddressInfo;
+	socklen_t valueSize;
+	long timeoutMilliseconds;
+	int addressCount;
+	int addressIndex;
+	int attemptCount;
+	int socketError;
+	int index;
+
+	/* Order addresses and set deadline */
+	addressCount = networkOrderAddresses(addressInfoResult, addressInfos);
+	networkSetDeadline(&deadline, NETWORK_CONNECT_TIMEOUT_MILLISECONDS);
+
+	/* Start attempts (one after another, spaced by the attempt delay) until one of them connects */
+	connectedAddressInfo = NULL;
+	addressIndex = 0;
+	attemptCount = 0;
+	while(connectedAddressInfo == NULL) {
+
+		/* Start next attempt if no attempt is pending or the pending attempts did not connect within the attempt delay */
+		if(addressIndex < addressCount && (attemptCount == 0 || networkGetRemainingMilliseconds(&nextAttemptTime) <= 0)) {
+			networkConnection->socketDescriptor = socket(addressInfos[addressIndex]->ai_family, addressInfos[addressIndex]->ai_socktype, addressInfos[addressIndex]->ai_protocol);
+			if(networkConnection->socketDescriptor == -1) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open a socket for the network connection. (errno = %d)", errno);
+			} else if(!networkSetNonBlocking(networkConnection)) {
+				close(networkConnection->socketDescriptor);
+			} else if(connect(networkConnection->socketDescriptor, addressInfos[addressIndex]->ai_addr, addressInfos[addressIndex]->ai_addrlen) == 0) {
+				connectedAddressInfo = addressInfos[addressIndex];
+				break;
+			} else if(errno != EINPROGRESS) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot connect network connection to host \"%s\". (errno = %d)", hostName, errno);
+				close(networkConnection->socketDescriptor);
+			} else {
+				pollDescriptors[attemptCount].fd = networkConnection->socketDescriptor;
+				pollDescriptors[attemptCount].events = POLLOUT;
+				attemptAddressInfos[attemptCount] = addressInfos[addressIndex];
+				attemptCount++;
+			}
+			networkConnection->socketDescriptor = UNUSED_SOCKET_DESCRIPTOR;
+			addressIndex++;
+			networkSetDeadline(&nextAttemptTime, NETWORK_CONNECT_ATTEMPT_DELAY_MILLISECONDS);
+			continue;
+		}
+
+		/* Fail if no attempts are left or the deadline passed */
+		timeoutMilliseconds = networkGetRemainingMilliseconds(&deadline);
+		if(attemptCount <= 0 || timeoutMilliseconds <= 0) {
+			if(attemptCount > 0) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot connect network connection to host \"%s\" within %d ms.", hostName, NETWORK_CONNECT_TIMEOUT_MILLISECONDS);
+			}
+			break;
+		}
+
+		/* Wait for pending attempts (until the next attempt should start) */
+		if(addressIndex < addressCount && networkGetRemainingMilliseconds(&nextAttemptTime) < timeoutMilliseconds) {
+			timeoutMilliseconds = networkGetRemainingMilliseconds(&nextAttemptTime);
+		}
+		for(index = 0; index < attemptCount; index++) {
+			pollDescriptors[index].revents = 0;
+		}
+		if(poll(pollDescriptors, attemptCount, timeoutMilliseconds > 0 ? (int)timeoutMilliseconds : 0) == -1 && errno != EINTR) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot wait for network connection to connect. (errno = %d)", errno);
+			break;
+		}
+
+		/* Check attempts which finished (keep the first connected, remove the failed ones) */
+		index = 0;
+		while(index < attemptCount) {
+			if(pollDescriptors[index].revents == 0) {
+				index++;
+				continue;
+			}
+			socketError = 0;
+			valueSize = sizeof(socketError);
+			if(getsockopt(pollDescriptors[index].fd, SOL_SOCKET, SO_ERROR, &socketError, &valueSize) == 0 && socketError == 0 && connectedAddressInfo == NULL) {
+				networkConnection->socketDescriptor = pollDescriptors[index].fd;
+				connectedAddressInfo = attemptAddressInfos[index];
+			} else {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot connect network connection to host \"%s\"%s. (errno = %d)", hostName, addressIndex < addressCount || attemptCount > 1 ? " (going to try another address)" : "", socketError);
+				close(pollDescriptors[index].fd);
+			}
+			attemptCount--;
+			pollDescriptors[index] = pollDescriptors[attemptCount];
+			attemptAddressInfos[index] = attemptAddressInfos[attemptCount];
+		}
+	}
+
+	/* Close attempts still pending */
+	for(index = 0; index < attemptCount; index++) {
+		close(pollDescriptors[index].fd);
+	}
+
+	return connectedAddressInfo;
+}
+
+int networkOrderAddresses(struct addrinfo *addressInfoResult, struct addrinfo **addressInfos) {
+	struct addrinfo *addressInfo;
+	int addressCount;
+	int index;
+	bool isUsed;
+
+	/* Keep the (preferred) order of the addresses, but alternate between address families */
+	addressCount = 0;
+	while(addressCount < NETWORK_MAX_CONNECT_ATTEMPTS) {
+		addressInfo = addressInfoResult;
+		do {
+			isUsed = false;
+			for(index = 0; index < addressCount && !isUsed; index++) {
+				isUsed = addressInfos[index] == addressInfo;
+			}
+			if(!isUsed && (addressCount == 0 || addressInfo->ai_family != addressInfos[addressCount - 1]->ai_family)) {
+				break;
+			}
+			addressInfo = addressInfo->ai_next;
+		} while(addressInfo != NULL);
+
+		/* Take the next unused address of any family if no address of another family is left */
+		if(addressInfo == NULL) {
+			addressInfo = addressInfoResult;
+			do {
+				isUsed = false;
+				for(index = 0; index < addressCount && !isUsed; index++) {
+					isUsed = addressInfos[index] == addressInfo;
+				}
+				if(!isUsed) {
+					break;
+				}
+				addressInfo = addressInfo->ai_next;
+			} while(addressInfo != NULL);
+			if(addressInfo == NULL) {
+				break;
+			}
+		}
+		addressInfos[addressCount] = addressInfo;
+		addressCount++;
+	}
+
+	return addressCount;
+}
+
+void networkSetDeadline(struct timespec *deadline, int timeoutMilliseconds) {
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += timeoutMilliseconds / 1000;
+	deadline->tv_nsec += (timeoutMilliseconds % 1000) * 1000000L;
+	if(deadline->tv_nsec >= 1000000000L) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+long networkGetRemainingMilliseconds(struct timespec *deadline) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (deadline->tv_sec - now.tv_sec) * 1000L + (deadline->tv_nsec - now.tv_nsec + 999999L) / 1000000L;
+}
+
+bool networkProbeHosts(const char **hostNames, int hostCount, const char *portName, int timeoutMilliseconds, NetworkProbeResult *probeResults) {
+	struct addrinfo *addressInfoResults[NETWORK_MAX_PROBE_HOSTS];
+	struct addrinfo *addressInfos[NETWORK_MAX_CONNECT_ATTEMPTS];
+	struct pollfd pollDescriptors[NETWORK_MAX_PROBE_HOSTS * NETWORK_MAX_CONNECT_ATTEMPTS];
+	int pollHostIndices[NETWORK_MAX_PROBE_HOSTS * NETWORK_MAX_CONNECT_ATTEMPTS];
+	struct timespec startTimes[NETWORK_MAX_PROBE_HOSTS * NETWORK_MAX_CONNECT_ATTEMPTS];
+	struct timespec currentTime;
+	struct timespec deadline;
+	NetworkConnection probeConnection;
+	socklen_t valueSize;
+	long remainingMilliseconds;
+	int addressCount;
+	int attemptCount;
+	int socketError;
+	int hostIndex;
+	int index;
+	bool result;
+
+	/* Validate input */
+	if(hostCount <= 0 || hostCount > NETWORK_MAX_PROBE_HOSTS) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot probe %d hosts (1 to %d hosts can be probed at once)", hostCount, NETWORK_MAX_PROBE_HOSTS);
+		return false;
+	}
+
+	/* Resolve all hosts first (resolving blocks, so it should not take from the time to connect) */
+	for(hostIndex = 0; hostIndex < hostCount; hostIndex++) {
+		probeResults[hostIndex].isReachable = false;
+		probeResults[hostIndex].connectTime = 0;
+		if(!networkGetAddressInfo(hostNames[hostIndex], portName, TCP_CONNECTION, &addressInfoResults[hostIndex])) {
+			addressInfoResults[hostIndex] = NULL;
+		}
+	}
+
+	/* Start connecting to all addresses of all hosts at once */
+	networkSetDeadline(&deadline, timeoutMilliseconds);
+	attemptCount = 0;
+	for(hostIndex = 0; hostIndex < hostCount; hostIndex++) {
+		if(addressInfoResults[hostIndex] == NULL) {
+			continue;
+		}
+		addressCount = networkOrderAddresses(addressInfoResults[hostIndex], addressInfos);
+		for(index = 0; index < addressCount; index++) {
+			probeConnection.socketDescriptor = socket(addressInfos[index]->ai_family, addressInfos[index]->ai_socktype, addressInfos[index]->ai_protocol);
+			if(probeConnection.socketDescriptor == -1) {
+				continue;
+			}
+			if(!networkSetNonBlocking(&probeConnection)) {
+				close(probeConnection.socketDescriptor);
+				continue;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &startTimes[attemptCount]);
+			if(connect(probeConnection.socketDescriptor, addressInfos[index]->ai_addr, addressInfos[index]->ai_addrlen) == 0 || errno == EINPROGRESS) {
+				pollDescriptors[attemptCount].fd = probeConnection.socketDescriptor;
+				pollDescriptors[attemptCount].events = POLLOUT;
+				pollDescriptors[attemptCount].revents = 0;
+				pollHostIndices[attemptCount] = hostIndex;
+				attemptCount++;
+			} else {
+				close(probeConnection.socketDescriptor);
+			}
+		}
+		freeaddrinfo(addressInfoResults[hostIndex]);
+	}
+
+	/* Wait until all attempts finished or the deadline passed (a host is reachable once any of its addresses connected) */
+	result = true;
+	while(attemptCount > 0) {
+		remainingMilliseconds = networkGetRemainingMilliseconds(&deadline);
+		if(remainingMilliseconds <= 0) {
+			break;
+		}
+		if(poll(pollDescriptors, attemptCount, (int)remainingMilliseconds) == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot wait for probing hosts. (errno = %d)", errno);
+			result = false;
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &currentTime);
+		index = 0;
+		while(index < attemptCount) {
+			if(pollDescriptors[index].revents == 0) {
+				index++;
+				continue;
+			}
+			hostIndex = pollHostIndices[index];
+			socketError = 0;
+			valueSize = sizeof(socketError);
+			if(getsockopt(pollDescriptors[index].fd, SOL_SOCKET, SO_ERROR, &socketError, &valueSize) == 0 && socketError == 0 && !probeResults[hostIndex].isReachable) {
+				probeResults[hostIndex].isReachable = true;
+				probeResults[hostIndex].connectTime = (uint32_t)((currentTime.tv_sec - startTimes[index].tv_sec) * 1000000L + (currentTime.tv_nsec - startTimes[index].tv_nsec) / 1000L);
+			}
+			close(pollDescriptors[index].fd);
+			attemptCount--;
+			pollDescriptors[index] = pollDescriptors[attemptCount];
+			pollHostIndices[index] = pollHostIndices[attemptCount];
+			startTimes[index] = startTimes[attemptCount];
+		}
+	}
+
+	/* Close attempts still pending */
+	for(index = 0; index < attemptCount; index++) {
+		close(pollDescriptors[index].fd);
+	}
+
+	return result;
+}
+
+bool networkReconnect(NetworkConnection *networkConnection) {
+
+	/* Validate connection (only a TCP client knows the address it connected to) */
+	if(!networkConnection->isClient || networkConnection->connectionType != TCP_CONNECTION || networkConnection->remoteAddress == NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot reconnect network connection, it is not a connected TCP connection");
+		return false;
+	}
+
+	/* Close socket of the lost connection */
+	networkCloseSocket(networkConnection);
+
+	/* Start connecting to the address connected to before (without resolving the host name again and without waiting) */
+	networkConnection->socketDescriptor = socket(networkConnection->remoteAddress->sa_family, SOCK_STREAM, IPPROTO_TCP);
+	if(networkConnection->socketDescriptor == -1) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open a socket for the network connection. (errno = %d)", errno);
+		networkConnection->socketDescriptor = UNUSED_SOCKET_DESCRIPTOR;
+		return false;
+	}
+	if(!networkSetNonBlocking(networkConnection)) {
+		networkCloseSocket(networkConnection);
+		return false;
+	}
+	if(connect(networkConnection->socketDescriptor, networkConnection->remoteAddress, networkConnection->remoteAddressSize) != 0 && errno != EINPROGRESS) {
+		logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Cannot reconnect network connection. (errno = %d)", errno);
+		networkCloseSocket(networkConnection);
+		return false;
+	}
+
+	return true;
+}
+
+bool networkFinishConnect(NetworkConnection *networkConnection) {
+	struct sockaddr_storage localAddress;
+	socklen_t localAddressSize;
+	socklen_t valueSize;
+	int socketError;
+
+	/* Check result of the connect started by networkReconnect */
+	socketError = 0;
+	valueSize = sizeof(socketError);
+	if(getsockopt(networkConnection->socketDescriptor, SOL_SOCKET, SO_ERROR, &socketError, &valueSize) != 0) {
+		socketError = errno;
+	}
+	if(socketError != 0) {
+		logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Cannot reconnect network connection. (errno = %d)", socketError);
+		return false;
+	}
+
+	/* Keep local address of the new connection (the remote address is unchanged) */
+	localAddressSize = sizeof(struct sockaddr_storage);
+	if(getsockname(networkConnection->socketDescriptor, (struct sockaddr *)&localAddress, &localAddressSize) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve local address from socket (errno = %d)", errno);
+		return false;
+	}
+	if(!bufferFree(&networkConnection->localAddress)) {
+		return false;
+	}
+	return networkCopySocketAddress(&networkConnection->localAddress, &networkConnection->localAddressSize, (struct sockaddr *)&localAddress, localAddressSize);
+}
+
 NetworkConnectionType networkGetConnectionType(NetworkConnection *networkConnection) {
 	return networkConnection->connectionType;
 }
@@ -157,29 +533,44 @@ bool networkGetAddressInfo(const char *hostName, const char *portName, NetworkCo
 	return true;
 }
 
-bool networkCopyAddressInfo(NetworkConnection *networkConnection, const char *hostName, const char *portName) {
-	struct sockaddr localAddress;
+bool networkCopyAddressInfo(NetworkConnection *networkConnection, struct sockaddr *remoteAddress, socklen_t remoteAddressSize) {
+	struct sockaddr_storage localAddress;
 	socklen_t localAddressSize;
-	struct addrinfo* remoteAddressInfo;
-	bool result;
 
 	/* Retrieve local address info (from socket) */
-	localAddressSize = sizeof(struct sockaddr);
-	if(getsockname(networkConnection->socketDescriptor, &localAddress, &localAddressSize) != 0) {
+	localAddressSize = sizeof(struct sockaddr_storage);
+	if(getsockname(networkConnection->socketDescriptor, (struct sockaddr *)&localAddress, &localAddressSize) != 0) {
 		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve local address from socket (errno = %d)", errno);
 		return false;
 	}
 
 	/* Copy local address info */
-	if(!networkCopySocketAddress(&networkConnection->localAddress, &networkConnection->localAddressSize, &localAddress, localAddressSize)) {
+	if(!networkCopySocketAddress(&networkConnection->localAddress, &networkConnection->localAddressSize, (struct sockaddr *)&localAddress, localAddressSize)) {
+		return false;
+	}
+
+	/* Copy remote address info (the address connected or bound to, no need to resolve it again) */
+	if(!bufferFree(&networkConnection->remoteAddress)) {
 		return false;
 	}
+	return networkCopySocketAddress(&networkConnection->remoteAddress, &networkConnection->remoteAddressSize, remoteAddress, remoteAddressSize);
+}
+
+bool networkSetRemoteAddress(NetworkConnection *networkConnection, const char *hostName, const char *portName) {
+	struct addrinfo* remoteAddressInfo;
+	bool result;
 
 	/* Retrieve remote address info (simply using UDP as connectionType) */
 	if(!networkGetAddressInfo(hostName, portName, UDP_CONNECTION, &remoteAddressInfo)) {
 		return false;
 	}
 
+	/* Remove any existing remote address */
+	if(!bufferFree(&networkConnection->remoteAddress)) {
+		freeaddrinfo(remoteAddressInfo);
+		return false;
+	}
+
 	/* Copy remote address info (if found and usable) */
 	result = true;
 	if(remoteAddressInfo->ai_family == AF_INET || remoteAddressInfo->ai_family == AF_INET6) {
@@ -214,6 +605,19 @@ bool networkGetRemoteAddressName(NetworkConnection *networkConnection, char *add
 	return networkGetAddressName(networkConnection->remoteAddress, addressName, maxAddressNameSize);
 }
 
+bool networkGetLocalPort(NetworkConnection *networkConnection, uint16_t *port) {
+	if(networkConnection->localAddress->sa_family == AF_INET) {
+		*port = ntohs(((struct sockaddr_in *)networkConnection->localAddress)->sin_port);
+	} else if(networkConnection->localAddress->sa_family == AF_INET6) {
+		*port = ntohs(((struct sockaddr_in6 *)networkConnection->localAddress)->sin6_port);
+	} else {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Unknown sa_family %d found when retrieving port number", networkConnection->localAddress->sa_family);
+		return false;
+	}
+
+	return true;
+}
+
 bool networkGetAddressName(struct sockaddr *address, char *addressName, int maxAddressNameSize) {
 	if(address->sa_family == AF_INET) {
 		if(inet_ntop(AF_INET, &((struct sockaddr_in *)address)->sin_addr, addressName, (socklen_t)maxAddressNameSize) == NULL) {
@@ -234,25 +638,140 @@ bool networkGetAddressName(struct sockaddr *address, char *addressName, int maxA
 }
 
 bool networkSendMessage(NetworkConnection *networkConnection, uint8_t *messageBuffer, size_t messageSize) {
+	struct iovec messagePart;
+	size_t sentSize;
+
+	messagePart.iov_base = messageBuffer;
+	messagePart.iov_len = messageSize;
+	return networkSendMessagePartsInternal(networkConnection, &messagePart, 1, NETWORK_SEND_TIMEOUT_MILLISECONDS, &sentSize) == NETWORK_SEND_COMPLETE;
+}
+
+bool networkSendMessageParts(NetworkConnection *networkConnection, uint8_t *headerBuffer, size_t headerSize, uint8_t *messageBuffer, size_t messageSize) {
+	struct iovec messageParts[2];
+	size_t sentSize;
+
+	messageParts[0].iov_base = headerBuffer;
+	messageParts[0].iov_len = headerSize;
+	messageParts[1].iov_base = messageBuffer;
+	messageParts[1].iov_len = messageSize;
+	return networkSendMessagePartsInternal(networkConnection, messageParts, 2, NETWORK_SEND_TIMEOUT_MILLISECONDS, &sentSize) == NETWORK_SEND_COMPLETE;
+}
+
+bool networkSendMessageVector(NetworkConnection *networkConnection, struct iovec *messageParts, int partCount) {
+	size_t sentSize;
+
+	return networkSendMessagePartsInternal(networkConnection, messageParts, partCount, NETWORK_SEND_TIMEOUT_MILLISECONDS, &sentSize) == NETWORK_SEND_COMPLETE;
+}
+
+NetworkSendResult networkTrySendMessageParts(NetworkConnection *networkConnection, uint8_t *headerBuffer, size_t headerSize, uint8_t *messageBuffer, size_t messageSize, size_t *sentSize) {
+	struct iovec messageParts[2];
+	int partCount;
+
+	/* Skip empty header */
+	partCount = 0;
+	if(headerSize > 0) {
+		messageParts[partCount].iov_base = headerBuffer;
+		messageParts[partCount].iov_len = headerSize;
+		partCount++;
+	}
+	messageParts[partCount].iov_base = messageBuffer;
+	messageParts[partCount].iov_len = messageSize;
+	partCount++;
+
+	return networkSendMessagePartsInternal(networkConnection, messageParts, partCount, 0, sentSize);
+}
+
+NetworkSendResult networkSendMessagePartsInternal(NetworkConnection *networkConnection, struct iovec *messageParts, int partCount, int timeoutMilliseconds, size_t *sentSize) {
+	struct msghdr message;
+	struct timespec deadline;
+	size_t totalSize;
 	ssize_t result;
- 
+	int index;
+
+	*sentSize = 0;
 	if(networkConnection == NULL) {
-		return false;
+		return NETWORK_SEND_FAILED;
 	}
-	if(networkConnection->isClient) {
-		result = send(networkConnection->socketDescriptor, messageBuffer, messageSize, 0);
-	} else {
-		result = sendto(networkConnection->socketDescriptor, messageBuffer, messageSize, 0, networkConnection->remoteAddress, networkConnection->remoteAddressSize);
+
+	/* Calculate total size and deadline */
+	totalSize = 0;
+	for(index = 0; index < partCount; index++) {
+		totalSize += messageParts[index].iov_len;
+	}
+	if(timeoutMilliseconds > 0) {
+		networkSetDeadline(&deadline, timeoutMilliseconds);
+	}
+
+	/* Send message (continuing after partial sends) until fully sent, would block or failed */
+	memset(&message, 0, sizeof(struct msghdr));
+	if(!networkConnection->isClient) {
+		message.msg_name = networkConnection->remoteAddress;
+		message.msg_namelen = networkConnection->remoteAddressSize;
+	}
+	while(*sentSize < totalSize) {
+		message.msg_iov = messageParts;
+		message.msg_iovlen = partCount;
+		result = sendmsg(networkConnection->socketDescriptor, &message, NETWORK_SEND_FLAGS);
+		if(result == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot send network message to server. (errno = %d)", errno);
+				return NETWORK_SEND_FAILED;
+			}
+
+			/* Let caller handle backpressure or wait until connection is writable again (within deadline) */
+			if(timeoutMilliseconds <= 0) {
+				return NETWORK_SEND_WOULD_BLOCK;
+			}
+			if(!networkWaitForWritable(networkConnection, &deadline)) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot send network message to server within %d ms (%zu of %zu bytes sent, connection stalled).", timeoutMilliseconds, *sentSize, totalSize);
+				return NETWORK_SEND_FAILED;
+			}
+			continue;
+		}
+		*sentSize += (size_t)result;
+
+		/* Skip the parts (partially) sent */
+		while(partCount > 0 && (size_t)result >= messageParts->iov_len) {
+			result -= messageParts->iov_len;
+			messageParts++;
+			partCount--;
+		}
+		if(partCount > 0) {
+			messageParts->iov_base = (uint8_t *)messageParts->iov_base + result;
+			messageParts->iov_len -= result;
+		}
 	}
+
+	return NETWORK_SEND_COMPLETE;
+}
+
+bool networkWaitForWritable(NetworkConnection *networkConnection, struct timespec *deadline) {
+	struct pollfd pollDescriptor;
+	struct timespec now;
+	long remainingMilliseconds;
+	int result;
+
+	pollDescriptor.fd = networkConnection->socketDescriptor;
+	pollDescriptor.events = POLLOUT;
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remainingMilliseconds = (deadline->tv_sec - now.tv_sec) * 1000L + (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+		if(remainingMilliseconds <= 0) {
+			return false;
+		}
+		pollDescriptor.revents = 0;
+		result = poll(&pollDescriptor, 1, (int)remainingMilliseconds);
+	} while(result == -1 && errno == EINTR);
 	if(result == -1) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot send network message to server. (errno = %d)", errno);
-		return false;
-	} else if(result != messageSize) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot send full network message to server (ie partial send). (errno = %d)", errno);
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot wait for network connection to become writable. (errno = %d)", errno);
 		return false;
 	}
 
-	return true;
+	/* Errors are reported by the next send */
+	return result == 1;
 }
 
 bool networkReceiveMessage(NetworkConnection *networkConnection, uint8_t *messageBuffer, size_t maxMessageSize, size_t *messageSize) {
@@ -260,7 +779,7 @@ bool networkReceiveMessage(NetworkConnection *networkConnection, uint8_t *messag
 }
 
 bool networkReceiveMessageInternal(NetworkConnection *networkConnection, uint8_t *messageBuffer, size_t maxMessageSize, size_t *messageSize, int flags) {
-	struct sockaddr remoteAddress;
+	struct sockaddr_storage remoteAddress;
 	socklen_t remoteAddressSize;
 	ssize_t result;
 
@@ -270,9 +789,9 @@ bool networkReceiveMessageInternal(NetworkConnection *networkConnection, uint8_t
 	if(networkConnection->isClient) {
 		result = recv(networkConnection->socketDescriptor, messageBuffer, maxMessageSize, flags);
 	} else {
-		remoteAddressSize = sizeof(struct sockaddr);
+		remoteAddressSize = sizeof(struct sockaddr_storage);
 		memset(&remoteAddress, 0, remoteAddressSize);
-		result = recvfrom(networkConnection->socketDescriptor, messageBuffer, maxMessageSize, flags, &remoteAddress, &remoteAddressSize);
+		result = recvfrom(networkConnection->socketDescriptor, messageBuffer, maxMessageSize, flags, (struct sockaddr *)&remoteAddress, &remoteAddressSize);
 		/* TODO: check value remoteAddress */
 	}
 	if(result == -1) {
@@ -288,11 +807,94 @@ bool networkReceiveMessageInternal(NetworkConnection *networkConnection, uint8_t
 }
 
 bool networkIsMessageAvailable(NetworkConnection *networkConnection) {
-	uint8_t byte;
-	size_t size;
+	struct pollfd pollDescriptor;
+
+	/* Poll without waiting (the connection is non-blocking, so peeking would not wait either, but would consume an error) */
+	pollDescriptor.fd = networkConnection->socketDescriptor;
+	pollDescriptor.events = POLLIN;
+	pollDescriptor.revents = 0;
+	if(poll(&pollDescriptor, 1, 0) == -1) {
+		if(errno != EINTR) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot poll network connection for messages. (errno = %d)", errno);
+		}
+		return false;
+	}
+
+	return (pollDescriptor.revents & (POLLIN | POLLERR | POLLHUP)) != 0;
+}
+
+bool networkSetNoDelay(NetworkConnection *networkConnection) {
+	int value;
+
+	/* Send small messages immediately (disable Nagle's algorithm) */
+	value = 1;
+	if(setsockopt(networkConnection->socketDescriptor, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set TCP_NODELAY on network connection. (errno = %d)", errno);
+		return false;
+	}
+
+	return true;
+}
+
+bool networkSetTypeOfService(NetworkConnection *networkConnection, int typeOfService) {
+	int result;
+
+	if(networkConnection->localAddress->sa_family == AF_INET6) {
+		result = setsockopt(networkConnection->socketDescriptor, IPPROTO_IPV6, IPV6_TCLASS, &typeOfService, sizeof(typeOfService));
+	} else {
+		result = setsockopt(networkConnection->socketDescriptor, IPPROTO_IP, IP_TOS, &typeOfService, sizeof(typeOfService));
+	}
+	if(result != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set type of service 0x%02x on network connection. (errno = %d)", typeOfService, errno);
+		return false;
+	}
+
+	return true;
+}
+
+bool networkSetSendBufferSize(NetworkConnection *networkConnection, int sendBufferSize, int *actualSendBufferSize) {
+	socklen_t valueSize;
+
+	if(setsockopt(networkConnection->socketDescriptor, SOL_SOCKET, SO_SNDBUF, &sendBufferSize, sizeof(sendBufferSize)) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set send buffer size %d on network connection. (errno = %d)", sendBufferSize, errno);
+		return false;
+	}
+
+	/* Retrieve the size actually used (the system might adjust it, Linux doubles it for bookkeeping overhead) */
+	valueSize = sizeof(*actualSendBufferSize);
+	if(getsockopt(networkConnection->socketDescriptor, SOL_SOCKET, SO_SNDBUF, actualSendBufferSize, &valueSize) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve send buffer size of network connection. (errno = %d)", errno);
+		return false;
+	}
+
+	return true;
+}
+
+bool networkGetSendQueueSize(NetworkConnection *networkConnection, int *queuedSize) {
 
-	/* Peek for a single byte to decide if a message is available */ 
-	return networkReceiveMessageInternal(networkConnection, &byte, 1, &size, MSG_PEEK) && size == 1;
+	/* For TCP this includes data sent but not acknowledged yet by the peer */
+	if(ioctl(networkConnection->socketDescriptor, SIOCOUTQ, queuedSize) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve size of send queue of network connection. (errno = %d)", errno);
+		return false;
+	}
+
+	return true;
+}
+
+int networkGetDescriptor(NetworkConnection *networkConnection) {
+	return networkConnection->socketDescriptor;
+}
+
+bool networkSetNonBlocking(NetworkConnection *networkConnection) {
+	int flags;
+
+	flags = fcntl(networkConnection->socketDescriptor, F_GETFL, 0);
+	if(flags == -1 || fcntl(networkConnection->socketDescriptor, F_SETFL, flags | O_NONBLOCK) == -1) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot make network connection non-blocking. (errno = %d)", errno);
+		return false;
+	}
+
+	return true;
 }
 
 bool networkCloseConnection(NetworkConnection **networkConnection) {
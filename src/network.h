@@ -25,6 +25,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <sys/uio.h>
 
 /* Type definition for NetworkConnection */
 typedef struct NetworkConnectionStruct NetworkConnection;
@@ -35,6 +36,22 @@ typedef enum {
 	UDP_CONNECTION = 1
 } NetworkConnectionType;
 
+/* Type definition for the result of sending without waiting */
+typedef enum {
+	NETWORK_SEND_FAILED = 0,
+	NETWORK_SEND_COMPLETE = 1,
+	NETWORK_SEND_WOULD_BLOCK = 2
+} NetworkSendResult;
+
+/* Type definition for the result of probing a host */
+typedef struct {
+	bool isReachable;
+	uint32_t connectTime;		/* In microseconds (only valid if reachable) */
+} NetworkProbeResult;
+
+/* Maximum number of hosts probed at once (see networkProbeHosts) */
+#define	NETWORK_MAX_PROBE_HOSTS		8
+
 /* Maximum name of IP address (IPv4 and IPv6 supported) */
 #ifdef INET6_ADDRSTRLEN
 #define MAX_ADDR_STRING_LENGTH (INET6_ADDRSTRLEN)
@@ -53,9 +70,73 @@ typedef enum {
  *
  * Remarks:
  * The portName parameter can either be the string representation of a port number but can also be a service name like "ftp" or "telnet".
+ * If doConnect is false, the connection is bound to the local address hostName (or any local address if hostName is NULL).
+ * The connection is non-blocking once opened: receiving should only be done when a message is available (for example
+ * after the network connection became readable in an event loop) and sending never waits longer than a short deadline.
+ * A TCP connection is connected to the first address of the host which answers: if an address does not connect within
+ * a short delay the next address is tried alongside it (alternating IPv6 and IPv4). Connecting fails after a few seconds
+ * if the host does not answer at all. The host name is resolved once, the address connected to is available through
+ * networkGetRemoteAddressName (use it for other connections to the same host to prevent resolving it again).
  */
 NetworkConnection *networkOpenConnection(const char *hostName, const char *portName, NetworkConnectionType connectionType, bool doConnect);
 
+/*
+ * Function: networkProbeHosts
+ * Parameters:
+ *	hostNames - array of names of hosts
+ *	hostCount - number of hosts in the array (1 to NETWORK_MAX_PROBE_HOSTS)
+ *	portName - name of (TCP) port to connect to
+ *	timeoutMilliseconds - maximum time (in milliseconds) a host may take to accept the connection
+ *	probeResults - array of results (one per host) specifying if the host is reachable and how long connecting took
+ * Returns: a boolean specifying if probing was successful (unreachable hosts are successful as well)
+ *
+ * Remarks:
+ * All host names are resolved first. Then all hosts (all of their addresses) are connected to at once without blocking,
+ * so probing takes at most the timeout (after resolving) however many hosts are unreachable. The connect time of a host
+ * is measured from the moment its connection was started. The connections are closed right away. Use it to skip unreachable hosts before opening
+ * connections to them (see networkOpenConnection).
+ */
+bool networkProbeHosts(const char **hostNames, int hostCount, const char *portName, int timeoutMilliseconds, NetworkProbeResult *probeResults);
+
+/*
+ * Function: networkReconnect
+ * Parameters:
+ *	networkConnection - TCP connection (opened using networkOpenConnection as client) whose connection is lost
+ * Returns: a boolean specifying if connecting is started successfully
+ *
+ * Remarks:
+ * The socket of the lost connection is closed and a connect to the address connected to before is started, without
+ * resolving the host name again and without waiting for the connect to finish. Once the descriptor becomes writable
+ * (for example in an event loop) networkFinishConnect tells if the connection is made. The caller decides how long
+ * to wait for it.
+ */
+bool networkReconnect(NetworkConnection *networkConnection);
+
+/*
+ * Function: networkFinishConnect
+ * Parameters:
+ *	networkConnection - TCP connection being connected (see networkReconnect)
+ * Returns: a boolean specifying if the connection is made
+ *
+ * Remarks:
+ * Should only be called once the descriptor of the connection is writable.
+ */
+bool networkFinishConnect(NetworkConnection *networkConnection);
+
+/*
+ * Function: networkSetRemoteAddress
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ *	hostName - name of remote host
+ *	portName - name of remote port
+ * Returns: a boolean specifying if the remote address is set successfully
+ *
+ * Remarks:
+ * Only useful for connections which were not connected (ie doConnect was false in networkOpenConnection). Messages
+ * sent using networkSendMessage will be sent to the remote address specified.
+ */
+bool networkSetRemoteAddress(NetworkConnection *networkConnection, const char *hostName, const char *portName);
+
 /*
  * Function: networkGetConnectionType
  * Parameters:
@@ -84,6 +165,18 @@ bool networkGetLocalAddressName(NetworkConnection *networkConnection, char *addr
  */
 bool networkGetRemoteAddressName(NetworkConnection *networkConnection, char *addressName, int maxAddressNameSize);
 
+/*
+ * Function: networkGetLocalPort
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ *	port - port number of the local side of the connection
+ * Returns: a boolean specifying if the port number was retrieved successfully
+ *
+ * Remarks:
+ * Useful for connections opened with port "0" where the system decides which (free) port is used.
+ */
+bool networkGetLocalPort(NetworkConnection *networkConnection, uint16_t *port);
+
 /*
  * Function: networkSendMessage
  * Parameters:
@@ -91,9 +184,62 @@ bool networkGetRemoteAddressName(NetworkConnection *networkConnection, char *add
  *	messageBuffer - array of bytes containing the message data
  *	messageSize - size of the message data (as number of bytes)
  * Returns: a boolean specifying if the message was sent successfully
+ *
+ * Remarks:
+ * A partially sent message is continued when the connection becomes writable again. If the message cannot be sent
+ * completely within a short deadline (a few hundred milliseconds) the peer is considered stalled and sending fails.
  */
 bool networkSendMessage(NetworkConnection *networkConnection, uint8_t *messageBuffer, size_t messageSize);
 
+/*
+ * Function: networkSendMessageParts
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ *	headerBuffer - array of bytes containing the first part of the message data
+ *	headerSize - size of the first part of the message data
+ *	messageBuffer - array of bytes containing the remaining message data
+ *	messageSize - size of the remaining message data
+ * Returns: a boolean specifying if the message is sent successfully
+ *
+ * Remarks:
+ * Both parts are sent as a single message (for UDP a single datagram), without copying them into one buffer first.
+ * The same deadline as for networkSendMessage applies.
+ */
+bool networkSendMessageParts(NetworkConnection *networkConnection, uint8_t *headerBuffer, size_t headerSize, uint8_t *messageBuffer, size_t messageSize);
+
+/*
+ * Function: networkSendMessageVector
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ *	messageParts - array of parts (base and length) of the message data
+ *	partCount - number of parts in the array
+ * Returns: a boolean specifying if the message is sent successfully
+ *
+ * Remarks:
+ * Same as networkSendMessageParts, but for any number of parts. The array of parts is changed while sending (parts
+ * already sent are skipped), so it cannot be reused for sending the same message again.
+ */
+bool networkSendMessageVector(NetworkConnection *networkConnection, struct iovec *messageParts, int partCount);
+
+/*
+ * Function: networkTrySendMessageParts
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ *	headerBuffer - array of bytes containing the first part of the message data (might be NULL if headerSize is 0)
+ *	headerSize - size of the first part of the message data
+ *	messageBuffer - array of bytes containing the remaining message data
+ *	messageSize - size of the remaining message data
+ *	sentSize - number of bytes actually sent
+ * Returns: NETWORK_SEND_COMPLETE if the full message is sent, NETWORK_SEND_WOULD_BLOCK if the connection cannot accept
+ * (all) data right now and NETWORK_SEND_FAILED if sending failed
+ *
+ * Remarks:
+ * Same as networkSendMessageParts, but does not wait if the connection cannot accept (all) data. For a TCP connection the
+ * message might be sent partially, the caller should send the remaining data when the connection becomes writable. For
+ * a UDP connection either the full message is sent or nothing at all.
+ */
+NetworkSendResult networkTrySendMessageParts(NetworkConnection *networkConnection, uint8_t *headerBuffer, size_t headerSize, uint8_t *messageBuffer, size_t messageSize, size_t *sentSize);
+
 /*
  * Function: networkReceiveMessage
  * Parameters:
@@ -114,9 +260,70 @@ bool networkReceiveMessage(NetworkConnection *networkConnection, uint8_t *messag
  * Parameters:
  *	networkConnection - already open network connection (as returned by networkOpenConnection)
  * Returns: a boolean specifying if a message is available to receive using networkReceiveMessage
+ *
+ * Remarks:
+ * Does not wait. A connection with a pending error or which is closed by the peer is reported as having a message
+ * available as well (receiving will report the situation).
  */
 bool networkIsMessageAvailable(NetworkConnection *networkConnection);
 
+/*
+ * Function: networkSetNoDelay
+ * Parameters:
+ *	networkConnection - already open TCP network connection (as returned by networkOpenConnection)
+ * Returns: a boolean specifying if the option is set successfully
+ *
+ * Remarks:
+ * Messages are sent immediately instead of being combined with subsequent messages (TCP_NODELAY).
+ */
+bool networkSetNoDelay(NetworkConnection *networkConnection);
+
+/*
+ * Function: networkSetTypeOfService
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ *	typeOfService - value of the type of service (IPv4) or traffic class (IPv6) field, ie DSCP value shifted left 2 bits
+ * Returns: a boolean specifying if the type of service is set successfully
+ */
+bool networkSetTypeOfService(NetworkConnection *networkConnection, int typeOfService);
+
+/*
+ * Function: networkSetSendBufferSize
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ *	sendBufferSize - requested size (in bytes) of the send buffer of the connection
+ *	actualSendBufferSize - size (in bytes) of the send buffer as actually used by the system
+ * Returns: a boolean specifying if the size of the send buffer is set successfully
+ *
+ * Remarks:
+ * Setting the size disables automatic tuning of the send buffer by the system.
+ */
+bool networkSetSendBufferSize(NetworkConnection *networkConnection, int sendBufferSize, int *actualSendBufferSize);
+
+/*
+ * Function: networkGetSendQueueSize
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ *	queuedSize - number of bytes in the send queue of the connection
+ * Returns: a boolean specifying if the size of the send queue is retrieved successfully
+ *
+ * Remarks:
+ * For a TCP connection the send queue contains the data not acknowledged by the peer yet. Together with the number of
+ * bytes sent, this allows calculating the rate at which the peer receives data.
+ */
+bool networkGetSendQueueSize(NetworkConnection *networkConnection, int *queuedSize);
+
+/*
+ * Function: networkGetDescriptor
+ * Parameters:
+ *	networkConnection - already open network connection (as returned by networkOpenConnection)
+ * Returns: the (socket) descriptor of the network connection
+ *
+ * Remarks:
+ * Used for waiting on the network connection together with other descriptors (see eventLoopAddDescriptor).
+ */
+int networkGetDescriptor(NetworkConnection *networkConnection);
+
 /*
  * Function: networkCloseConnection
  * Parameters:
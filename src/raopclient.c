@@ -19,7 +19,6 @@
  * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -33,6 +32,8 @@
 #include "log.h"
 #include "buffer.h"
 #include "utils.h"
+#include "aescipher.h"
+#include "rsacipher.h"
 
 /* Values for volume. Anything below VOLUME_MIN_VALUE will be set to 'muted'. Anything above VOLUME_MAX_VALUE will be set to VOLUME_MAX_VALUE. */
 #define VOLUME_DEFAULT			15.0
@@ -47,30 +48,56 @@
 #define	PLAYING_TIME_LAG_SECONDS	2
 #define	PLAYING_TIME_LAG_NANO_SECONDS	0
 #define MAX_ANNOUNCE_CONTENT_SIZE_NO_ADDRESSES	160
-#define MAX_ANNOUNCE_CONTENT_SIZE	(MAX_ANNOUNCE_CONTENT_SIZE_NO_ADDRESSES + MAX_ADDR_STRING_LENGTH + MAX_ADDR_STRING_LENGTH)
+#define	MAX_ANNOUNCE_ENCRYPTION_SIZE	400	/* Base64 encoded RSA encrypted key and AES initialization vector */
+#define MAX_ANNOUNCE_CONTENT_SIZE	(MAX_ANNOUNCE_CONTENT_SIZE_NO_ADDRESSES + MAX_ADDR_STRING_LENGTH + MAX_ADDR_STRING_LENGTH + MAX_ANNOUNCE_ENCRYPTION_SIZE)
 #define	MAX_SET_PARAMETER_CONTENT_SIZE	20
-#define	MAX_NUMBER_STRING_SIZE		11
-#define AUDIO_MESSAGE_HEADER_SIZE	16
+#define	MAX_TRANSPORT_STRING_SIZE	128
+#define	FRAMES_PER_PACKET		4096
+#define	MAX_LATENCY_OFFSET		1000	/* In milliseconds, keep below PLAYING_TIME_LAG */
+#define	ONE_SECOND_IN_NANO_SECONDS	1000000000LL
+#define	ONE_MILLI_SECOND_IN_NANO_SECONDS	1000000LL
 
 /* Type definition for the RAOP client */
 struct RAOPClientStruct {
 
 	/* Connections and port info for communicating with server */
         char *hostName;
+	char *portName;				/* Kept (with password) for reconnecting */
+	char *password;
 	RTSPClient *rtspClient;
-	NetworkConnection *audioConnection;
-	int audioPort;
-
-	/* Thread for handling audio packets */
-	pthread_t audioThread;
-	bool audioThreadJoinable;	/* TODO: Not implemented thread-safe, but worst case is error message that joining failed */
+	RTPTransport transport;
+	bool isEncrypted;
+	bool isMemoryLocked;			/* Buffers of audio stream are locked in memory */
+	RTPStream *rtpStream;
+	uint16_t audioPort;
+	uint16_t controlPort;
+	uint16_t timingPort;
+
+	/* State of session with server */
+	RAOPClientState state;
+	RTSPRequestMethod requestMethod;	/* Method of request answered last */
+	bool hasSession;			/* SETUP succeeded, so session should be torn down */
+	bool isWarm;				/* OPTIONS answered while idle, handshake of next session starts with ANNOUNCE */
+	bool isStopRequested;			/* Stop as soon as response is received */
+	bool isFlushRequested;			/* Flush buffered audio when stopping */
+	bool isVolumeChanged;			/* Volume should be sent as soon as response is received */
+	bool isFileChangeRequested;		/* Prepare session for next file as soon as response is received */
+	bool isPauseRequested;			/* Flush buffered audio (keeping the session) as soon as response is received */
+	bool isResumeRequested;			/* Continue recording as soon as response is received */
+	bool isResuming;			/* RECORD is sent to resume streaming (no handshake needed) */
 
 	/* Session information */
 	float volume;
+	struct timespec volumeSendTime;		/* Time volume was sent last (for reporting the time until it is answered) */
+	int32_t latencyOffset;			/* In milliseconds */
+	bool hasInitialTimestamp;
+	uint32_t initialTimestamp;
 	M4AFile *m4aFile;
-	bool isSendingAudio;
+	uint32_t sessionTimescale;		/* Audio format announced for the session */
 	struct timespec playingTimeOffset;	/* Absolute offset when playing started (takes lag into account) */
 	struct timespec startTime;		/* Start time within file */
+	uint8_t aesKey[AES_KEY_SIZE];		/* Key and initialization vector announced for the session (if encrypted) */
+	uint8_t aesIV[AES_IV_SIZE];
 };
 
 static const char *LOG_COMPONENT_NAME = "raopclient.c";
@@ -81,15 +108,43 @@ static const struct timespec PLAYING_TIME_LAG = {
 	.tv_nsec = PLAYING_TIME_LAG_NANO_SECONDS
 };
 
+/* Modulus of the public RSA key of AirTunes (exponent is 65537), used for announcing the AES key */
+static const uint8_t AIRTUNES_RSA_MODULUS[] = {
+	0xe7, 0xd7, 0x44, 0xf2, 0xa2, 0xe2, 0x78, 0x8b, 0x6c, 0x1f, 0x55, 0xa0, 0x8e, 0xb7, 0x05, 0x44,
+	0xa8, 0xfa, 0x79, 0x45, 0xaa, 0x8b, 0xe6, 0xc6, 0x2c, 0xe5, 0xf5, 0x1c, 0xbd, 0xd4, 0xdc, 0x68,
+	0x42, 0xfe, 0x3d, 0x10, 0x83, 0xdd, 0x2e, 0xde, 0xc1, 0xbf, 0xd4, 0x25, 0x2d, 0xc0, 0x2e, 0x6f,
+	0x39, 0x8b, 0xdf, 0x0e, 0x61, 0x48, 0xea, 0x84, 0x85, 0x5e, 0x2e, 0x44, 0x2d, 0xa6, 0xd6, 0x26,
+	0x64, 0xf6, 0x74, 0xa1, 0xf3, 0x04, 0x92, 0x9a, 0xde, 0x4f, 0x68, 0x93, 0xef, 0x2d, 0xf6, 0xe7,
+	0x11, 0xa8, 0xc7, 0x7a, 0x0d, 0x91, 0xc9, 0xd9, 0x80, 0x82, 0x2e, 0x50, 0xd1, 0x29, 0x22, 0xaf,
+	0xea, 0x40, 0xea, 0x9f, 0x0e, 0x14, 0xc0, 0xf7, 0x69, 0x38, 0xc5, 0xf3, 0x88, 0x2f, 0xc0, 0x32,
+	0x3d, 0xd9, 0xfe, 0x55, 0x15, 0x5f, 0x51, 0xbb, 0x59, 0x21, 0xc2, 0x01, 0x62, 0x9f, 0xd7, 0x33,
+	0x52, 0xd5, 0xe2, 0xef, 0xaa, 0xbf, 0x9b, 0xa0, 0x48, 0xd7, 0xb8, 0x13, 0xa2, 0xb6, 0x76, 0x7f,
+	0x6c, 0x3c, 0xcf, 0x1e, 0xb4, 0xce, 0x67, 0x3d, 0x03, 0x7b, 0x0d, 0x2e, 0xa3, 0x0c, 0x5f, 0xff,
+	0xeb, 0x06, 0xf8, 0xd0, 0x8a, 0xdd, 0xe4, 0x09, 0x57, 0x1a, 0x9c, 0x68, 0x9f, 0xef, 0x10, 0x72,
+	0x88, 0x55, 0xdd, 0x8c, 0xfb, 0x9a, 0x8b, 0xef, 0x5c, 0x89, 0x43, 0xef, 0x3b, 0x5f, 0xaa, 0x15,
+	0xdd, 0xe6, 0x98, 0xbe, 0xdd, 0xf3, 0x59, 0x96, 0x03, 0xeb, 0x3e, 0x6f, 0x61, 0x37, 0x2b, 0xb6,
+	0x28, 0xf6, 0x55, 0x9f, 0x59, 0x9a, 0x78, 0xbf, 0x50, 0x06, 0x87, 0xaa, 0x7f, 0x49, 0x76, 0xc0,
+	0x56, 0x2d, 0x41, 0x29, 0x56, 0xf8, 0x98, 0x9e, 0x18, 0xa6, 0x35, 0x5b, 0xd8, 0x15, 0x97, 0x82,
+	0x5e, 0x0f, 0xc8, 0x75, 0x34, 0x3e, 0xc7, 0x82, 0x11, 0x76, 0x25, 0xcd, 0xbf, 0x98, 0x44, 0x7b
+};
+
 /* Declare internal functions */
 static bool raopClientInitialize(RAOPClient *raopClient);
-static bool raopClientStartPlaying(RAOPClient *raopClient);
-static void *raopClientSendAudio(void *arg);
-static bool raopClientSendAudioMessages(RAOPClient *raopClient);
-static bool raopClientWaitForBufferedAudio(RAOPClient *raopClient);
+static bool raopClientSendRequest(RAOPClient *raopClient, RTSPRequestMethod requestMethod);
+static bool raopClientHandleCompleteResponse(RAOPClient *raopClient);
+static bool raopClientContinue(RAOPClient *raopClient);
+static bool raopClientStartTeardown(RAOPClient *raopClient);
+static bool raopClientStartFileChange(RAOPClient *raopClient);
+static bool raopClientStartPause(RAOPClient *raopClient);
+static bool raopClientStartResume(RAOPClient *raopClient);
+static bool raopClientFail(RAOPClient *raopClient);
+static bool raopClientSetupAudioStream(RAOPClient *raopClient);
+static bool raopClientCloseAudioStream(RAOPClient *raopClient);
 static bool raopClientSetupAudioConnection(RAOPClient *raopClient);
 static bool raopClientAnnounceContentSupplier(RAOPClient *raopClient, RTSPRequest *rtspRequest);
+static bool raopClientCreateEncryptionContent(RAOPClient *raopClient, char *content, size_t maxContentSize);
 static bool raopClientSetVolumeContentSupplier(RAOPClient *raopClient, RTSPRequest *rtspRequest);
+static void raopClientReportVolumeLatency(RAOPClient *raopClient);
 static bool raopClientCloseConnectionInternal(RAOPClient **raopClient);
 
 RAOPClient *raopClientOpenConnection(const char *hostName, const char *portName, const char *password) {
@@ -111,7 +166,20 @@ RAOPClient *raopClientOpenConnection(const char *hostName, const char *portName,
 		bufferFree(&raopClient);
 		return NULL;
 	}
-	raopClient->volume = VOLUME_DEFAULT;	/* Set volume separately (not in 'raopClientInitialize'), so it retains it value between different calls to 'raopClientPlayM4AFile'. */
+	raopClient->portName = strdup((char *)portName);
+	raopClient->password = password != NULL ? strdup((char *)password) : NULL;
+	if(raopClient->portName == NULL || (password != NULL && raopClient->password == NULL)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot allocate memory for port name and password in new RAOP Client to host.");
+		raopClientCloseConnection(&raopClient);
+		return NULL;
+	}
+	raopClient->volume = VOLUME_DEFAULT;	/* Set volume separately (not in 'raopClientInitialize'), so it retains it value between different calls to 'raopClientStartPlaying'. */
+	timespecInitialize(&raopClient->volumeSendTime);
+	raopClient->transport = RTP_TRANSPORT_TCP;	/* Idem for transport */
+	raopClient->isEncrypted = false;		/* Idem for encryption */
+	raopClient->isMemoryLocked = false;		/* Idem for locking memory */
+	raopClient->latencyOffset = 0;			/* Idem for latency offset */
+	raopClient->hasInitialTimestamp = false;	/* Idem for initial timestamp */
 
 	/* Open the RTSP connection */
 	raopClient->rtspClient = rtspClientOpenConnection(hostName, portName, password);
@@ -129,205 +197,489 @@ bool raopClientInitialize(RAOPClient *raopClient) {
 		It is set separately so it will retain its value between files.
 	*/
 	raopClient->hostName = NULL;
+	raopClient->portName = NULL;
+	raopClient->password = NULL;
 	raopClient->rtspClient = NULL;
-	raopClient->audioConnection = NULL;
+	raopClient->rtpStream = NULL;
 	raopClient->audioPort = UNUSED_PORT_NUMBER;
-	raopClient->audioThreadJoinable = false;
+	raopClient->controlPort = UNUSED_PORT_NUMBER;
+	raopClient->timingPort = UNUSED_PORT_NUMBER;
+	raopClient->state = RAOP_CLIENT_STATE_IDLE;
+	raopClient->hasSession = false;
+	raopClient->isWarm = false;
+	raopClient->isStopRequested = false;
+	raopClient->isFlushRequested = false;
+	raopClient->isVolumeChanged = false;
+	raopClient->isFileChangeRequested = false;
+	raopClient->isPauseRequested = false;
+	raopClient->isResumeRequested = false;
+	raopClient->isResuming = false;
 	raopClient->m4aFile = NULL;
-	raopClient->isSendingAudio = false;
+	raopClient->sessionTimescale = 0;
 	timespecInitialize(&raopClient->playingTimeOffset);
 	timespecInitialize(&raopClient->startTime);
 
 	return true;
 }
 
-bool raopClientSetAudioPort(RAOPClient *raopClient, int16_t audioPort) {
+const char *raopClientGetHostName(RAOPClient *raopClient) {
+	return raopClient->hostName;
+}
+
+bool raopClientSetTransport(RAOPClient *raopClient, RTPTransport transport) {
+	raopClient->transport = transport;
+
+	return true;
+}
+
+bool raopClientSetEncryption(RAOPClient *raopClient, bool isEncrypted) {
+	raopClient->isEncrypted = isEncrypted;
+
+	return true;
+}
+
+bool raopClientSetMemoryLocked(RAOPClient *raopClient, bool isMemoryLocked) {
+	raopClient->isMemoryLocked = isMemoryLocked;
+
+	/* Lock buffers of current audio stream (a buffer which cannot be locked is used unlocked) */
+	if(isMemoryLocked && raopClient->rtpStream != NULL) {
+		rtpStreamLockMemory(raopClient->rtpStream);
+	}
+
+	return true;
+}
+
+bool raopClientSetLatencyOffset(RAOPClient *raopClient, int32_t latencyOffset) {
+
+	/* Validate input */
+	if(latencyOffset < -MAX_LATENCY_OFFSET || latencyOffset > MAX_LATENCY_OFFSET) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Latency offset %" PRIi32 " ms for server [%s] is out of range (maximum %d ms)", latencyOffset, raopClient->hostName, MAX_LATENCY_OFFSET);
+		return false;
+	}
+	raopClient->latencyOffset = latencyOffset;
+
+	return true;
+}
+
+void raopClientSetInitialTimestamp(RAOPClient *raopClient, uint32_t initialTimestamp) {
+	raopClient->hasInitialTimestamp = true;
+	raopClient->initialTimestamp = initialTimestamp;
+}
+
+bool raopClientSetAudioPort(RAOPClient *raopClient, uint16_t audioPort) {
 	raopClient->audioPort = audioPort;
 	
 	return true;
 }
 
-bool raopClientPlayM4AFile(RAOPClient *raopClient, M4AFile *m4aFile, struct timespec *startTime) {
+bool raopClientSetControlPort(RAOPClient *raopClient, uint16_t controlPort) {
+	raopClient->controlPort = controlPort;
+
+	return true;
+}
+
+bool raopClientSetTimingPort(RAOPClient *raopClient, uint16_t timingPort) {
+	raopClient->timingPort = timingPort;
+
+	return true;
+}
+
+RAOPClientState raopClientGetState(RAOPClient *raopClient) {
+	return raopClient->state;
+}
+
+int raopClientGetDescriptor(RAOPClient *raopClient) {
+	return rtspClientGetDescriptor(raopClient->rtspClient);
+}
+
+RTPStream *raopClientGetAudioStream(RAOPClient *raopClient) {
+	return raopClient->rtpStream;
+}
+
+bool raopClientStartPlaying(RAOPClient *raopClient, M4AFile *m4aFile, struct timespec *startTime) {
+
+	/* Validate state */
+	if(raopClient->state != RAOP_CLIENT_STATE_IDLE && raopClient->state != RAOP_CLIENT_STATE_STREAMING) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot start playing on server [%s], it is not idle", raopClient->hostName);
+		return false;
+	}
 
 	/* Initialize audio configuration */
 	raopClient->m4aFile = m4aFile;
+	timespecInitialize(&raopClient->startTime);
 	if(startTime != NULL) {
 		timespecCopy(&raopClient->startTime, startTime);
 	}
 
-	/* Send OPTIONS command to initialize RTSP connection (will fail if AirTunes device requires authentication) */
-	if(!rtspClientSendCommand(raopClient->rtspClient, RTSP_METHOD_OPTIONS, raopClient, NULL)) {
-		return false;
+	/* Continue an existing session (as soon as the pending request, if any, is answered) */
+	if(raopClient->state == RAOP_CLIENT_STATE_STREAMING) {
+		raopClient->state = RAOP_CLIENT_STATE_HANDSHAKE;
+		if(rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+			raopClient->isFileChangeRequested = true;
+			return true;
+		}
+		if(!raopClientStartFileChange(raopClient)) {
+			return raopClientFail(raopClient);
+		}
+		return true;
 	}
+	raopClient->hasSession = false;
+	raopClient->isStopRequested = false;
+	raopClient->isVolumeChanged = false;
 
-	/* Send ANNOUNCE command */
-	if(!rtspClientSendCommand(raopClient->rtspClient, RTSP_METHOD_ANNOUNCE, raopClient, raopClientAnnounceContentSupplier)) {
-		return false;
+	/* Continue handshake on the answer of OPTIONS sent to keep the connection alive (if still pending) */
+	raopClient->state = RAOP_CLIENT_STATE_HANDSHAKE;
+	if(rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+		return true;
 	}
 
-	/* Send SETUP command */
-	if(!rtspClientSendCommand(raopClient->rtspClient, RTSP_METHOD_SETUP, raopClient, NULL)) {
-		return false;
+	/* Send ANNOUNCE command if OPTIONS is answered already (connection is warmed up, see raopClientKeepAlive) */
+	if(raopClient->isWarm) {
+		raopClient->isWarm = false;
+		if(!raopClientSendRequest(raopClient, RTSP_METHOD_ANNOUNCE)) {
+			return raopClientFail(raopClient);
+		}
+		return true;
 	}
 
-	/* Setup audio connection */
-	if(!raopClientSetupAudioConnection(raopClient)) {
-		return false;
+	/* Send OPTIONS command to initialize RTSP connection, the other commands of the handshake follow on the responses */
+	if(!raopClientSendRequest(raopClient, RTSP_METHOD_OPTIONS)) {
+		return raopClientFail(raopClient);
 	}
 
-	/* Send RECORD command */
-	if(!rtspClientSendCommand(raopClient->rtspClient, RTSP_METHOD_RECORD, raopClient, NULL)) {
+	return true;
+}
+
+bool raopClientReconnect(RAOPClient *raopClient) {
+
+	/* Close audio stream of the lost session (the session itself cannot be torn down anymore) */
+	raopClientCloseAudioStream(raopClient);
+	raopClient->state = RAOP_CLIENT_STATE_FAILED;
+	raopClient->audioPort = UNUSED_PORT_NUMBER;
+	raopClient->controlPort = UNUSED_PORT_NUMBER;
+	raopClient->timingPort = UNUSED_PORT_NUMBER;
+	raopClient->hasSession = false;
+	raopClient->isWarm = false;
+	raopClient->isStopRequested = false;
+	raopClient->isFlushRequested = false;
+	raopClient->isVolumeChanged = false;
+	raopClient->isFileChangeRequested = false;
+	raopClient->isPauseRequested = false;
+	raopClient->isResumeRequested = false;
+	raopClient->isResuming = false;
+	raopClient->sessionTimescale = 0;
+
+	/* Start connecting to the address of the lost RTSP connection (the authentication of the lost connection is kept) */
+	return rtspClientReconnect(raopClient->rtspClient);
+}
+
+bool raopClientFinishReconnect(RAOPClient *raopClient) {
+	if(!rtspClientFinishConnect(raopClient->rtspClient)) {
 		return false;
 	}
+	raopClient->state = RAOP_CLIENT_STATE_IDLE;
 
-	/* Send SET_PARAMETER command (for the volume) */
-	if(!rtspClientSendCommand(raopClient->rtspClient, RTSP_METHOD_SET_PARAMETER, raopClient, raopClientSetVolumeContentSupplier)) {
-		return false;
+	return true;
+}
+
+bool raopClientKeepAlive(RAOPClient *raopClient) {
+
+	/* Only needed when the connection is not used otherwise */
+	if((raopClient->state != RAOP_CLIENT_STATE_IDLE && raopClient->state != RAOP_CLIENT_STATE_PAUSED) || rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+		return true;
 	}
 
-	/* Send audio data (in separate thread) */
-	if(!raopClientStartPlaying(raopClient)) {
-		return false;
+	/* Send OPTIONS command (authenticating if required), its response is handled in raopClientHandleResponse */
+	if(!raopClientSendRequest(raopClient, RTSP_METHOD_OPTIONS)) {
+		return raopClientFail(raopClient);
 	}
 
 	return true;
 }
 
-bool raopClientStartPlaying(RAOPClient *raopClient) {
+bool raopClientContinuePlaying(RAOPClient *raopClient, M4AFile *m4aFile) {
 
-	/* Set status of client */
-	raopClient->isSendingAudio = true;
-
-	/* Start a new thread for sending audio packets */
-	if(pthread_create(&raopClient->audioThread, NULL, raopClientSendAudio, raopClient) != 0) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create thread for sending audio packets through audio port");
-		raopClient->isSendingAudio = false;
+	/* Audio of the file is sent within the current session, so its format should match */
+	if(m4aFileGetTimescale(m4aFile) != raopClient->sessionTimescale) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot continue playing next file on server [%s], audio format differs", raopClient->hostName);
 		return false;
 	}
-	raopClient->audioThreadJoinable = true;
+	raopClient->m4aFile = m4aFile;
 
 	return true;
 }
 
-void *raopClientSendAudio(void *arg) {
-	RAOPClient *raopClient;
+bool raopClientHandleResponse(RAOPClient *raopClient) {
+	bool isComplete;
 
-	/* Initialize */
-	raopClient = (RAOPClient *)arg;
+	/* Receive (remainder of) response and handle it (repeat for pipelined responses received together) */
+	do {
+		if(!rtspClientReceiveResponse(raopClient->rtspClient, &isComplete)) {
+			return raopClientFail(raopClient);
+		}
+		if(!isComplete) {
+			return true;
+		}
+		if(!raopClientHandleCompleteResponse(raopClient)) {
+			return raopClientFail(raopClient);
+		}
+	} while(rtspClientIsNextResponseComplete(raopClient->rtspClient));
 
-	/* Position at starting sample, according to 'startTime' */
-	if(!m4aFileSetSampleOffset(raopClient->m4aFile, &raopClient->startTime)) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set initial offset for playing file");
-		raopClient->audioThreadJoinable = false;
-		pthread_exit(NULL);
-		return NULL;
-	}
+	return true;
+}
 
-	/* Keep absolute time offset */
-	if(clock_gettime(CLOCK_MONOTONIC, &raopClient->playingTimeOffset) != 0) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve clock value at start of playing (errno = %d)", errno);
-		raopClient->audioThreadJoinable = false;
-		pthread_exit(NULL);
-		return NULL;
+bool raopClientHandleCompleteResponse(RAOPClient *raopClient) {
+	RTSPRequestMethod requestMethod;
+	bool needResend;
+
+	/* Validate state */
+	if(!rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Unexpected RTSP response received from server [%s]. Ignoring it.", raopClient->hostName);
+		return true;
 	}
 
-	/* Already calculate lag time into offset value */
-	timespecAdd(&raopClient->playingTimeOffset, &PLAYING_TIME_LAG);
+	/* Check response (resend request if authentication is required) */
+	if(!rtspClientHandleResponse(raopClient->rtspClient, &requestMethod, raopClient, &needResend)) {
+		return false;
+	}
+	if(needResend) {
+		return raopClientSendRequest(raopClient, requestMethod);
+	}
+	raopClient->requestMethod = requestMethod;
+	if(requestMethod == RTSP_METHOD_SET_PARAMETER) {
+		raopClientReportVolumeLatency(raopClient);
+	}
 
-	/* Send audio messages */
-	if(!raopClientSendAudioMessages(raopClient)) {
-		raopClient->audioThreadJoinable = false;
-		pthread_exit(NULL);
-		return NULL;
+	/* Send next request (if any) once all pipelined requests are answered */
+	if(rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+		return true;
 	}
+	return raopClientContinue(raopClient);
+}
 
-	/* Wait for buffered audio messages to be played */
-	if(!raopClientWaitForBufferedAudio(raopClient)) {
-		raopClient->audioThreadJoinable = false;
-		pthread_exit(NULL);
-		return NULL;
+bool raopClientContinue(RAOPClient *raopClient) {
+
+	/* Handle stop request before anything else */
+	if(raopClient->isStopRequested && (raopClient->state == RAOP_CLIENT_STATE_HANDSHAKE || raopClient->state == RAOP_CLIENT_STATE_STREAMING || raopClient->state == RAOP_CLIENT_STATE_PAUSED)) {
+		return raopClientStartTeardown(raopClient);
+	}
+	if(raopClient->isFileChangeRequested) {
+		return raopClientStartFileChange(raopClient);
+	}
+	if(raopClient->isPauseRequested) {
+		return raopClientStartPause(raopClient);
+	}
+	if(raopClient->isResumeRequested) {
+		return raopClientStartResume(raopClient);
 	}
 
-	/* Playing is done, stop the thread */
-	raopClient->audioThreadJoinable = false;
-	pthread_exit(NULL);
-	return NULL;
+	switch(raopClient->requestMethod) {
+		case RTSP_METHOD_OPTIONS:
+			/* Connection is kept alive (when idle the handshake of the next session can start with ANNOUNCE) */
+			if(raopClient->state != RAOP_CLIENT_STATE_HANDSHAKE) {
+				raopClient->isWarm = raopClient->state == RAOP_CLIENT_STATE_IDLE;
+				return true;
+			}
+
+			/* Send ANNOUNCE command */
+			return raopClientSendRequest(raopClient, RTSP_METHOD_ANNOUNCE);
+		case RTSP_METHOD_ANNOUNCE:
+			/* Setup audio stream (including local ports for UDP transport) and send SETUP command */
+			if(!raopClientSetupAudioStream(raopClient)) {
+				return false;
+			}
+			return raopClientSendRequest(raopClient, RTSP_METHOD_SETUP);
+		case RTSP_METHOD_SETUP:
+			/* Setup audio connection and send RECORD command */
+			raopClient->hasSession = true;
+			if(!raopClientSetupAudioConnection(raopClient)) {
+				return false;
+			}
+			rtspClientSetRTPInfo(raopClient->rtspClient, rtpStreamGetSequenceNumber(raopClient->rtpStream), rtpStreamGetTimestamp(raopClient->rtpStream));
+
+			/* Send RECORD command and SET_PARAMETER command (for the volume) without awaiting the first response (pipelined) */
+			if(!raopClientSendRequest(raopClient, RTSP_METHOD_RECORD)) {
+				return false;
+			}
+			raopClient->isVolumeChanged = false;
+			return raopClientSendRequest(raopClient, RTSP_METHOD_SET_PARAMETER);
+		case RTSP_METHOD_RECORD:
+		case RTSP_METHOD_SET_PARAMETER:
+			/* From now on audio can be sent (and should be stopped explicitly), both RECORD and SET_PARAMETER might be answered last */
+			if(raopClient->state == RAOP_CLIENT_STATE_HANDSHAKE) {
+				logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Server [%s] is ready for receiving audio%s", raopClient->hostName, raopClient->isResuming ? " again" : "");
+				raopClient->isResuming = false;
+				raopClient->state = RAOP_CLIENT_STATE_STREAMING;
+			}
+
+			/* Send volume changed meanwhile */
+			if(raopClient->isVolumeChanged) {
+				raopClient->isVolumeChanged = false;
+				return raopClientSendRequest(raopClient, RTSP_METHOD_SET_PARAMETER);
+			}
+			return true;
+		case RTSP_METHOD_FLUSH:
+			/* Paused (send volume changed meanwhile) */
+			if(raopClient->state == RAOP_CLIENT_STATE_PAUSED) {
+				if(raopClient->isVolumeChanged) {
+					raopClient->isVolumeChanged = false;
+					return raopClientSendRequest(raopClient, RTSP_METHOD_SET_PARAMETER);
+				}
+				return true;
+			}
+
+			/* Next file is played within the same session (send volume changed meanwhile) */
+			if(raopClient->state == RAOP_CLIENT_STATE_HANDSHAKE) {
+				logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Server [%s] is ready for receiving audio of next file", raopClient->hostName);
+				raopClient->state = RAOP_CLIENT_STATE_STREAMING;
+				if(raopClient->isVolumeChanged) {
+					raopClient->isVolumeChanged = false;
+					return raopClientSendRequest(raopClient, RTSP_METHOD_SET_PARAMETER);
+				}
+				return true;
+			}
+
+			/* Send TEARDOWN command */
+			raopClient->state = RAOP_CLIENT_STATE_TEARDOWN;
+			return raopClientSendRequest(raopClient, RTSP_METHOD_TEARDOWN);
+		case RTSP_METHOD_TEARDOWN:
+			/* Session has ended (start a new session if next file has a different audio format) */
+			raopClient->hasSession = false;
+			if(raopClient->state == RAOP_CLIENT_STATE_HANDSHAKE) {
+				return raopClientSendRequest(raopClient, RTSP_METHOD_OPTIONS);
+			}
+			raopClient->state = RAOP_CLIENT_STATE_IDLE;
+			return true;
+		default:
+			return true;
+	}
 }
 
-bool raopClientSendAudioMessages(RAOPClient *raopClient) {
-	uint8_t *audioMessage;
-	uint32_t sampleSize;
-	uint16_t packetLength;
+bool raopClientStartFileChange(RAOPClient *raopClient) {
+	raopClient->isFileChangeRequested = false;
+
+	/* A new session is needed if the audio format differs from the one announced */
+	if(m4aFileGetTimescale(raopClient->m4aFile) != raopClient->sessionTimescale) {
+		logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Audio format of next file differs, starting new session with server [%s]", raopClient->hostName);
+		return raopClientSendRequest(raopClient, RTSP_METHOD_TEARDOWN);
+	}
 
-	/* Create buffer for audio message, large enough to contain the largest sample */
-	if(!bufferAllocate(&audioMessage, AUDIO_MESSAGE_HEADER_SIZE + m4aFileGetLargestSampleSize(raopClient->m4aFile), "audio sample buffer")) {
+	/* Flush audio of previous file and continue the stream from the (aligned) initial timestamp */
+	if(raopClient->hasInitialTimestamp) {
+		rtpStreamSetTimestamp(raopClient->rtpStream, raopClient->initialTimestamp);
+	}
+	if(!rtpStreamRestart(raopClient->rtpStream, m4aFileGetLargestSampleSize(raopClient->m4aFile))) {
 		return false;
 	}
+	rtspClientSetRTPInfo(raopClient->rtspClient, rtpStreamGetSequenceNumber(raopClient->rtpStream), rtpStreamGetTimestamp(raopClient->rtpStream));
+	return raopClientSendRequest(raopClient, RTSP_METHOD_FLUSH);
+}
 
-	/* Write info to log */
-	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Start to send audio packets.");
+bool raopClientStartPause(RAOPClient *raopClient) {
+	raopClient->isPauseRequested = false;
 
-	/* As long as playing is not stopped and data is available send audio packets */
-	while(m4aFileHasMoreSamples(raopClient->m4aFile) && raopClient->isSendingAudio) {
+	/* Flush buffered audio, the session and the RTP stream are kept for resuming */
+	rtspClientSetRTPInfo(raopClient->rtspClient, rtpStreamGetSequenceNumber(raopClient->rtpStream), rtpStreamGetTimestamp(raopClient->rtpStream));
+	return raopClientSendRequest(raopClient, RTSP_METHOD_FLUSH);
+}
 
-		/* Get audio sample (copy into audio message buffer) */
-		if(!m4aFileGetNextSample(raopClient->m4aFile, audioMessage + AUDIO_MESSAGE_HEADER_SIZE, &sampleSize)) {
-			bufferFree(&audioMessage);
-			return false;
-		}
+bool raopClientStartResume(RAOPClient *raopClient) {
+	raopClient->isResumeRequested = false;
 
-		/* Set header of audio message */
-		memset(audioMessage, 0, 16);
-		audioMessage[0] = 0x24;
-		audioMessage[4] = 0xf0;
-		audioMessage[5] = 0xff;
-		packetLength = (uint16_t)htons(sampleSize + 12);
-		memcpy(audioMessage + 2, &packetLength, sizeof(uint16_t));
-
-		/* Send message */
-		if(!networkSendMessage(raopClient->audioConnection, audioMessage, AUDIO_MESSAGE_HEADER_SIZE + sampleSize)) {
-			bufferFree(&audioMessage);
-			return false;
-		}
+	/* Continue recording from the next packet (the stream is not reset, packets sent before the flush are not resendable) */
+	if(!rtpStreamRestart(raopClient->rtpStream, m4aFileGetLargestSampleSize(raopClient->m4aFile))) {
+		return false;
+	}
+	raopClient->isResuming = true;
+	rtspClientSetRTPInfo(raopClient->rtspClient, rtpStreamGetSequenceNumber(raopClient->rtpStream), rtpStreamGetTimestamp(raopClient->rtpStream));
+	if(!raopClientSendRequest(raopClient, RTSP_METHOD_RECORD)) {
+		return false;
 	}
 
-	/* Free buffer */
-	bufferFree(&audioMessage);
-
+	/* Send volume changed meanwhile (pipelined) */
+	if(raopClient->isVolumeChanged) {
+		raopClient->isVolumeChanged = false;
+		return raopClientSendRequest(raopClient, RTSP_METHOD_SET_PARAMETER);
+	}
 	return true;
 }
 
-bool raopClientWaitForBufferedAudio(RAOPClient *raopClient) {
-	struct timespec progress;
-	struct timespec length;
-	uint32_t remainingSeconds;
+bool raopClientStartTeardown(RAOPClient *raopClient) {
+	raopClient->isStopRequested = false;
+	raopClient->isFileChangeRequested = false;
+	raopClient->isPauseRequested = false;
+	raopClient->isResumeRequested = false;
+	raopClient->isResuming = false;
 
-	/* Get progress (how much is played already) */
-	if(!raopClientGetProgress(raopClient, &progress)) {
-		return false;
+	/* Without a session there is nothing to tear down */
+	if(!raopClient->hasSession) {
+		raopClient->state = RAOP_CLIENT_STATE_IDLE;
+		return true;
 	}
 
-	/* Get length (how much there is to play) */
-	if(!m4aFileGetLength(raopClient->m4aFile, &length)) {
-		return false;
+	/* Send FLUSH command (stop AirTunes from streaming/playing its buffered content) if audio is sent */
+	if(raopClient->isFlushRequested && raopClient->state == RAOP_CLIENT_STATE_STREAMING) {
+		raopClient->state = RAOP_CLIENT_STATE_FLUSHING;
+		rtspClientSetRTPInfo(raopClient->rtspClient, rtpStreamGetSequenceNumber(raopClient->rtpStream), rtpStreamGetTimestamp(raopClient->rtpStream));
+		return raopClientSendRequest(raopClient, RTSP_METHOD_FLUSH);
 	}
 
-	/* If audio is still buffered (length >= progress), wait for total playing time to pass */
-	if(length.tv_sec >= progress.tv_sec) {
-		remainingSeconds = length.tv_sec - progress.tv_sec + 1;	/* Add 1 second for remaining partial second */
-		while(raopClient->isSendingAudio && remainingSeconds > 0) {
-			if(sleep(1) != 0) {
-				logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Waiting for buffered data to being played is interrupted.");
-				remainingSeconds = 0;
-			} else {
-				remainingSeconds--;
-			}
-		}
+	/* Send TEARDOWN command */
+	raopClient->state = RAOP_CLIENT_STATE_TEARDOWN;
+	return raopClientSendRequest(raopClient, RTSP_METHOD_TEARDOWN);
+}
+
+bool raopClientSendRequest(RAOPClient *raopClient, RTSPRequestMethod requestMethod) {
+	bool (*raopClientContentSupplier)(RAOPClient *raopClient, RTSPRequest *rtspRequest);
+
+	/* Select content for request */
+	if(requestMethod == RTSP_METHOD_ANNOUNCE) {
+		raopClientContentSupplier = raopClientAnnounceContentSupplier;
+	} else if(requestMethod == RTSP_METHOD_SET_PARAMETER) {
+		raopClientContentSupplier = raopClientSetVolumeContentSupplier;
+	} else {
+		raopClientContentSupplier = NULL;
+	}
+
+	/* Send request (response is handled in raopClientHandleResponse) */
+	if(!rtspClientSendRequest(raopClient->rtspClient, requestMethod, raopClient, raopClientContentSupplier)) {
+		return false;
 	}
 
 	return true;
 }
 
+bool raopClientFail(RAOPClient *raopClient) {
+	logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Communication with server [%s] failed", raopClient->hostName);
+	raopClient->state = RAOP_CLIENT_STATE_FAILED;
+
+	return false;
+}
+
+void raopClientSetReferenceTime(RAOPClient *raopClient, const struct timespec *referenceTime, const struct timespec *position) {
+	struct timespec playingTimeOffset;
+
+	/* Next packet is due at reference time */
+	rtpStreamSetReferenceTime(raopClient->rtpStream, referenceTime);
+
+	/* Keep absolute time offset (already calculate lag time and position of next packet into offset value) */
+	timespecCopy(&playingTimeOffset, referenceTime);
+	timespecAdd(&playingTimeOffset, &PLAYING_TIME_LAG);
+	timespecSubtract(&playingTimeOffset, position, &raopClient->playingTimeOffset);
+}
+
+bool raopClientSendAudioPacket(RAOPClient *raopClient, uint8_t *audioPacket, uint32_t audioPacketSize, bool *isSent) {
+
+	/* Validate state (a packet partially sent before pausing is completed while paused) */
+	if(raopClient->state != RAOP_CLIENT_STATE_STREAMING && raopClient->state != RAOP_CLIENT_STATE_PAUSED) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot send audio packet to server [%s], it is not ready for receiving audio", raopClient->hostName);
+		return false;
+	}
+
+	/* Send (remainder of) packet */
+	return rtpStreamSendPayload(raopClient->rtpStream, audioPacket, audioPacketSize, FRAMES_PER_PACKET, isSent);
+}
+
 bool raopClientSetVolume(RAOPClient *raopClient, float volume) {
 
 	/* Validate input */
@@ -339,10 +691,12 @@ bool raopClientSetVolume(RAOPClient *raopClient, float volume) {
 	}
 	raopClient->volume = volume;
 
-	/* If already playing, send new volume value */
-	if(raopClient->isSendingAudio) {
-		if(!rtspClientSendCommand(raopClient->rtspClient, RTSP_METHOD_SET_PARAMETER, raopClient, raopClientSetVolumeContentSupplier)) {
-			return false;
+	/* If already playing, send new volume value (after the response of a pending request) */
+	if(raopClient->state == RAOP_CLIENT_STATE_HANDSHAKE || raopClient->state == RAOP_CLIENT_STATE_STREAMING || raopClient->state == RAOP_CLIENT_STATE_PAUSED) {
+		if(rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+			raopClient->isVolumeChanged = true;
+		} else if(!raopClientSendRequest(raopClient, RTSP_METHOD_SET_PARAMETER)) {
+			return raopClientFail(raopClient);
 		}
 	}
 
@@ -351,6 +705,8 @@ bool raopClientSetVolume(RAOPClient *raopClient, float volume) {
 
 bool raopClientGetProgress(RAOPClient *raopClient, struct timespec *progress) {
 	struct timespec currentTime;
+	int64_t nanoSeconds;
+	int32_t playingDrift;
 
 	/* Get current time */
 	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0) {
@@ -361,74 +717,222 @@ bool raopClientGetProgress(RAOPClient *raopClient, struct timespec *progress) {
 	/* Calculate progress made */
 	timespecSubtract(&currentTime, &raopClient->playingTimeOffset, progress);
 
+	/* Server plays at the rate of its own clock, correct progress for its drift (if known) */
+	playingDrift = raopClient->rtpStream != NULL ? rtpStreamGetPlayingDrift(raopClient->rtpStream) : 0;
+	if(playingDrift != 0) {
+		nanoSeconds = (int64_t)progress->tv_sec * ONE_SECOND_IN_NANO_SECONDS + progress->tv_nsec;
+		nanoSeconds += nanoSeconds / 1000 * playingDrift / 1000;
+		progress->tv_sec = (time_t)(nanoSeconds / ONE_SECOND_IN_NANO_SECONDS);
+		progress->tv_nsec = (long)(nanoSeconds % ONE_SECOND_IN_NANO_SECONDS);
+	}
+
 	/* Add starttime in case we didn't start at the beginning of the file */
 	timespecAdd(progress, &raopClient->startTime);
 
 	return true;
 }
 
-bool raopClientStopPlaying(RAOPClient *raopClient) {
-	bool result;
+bool raopClientSeekPlaying(RAOPClient *raopClient, struct timespec *startTime) {
 
-	/* Return if nothing to stop */
-	if(!raopClient->isSendingAudio) {
+	/* Validate state */
+	if(raopClient->state != RAOP_CLIENT_STATE_STREAMING && raopClient->state != RAOP_CLIENT_STATE_PAUSED) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot seek on server [%s], it is not streaming", raopClient->hostName);
+		return false;
+	}
+	timespecCopy(&raopClient->startTime, startTime);
+
+	/* When paused the buffered audio is flushed already (resuming continues at the new position) */
+	if(raopClient->state == RAOP_CLIENT_STATE_PAUSED) {
 		return true;
 	}
 
-	/* Stop sending and streaming audio */
-	raopClient->isSendingAudio = false;
-	result = true;
+	/* Flush audio and continue the stream within the same session (like for a next file, see raopClientStartPlaying) */
+	raopClient->state = RAOP_CLIENT_STATE_HANDSHAKE;
+	if(rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+		raopClient->isFileChangeRequested = true;
+		return true;
+	}
+	if(!raopClientStartFileChange(raopClient)) {
+		return raopClientFail(raopClient);
+	}
 
-	/* Wait for audio thread to stop */
-	if(raopClient->audioThreadJoinable) {
-		raopClient->audioThreadJoinable = false;
-		if(pthread_join(raopClient->audioThread, NULL) != 0) {
-			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot join audio thread (to wait for it to stop). Flush audio anyway.");
-			result = false;
-		}
+	return true;
+}
+
+bool raopClientPausePlaying(RAOPClient *raopClient) {
+
+	/* Validate state */
+	if(raopClient->state != RAOP_CLIENT_STATE_STREAMING) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot pause playing on server [%s], it is not streaming", raopClient->hostName);
+		return false;
 	}
 
-	/* Send FLUSH command (stop AirTunes from streaming/playing its buffered content) */
-	if(!rtspClientSendCommand(raopClient->rtspClient, RTSP_METHOD_FLUSH, raopClient, NULL)) {
-		result = false;
+	/* No audio is sent anymore, flush as soon as the pending request (if any) is answered */
+	raopClient->state = RAOP_CLIENT_STATE_PAUSED;
+	if(rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+		raopClient->isPauseRequested = true;
+		return true;
+	}
+	if(!raopClientStartPause(raopClient)) {
+		return raopClientFail(raopClient);
 	}
 
-	/* Send TEARDOWN command */
-	if(!rtspClientSendCommand(raopClient->rtspClient, RTSP_METHOD_TEARDOWN, raopClient, NULL)) {
-		result = false;
+	return true;
+}
+
+bool raopClientResumePlaying(RAOPClient *raopClient) {
+
+	/* Validate state */
+	if(raopClient->state != RAOP_CLIENT_STATE_PAUSED) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot resume playing on server [%s], it is not paused", raopClient->hostName);
+		return false;
 	}
 
-	return result;
+	/* Record again as soon as the pending request (if any, like the flush of pausing) is answered */
+	raopClient->state = RAOP_CLIENT_STATE_HANDSHAKE;
+	if(rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+		raopClient->isResumeRequested = true;
+		return true;
+	}
+	if(!raopClientStartResume(raopClient)) {
+		return raopClientFail(raopClient);
+	}
+
+	return true;
 }
 
-bool raopClientWait(RAOPClient *raopClient) {
+bool raopClientStopPlaying(RAOPClient *raopClient, bool flush) {
 
-	/* Only wait if an audio thread is created, otherwise nothing to wait for */
-	if(raopClient->audioThreadJoinable) {
-		raopClient->audioThreadJoinable = false;
-		if(pthread_join(raopClient->audioThread, NULL) != 0) {
-			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot join audio thread to wait for it to stop");
-			return false;
-		}
+	/* Return if nothing to stop */
+	if(raopClient->state != RAOP_CLIENT_STATE_HANDSHAKE && raopClient->state != RAOP_CLIENT_STATE_STREAMING && raopClient->state != RAOP_CLIENT_STATE_PAUSED) {
+		return true;
+	}
 
-		/* In case the playing has finished normally, audio is not sent anymore */
-		raopClient->isSendingAudio = false;
+	/* Stop as soon as the pending request (if any) is answered */
+	raopClient->isStopRequested = true;
+	raopClient->isFlushRequested = flush;
+	if(rtspClientIsAwaitingResponse(raopClient->rtspClient)) {
+		return true;
+	}
+	if(!raopClientStartTeardown(raopClient)) {
+		return raopClientFail(raopClient);
 	}
 
 	return true;
 }
 
+void raopClientAbandonSession(RAOPClient *raopClient) {
+
+	/* Nothing to abandon if session has ended already */
+	if(raopClient->state == RAOP_CLIENT_STATE_IDLE || raopClient->state == RAOP_CLIENT_STATE_FAILED) {
+		return;
+	}
+	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Abandoning session with server [%s]", raopClient->hostName);
+	raopClient->state = RAOP_CLIENT_STATE_FAILED;
+}
+
+bool raopClientSetupAudioStream(RAOPClient *raopClient) {
+	struct timespec latency;
+	int64_t latencyNanoSeconds;
+	char localAddressName[MAX_ADDR_STRING_LENGTH];
+	char transport[MAX_TRANSPORT_STRING_SIZE];
+	uint16_t controlPort;
+	uint16_t timingPort;
+
+	/* Close audio stream of previously played file */
+	if(!raopClientCloseAudioStream(raopClient)) {
+		return false;
+	}
+
+	/* Create audio stream (latency offset delays or advances playing on this device, only the UDP transport announces latency) */
+	if(raopClient->latencyOffset != 0 && raopClient->transport != RTP_TRANSPORT_UDP) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Latency offset %" PRIi32 " ms for server [%s] is ignored, it only applies to the UDP transport", raopClient->latencyOffset, raopClient->hostName);
+	}
+	latencyNanoSeconds = (int64_t)PLAYING_TIME_LAG.tv_sec * ONE_SECOND_IN_NANO_SECONDS + PLAYING_TIME_LAG.tv_nsec + (int64_t)raopClient->latencyOffset * ONE_MILLI_SECOND_IN_NANO_SECONDS;
+	latency.tv_sec = (time_t)(latencyNanoSeconds / ONE_SECOND_IN_NANO_SECONDS);
+	latency.tv_nsec = (long)(latencyNanoSeconds % ONE_SECOND_IN_NANO_SECONDS);
+	raopClient->rtpStream = rtpStreamCreate(raopClient->transport, m4aFileGetTimescale(raopClient->m4aFile), &latency, m4aFileGetLargestSampleSize(raopClient->m4aFile));
+	if(raopClient->rtpStream == NULL) {
+		return false;
+	}
+	raopClient->sessionTimescale = m4aFileGetTimescale(raopClient->m4aFile);
+	if(raopClient->hasInitialTimestamp) {
+		rtpStreamSetTimestamp(raopClient->rtpStream, raopClient->initialTimestamp);
+	}
+	if(raopClient->isMemoryLocked) {
+		rtpStreamLockMemory(raopClient->rtpStream);
+	}
+	if(raopClient->isEncrypted && !rtpStreamSetEncryption(raopClient->rtpStream, raopClient->aesKey, raopClient->aesIV)) {
+		return false;
+	}
+
+	/* TCP transport uses the default transport of the RTSP client */
+	if(raopClient->transport != RTP_TRANSPORT_UDP) {
+		return rtspClientSetTransport(raopClient->rtspClient, RTSP_CLIENT_DEFAULT_TRANSPORT);
+	}
+
+	/* Open local control and timing ports (on same interface as RTSP connection) */
+	if(!rtspClientGetLocalAddressName(raopClient->rtspClient, localAddressName, MAX_ADDR_STRING_LENGTH)) {
+		return false;
+	}
+	if(!rtpStreamOpenControlPorts(raopClient->rtpStream, localAddressName)) {
+		return false;
+	}
+	if(!rtpStreamGetControlPort(raopClient->rtpStream, &controlPort) || !rtpStreamGetTimingPort(raopClient->rtpStream, &timingPort)) {
+		return false;
+	}
+
+	/* Set UDP transport (announcing local control and timing ports) */
+	if(snprintf(transport, MAX_TRANSPORT_STRING_SIZE, "RTP/AVP/UDP;unicast;interleaved=0-1;mode=record;control_port=%" PRIu16 ";timing_port=%" PRIu16, controlPort, timingPort) < 1) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create string for transport");
+		return false;
+	}
+
+	return rtspClientSetTransport(raopClient->rtspClient, transport);
+}
+
+bool raopClientGetStatistics(RAOPClient *raopClient, RTPStreamStatistics *statistics) {
+	if(raopClient->rtpStream == NULL) {
+		return false;
+	}
+	rtpStreamGetStatistics(raopClient->rtpStream, statistics);
+
+	return true;
+}
+
+bool raopClientCloseAudioStream(RAOPClient *raopClient) {
+	RTPStreamStatistics statistics;
+
+	if(raopClient->rtpStream == NULL) {
+		return true;
+	}
+
+	/* Report loss and retransmit rates (per mille, only meaningful for UDP transport) */
+	rtpStreamGetStatistics(raopClient->rtpStream, &statistics);
+	if(statistics.sentPackets > 0) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Audio packets for server [%s]: sent %" PRIu32 ", lost %" PRIu32 " (%" PRIu32 " per mille), resent %" PRIu32 ", not resendable %" PRIu32, raopClient->hostName, statistics.sentPackets, statistics.lostPackets, (uint32_t)((uint64_t)statistics.lostPackets * 1000 / statistics.sentPackets), statistics.resentPackets, statistics.unavailablePackets);
+	}
+
+	/* Report cost of encryption (relative to the playing time of a packet, the unencrypted path has no cost here) */
+	if(statistics.encryptedPackets > 0) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Audio encryption for server [%s] (%s): %" PRIu32 " packets, %" PRIu32 " ns per packet (%" PRIu32 " MB/s), %" PRIu32 " ppm of playing time", raopClient->hostName, rtpStreamGetEncryptionImplementation(raopClient->rtpStream), statistics.encryptedPackets, statistics.averageEncryptionTime, statistics.encryptionRate, (uint32_t)((uint64_t)statistics.averageEncryptionTime * raopClient->sessionTimescale / FRAMES_PER_PACKET / 1000));
+	}
+
+	return rtpStreamClose(&raopClient->rtpStream);
+}
+
 bool raopClientSetupAudioConnection(RAOPClient *raopClient) {
-	char portNumberString[MAX_NUMBER_STRING_SIZE];
+	char remoteAddressName[MAX_ADDR_STRING_LENGTH];
 
-	/* Open TCP connection to server for audio */
-	if(snprintf(portNumberString, MAX_NUMBER_STRING_SIZE, "%" PRIu32, raopClient->audioPort) < 1) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create string for server port number");
+	/* Connect audio stream to server (at the address of the RTSP connection, so the host name is not resolved again) */
+	if(raopClient->transport == RTP_TRANSPORT_UDP && (raopClient->controlPort == UNUSED_PORT_NUMBER || raopClient->timingPort == UNUSED_PORT_NUMBER)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Server [%s] did not provide control and timing ports for UDP transport", raopClient->hostName);
 		return false;
 	}
-	raopClient->audioConnection = networkOpenConnection(raopClient->hostName, portNumberString, TCP_CONNECTION, true);
-	if(raopClient->audioConnection == NULL) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open audio connection to server [%s] on port [%s]", raopClient->hostName, portNumberString);
+	if(!rtspClientGetRemoteAddressName(raopClient->rtspClient, remoteAddressName, MAX_ADDR_STRING_LENGTH)) {
+		return false;
+	}
+	if(!rtpStreamConnect(raopClient->rtpStream, remoteAddressName, raopClient->audioPort, raopClient->controlPort, raopClient->timingPort)) {
 		return false;
 	}
 
@@ -440,6 +944,7 @@ bool raopClientAnnounceContentSupplier(RAOPClient *raopClient, RTSPRequest *rtsp
 	size_t contentSize;
 	char localAddressName[MAX_ADDR_STRING_LENGTH];
 	char remoteAddressName[MAX_ADDR_STRING_LENGTH];
+	char encryptionContent[MAX_ANNOUNCE_ENCRYPTION_SIZE];
 
 	/* Add ANNOUNCE specific content */
 	if(!rtspClientGetLocalAddressName(raopClient->rtspClient, localAddressName, MAX_ADDR_STRING_LENGTH)) {
@@ -448,6 +953,10 @@ bool raopClientAnnounceContentSupplier(RAOPClient *raopClient, RTSPRequest *rtsp
 	if(!rtspClientGetRemoteAddressName(raopClient->rtspClient, remoteAddressName, MAX_ADDR_STRING_LENGTH)) {
 		return false;
 	}
+	encryptionContent[0] = '\0';
+	if(raopClient->isEncrypted && !raopClientCreateEncryptionContent(raopClient, encryptionContent, MAX_ANNOUNCE_ENCRYPTION_SIZE)) {
+		return false;
+	}
 	if(snprintf(content, MAX_ANNOUNCE_CONTENT_SIZE,
 			"v=0\r\n"
 			"o=iTunes 1 O IN IP4 %s\r\n"
@@ -456,7 +965,8 @@ bool raopClientAnnounceContentSupplier(RAOPClient *raopClient, RTSPRequest *rtsp
 			"t=0 0\r\n"
 			"m=audio 0 RTP/AVP 96\r\n"
 			"a=rtpmap:96 AppleLossless\r\n"
-			"a=fmtp:96 4096 0 16 40 10 14 2 255 0 0 %" PRIu32 "\r\n", localAddressName, remoteAddressName, m4aFileGetTimescale(raopClient->m4aFile)) < 0) {
+			"a=fmtp:96 4096 0 16 40 10 14 2 255 0 0 %" PRIu32 "\r\n"
+			"%s", localAddressName, remoteAddressName, m4aFileGetTimescale(raopClient->m4aFile), encryptionContent) < 0) {
 		return false;
 	}
 	contentSize = strlen(content);
@@ -468,6 +978,33 @@ bool raopClientAnnounceContentSupplier(RAOPClient *raopClient, RTSPRequest *rtsp
 	return true;
 }
 
+bool raopClientCreateEncryptionContent(RAOPClient *raopClient, char *content, size_t maxContentSize) {
+	uint8_t encryptedKey[sizeof(AIRTUNES_RSA_MODULUS)];
+	char encryptedKeyString[MAX_ANNOUNCE_ENCRYPTION_SIZE];
+	char ivString[2 * AES_IV_SIZE];
+
+	/* Create new key and initialization vector for the session (kept for setting up the audio stream) */
+	if(!getRandomBytes(raopClient->aesKey, AES_KEY_SIZE) || !getRandomBytes(raopClient->aesIV, AES_IV_SIZE)) {
+		return false;
+	}
+
+	/* Announce key (encrypted with public key of AirTunes) and initialization vector */
+	if(!rsaCipherEncrypt(AIRTUNES_RSA_MODULUS, sizeof(AIRTUNES_RSA_MODULUS), raopClient->aesKey, AES_KEY_SIZE, encryptedKey)) {
+		return false;
+	}
+	if(!base64Encode(encryptedKey, sizeof(encryptedKey), encryptedKeyString, MAX_ANNOUNCE_ENCRYPTION_SIZE) || !base64Encode(raopClient->aesIV, AES_IV_SIZE, ivString, 2 * AES_IV_SIZE)) {
+		return false;
+	}
+	if(snprintf(content, maxContentSize,
+			"a=rsaaeskey:%s\r\n"
+			"a=aesiv:%s\r\n", encryptedKeyString, ivString) >= (int)maxContentSize) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create string for encryption key");
+		return false;
+	}
+
+	return true;
+}
+
 bool raopClientSetVolumeContentSupplier(RAOPClient *raopClient, RTSPRequest *rtspRequest) {
 	char content[MAX_SET_PARAMETER_CONTENT_SIZE];
 	size_t contentSize;
@@ -484,9 +1021,29 @@ bool raopClientSetVolumeContentSupplier(RAOPClient *raopClient, RTSPRequest *rts
 		return false;
 	}
 
+	/* Keep time of sending (the request is sent directly after its content is supplied) */
+	if(clock_gettime(CLOCK_MONOTONIC, &raopClient->volumeSendTime) != 0) {
+		timespecInitialize(&raopClient->volumeSendTime);
+	}
+
 	return true;
 }
 
+void raopClientReportVolumeLatency(RAOPClient *raopClient) {
+	struct timespec currentTime;
+	struct timespec latency;
+
+	/* Report time between sending volume and receiving its response */
+	if(raopClient->volumeSendTime.tv_sec == 0 && raopClient->volumeSendTime.tv_nsec == 0) {
+		return;
+	}
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0) {
+		return;
+	}
+	timespecSubtract(&currentTime, &raopClient->volumeSendTime, &latency);
+	logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Volume set on server [%s] in %" PRIu32 " us", raopClient->hostName, (uint32_t)(latency.tv_sec * 1000000 + latency.tv_nsec / 1000));
+}
+
 bool raopClientCloseConnection(RAOPClient **raopClient) {
 	bool result;
 
@@ -512,18 +1069,9 @@ bool raopClientCloseConnectionInternal(RAOPClient **raopClient) {
 
 	/* Close all opened/allocated resource. Continu if a failure occurs, but remember failure for final result. */
 	result = true;
-	if((*raopClient)->audioThreadJoinable) {
-		if(pthread_cancel((*raopClient)->audioThread) != 0) {
-			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot cancel audio thread of RAOP client");
-			result = false;
-		}
-		(*raopClient)->audioThreadJoinable = false;
-	}
-	if((*raopClient)->audioConnection != NULL) {
-		if(!networkCloseConnection(&(*raopClient)->audioConnection)) {
-			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot close server connection of RAOP client");
-			result = false;
-		}
+	if(!raopClientCloseAudioStream(*raopClient)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot close audio stream of RAOP client");
+		result = false;
 	}
 	if((*raopClient)->rtspClient != NULL) {
 		if(!rtspClientCloseConnection(&(*raopClient)->rtspClient)) {
@@ -532,6 +1080,8 @@ bool raopClientCloseConnectionInternal(RAOPClient **raopClient) {
 	}
 	(*raopClient)->m4aFile = NULL;	/* Is opened elsewhere, let it be closed there as well */
 	free((*raopClient)->hostName);	/* hostName is allocated using strdup, do not use bufferFree here */
+	free((*raopClient)->portName);	/* Idem */
+	free((*raopClient)->password);	/* Idem */
 
 	if(!result) {
 		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Not all RAOP client resources have been properly closed and freed, this might influence the application stability");
@@ -24,10 +24,22 @@
 
 #include <time.h>
 #include "m4afile.h"
+#include "rtpstream.h"
 
 /* Type definition for RAOPClient */
 typedef struct RAOPClientStruct RAOPClient;
 
+/* Type definition for the state of the session with the AirTunes device */
+typedef enum {
+	RAOP_CLIENT_STATE_IDLE = 0,		/* Not playing (initially and after the session is torn down) */
+	RAOP_CLIENT_STATE_HANDSHAKE = 1,	/* Preparing the AirTunes device for receiving audio */
+	RAOP_CLIENT_STATE_STREAMING = 2,	/* Audio packets can be sent */
+	RAOP_CLIENT_STATE_FLUSHING = 3,		/* Audio buffered by the AirTunes device is being flushed */
+	RAOP_CLIENT_STATE_TEARDOWN = 4,		/* Session is being torn down */
+	RAOP_CLIENT_STATE_FAILED = 5,		/* Communication with the AirTunes device failed */
+	RAOP_CLIENT_STATE_PAUSED = 6		/* Buffered audio is flushed, the session is kept for resuming */
+} RAOPClientState;
+
 /*
  * Function: raopClientOpenConnection
  * Parameters:
@@ -41,6 +53,80 @@ typedef struct RAOPClientStruct RAOPClient;
  */
 RAOPClient *raopClientOpenConnection(const char *hostName, const char *portName, const char *password);
 
+/*
+ * Function: raopClientGetHostName
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ * Returns: the name of the host the RAOP Client is connected to
+ */
+const char *raopClientGetHostName(RAOPClient *raopClient);
+
+/*
+ * Function: raopClientSetTransport
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	transport - the transport (TCP/UDP) for sending audio data
+ * Returns: a boolean specifying if the transport is set successfully
+ *
+ * Remarks:
+ * The transport is used for files played afterwards (default is TCP). With the UDP transport the audio packets are sent
+ * at the pace they are played and timing and sync information is exchanged with the AirTunes device on separate ports.
+ */
+bool raopClientSetTransport(RAOPClient *raopClient, RTPTransport transport);
+
+/*
+ * Function: raopClientSetEncryption
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	isEncrypted - boolean specifying if the audio data should be encrypted
+ * Returns: a boolean specifying if the encryption is set successfully
+ *
+ * Remarks:
+ * Takes effect for the next session (default is not encrypted). A random AES key and initialization vector are created
+ * for every session and announced to the AirTunes device (the key encrypted with the public RSA key of AirTunes).
+ * The cost of encrypting is logged (at info level) when the audio stream is closed.
+ */
+bool raopClientSetEncryption(RAOPClient *raopClient, bool isEncrypted);
+
+/*
+ * Function: raopClientSetMemoryLocked
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	isMemoryLocked - boolean specifying if the buffers of the audio stream should be locked in memory
+ * Returns: a boolean specifying if locking memory is set successfully
+ *
+ * Remarks:
+ * Applies to the current audio stream and to every session afterwards (see rtpStreamLockMemory). Buffers which cannot
+ * be locked are used unlocked, a warning is logged.
+ */
+bool raopClientSetMemoryLocked(RAOPClient *raopClient, bool isMemoryLocked);
+
+/*
+ * Function: raopClientSetLatencyOffset
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	latencyOffset - offset (in milliseconds, between -1000 and 1000) added to the latency of the AirTunes device
+ * Returns: a boolean specifying if the latency offset is set successfully
+ *
+ * Remarks:
+ * A positive offset makes the AirTunes device play later, a negative offset makes it play earlier. Used to compensate
+ * for differences in (analog) output delay when playing on multiple devices. Only applies to the UDP transport and
+ * takes effect for the next file played.
+ */
+bool raopClientSetLatencyOffset(RAOPClient *raopClient, int32_t latencyOffset);
+
+/*
+ * Function: raopClientSetInitialTimestamp
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	initialTimestamp - (RTP) timestamp of the first frame to be played
+ *
+ * Remarks:
+ * Used to align the timestamps of multiple RAOP Clients playing the same file (otherwise a random initial timestamp is used).
+ * Should be set before calling raopClientStartPlaying.
+ */
+void raopClientSetInitialTimestamp(RAOPClient *raopClient, uint32_t initialTimestamp);
+
 /*
  * Function: raopClientSetAudioPort
  * Parameters:
@@ -48,34 +134,185 @@ RAOPClient *raopClientOpenConnection(const char *hostName, const char *portName,
  *	audioPort - the port (number) for sending audio data
  * Returns: a boolean specifying if the audio port is set successfully
  */
-bool raopClientSetAudioPort(RAOPClient *raopClient, int16_t audioPort);
+bool raopClientSetAudioPort(RAOPClient *raopClient, uint16_t audioPort);
+
+/*
+ * Function: raopClientSetControlPort
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	controlPort - the port (number) of the AirTunes device for sending control data (UDP transport only)
+ * Returns: a boolean specifying if the control port is set successfully
+ */
+bool raopClientSetControlPort(RAOPClient *raopClient, uint16_t controlPort);
+
+/*
+ * Function: raopClientSetTimingPort
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	timingPort - the port (number) of the AirTunes device for exchanging timing data (UDP transport only)
+ * Returns: a boolean specifying if the timing port is set successfully
+ */
+bool raopClientSetTimingPort(RAOPClient *raopClient, uint16_t timingPort);
+
+/*
+ * Function: raopClientGetState
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ * Returns: the state of the session with the AirTunes device
+ */
+RAOPClientState raopClientGetState(RAOPClient *raopClient);
 
 /*
- * Function: raopClientPlayM4AFile
+ * Function: raopClientGetDescriptor
  * Parameters:
  *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ * Returns: the descriptor of the (non-blocking) RTSP connection
+ *
+ * Remarks:
+ * When the descriptor is readable, raopClientHandleResponse should be called.
+ */
+int raopClientGetDescriptor(RAOPClient *raopClient);
+
+/*
+ * Function: raopClientGetAudioStream
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ * Returns: the RTP Stream used for sending audio (NULL if no file is played yet)
+ *
+ * Remarks:
+ * The descriptors of the RTP Stream can be waited on by the caller (see rtpStreamGetAudioDescriptor).
+ */
+RTPStream *raopClientGetAudioStream(RAOPClient *raopClient);
+
+/*
+ * Function: raopClientStartPlaying
+ * Parameters:
+ *	raopClient - already open (and idle or streaming) RAOP Client (as returned by raopClientOpenConnection)
  *	m4aFile - M4AFile to play
  *	startTime - time within file from which playing starts (offset from beginning of file)
- * Returns: a boolean specifying if the client could start playing successfully
+ * Returns: a boolean specifying if the client could start the handshake successfully
  *
  * Remarks:
- * The RAOP Client will play the file asynchronously (ie in separate thread). With raopClientWait a thread can wait for the
- * playing to finish (either through normal termination when the complete file has been played or by stopping it by calling
- * raopClientStopPlaying).
+ * Starts the handshake with the AirTunes device without waiting for it to finish. Every response received (see
+ * raopClientHandleResponse) makes the handshake continue until the state becomes RAOP_CLIENT_STATE_STREAMING (or
+ * RAOP_CLIENT_STATE_FAILED). From then on the caller supplies the audio packets (see raopClientSetReferenceTime
+ * and raopClientSendAudioPacket). Playing is stopped using raopClientStopPlaying.
+ * If the client is still streaming (ie the previous file is played completely, but playing is not stopped), the session
+ * is kept: the AirTunes device is only flushed (using the RTP-Info of the next packet) and the state becomes
+ * RAOP_CLIENT_STATE_HANDSHAKE until the device answered. A new session is only set up if the audio format of the file
+ * differs from the format announced for the session.
  */
-bool raopClientPlayM4AFile(RAOPClient *raopClient, M4AFile *m4aFile, struct timespec *startTime);
+bool raopClientStartPlaying(RAOPClient *raopClient, M4AFile *m4aFile, struct timespec *startTime);
+
+/*
+ * Function: raopClientReconnect
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ * Returns: a boolean specifying if the client could start reconnecting successfully
+ *
+ * Remarks:
+ * Used after the connection with the AirTunes device is lost. The audio stream is closed (without tearing down the
+ * session) and a new RTSP connection to the address of the lost connection is started, without resolving the host name
+ * again and without waiting for it. The state is RAOP_CLIENT_STATE_FAILED until the descriptor (see raopClientGetDescriptor)
+ * becomes writable and raopClientFinishReconnect is called. The caller decides how long to wait for it (an unreachable
+ * server does not accept a connection at all). Volume, transport, latency offset and initial timestamp are kept.
+ */
+bool raopClientReconnect(RAOPClient *raopClient);
+
+/*
+ * Function: raopClientFinishReconnect
+ * Parameters:
+ *	raopClient - reconnecting RAOP Client (see raopClientReconnect)
+ * Returns: a boolean specifying if the client is reconnected successfully
+ *
+ * Remarks:
+ * The state becomes RAOP_CLIENT_STATE_IDLE on success. The handshake is started again using raopClientStartPlaying.
+ */
+bool raopClientFinishReconnect(RAOPClient *raopClient);
+
+/*
+ * Function: raopClientKeepAlive
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ * Returns: a boolean specifying if the keep-alive request was sent successfully (or was not needed)
+ *
+ * Remarks:
+ * Sends OPTIONS (including authentication) if the client is idle or paused and no response is pending. When idle, the
+ * connection is warmed up: the handshake of the next raopClientStartPlaying starts with ANNOUNCE (or continues as soon as
+ * the pending OPTIONS is answered). Call it right after opening the connection to have the connection and authentication
+ * done while the file to play is opened, and periodically to keep an unused connection alive.
+ */
+bool raopClientKeepAlive(RAOPClient *raopClient);
+
+/*
+ * Function: raopClientContinuePlaying
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	m4aFile - M4AFile whose audio directly follows the audio sent so far
+ * Returns: a boolean specifying if the client can continue with the file
+ *
+ * Remarks:
+ * Used for playing files without gap: the audio packets of the file are sent within the same session and RTP stream
+ * (no flush). The audio format of the file should match the format announced for the session.
+ */
+bool raopClientContinuePlaying(RAOPClient *raopClient, M4AFile *m4aFile);
+
+/*
+ * Function: raopClientHandleResponse
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ * Returns: a boolean specifying if the response is handled successfully
+ *
+ * Remarks:
+ * Should be called when the RTSP connection is readable (see raopClientGetDescriptor). Receives the available part of
+ * the response and once the response is complete, the next request of the session is sent (if any). If the communication
+ * fails, the state becomes RAOP_CLIENT_STATE_FAILED.
+ */
+bool raopClientHandleResponse(RAOPClient *raopClient);
+
+/*
+ * Function: raopClientSetReferenceTime
+ * Parameters:
+ *	raopClient - streaming RAOP Client (see raopClientStartPlaying)
+ *	referenceTime - absolute time (CLOCK_MONOTONIC) at which the next audio packet is due
+ *	position - time within the audio (relative to the start time of playing) of the next audio packet
+ *
+ * Remarks:
+ * The position is zero when streaming starts and is used for calculating the progress (see raopClientGetProgress)
+ * when streaming is resumed at an earlier packet (see raopClientResumePlaying).
+ */
+void raopClientSetReferenceTime(RAOPClient *raopClient, const struct timespec *referenceTime, const struct timespec *position);
+
+/*
+ * Function: raopClientSendAudioPacket
+ * Parameters:
+ *	raopClient - streaming RAOP Client (see raopClientStartPlaying)
+ *	audioPacket - buffer containing the next sample of the M4AFile (not changed, so it can be shared between clients)
+ *	audioPacketSize - size (in bytes) of the sample
+ *	isSent - boolean specifying if the audio packet is sent completely
+ * Returns: a boolean specifying if sending the audio packet did not fail
+ *
+ * Remarks:
+ * Does not wait for the audio connection to accept the packet. If the packet is not sent completely, this function should
+ * be called again with the same packet when the audio connection is writable (see rtpStreamGetAudioDescriptor).
+ * For the UDP transport the caller should send a packet when it is due (see rtpStreamGetPacketTime), for the TCP
+ * transport the AirTunes device decides the pace.
+ */
+bool raopClientSendAudioPacket(RAOPClient *raopClient, uint8_t *audioPacket, uint32_t audioPacketSize, bool *isSent);
 
 /*
  * Function: raopClientSetVolume
  * Parameters:
  *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
- *	volume - volume as range from minimum -30.0 to maximum 0.0 or -144.0 for muted (Apple AirTunes volume range)
+ *	volume - volume as range from 0.0 (muted) to maximum 30.0
  * Returns: a boolean specifying if the client could set the volume successfully
  *
  * Remarks:
- * The volume range is taken from the (unofficial) Apple AirTunes specification (see http://nto.github.io/AirPlay.html).
- * If a file is playing the (audible) volume will change. If no file is playing yet, the volume is set as the default value for when
- * a new file is being played.
+ * The volume is sent as offset from -30.0 or as -144.0 for muted (the Apple AirTunes volume range, taken from the
+ * (unofficial) Apple AirTunes specification, see http://nto.github.io/AirPlay.html).
+ * If a file is playing the (audible) volume will change (the new volume is sent without waiting for the response, if a
+ * response is pending only the latest volume is sent once it arrives). The time until the volume is answered is logged.
+ * If no file is playing yet, the volume is set as the default value for when a new file is being played.
  */
 bool raopClientSetVolume(RAOPClient *raopClient, float volume);
 
@@ -87,36 +324,87 @@ bool raopClientSetVolume(RAOPClient *raopClient, float volume);
  * Returns: a boolean specifying if the client could retrieve the progress successfully
  *
  * Remarks:
+ * The progress is corrected for the drift of the clock of the AirTunes device (see rtpStreamGetPlayingDrift).
  * @@When fails? What if nothing plays?
  */
 bool raopClientGetProgress(RAOPClient *raopClient, struct timespec *progress);
 
+/*
+ * Function: raopClientGetStatistics
+ * Parameters:
+ *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
+ *	statistics - statistics of the audio packets sent so far
+ * Returns: a boolean specifying if the statistics could be retrieved successfully (false if no file is played)
+ */
+bool raopClientGetStatistics(RAOPClient *raopClient, RTPStreamStatistics *statistics);
+
+/*
+ * Function: raopClientSeekPlaying
+ * Parameters:
+ *	raopClient - streaming or paused RAOP Client (see raopClientStartPlaying)
+ *	startTime - time within file from which playing continues (offset from beginning of file)
+ * Returns: a boolean specifying if the client could seek successfully
+ *
+ * Remarks:
+ * The audio buffered by the AirTunes device is flushed (using the RTP-Info of the next packet) within the same session
+ * and the state is RAOP_CLIENT_STATE_HANDSHAKE until the device answered. The caller positions the file and should set
+ * a new reference time (see raopClientSetReferenceTime) before sending audio packets again. When paused, only the
+ * start time is changed (the audio is flushed already).
+ */
+bool raopClientSeekPlaying(RAOPClient *raopClient, struct timespec *startTime);
+
+/*
+ * Function: raopClientPausePlaying
+ * Parameters:
+ *	raopClient - streaming RAOP Client (see raopClientStartPlaying)
+ * Returns: a boolean specifying if the client could pause playing successfully
+ *
+ * Remarks:
+ * The state becomes RAOP_CLIENT_STATE_PAUSED and the audio buffered by the AirTunes device is flushed (after the response
+ * of a pending request). The session, the audio connection and the RTP stream are kept. No new audio packets should be
+ * sent while paused (only a partially sent packet should be completed).
+ */
+bool raopClientPausePlaying(RAOPClient *raopClient);
+
+/*
+ * Function: raopClientResumePlaying
+ * Parameters:
+ *	raopClient - paused RAOP Client (see raopClientPausePlaying)
+ * Returns: a boolean specifying if the client could resume playing successfully
+ *
+ * Remarks:
+ * Sends RECORD with the RTP-Info of the next packet (no new handshake). The state is RAOP_CLIENT_STATE_HANDSHAKE until
+ * the AirTunes device answered and becomes RAOP_CLIENT_STATE_STREAMING afterwards. The caller should set a new reference
+ * time (see raopClientSetReferenceTime) before sending audio packets again.
+ */
+bool raopClientResumePlaying(RAOPClient *raopClient);
+
 /*
  * Function: raopClientStopPlaying
  * Parameters:
  *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
- * Returns: a boolean specifying if the client could stop playing successfully
+ *	flush - flush the audio buffered by the AirTunes device (stop immediately instead of playing the buffered audio)
+ * Returns: a boolean specifying if the client could start stopping successfully
  *
  * Remarks:
- * The RAOP Client plays files asynchronously (ie in separate thread). Also buffering can take place at the receiver. Therefore
- * stopping the playing might take a number of milliseconds to complete (ie it might not become silent instantly). The current
- * progress (as retrieved through raopClientGetProgress) will however indicate as if the playing stopped immediately.
+ * Stopping is done without waiting: the session is torn down once the pending response (if any) is received. The state
+ * becomes RAOP_CLIENT_STATE_IDLE when the AirTunes device has answered the TEARDOWN command. Buffering takes place at the
+ * receiver, so stopping might take a number of milliseconds to complete (ie it might not become silent instantly). The
+ * current progress (as retrieved through raopClientGetProgress) will however indicate as if the playing stopped immediately.
  * If no playing has been started raopClientStopPlaying will just return 'true'.
  */
-bool raopClientStopPlaying(RAOPClient *raopClient);
+bool raopClientStopPlaying(RAOPClient *raopClient, bool flush);
 
 /*
- * Function: raopClientWait
+ * Function: raopClientAbandonSession
  * Parameters:
  *	raopClient - already open RAOP Client (as returned by raopClientOpenConnection)
- * Returns: a boolean specifying if the client could wait successfully
  *
  * Remarks:
- * The RAOP Client plays files asynchronously (ie in separate thread). Calling raopClientWait lets the current thread wait for the playing
- * to complete. The playing will complete when the full file has been played or when the playing is stopped by calling raopClientStopPlaying.
- * If no playing has been started raopClientWait will just return 'true'.
+ * Gives up on a session which is not torn down in time (ie the AirTunes device does not answer the pending request).
+ * The response is not waited for anymore and the state becomes RAOP_CLIENT_STATE_FAILED (unless already idle).
  */
-bool raopClientWait(RAOPClient *raopClient);
+void raopClientAbandonSession(RAOPClient *raopClient);
 
 /*
  * Function: raopClientCloseConnection
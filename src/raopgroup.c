@@ -0,0 +1,2019 @@
+/*
+ * File: raopgroup.c
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define	_GNU_SOURCE		/* For setting the CPU affinity */
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "raopgroup.h"
+#include "rtpstream.h"
+#include "eventloop.h"
+#include "log.h"
+#include "buffer.h"
+#include "utils.h"
+
+/* Number of packets kept (a power of 2, ~6 seconds of audio with 4096 frames per packet at 44.1kHz) */
+#define	GROUP_PACKET_COUNT		64
+#define	GROUP_FRAMES_PER_PACKET		4096
+
+/* Time packets are read ahead of being due (should be well below the time covered by GROUP_PACKET_COUNT) */
+#define	GROUP_READ_AHEAD_SECONDS	2
+
+/* Time the audio connection may stay non-writable after the pending packet is due, before the device is considered stalled */
+#define	GROUP_STALL_MILLISECONDS	500
+
+/* Interval for keeping the RTSP connections alive while paused (well below the session timeout of the devices) */
+#define	GROUP_KEEP_ALIVE_SECONDS	20
+
+/* Time the devices may take to end their sessions once stopped (a device not answering in time is abandoned) */
+#define	GROUP_STOP_MILLISECONDS		1000
+
+/* Reconnecting a device which lost its connection (delay doubles per attempt, the device may take a short while to accept the connection) */
+#define	GROUP_RECOVERY_INITIAL_MILLISECONDS	250
+#define	GROUP_RECOVERY_MAX_MILLISECONDS		8000
+#define	GROUP_MAX_RECOVERY_ATTEMPTS		8
+#define	GROUP_RECOVERY_CONNECT_MILLISECONDS	1000
+
+/* Largest seek position (kept in milliseconds in a sig_atomic_t, so it can be set from a signal handler) */
+#define	GROUP_MAX_SEEK_SECONDS		(INT32_MAX / 1000)
+
+/* Size of the stack pre-faulted in real-time mode (so handlers never fault on a new stack page) */
+#define	GROUP_PREFAULT_STACK_SIZE	(64 * 1024)
+#define	ONE_SECOND_IN_NANO_SECONDS	1000000000LL
+#define	ONE_MILLISECOND_IN_NANO_SECONDS	1000000LL
+
+/* Volume (in tenths, same default as RAOP client) and minimum interval between volume changes sent to the devices */
+#define	GROUP_VOLUME_DEFAULT		150
+#define	GROUP_VOLUME_MAX		300
+#define	GROUP_VOLUME_INTERVAL_MILLISECONDS	200
+
+/* Type definition for the state of the group */
+typedef enum {
+	RAOP_GROUP_STATE_IDLE = 0,		/* Not playing (sessions of a completely played file are kept for the next file) */
+	RAOP_GROUP_STATE_HANDSHAKE = 1,		/* Waiting for all devices to become ready for receiving audio */
+	RAOP_GROUP_STATE_STREAMING = 2,		/* Reading and sending audio packets */
+	RAOP_GROUP_STATE_DRAINING = 3,		/* All packets are sent, waiting for the audio buffered by the devices to be played */
+	RAOP_GROUP_STATE_STOPPING = 4,		/* Waiting for the sessions of all devices to be torn down */
+	RAOP_GROUP_STATE_PAUSED = 5		/* Audio buffered by the devices is flushed, sessions and packets read are kept */
+} RAOPGroupState;
+
+/* Type definition for a device within the group */
+typedef struct {
+	RAOPGroup *raopGroup;
+	RAOPClient *raopClient;
+
+	/* Descriptors and timer of device in event loop */
+	bool isConnectionAdded;			/* RTSP connection is added to event loop */
+	bool isStreamAdded;			/* Connections of audio stream are added to event loop */
+	bool isWaitingForWritable;		/* Audio connection should become writable before sending continues */
+	EventLoopTimer *sendTimer;		/* Expires when next packet is due (UDP only) or when device is stalled */
+
+	/* State of device */
+	bool isActive;				/* Device is (being) prepared and did not fail sending */
+	bool isSendingPacket;			/* Packet at packetIndex is partially sent */
+	bool isRestartPending;			/* Partially sent packet is completed before continuing at resumePacketIndex */
+	bool isSeekPending;			/* Device is flushed for seeking once its partially sent packet is completed */
+	uint32_t packetIndex;			/* Index of next packet to send */
+	uint32_t skippedPackets;
+
+	/* Recovery of a lost connection (see raopGroupSetRecovery) */
+	bool isRecovering;			/* Connection is lost, device is reconnected (and active again during its handshake) */
+	bool isReconnecting;			/* Connect is pending (its descriptor is added until writable) */
+	EventLoopTimer *recoveryTimer;		/* Expires when the next reconnect attempt is due or when connecting takes too long */
+	uint32_t recoveryAttempts;
+	struct timespec lostTime;		/* Time the connection was lost */
+	uint32_t recoveryCount;
+	uint32_t totalGap;			/* In milliseconds, for all recoveries */
+	uint32_t maxGap;			/* Idem, for the longest recovery */
+} RAOPGroupDevice;
+
+/* Type definition for the RAOP group */
+struct RAOPGroupStruct {
+
+	/* Devices */
+	RAOPGroupDevice devices[MAX_GROUP_DEVICES];
+	uint32_t deviceCount;
+	RAOPClient *progressClient;		/* Client used for retrieving progress */
+	RTPTransport transport;
+	bool isEncrypted;
+	bool isRecoveryEnabled;			/* Reconnect devices which lost their connection while playing */
+	int schedulingPolicy;			/* SCHED_OTHER unless real-time mode is requested (or it failed) */
+	int schedulingPriority;
+	int cpu;				/* CPU the event loop runs on (-1 for any) */
+	bool isRealTimeApplied;			/* Real-time mode applied to the thread calling raopGroupWait */
+	bool isMemoryLocked;
+
+	/* Event loop handling all devices (from the thread calling raopGroupWait) */
+	EventLoop *eventLoop;
+	EventLoopTimer *readTimer;		/* Expires when next packet should be read */
+	EventLoopTimer *drainTimer;		/* Expires when buffered audio is played */
+	EventLoopTimer *keepAliveTimer;		/* Expires when the connections should be kept alive (while paused) */
+	EventLoopTimer *volumeTimer;		/* Expires when the volume requested meanwhile may be sent */
+	EventLoopTimer *stopTimer;		/* Expires when stopping takes too long */
+	volatile sig_atomic_t isStopRequested;
+	volatile sig_atomic_t isPauseRequested;	/* Pause (or resume if reset) on request of another thread or signal handler */
+	volatile sig_atomic_t isSeekRequested;	/* Idem for seeking to seekPosition */
+	volatile sig_atomic_t seekPosition;	/* In milliseconds from beginning of file */
+	volatile sig_atomic_t isVolumeRequested;	/* Idem for changing the volume to requestedVolume */
+	volatile sig_atomic_t requestedVolume;	/* In tenths (only the latest value requested is sent) */
+	uint32_t volumeInterval;		/* Minimum time (in milliseconds) between volume changes sent */
+	struct timespec volumeChangeTime;	/* Time the last volume change was sent */
+
+	/* Audio configuration */
+	M4AFile *m4aFile;
+	M4AFile *nextM4AFile;			/* Queued file, read directly after m4aFile (without gap) */
+	RAOPGroupState state;
+	uint32_t timescale;
+	struct timespec referenceTime;		/* Absolute time at which first packet is due */
+	int32_t playingDrift;			/* Drift (in ppm) of the fastest device, packets are due at its rate (TCP only, see rtpStreamGetPlayingDrift) */
+	struct timespec startTime;		/* Time within first file from which playing started */
+	struct timespec fileOffset;		/* Progress (see raopClientGetProgress) at which the file being read starts */
+	struct timespec previousFileOffset;	/* Idem for the previous file (which might still be playing) */
+	bool isPaused;				/* Paused or resuming (progress is not changing) */
+	struct timespec pausedProgress;		/* Progress (see raopClientGetProgress) at which playing is paused */
+
+	/* Packets read ahead, slot is selected by packet index */
+	uint8_t *packetBuffer;
+	uint32_t maxPacketSize;
+	uint32_t packetSizes[GROUP_PACKET_COUNT];
+	uint32_t packetCount;			/* Number of packets read so far */
+	uint32_t resumePacketIndex;		/* Index of packet which is sent first when streaming (re)starts */
+	bool isEndOfFile;
+};
+
+/* Logging component name */
+static const char *LOG_COMPONENT_NAME = "raopgroup.c";
+
+/* Declare internal functions */
+static void raopGroupHandleWakeup(void *context, uint32_t events);
+static void raopGroupHandleResponse(void *context, uint32_t events);
+static void raopGroupHandleAudio(void *context, uint32_t events);
+static void raopGroupHandleControl(void *context, uint32_t events);
+static void raopGroupHandleTiming(void *context, uint32_t events);
+static void raopGroupHandleSendTimer(void *context, uint32_t events);
+static void raopGroupHandleReadTimer(void *context, uint32_t events);
+static void raopGroupHandleDrainTimer(void *context, uint32_t events);
+static void raopGroupHandleKeepAliveTimer(void *context, uint32_t events);
+static void raopGroupSetKeepAliveTimer(RAOPGroup *raopGroup);
+static void raopGroupSetStopTimer(RAOPGroup *raopGroup);
+static void raopGroupHandleVolumeTimer(void *context, uint32_t events);
+static void raopGroupHandleStopTimer(void *context, uint32_t events);
+static void raopGroupHandleRecoveryTimer(void *context, uint32_t events);
+static void raopGroupHandleReconnect(void *context, uint32_t events);
+static void raopGroupRejoinDevice(RAOPGroupDevice *device);
+static void raopGroupSetTimerAfter(EventLoopTimer *timer, uint32_t milliseconds);
+static bool raopGroupIsRecoverable(RAOPGroupDevice *device);
+static void raopGroupLoseDevice(RAOPGroupDevice *device);
+static void raopGroupRecoverDevice(RAOPGroupDevice *device);
+static bool raopGroupIsRecovering(RAOPGroup *raopGroup);
+static void raopGroupHoldPlaying(RAOPGroup *raopGroup);
+static void raopGroupKeepPosition(RAOPGroup *raopGroup);
+static void raopGroupChangeVolume(RAOPGroup *raopGroup);
+static void raopGroupUpdateDevice(RAOPGroupDevice *device);
+static bool raopGroupAddStream(RAOPGroupDevice *device);
+static void raopGroupRemoveStream(RAOPGroupDevice *device);
+static void raopGroupFailDevice(RAOPGroupDevice *device);
+static void raopGroupStartStreaming(RAOPGroup *raopGroup);
+static void raopGroupPauseDevices(RAOPGroup *raopGroup);
+static void raopGroupResumeDevices(RAOPGroup *raopGroup);
+static void raopGroupSeekDevices(RAOPGroup *raopGroup);
+static void raopGroupReadPackets(RAOPGroup *raopGroup);
+static bool raopGroupHasRoom(RAOPGroup *raopGroup);
+static void raopGroupGetReadTime(RAOPGroup *raopGroup, struct timespec *readTime);
+static void raopGroupGetPacketDelta(RAOPGroup *raopGroup, uint32_t packetIndex, struct timespec *delta);
+static void raopGroupGetPlayingDelta(RAOPGroup *raopGroup, uint32_t packetIndex, struct timespec *delta);
+static void raopGroupUpdatePlayingDrift(RAOPGroup *raopGroup);
+static void raopGroupChangeFile(RAOPGroup *raopGroup);
+static void raopGroupReleaseSlot(RAOPGroup *raopGroup);
+static void raopGroupSendPackets(RAOPGroupDevice *device);
+static void raopGroupCheckAllSent(RAOPGroup *raopGroup);
+static void raopGroupStopDevices(RAOPGroup *raopGroup, bool flush);
+static void raopGroupFinishFile(RAOPGroup *raopGroup);
+static void raopGroupReportSkipped(RAOPGroupDevice *device);
+static void raopGroupReportRecoveries(RAOPGroupDevice *device);
+static void raopGroupCheckFinished(RAOPGroup *raopGroup);
+static bool raopGroupIsBefore(const struct timespec *time1, const struct timespec *time2);
+static void raopGroupReportSkew(RAOPGroup *raopGroup);
+static void raopGroupApplyRealTime(RAOPGroup *raopGroup);
+static bool raopGroupLockPacketBuffer(RAOPGroup *raopGroup);
+static void raopGroupPrefaultStack(void);
+static const char *raopGroupGetSchedulingName(RAOPGroup *raopGroup);
+
+RAOPGroup *raopGroupCreate() {
+	RAOPGroup *raopGroup;
+
+	/* Create RAOP group structure */
+	if(!bufferAllocate(&raopGroup, sizeof(RAOPGroup), "RAOP group")) {
+		return NULL;
+	}
+
+	/* Initialize structure */
+	raopGroup->deviceCount = 0;
+	raopGroup->progressClient = NULL;
+	raopGroup->transport = RTP_TRANSPORT_TCP;
+	raopGroup->isEncrypted = false;
+	raopGroup->isRecoveryEnabled = false;
+	raopGroup->schedulingPolicy = SCHED_OTHER;
+	raopGroup->schedulingPriority = 0;
+	raopGroup->cpu = -1;
+	raopGroup->isRealTimeApplied = false;
+	raopGroup->isMemoryLocked = false;
+	raopGroup->readTimer = NULL;
+	raopGroup->drainTimer = NULL;
+	raopGroup->keepAliveTimer = NULL;
+	raopGroup->volumeTimer = NULL;
+	raopGroup->stopTimer = NULL;
+	raopGroup->isStopRequested = 0;
+	raopGroup->isPauseRequested = 0;
+	raopGroup->isSeekRequested = 0;
+	raopGroup->seekPosition = 0;
+	raopGroup->isVolumeRequested = 0;
+	raopGroup->requestedVolume = GROUP_VOLUME_DEFAULT;
+	raopGroup->volumeInterval = GROUP_VOLUME_INTERVAL_MILLISECONDS;
+	timespecInitialize(&raopGroup->volumeChangeTime);
+	raopGroup->m4aFile = NULL;
+	raopGroup->nextM4AFile = NULL;
+	raopGroup->state = RAOP_GROUP_STATE_IDLE;
+	raopGroup->packetBuffer = NULL;
+	raopGroup->maxPacketSize = 0;
+	raopGroup->packetCount = 0;
+	raopGroup->resumePacketIndex = 0;
+	raopGroup->isEndOfFile = false;
+	raopGroup->isPaused = false;
+
+	/* Create event loop (with timers for reading packets, for waiting on buffered audio, for keeping connections alive, for changing volume and for stopping) */
+	raopGroup->eventLoop = eventLoopCreate(raopGroupHandleWakeup, raopGroup);
+	if(raopGroup->eventLoop == NULL) {
+		raopGroupClose(&raopGroup);
+		return NULL;
+	}
+	raopGroup->readTimer = eventLoopAddTimer(raopGroup->eventLoop, raopGroupHandleReadTimer, raopGroup);
+	if(raopGroup->readTimer == NULL) {
+		raopGroupClose(&raopGroup);
+		return NULL;
+	}
+	raopGroup->drainTimer = eventLoopAddTimer(raopGroup->eventLoop, raopGroupHandleDrainTimer, raopGroup);
+	if(raopGroup->drainTimer == NULL) {
+		raopGroupClose(&raopGroup);
+		return NULL;
+	}
+	raopGroup->keepAliveTimer = eventLoopAddTimer(raopGroup->eventLoop, raopGroupHandleKeepAliveTimer, raopGroup);
+	if(raopGroup->keepAliveTimer == NULL) {
+		raopGroupClose(&raopGroup);
+		return NULL;
+	}
+	raopGroup->volumeTimer = eventLoopAddTimer(raopGroup->eventLoop, raopGroupHandleVolumeTimer, raopGroup);
+	if(raopGroup->volumeTimer == NULL) {
+		raopGroupClose(&raopGroup);
+		return NULL;
+	}
+	raopGroup->stopTimer = eventLoopAddTimer(raopGroup->eventLoop, raopGroupHandleStopTimer, raopGroup);
+	if(raopGroup->stopTimer == NULL) {
+		raopGroupClose(&raopGroup);
+		return NULL;
+	}
+
+	return raopGroup;
+}
+
+bool raopGroupAddDevice(RAOPGroup *raopGroup, const char *hostName, const char *portName, const char *password, int32_t latencyOffset) {
+	RAOPGroupDevice *device;
+
+	/* Validate input */
+	if(raopGroup->deviceCount >= MAX_GROUP_DEVICES) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot add device [%s], maximum number of devices (%d) reached", hostName, MAX_GROUP_DEVICES);
+		return false;
+	}
+
+	/* Open RAOP client for device */
+	device = &raopGroup->devices[raopGroup->deviceCount];
+	device->raopClient = raopClientOpenConnection(hostName, portName, password);
+	if(device->raopClient == NULL) {
+		return false;
+	}
+	if(!raopClientSetLatencyOffset(device->raopClient, latencyOffset) || !raopClientSetTransport(device->raopClient, raopGroup->transport) || !raopClientSetEncryption(device->raopClient, raopGroup->isEncrypted) || !raopClientSetMemoryLocked(device->raopClient, raopGroup->isMemoryLocked)) {
+		raopClientCloseConnection(&device->raopClient);
+		return false;
+	}
+	device->raopGroup = raopGroup;
+	device->isConnectionAdded = false;
+	device->isStreamAdded = false;
+	device->isWaitingForWritable = false;
+	device->isActive = false;
+	device->isSendingPacket = false;
+	device->isRestartPending = false;
+	device->isSeekPending = false;
+	device->packetIndex = 0;
+	device->skippedPackets = 0;
+	device->isRecovering = false;
+	device->isReconnecting = false;
+	device->recoveryAttempts = 0;
+	device->recoveryCount = 0;
+	device->totalGap = 0;
+	device->maxGap = 0;
+
+	/* Let event loop handle responses on the RTSP connection and pace the audio packets (and reconnect if needed) */
+	device->sendTimer = eventLoopAddTimer(raopGroup->eventLoop, raopGroupHandleSendTimer, device);
+	if(device->sendTimer == NULL) {
+		raopClientCloseConnection(&device->raopClient);
+		return false;
+	}
+	device->recoveryTimer = eventLoopAddTimer(raopGroup->eventLoop, raopGroupHandleRecoveryTimer, device);
+	if(device->recoveryTimer == NULL) {
+		eventLoopRemoveTimer(&device->sendTimer);
+		raopClientCloseConnection(&device->raopClient);
+		return false;
+	}
+	if(!eventLoopAddDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient), EVENT_LOOP_READ, raopGroupHandleResponse, device)) {
+		eventLoopRemoveTimer(&device->recoveryTimer);
+		eventLoopRemoveTimer(&device->sendTimer);
+		raopClientCloseConnection(&device->raopClient);
+		return false;
+	}
+	device->isConnectionAdded = true;
+
+	/* Warm up the connection (OPTIONS and authentication are answered while the file to play is opened) */
+	if(!raopClientKeepAlive(device->raopClient)) {
+		eventLoopRemoveDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient));
+		eventLoopRemoveTimer(&device->recoveryTimer);
+		eventLoopRemoveTimer(&device->sendTimer);
+		raopClientCloseConnection(&device->raopClient);
+		return false;
+	}
+	raopGroup->deviceCount++;
+
+	return true;
+}
+
+bool raopGroupSetTransport(RAOPGroup *raopGroup, RTPTransport transport) {
+	uint32_t i;
+
+	raopGroup->transport = transport;
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		if(!raopClientSetTransport(raopGroup->devices[i].raopClient, transport)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool raopGroupSetEncryption(RAOPGroup *raopGroup, bool isEncrypted) {
+	uint32_t i;
+
+	raopGroup->isEncrypted = isEncrypted;
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		if(!raopClientSetEncryption(raopGroup->devices[i].raopClient, isEncrypted)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool raopGroupSetRecovery(RAOPGroup *raopGroup, bool isRecoveryEnabled) {
+	raopGroup->isRecoveryEnabled = isRecoveryEnabled;
+
+	return true;
+}
+
+bool raopGroupSetRealTime(RAOPGroup *raopGroup, int schedulingPolicy, int priority, int cpu) {
+
+	/* Validate input */
+	if(schedulingPolicy != SCHED_FIFO && schedulingPolicy != SCHED_RR) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Real-time mode needs SCHED_FIFO or SCHED_RR scheduling policy");
+		return false;
+	}
+	if(priority < sched_get_priority_min(schedulingPolicy) || priority > sched_get_priority_max(schedulingPolicy)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Real-time priority %d is out of range (%d - %d)", priority, sched_get_priority_min(schedulingPolicy), sched_get_priority_max(schedulingPolicy));
+		return false;
+	}
+	if(cpu < -1 || cpu >= CPU_SETSIZE) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "CPU %d is out of range (maximum %d)", cpu, CPU_SETSIZE - 1);
+		return false;
+	}
+	if(raopGroup->isRealTimeApplied) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Real-time mode should be set before waiting for the group");
+		return false;
+	}
+	raopGroup->schedulingPolicy = schedulingPolicy;
+	raopGroup->schedulingPriority = priority;
+	raopGroup->cpu = cpu;
+
+	return true;
+}
+
+bool raopGroupPlayM4AFile(RAOPGroup *raopGroup, M4AFile *m4aFile, struct timespec *startTime) {
+	RAOPGroupDevice *device;
+	uint32_t initialTimestamp;
+	uint32_t activeCount;
+	uint32_t i;
+
+	/* Validate state */
+	if(raopGroup->state != RAOP_GROUP_STATE_IDLE) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot start playing, group is already playing");
+		return false;
+	}
+	if(raopGroup->isStopRequested) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot start playing, playing is stopped on request");
+		return false;
+	}
+
+	/* Create buffer for packets read ahead (all slots at once, so no allocations are needed while playing) */
+	if(raopGroup->isMemoryLocked && raopGroup->packetBuffer != NULL) {
+		munlock(raopGroup->packetBuffer, GROUP_PACKET_COUNT * raopGroup->maxPacketSize);
+	}
+	bufferFree(&raopGroup->packetBuffer);
+	raopGroup->maxPacketSize = m4aFileGetLargestSampleSize(m4aFile);
+	if(!bufferAllocate(&raopGroup->packetBuffer, GROUP_PACKET_COUNT * raopGroup->maxPacketSize, "group packet buffer")) {
+		return false;
+	}
+	if(raopGroup->isMemoryLocked) {
+		raopGroupLockPacketBuffer(raopGroup);
+	}
+	raopGroup->m4aFile = m4aFile;
+	raopGroup->nextM4AFile = NULL;
+	raopGroup->timescale = m4aFileGetTimescale(m4aFile);
+	timespecInitialize(&raopGroup->startTime);
+	if(startTime != NULL) {
+		timespecCopy(&raopGroup->startTime, startTime);
+	}
+	timespecInitialize(&raopGroup->fileOffset);
+	timespecInitialize(&raopGroup->previousFileOffset);
+	raopGroup->packetCount = 0;
+	raopGroup->resumePacketIndex = 0;
+	raopGroup->isEndOfFile = false;
+	raopGroup->isPaused = false;
+	raopGroup->progressClient = NULL;
+	raopGroup->playingDrift = 0;
+
+	/* Position at starting sample, according to 'startTime' */
+	if(startTime != NULL) {
+		if(!m4aFileSetSampleOffset(m4aFile, startTime)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set initial offset for playing file");
+			return false;
+		}
+	}
+
+	/* All devices use the same timestamps, so their sync packets refer to the same frames at the same (reference) time */
+	if(!getRandomNumber(&initialTimestamp)) {
+		return false;
+	}
+
+	/* Use volume requested before playing from the start (instead of changing it once the handshake is done) */
+	if(raopGroup->isVolumeRequested) {
+		raopGroupChangeVolume(raopGroup);
+	}
+
+	/* Start handshake on all devices (skip devices which fail), the handshakes continue in the event loop */
+	/* Devices with a session kept from the previous file are only flushed, their audio stream is added again once ready */
+	activeCount = 0;
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		raopClientSetInitialTimestamp(device->raopClient, initialTimestamp);
+		raopGroupRemoveStream(device);
+		device->isActive = raopClientStartPlaying(device->raopClient, m4aFile, startTime);
+		device->isSendingPacket = false;
+		device->isRestartPending = false;
+		device->isSeekPending = false;
+		device->isWaitingForWritable = false;
+		device->packetIndex = 0;
+		device->skippedPackets = 0;
+		if(device->isActive) {
+			activeCount++;
+		} else {
+			logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot prepare device [%s] for playing. Skipping it.", raopClientGetHostName(device->raopClient));
+		}
+	}
+	if(activeCount == 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "No device available for playing");
+		return false;
+	}
+	raopGroup->state = RAOP_GROUP_STATE_HANDSHAKE;
+
+	return true;
+}
+
+void raopGroupHandleWakeup(void *context, uint32_t events) {
+	RAOPGroup *raopGroup;
+
+	/* Stop playing (on request of another thread or signal handler) */
+	raopGroup = (RAOPGroup *)context;
+	if(raopGroup->isStopRequested) {
+		if(raopGroup->state != RAOP_GROUP_STATE_IDLE && raopGroup->state != RAOP_GROUP_STATE_STOPPING) {
+			raopGroupStopDevices(raopGroup, true);
+		}
+		raopGroupCheckFinished(raopGroup);
+		return;
+	}
+
+	/* Change volume (idem, rapid changes are coalesced so only the latest volume is sent) */
+	if(raopGroup->isVolumeRequested) {
+		raopGroupChangeVolume(raopGroup);
+	}
+
+	/* Seek, pause or resume playing (idem, requests during the handshake are handled once streaming starts, requests
+	 * during the handshake of a recovering device once it has joined) */
+	if(raopGroupIsRecovering(raopGroup)) {
+		return;
+	}
+	if(raopGroup->isSeekRequested && (raopGroup->state == RAOP_GROUP_STATE_STREAMING || raopGroup->state == RAOP_GROUP_STATE_DRAINING || raopGroup->state == RAOP_GROUP_STATE_PAUSED)) {
+		raopGroupSeekDevices(raopGroup);
+	}
+	if(raopGroup->isPauseRequested && (raopGroup->state == RAOP_GROUP_STATE_STREAMING || raopGroup->state == RAOP_GROUP_STATE_DRAINING)) {
+		raopGroupPauseDevices(raopGroup);
+	} else if(!raopGroup->isPauseRequested && raopGroup->state == RAOP_GROUP_STATE_PAUSED) {
+		raopGroupResumeDevices(raopGroup);
+	}
+}
+
+void raopGroupHandleResponse(void *context, uint32_t events) {
+	RAOPGroupDevice *device;
+
+	/* Let RAOP client continue its session (failure is handled when updating the device) */
+	device = (RAOPGroupDevice *)context;
+	raopClientHandleResponse(device->raopClient);
+	raopGroupUpdateDevice(device);
+}
+
+void raopGroupHandleAudio(void *context, uint32_t events) {
+	RAOPGroupDevice *device;
+
+	/* Continue sending packets (if audio connection is still usable) */
+	device = (RAOPGroupDevice *)context;
+	if((events & EVENT_LOOP_ERROR) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Audio connection of device [%s] failed.", raopClientGetHostName(device->raopClient));
+		raopGroupLoseDevice(device);
+		return;
+	}
+	eventLoopModifyDescriptor(device->raopGroup->eventLoop, rtpStreamGetAudioDescriptor(raopClientGetAudioStream(device->raopClient)), 0);
+	eventLoopSetTimer(device->sendTimer, NULL);
+	device->isWaitingForWritable = false;
+	raopGroupSendPackets(device);
+	raopGroupReadPackets(device->raopGroup);
+}
+
+void raopGroupHandleControl(void *context, uint32_t events) {
+	RAOPGroupDevice *device;
+
+	device = (RAOPGroupDevice *)context;
+	if(!rtpStreamHandleControlPacket(raopClientGetAudioStream(device->raopClient))) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot handle control packet of device [%s]", raopClientGetHostName(device->raopClient));
+	}
+}
+
+void raopGroupHandleTiming(void *context, uint32_t events) {
+	RAOPGroupDevice *device;
+
+	device = (RAOPGroupDevice *)context;
+	if(!rtpStreamHandleTimingPacket(raopClientGetAudioStream(device->raopClient))) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot handle timing packet of device [%s]", raopClientGetHostName(device->raopClient));
+	}
+}
+
+void raopGroupHandleSendTimer(void *context, uint32_t events) {
+	RAOPGroupDevice *device;
+
+	/* Audio connection did not become writable in time */
+	device = (RAOPGroupDevice *)context;
+	if(device->isWaitingForWritable) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Audio connection of device [%s] stalled (not writable for %d ms after packet was due).", raopClientGetHostName(device->raopClient), GROUP_STALL_MILLISECONDS);
+		raopGroupLoseDevice(device);
+		raopGroupReadPackets(device->raopGroup);
+		return;
+	}
+
+	/* Next packet is due */
+	raopGroupSendPackets(device);
+	raopGroupReadPackets(device->raopGroup);
+}
+
+void raopGroupHandleReadTimer(void *context, uint32_t events) {
+	raopGroupReadPackets((RAOPGroup *)context);
+}
+
+void raopGroupHandleDrainTimer(void *context, uint32_t events) {
+	RAOPGroup *raopGroup;
+
+	/* Buffered audio is played, keep sessions for playing a next file */
+	raopGroup = (RAOPGroup *)context;
+	if(raopGroup->state == RAOP_GROUP_STATE_DRAINING) {
+		raopGroupFinishFile(raopGroup);
+	}
+}
+
+void raopGroupHandleKeepAliveTimer(void *context, uint32_t events) {
+	RAOPGroup *raopGroup;
+	RAOPGroupDevice *device;
+	uint32_t i;
+
+	/* Keep sessions of paused devices alive (until resumed or stopped) */
+	raopGroup = (RAOPGroup *)context;
+	if(raopGroup->state != RAOP_GROUP_STATE_PAUSED) {
+		return;
+	}
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isActive && !raopClientKeepAlive(device->raopClient)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot keep connection with device [%s] alive. Stop playing on this device.", raopClientGetHostName(device->raopClient));
+			raopGroupFailDevice(device);
+		}
+	}
+	raopGroupSetKeepAliveTimer(raopGroup);
+}
+
+void raopGroupSetKeepAliveTimer(RAOPGroup *raopGroup) {
+	struct timespec keepAliveTime;
+
+	if(clock_gettime(CLOCK_MONOTONIC, &keepAliveTime) != 0) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot retrieve clock value for keeping connections alive (errno = %d)", errno);
+		return;
+	}
+	keepAliveTime.tv_sec += GROUP_KEEP_ALIVE_SECONDS;
+	eventLoopSetTimer(raopGroup->keepAliveTimer, &keepAliveTime);
+}
+
+void raopGroupSetStopTimer(RAOPGroup *raopGroup) {
+	raopGroupSetTimerAfter(raopGroup->stopTimer, GROUP_STOP_MILLISECONDS);
+}
+
+void raopGroupSetTimerAfter(EventLoopTimer *timer, uint32_t milliseconds) {
+	struct timespec expireTime;
+
+	if(clock_gettime(CLOCK_MONOTONIC, &expireTime) != 0) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot retrieve clock value for setting timer (errno = %d)", errno);
+		return;
+	}
+	expireTime.tv_sec += milliseconds / 1000;
+	expireTime.tv_nsec += (milliseconds % 1000) * ONE_MILLISECOND_IN_NANO_SECONDS;
+	if(expireTime.tv_nsec >= ONE_SECOND_IN_NANO_SECONDS) {
+		expireTime.tv_sec++;
+		expireTime.tv_nsec -= ONE_SECOND_IN_NANO_SECONDS;
+	}
+	eventLoopSetTimer(timer, &expireTime);
+}
+
+void raopGroupHandleVolumeTimer(void *context, uint32_t events) {
+	RAOPGroup *raopGroup;
+
+	/* Minimum interval has passed, send the volume requested meanwhile */
+	raopGroup = (RAOPGroup *)context;
+	if(raopGroup->isVolumeRequested) {
+		raopGroupChangeVolume(raopGroup);
+	}
+}
+
+void raopGroupHandleStopTimer(void *context, uint32_t events) {
+	RAOPGroup *raopGroup;
+	RAOPGroupDevice *device;
+	uint32_t i;
+
+	/* Do not wait any longer for devices which did not end their session (so stopping never hangs on a single device) */
+	raopGroup = (RAOPGroup *)context;
+	if(raopGroup->state != RAOP_GROUP_STATE_STOPPING) {
+		return;
+	}
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		raopClientAbandonSession(device->raopClient);
+		if(raopClientGetState(device->raopClient) == RAOP_CLIENT_STATE_FAILED && device->isConnectionAdded) {
+			eventLoopRemoveDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient));
+			device->isConnectionAdded = false;
+		}
+	}
+	raopGroupCheckFinished(raopGroup);
+}
+
+void raopGroupHandleRecoveryTimer(void *context, uint32_t events) {
+	RAOPGroupDevice *device;
+	RAOPGroup *raopGroup;
+
+	/* Reconnect is due (unless playing is stopped meanwhile) */
+	device = (RAOPGroupDevice *)context;
+	raopGroup = device->raopGroup;
+	if(!device->isRecovering || raopGroup->state == RAOP_GROUP_STATE_STOPPING) {
+		return;
+	}
+
+	/* Connecting takes too long, the device is not reachable (yet) */
+	if(device->isReconnecting) {
+		logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Device [%s] is not reachable (yet)", raopClientGetHostName(device->raopClient));
+		raopGroupLoseDevice(device);
+		return;
+	}
+
+	/* Wait while paused (the device joins once playing is resumed) */
+	if(raopGroup->state == RAOP_GROUP_STATE_PAUSED) {
+		raopGroupSetTimerAfter(device->recoveryTimer, GROUP_RECOVERY_INITIAL_MILLISECONDS);
+		return;
+	}
+
+	/* Join playing if the device is reconnected already (while paused) */
+	if(raopClientGetState(device->raopClient) == RAOP_CLIENT_STATE_IDLE && device->isConnectionAdded) {
+		raopGroupRejoinDevice(device);
+		return;
+	}
+
+	/* Give up after too many attempts */
+	if(device->recoveryAttempts == GROUP_MAX_RECOVERY_ATTEMPTS) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot reconnect to device [%s] (%d attempts). Stop playing on this device.", raopClientGetHostName(device->raopClient), GROUP_MAX_RECOVERY_ATTEMPTS);
+		device->isRecovering = false;
+		raopGroupUpdateDevice(device);
+		return;
+	}
+	device->recoveryAttempts++;
+
+	/* Start connecting without waiting (see raopGroupHandleReconnect), so the other devices are not held up */
+	if(!raopClientReconnect(device->raopClient)) {
+		raopGroupLoseDevice(device);
+		return;
+	}
+	if(!eventLoopAddDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient), EVENT_LOOP_WRITE, raopGroupHandleReconnect, device)) {
+		raopGroupLoseDevice(device);
+		return;
+	}
+	device->isConnectionAdded = true;
+	device->isReconnecting = true;
+	raopGroupSetTimerAfter(device->recoveryTimer, GROUP_RECOVERY_CONNECT_MILLISECONDS);
+}
+
+void raopGroupHandleReconnect(void *context, uint32_t events) {
+	RAOPGroupDevice *device;
+	RAOPGroup *raopGroup;
+
+	/* Connect is finished (successfully or not), stop waiting for it */
+	device = (RAOPGroupDevice *)context;
+	raopGroup = device->raopGroup;
+	device->isReconnecting = false;
+	eventLoopSetTimer(device->recoveryTimer, NULL);
+	eventLoopRemoveDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient));
+	device->isConnectionAdded = false;
+	if(!raopClientFinishReconnect(device->raopClient)) {
+		logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Device [%s] is not reachable (yet)", raopClientGetHostName(device->raopClient));
+		raopGroupLoseDevice(device);
+		return;
+	}
+
+	/* Handle responses on the new connection */
+	if(!eventLoopAddDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient), EVENT_LOOP_READ, raopGroupHandleResponse, device)) {
+		raopGroupLoseDevice(device);
+		return;
+	}
+	device->isConnectionAdded = true;
+
+	/* Wait while paused (the device joins once playing is resumed, see raopGroupHandleRecoveryTimer) */
+	if(raopGroup->state == RAOP_GROUP_STATE_PAUSED) {
+		raopGroupSetTimerAfter(device->recoveryTimer, GROUP_RECOVERY_INITIAL_MILLISECONDS);
+		return;
+	}
+	raopGroupRejoinDevice(device);
+}
+
+void raopGroupRejoinDevice(RAOPGroupDevice *device) {
+	RAOPGroup *raopGroup;
+
+	/* Connection is ready for the next file if not playing */
+	raopGroup = device->raopGroup;
+	if(raopGroup->state == RAOP_GROUP_STATE_IDLE) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Reconnected to device [%s]", raopClientGetHostName(device->raopClient));
+		device->isRecovering = false;
+		return;
+	}
+
+	/* Redo handshake (authenticating right away), the device joins playing once ready (see raopGroupRecoverDevice) */
+	device->isSendingPacket = false;
+	device->isRestartPending = false;
+	device->isSeekPending = false;
+	device->isWaitingForWritable = false;
+	device->packetIndex = raopGroup->resumePacketIndex;
+	device->isActive = raopClientStartPlaying(device->raopClient, raopGroup->m4aFile, &raopGroup->startTime);
+	if(!device->isActive) {
+		raopGroupLoseDevice(device);
+	}
+}
+
+bool raopGroupIsRecoverable(RAOPGroupDevice *device) {
+	RAOPGroup *raopGroup;
+
+	/* Only connections lost while playing are recovered (a failing handshake of a recovering device is retried) */
+	raopGroup = device->raopGroup;
+	if(!raopGroup->isRecoveryEnabled) {
+		return false;
+	}
+	if(device->isRecovering) {
+		return raopGroup->state != RAOP_GROUP_STATE_STOPPING;
+	}
+	return raopGroup->state == RAOP_GROUP_STATE_STREAMING || raopGroup->state == RAOP_GROUP_STATE_DRAINING;
+}
+
+void raopGroupLoseDevice(RAOPGroupDevice *device) {
+	RAOPGroup *raopGroup;
+	uint32_t delay;
+	uint32_t i;
+
+	/* Stop playing on device if its connection cannot be recovered */
+	if(!raopGroupIsRecoverable(device)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Stop playing on device [%s].", raopClientGetHostName(device->raopClient));
+		raopGroupFailDevice(device);
+		return;
+	}
+
+	/* Stop sending audio to device and drop its connections (they are opened again when reconnecting) */
+	raopGroup = device->raopGroup;
+	device->isActive = false;
+	device->isSendingPacket = false;
+	device->isRestartPending = false;
+	device->isSeekPending = false;
+	device->isReconnecting = false;
+	raopGroupRemoveStream(device);
+	if(device->isConnectionAdded) {
+		eventLoopRemoveDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient));
+		device->isConnectionAdded = false;
+	}
+	raopClientAbandonSession(device->raopClient);
+	if(!device->isRecovering) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Connection with device [%s] lost. Reconnecting.", raopClientGetHostName(device->raopClient));
+		device->isRecovering = true;
+		device->recoveryAttempts = 0;
+		if(clock_gettime(CLOCK_MONOTONIC, &device->lostTime) != 0) {
+			timespecInitialize(&device->lostTime);
+		}
+	}
+
+	/* Reconnect after a delay, which doubles with every attempt */
+	delay = GROUP_RECOVERY_INITIAL_MILLISECONDS;
+	for(i = 1; i < device->recoveryAttempts && delay < GROUP_RECOVERY_MAX_MILLISECONDS; i++) {
+		delay *= 2;
+	}
+	if(delay > GROUP_RECOVERY_MAX_MILLISECONDS) {
+		delay = GROUP_RECOVERY_MAX_MILLISECONDS;
+	}
+	raopGroupSetTimerAfter(device->recoveryTimer, delay);
+
+	/* Hold playing at the position reached if no other device is playing */
+	if(raopGroup->state == RAOP_GROUP_STATE_STREAMING || raopGroup->state == RAOP_GROUP_STATE_DRAINING) {
+		for(i = 0; i < raopGroup->deviceCount; i++) {
+			if(raopGroup->devices[i].isActive) {
+				return;
+			}
+		}
+		raopGroupHoldPlaying(raopGroup);
+	}
+}
+
+void raopGroupHoldPlaying(RAOPGroup *raopGroup) {
+	uint32_t i;
+
+	/* Like pausing, but without devices to flush. Streaming restarts once a recovered device finished its handshake. */
+	raopGroupKeepPosition(raopGroup);
+	raopGroup->state = RAOP_GROUP_STATE_HANDSHAKE;
+	raopGroup->isPaused = true;
+	raopGroup->progressClient = NULL;	/* Taken from the devices which restart streaming */
+	eventLoopSetTimer(raopGroup->readTimer, NULL);
+	eventLoopSetTimer(raopGroup->drainTimer, NULL);
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		raopGroup->devices[i].packetIndex = raopGroup->resumePacketIndex;
+	}
+
+	/* Write info to log */
+	logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Hold playing at %" PRIu32 " seconds until a device is reconnected", (uint32_t)raopGroup->pausedProgress.tv_sec);
+}
+
+void raopGroupRecoverDevice(RAOPGroupDevice *device) {
+	RAOPGroup *raopGroup;
+	struct timespec currentTime;
+	struct timespec gap;
+	struct timespec position;
+	struct timespec packetTime;
+	uint64_t frames;
+	uint32_t gapMilliseconds;
+	uint32_t oldestPacketIndex;
+
+	/* Report time between losing the connection and being ready for receiving audio again */
+	raopGroup = device->raopGroup;
+	device->isRecovering = false;
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve clock value when recovering device (errno = %d)", errno);
+		raopGroupFailDevice(device);
+		return;
+	}
+	timespecSubtract(&currentTime, &device->lostTime, &gap);
+	gapMilliseconds = (uint32_t)(gap.tv_sec * 1000 + gap.tv_nsec / ONE_MILLISECOND_IN_NANO_SECONDS);
+	device->recoveryCount++;
+	device->totalGap += gapMilliseconds;
+	if(gapMilliseconds > device->maxGap) {
+		device->maxGap = gapMilliseconds;
+	}
+	logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Connection with device [%s] recovered after %" PRIu32 " ms (%" PRIu32 " attempt(s))", raopClientGetHostName(device->raopClient), gapMilliseconds, device->recoveryAttempts);
+
+	/* When holding, streaming restarts at the position held on all devices (see raopGroupUpdateDevice) */
+	if(raopGroup->state != RAOP_GROUP_STATE_STREAMING && raopGroup->state != RAOP_GROUP_STATE_DRAINING) {
+		return;
+	}
+
+	/* Join the other devices at the packet due now (within the packets kept) */
+	timespecSubtract(&currentTime, &raopGroup->referenceTime, &position);
+	frames = (uint64_t)position.tv_sec * raopGroup->timescale + (uint64_t)position.tv_nsec * raopGroup->timescale / ONE_SECOND_IN_NANO_SECONDS;
+	frames += (int64_t)frames * raopGroup->playingDrift / 1000000;
+	device->packetIndex = frames / GROUP_FRAMES_PER_PACKET < raopGroup->packetCount ? (uint32_t)(frames / GROUP_FRAMES_PER_PACKET) : raopGroup->packetCount;
+	oldestPacketIndex = raopGroup->packetCount > GROUP_PACKET_COUNT ? raopGroup->packetCount - GROUP_PACKET_COUNT : 0;
+	if(device->packetIndex < oldestPacketIndex) {
+		device->packetIndex = oldestPacketIndex;
+	}
+	raopGroupGetPlayingDelta(raopGroup, device->packetIndex, &position);
+	timespecCopy(&packetTime, &raopGroup->referenceTime);
+	timespecAdd(&packetTime, &position);
+	raopGroupGetPacketDelta(raopGroup, device->packetIndex, &position);
+	raopClientSetReferenceTime(device->raopClient, &packetTime, &position);
+	raopGroupSendPackets(device);
+
+	/* Handle requests which waited for the device to join */
+	raopGroupHandleWakeup(raopGroup, EVENT_LOOP_READ);
+}
+
+bool raopGroupIsRecovering(RAOPGroup *raopGroup) {
+	uint32_t i;
+
+	/* A recovering device is busy with its handshake (pausing or seeking waits until it has joined) */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		if(raopGroup->devices[i].isRecovering && raopGroup->devices[i].isActive) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void raopGroupChangeVolume(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	struct timespec currentTime;
+	struct timespec changeTime;
+	struct timespec interval;
+	float volume;
+	uint32_t i;
+
+	/* Wait until the minimum interval since the last change has passed (the timer is kept if already set) */
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot retrieve clock value for changing volume (errno = %d)", errno);
+		return;
+	}
+	interval.tv_sec = raopGroup->volumeInterval / 1000;
+	interval.tv_nsec = (raopGroup->volumeInterval % 1000) * ONE_MILLISECOND_IN_NANO_SECONDS;
+	timespecCopy(&changeTime, &raopGroup->volumeChangeTime);
+	timespecAdd(&changeTime, &interval);
+	if(raopGroupIsBefore(&currentTime, &changeTime)) {
+		eventLoopSetTimer(raopGroup->volumeTimer, &changeTime);
+		return;
+	}
+
+	/* Take the latest volume requested (reset request first, so a request arriving meanwhile is not lost) */
+	raopGroup->isVolumeRequested = 0;
+	volume = (float)raopGroup->requestedVolume / 10.0f;
+	timespecCopy(&raopGroup->volumeChangeTime, &currentTime);
+
+	/* Let all devices change their volume (a device with a pending response sends it once answered) */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isConnectionAdded && !device->isReconnecting && !raopClientSetVolume(device->raopClient, volume)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot change volume of device [%s]. Stop playing on this device.", raopClientGetHostName(device->raopClient));
+			raopGroupFailDevice(device);
+		}
+	}
+	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Volume changed to %.1f", volume);
+}
+
+void raopGroupUpdateDevice(RAOPGroupDevice *device) {
+	RAOPGroup *raopGroup;
+	RAOPClientState state;
+	uint32_t activeCount;
+	uint32_t handshakeCount;
+	uint32_t recoveringCount;
+	uint32_t i;
+
+	/* Act on state of session with device */
+	raopGroup = device->raopGroup;
+	state = raopClientGetState(device->raopClient);
+	if(state == RAOP_CLIENT_STATE_STREAMING && device->isActive && !device->isStreamAdded) {
+		if(!raopGroupAddStream(device)) {
+			raopGroupFailDevice(device);
+			return;
+		}
+		if(device->isRecovering) {
+			raopGroupRecoverDevice(device);
+		}
+	} else if(state == RAOP_CLIENT_STATE_FAILED && device->isActive && raopGroupIsRecoverable(device)) {
+		raopGroupLoseDevice(device);
+		return;
+	} else if(state == RAOP_CLIENT_STATE_FAILED || (state == RAOP_CLIENT_STATE_IDLE && device->isActive)) {
+		if(device->isActive) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Session with device [%s] ended unexpectedly. Stop playing on this device.", raopClientGetHostName(device->raopClient));
+		}
+		device->isActive = false;
+		device->isReconnecting = false;
+		raopGroupRemoveStream(device);
+		if(state == RAOP_CLIENT_STATE_FAILED && device->isConnectionAdded) {
+			eventLoopRemoveDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient));
+			device->isConnectionAdded = false;
+		}
+	} else if(state == RAOP_CLIENT_STATE_IDLE) {
+		raopGroupRemoveStream(device);
+	}
+
+	/* Count devices still playing (or being recovered) and devices still busy with their handshake */
+	activeCount = 0;
+	handshakeCount = 0;
+	recoveringCount = 0;
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		if(raopGroup->devices[i].isRecovering) {
+			recoveringCount++;
+		}
+		if(raopGroup->devices[i].isActive) {
+			activeCount++;
+			if(raopClientGetState(raopGroup->devices[i].raopClient) == RAOP_CLIENT_STATE_HANDSHAKE || raopGroup->devices[i].isSeekPending) {
+				handshakeCount++;
+			}
+		}
+	}
+
+	/* Stop if no device is left, start streaming once all handshakes are done */
+	if(raopGroup->state != RAOP_GROUP_STATE_IDLE && raopGroup->state != RAOP_GROUP_STATE_STOPPING && activeCount == 0 && recoveringCount == 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "No device left for playing");
+		raopGroupStopDevices(raopGroup, true);
+	} else if(raopGroup->state == RAOP_GROUP_STATE_HANDSHAKE && handshakeCount == 0 && activeCount > 0) {
+		raopGroupStartStreaming(raopGroup);
+	}
+	raopGroupCheckFinished(raopGroup);
+}
+
+bool raopGroupAddStream(RAOPGroupDevice *device) {
+	RAOPGroup *raopGroup;
+	RTPStream *rtpStream;
+
+	/* Audio connection is only waited on when a packet could not be sent completely */
+	raopGroup = device->raopGroup;
+	rtpStream = raopClientGetAudioStream(device->raopClient);
+	if(!eventLoopAddDescriptor(raopGroup->eventLoop, rtpStreamGetAudioDescriptor(rtpStream), 0, raopGroupHandleAudio, device)) {
+		return false;
+	}
+	device->isStreamAdded = true;
+
+	/* Control and timing requests of the AirTunes device (UDP only) */
+	if(rtpStreamGetControlDescriptor(rtpStream) != -1) {
+		if(!eventLoopAddDescriptor(raopGroup->eventLoop, rtpStreamGetControlDescriptor(rtpStream), EVENT_LOOP_READ, raopGroupHandleControl, device)) {
+			return false;
+		}
+		if(!eventLoopAddDescriptor(raopGroup->eventLoop, rtpStreamGetTimingDescriptor(rtpStream), EVENT_LOOP_READ, raopGroupHandleTiming, device)) {
+			eventLoopRemoveDescriptor(raopGroup->eventLoop, rtpStreamGetControlDescriptor(rtpStream));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void raopGroupRemoveStream(RAOPGroupDevice *device) {
+	RAOPGroup *raopGroup;
+	RTPStream *rtpStream;
+
+	if(!device->isStreamAdded) {
+		return;
+	}
+
+	/* Remove descriptors of audio stream (before it is closed by the RAOP client) */
+	raopGroup = device->raopGroup;
+	rtpStream = raopClientGetAudioStream(device->raopClient);
+	eventLoopRemoveDescriptor(raopGroup->eventLoop, rtpStreamGetAudioDescriptor(rtpStream));
+	if(rtpStreamGetControlDescriptor(rtpStream) != -1) {
+		eventLoopRemoveDescriptor(raopGroup->eventLoop, rtpStreamGetControlDescriptor(rtpStream));
+		eventLoopRemoveDescriptor(raopGroup->eventLoop, rtpStreamGetTimingDescriptor(rtpStream));
+	}
+	eventLoopSetTimer(device->sendTimer, NULL);
+	device->isStreamAdded = false;
+	device->isWaitingForWritable = false;
+}
+
+void raopGroupFailDevice(RAOPGroupDevice *device) {
+
+	/* Stop sending audio to device, but end its session properly */
+	device->isActive = false;
+	device->isSendingPacket = false;
+	device->isRestartPending = false;
+	device->isSeekPending = false;
+	raopGroupRemoveStream(device);
+	raopClientStopPlaying(device->raopClient, true);
+	raopGroupUpdateDevice(device);
+}
+
+void raopGroupStartStreaming(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	struct timespec referenceTime;
+	struct timespec position;
+	uint32_t i;
+
+	/* First packet to send (the first packet of the file or the packet at which playing paused) is due now on all devices */
+	if(clock_gettime(CLOCK_MONOTONIC, &referenceTime) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve clock value at start of playing (errno = %d)", errno);
+		raopGroupStopDevices(raopGroup, true);
+		return;
+	}
+	raopGroupGetPlayingDelta(raopGroup, raopGroup->resumePacketIndex, &position);
+	timespecSubtract(&referenceTime, &position, &raopGroup->referenceTime);
+	raopGroupGetPacketDelta(raopGroup, raopGroup->resumePacketIndex, &position);
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isActive) {
+			raopClientSetReferenceTime(device->raopClient, &referenceTime, &position);
+			if(raopGroup->progressClient == NULL) {
+				raopGroup->progressClient = device->raopClient;
+			}
+		}
+	}
+
+	/* Write info to log */
+	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Start to read audio packets.");
+
+	raopGroup->state = RAOP_GROUP_STATE_STREAMING;
+	raopGroup->isPaused = false;
+	if(raopGroup->isSeekRequested) {
+		raopGroupSeekDevices(raopGroup);
+		return;
+	}
+	if(raopGroup->isPauseRequested) {
+		raopGroupPauseDevices(raopGroup);
+		return;
+	}
+	raopGroupReadPackets(raopGroup);
+}
+
+void raopGroupPauseDevices(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	uint32_t i;
+
+	/* Find packet being played, it is sent first again when resuming (packets read ahead are kept) */
+	raopGroupKeepPosition(raopGroup);
+
+	/* Stop reading and sending audio */
+	raopGroup->state = RAOP_GROUP_STATE_PAUSED;
+	raopGroup->isPaused = true;
+	eventLoopSetTimer(raopGroup->readTimer, NULL);
+	eventLoopSetTimer(raopGroup->drainTimer, NULL);
+
+	/* Flush devices (a partially sent packet is completed first, see raopGroupSendPackets) */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(!device->isActive) {
+			continue;
+		}
+		if(device->isSendingPacket) {
+			device->isRestartPending = true;
+		} else {
+			device->packetIndex = raopGroup->resumePacketIndex;
+			eventLoopSetTimer(device->sendTimer, NULL);
+		}
+		if(!raopClientPausePlaying(device->raopClient)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot pause playing on device [%s]. Stop playing on this device.", raopClientGetHostName(device->raopClient));
+			raopGroupFailDevice(device);
+		}
+	}
+
+	/* Keep sessions alive while paused */
+	raopGroupSetKeepAliveTimer(raopGroup);
+
+	/* Write info to log */
+	logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Paused playing (%" PRIu32 " packets kept for resuming)", raopGroup->packetCount - raopGroup->resumePacketIndex);
+}
+
+void raopGroupKeepPosition(RAOPGroup *raopGroup) {
+	struct timespec position;
+	uint64_t frames;
+	uint32_t oldestPacketIndex;
+
+	/* Packet being played (within the packets kept) is sent first when streaming restarts */
+	raopGroup->resumePacketIndex = 0;
+	if(raopGroup->progressClient != NULL && raopClientGetProgress(raopGroup->progressClient, &position) && raopGroupIsBefore(&raopGroup->startTime, &position)) {
+		timespecSubtract(&position, &raopGroup->startTime, &position);
+		frames = (uint64_t)position.tv_sec * raopGroup->timescale + (uint64_t)position.tv_nsec * raopGroup->timescale / ONE_SECOND_IN_NANO_SECONDS;
+		raopGroup->resumePacketIndex = frames / GROUP_FRAMES_PER_PACKET < raopGroup->packetCount ? (uint32_t)(frames / GROUP_FRAMES_PER_PACKET) : raopGroup->packetCount;
+	}
+	oldestPacketIndex = raopGroup->packetCount > GROUP_PACKET_COUNT ? raopGroup->packetCount - GROUP_PACKET_COUNT : 0;
+	if(raopGroup->resumePacketIndex < oldestPacketIndex) {
+		raopGroup->resumePacketIndex = oldestPacketIndex;
+	}
+	raopGroupGetPacketDelta(raopGroup, raopGroup->resumePacketIndex, &position);
+	timespecCopy(&raopGroup->pausedProgress, &raopGroup->startTime);
+	timespecAdd(&raopGroup->pausedProgress, &position);
+}
+
+void raopGroupResumeDevices(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	uint32_t i;
+
+	/* Record again on all devices, streaming restarts once all of them answered (see raopGroupUpdateDevice) */
+	raopGroup->state = RAOP_GROUP_STATE_HANDSHAKE;
+	eventLoopSetTimer(raopGroup->keepAliveTimer, NULL);
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isActive && !raopClientResumePlaying(device->raopClient)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot resume playing on device [%s]. Stop playing on this device.", raopClientGetHostName(device->raopClient));
+			raopGroupFailDevice(device);
+		}
+	}
+
+	/* Write info to log */
+	logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Resume playing");
+}
+
+void raopGroupSeekDevices(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	struct timespec position;
+	uint32_t i;
+
+	/* Position file being read (using its seek index) */
+	raopGroup->isSeekRequested = 0;
+	position.tv_sec = raopGroup->seekPosition / 1000;
+	position.tv_nsec = (long)(raopGroup->seekPosition % 1000) * ONE_MILLISECOND_IN_NANO_SECONDS;
+	if(!m4aFileSetSampleOffset(raopGroup->m4aFile, &position)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot seek to %" PRIu32 ".%03" PRIu32 " seconds, position is not within file", (uint32_t)position.tv_sec, (uint32_t)(position.tv_nsec / ONE_MILLISECOND_IN_NANO_SECONDS));
+		return;
+	}
+
+	/* Packets read ahead are discarded, playing restarts as if the file is played from the new position */
+	timespecCopy(&raopGroup->startTime, &position);
+	timespecInitialize(&raopGroup->fileOffset);
+	timespecInitialize(&raopGroup->previousFileOffset);
+	timespecCopy(&raopGroup->pausedProgress, &position);
+	raopGroup->isPaused = true;
+	raopGroup->packetCount = 0;
+	raopGroup->resumePacketIndex = 0;
+	raopGroup->isEndOfFile = false;
+	eventLoopSetTimer(raopGroup->readTimer, NULL);
+	eventLoopSetTimer(raopGroup->drainTimer, NULL);
+
+	/* Flush devices within their sessions (a partially sent packet is completed first, see raopGroupSendPackets) */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(!device->isActive) {
+			continue;
+		}
+		if(device->isSendingPacket) {
+			device->isRestartPending = true;
+			device->isSeekPending = true;
+			continue;
+		}
+		device->packetIndex = 0;
+		eventLoopSetTimer(device->sendTimer, NULL);
+		if(!raopClientSeekPlaying(device->raopClient, &position)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot seek on device [%s]. Stop playing on this device.", raopClientGetHostName(device->raopClient));
+			raopGroupFailDevice(device);
+		}
+	}
+
+	/* Streaming restarts once all devices answered (see raopGroupUpdateDevice), when paused it restarts on resume */
+	if(raopGroup->state != RAOP_GROUP_STATE_PAUSED) {
+		raopGroup->state = RAOP_GROUP_STATE_HANDSHAKE;
+	}
+
+	/* Write info to log */
+	logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Seek to %" PRIu32 ".%03" PRIu32 " seconds", (uint32_t)position.tv_sec, (uint32_t)(position.tv_nsec / ONE_MILLISECOND_IN_NANO_SECONDS));
+}
+
+void raopGroupReadPackets(RAOPGroup *raopGroup) {
+	uint8_t *packet;
+	uint32_t packetSize;
+	struct timespec readTime;
+	struct timespec currentTime;
+	uint32_t i;
+
+	/* Complete packets partially sent before pausing or seeking first, they block reading (see raopGroupHasRoom) */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		if(raopGroup->devices[i].isRestartPending) {
+			raopGroupSendPackets(&raopGroup->devices[i]);
+		}
+	}
+
+	/* Read every packet once, as long as playing is not stopped, data is available and a device has room for it */
+	raopGroupUpdatePlayingDrift(raopGroup);
+	while(raopGroup->state == RAOP_GROUP_STATE_STREAMING && !raopGroup->isEndOfFile && raopGroupHasRoom(raopGroup)) {
+		if(!m4aFileHasMoreSamples(raopGroup->m4aFile)) {
+			if(raopGroup->nextM4AFile == NULL) {
+				raopGroup->isEndOfFile = true;
+				break;
+			}
+			raopGroupChangeFile(raopGroup);
+			continue;
+		}
+
+		/* Do not read too far ahead, so devices only fall behind if they are really late */
+		raopGroupGetReadTime(raopGroup, &readTime);
+		clock_gettime(CLOCK_MONOTONIC, &currentTime);
+		if(raopGroupIsBefore(&currentTime, &readTime)) {
+			if(!eventLoopIsTimerSet(raopGroup->readTimer)) {
+				eventLoopSetTimer(raopGroup->readTimer, &readTime);
+			}
+			break;
+		}
+
+		/* Read packet into the slot of the oldest packet */
+		raopGroupReleaseSlot(raopGroup);
+		packet = raopGroup->packetBuffer + (raopGroup->packetCount & (GROUP_PACKET_COUNT - 1)) * raopGroup->maxPacketSize;
+		if(!m4aFileGetNextSample(raopGroup->m4aFile, packet, &packetSize)) {
+			raopGroup->isEndOfFile = true;
+			break;
+		}
+		raopGroup->packetSizes[raopGroup->packetCount & (GROUP_PACKET_COUNT - 1)] = packetSize;
+		raopGroup->packetCount++;
+	}
+
+	/* Hand packets to all devices */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		raopGroupSendPackets(&raopGroup->devices[i]);
+	}
+	raopGroupCheckAllSent(raopGroup);
+}
+
+bool raopGroupHasRoom(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	uint32_t i;
+
+	/* Check if any active device has room for another packet (a device partially sending the oldest packet blocks its slot) */
+	/* A packet partially sent before seeking is indexed from before the seek, its slot is unknown until it is completed */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isActive && device->isSendingPacket && (device->isRestartPending || raopGroup->packetCount - device->packetIndex >= GROUP_PACKET_COUNT)) {
+			return false;
+		}
+	}
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isActive && raopGroup->packetCount - device->packetIndex < GROUP_PACKET_COUNT) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void raopGroupGetReadTime(RAOPGroup *raopGroup, struct timespec *readTime) {
+	struct timespec delta;
+
+	/* Packet is read GROUP_READ_AHEAD_SECONDS before it is due */
+	raopGroupGetPlayingDelta(raopGroup, raopGroup->packetCount, &delta);
+	timespecCopy(readTime, &raopGroup->referenceTime);
+	timespecAdd(readTime, &delta);
+	readTime->tv_sec -= GROUP_READ_AHEAD_SECONDS;
+}
+
+void raopGroupGetPacketDelta(RAOPGroup *raopGroup, uint32_t packetIndex, struct timespec *delta) {
+	uint64_t frames;
+
+	/* Time between first packet and specified packet being due */
+	frames = (uint64_t)packetIndex * GROUP_FRAMES_PER_PACKET;
+	delta->tv_sec = frames / raopGroup->timescale;
+	delta->tv_nsec = (long)((frames % raopGroup->timescale) * ONE_SECOND_IN_NANO_SECONDS / raopGroup->timescale);
+}
+
+void raopGroupGetPlayingDelta(RAOPGroup *raopGroup, uint32_t packetIndex, struct timespec *delta) {
+	int64_t nanoSeconds;
+
+	/* Time (reference clock) between first packet and specified packet being due at the rate the devices play */
+	raopGroupGetPacketDelta(raopGroup, packetIndex, delta);
+	if(raopGroup->playingDrift != 0) {
+		nanoSeconds = (int64_t)delta->tv_sec * ONE_SECOND_IN_NANO_SECONDS + delta->tv_nsec;
+		nanoSeconds -= nanoSeconds * raopGroup->playingDrift / (1000000 + raopGroup->playingDrift);
+		delta->tv_sec = (time_t)(nanoSeconds / ONE_SECOND_IN_NANO_SECONDS);
+		delta->tv_nsec = (long)(nanoSeconds % ONE_SECOND_IN_NANO_SECONDS);
+	}
+}
+
+void raopGroupUpdatePlayingDrift(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	RTPStream *rtpStream;
+	struct timespec previousDelta;
+	struct timespec delta;
+	struct timespec referenceTime;
+	int32_t playingDrift;
+	uint32_t i;
+
+	/* Packets are due at the rate of the fastest device, so no device runs out of audio (a slower one skips audio) */
+	playingDrift = INT32_MIN;
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		rtpStream = raopClientGetAudioStream(device->raopClient);
+		if(device->isActive && rtpStream != NULL && rtpStreamGetPlayingDrift(rtpStream) > playingDrift) {
+			playingDrift = rtpStreamGetPlayingDrift(rtpStream);
+		}
+	}
+	if(playingDrift == INT32_MIN || playingDrift == raopGroup->playingDrift) {
+		return;
+	}
+
+	/* Move reference time so the next packet to read stays due at the same time (the drift only applies from now on) */
+	raopGroupGetPlayingDelta(raopGroup, raopGroup->packetCount, &previousDelta);
+	raopGroup->playingDrift = playingDrift;
+	raopGroupGetPlayingDelta(raopGroup, raopGroup->packetCount, &delta);
+	if(raopGroupIsBefore(&delta, &previousDelta)) {
+		timespecSubtract(&previousDelta, &delta, &delta);
+		timespecAdd(&raopGroup->referenceTime, &delta);
+	} else {
+		timespecSubtract(&delta, &previousDelta, &delta);
+		timespecCopy(&referenceTime, &raopGroup->referenceTime);
+		timespecSubtract(&referenceTime, &delta, &raopGroup->referenceTime);
+	}
+
+	/* Write info to log */
+	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Packets are due at the rate of the fastest device (clock drift %" PRIi32 " ppm)", playingDrift);
+}
+
+void raopGroupChangeFile(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	uint32_t i;
+
+	/* The first packet of the queued file directly follows the last packet read (same RTP stream, no flush) */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isActive && !raopClientContinuePlaying(device->raopClient, raopGroup->nextM4AFile)) {
+			raopGroupFailDevice(device);
+		}
+	}
+	timespecCopy(&raopGroup->previousFileOffset, &raopGroup->fileOffset);
+	raopGroupGetPacketDelta(raopGroup, raopGroup->packetCount, &raopGroup->fileOffset);
+	timespecAdd(&raopGroup->fileOffset, &raopGroup->startTime);
+	raopGroup->m4aFile = raopGroup->nextM4AFile;
+	raopGroup->nextM4AFile = NULL;
+
+	/* Write info to log */
+	logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Continue reading from next file (without gap)");
+
+	/* Let raopGroupWait return, so the caller can queue another file (packets are still sent when waiting again) */
+	eventLoopStop(raopGroup->eventLoop);
+}
+
+void raopGroupReleaseSlot(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	uint32_t i;
+
+	/* Devices which did not send the oldest packet yet, skip it (not called while such a packet is partially sent) */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isActive && raopGroup->packetCount - device->packetIndex >= GROUP_PACKET_COUNT) {
+			if(device->skippedPackets == 0) {
+				logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Device [%s] cannot keep up with other devices. Skipping audio packets.", raopClientGetHostName(device->raopClient));
+			}
+			device->packetIndex++;
+			device->skippedPackets++;
+		}
+	}
+}
+
+void raopGroupSendPackets(RAOPGroupDevice *device) {
+	RAOPGroup *raopGroup;
+	uint8_t *packet;
+	uint32_t packetSize;
+	struct timespec packetTime;
+	struct timespec currentTime;
+	struct timespec stallDelay;
+	bool isSent;
+
+	/* Only send if device is ready and not waiting already (for its audio connection or for the next packet to be due) */
+	raopGroup = device->raopGroup;
+	if(!device->isActive || !device->isStreamAdded || device->isWaitingForWritable || eventLoopIsTimerSet(device->sendTimer)) {
+		return;
+	}
+	if(raopGroup->state != RAOP_GROUP_STATE_STREAMING && raopGroup->state != RAOP_GROUP_STATE_DRAINING && !device->isRestartPending) {
+		return;
+	}
+
+	/* Send packets which are read, until the device cannot accept more (a partially sent packet is completed in any state) */
+	while(device->isRestartPending || device->packetIndex != raopGroup->packetCount) {
+
+		/* UDP has no flow control, wait until the packet is due (TCP is paced by the AirTunes device) */
+		if(raopGroup->transport == RTP_TRANSPORT_UDP && !device->isSendingPacket) {
+			rtpStreamGetPacketTime(raopClientGetAudioStream(device->raopClient), &packetTime);
+			clock_gettime(CLOCK_MONOTONIC, &currentTime);
+			if(raopGroupIsBefore(&currentTime, &packetTime)) {
+				eventLoopSetTimer(device->sendTimer, &packetTime);
+				return;
+			}
+		}
+
+		/* Send (remainder of) packet */
+		packet = raopGroup->packetBuffer + (device->packetIndex & (GROUP_PACKET_COUNT - 1)) * raopGroup->maxPacketSize;
+		packetSize = raopGroup->packetSizes[device->packetIndex & (GROUP_PACKET_COUNT - 1)];
+		if(!raopClientSendAudioPacket(device->raopClient, packet, packetSize, &isSent)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot send audio packet to device [%s].", raopClientGetHostName(device->raopClient));
+			raopGroupLoseDevice(device);
+			return;
+		}
+		if(!isSent) {
+			device->isSendingPacket = true;
+			device->isWaitingForWritable = true;
+			eventLoopModifyDescriptor(raopGroup->eventLoop, rtpStreamGetAudioDescriptor(raopClientGetAudioStream(device->raopClient)), EVENT_LOOP_WRITE);
+
+			/* Consider device stalled if it does not accept the packet shortly after it is due */
+			rtpStreamGetPacketTime(raopClientGetAudioStream(device->raopClient), &packetTime);
+			clock_gettime(CLOCK_MONOTONIC, &currentTime);
+			if(raopGroupIsBefore(&packetTime, &currentTime)) {
+				timespecCopy(&packetTime, &currentTime);
+			}
+			stallDelay.tv_sec = GROUP_STALL_MILLISECONDS / 1000;
+			stallDelay.tv_nsec = (GROUP_STALL_MILLISECONDS % 1000) * 1000000L;
+			timespecAdd(&packetTime, &stallDelay);
+			eventLoopSetTimer(device->sendTimer, &packetTime);
+			return;
+		}
+		device->isSendingPacket = false;
+		device->packetIndex++;
+
+		/* Packet partially sent before pausing (or seeking) is completed, continue at the packet to restart with */
+		if(device->isRestartPending) {
+			device->isRestartPending = false;
+			device->packetIndex = raopGroup->resumePacketIndex;
+
+			/* The device is flushed now the RTP stream is at a packet boundary (see raopGroupSeekDevices) */
+			if(device->isSeekPending) {
+				device->isSeekPending = false;
+				if(!raopClientSeekPlaying(device->raopClient, &raopGroup->startTime)) {
+					logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot seek on device [%s]. Stop playing on this device.", raopClientGetHostName(device->raopClient));
+					raopGroupFailDevice(device);
+					return;
+				}
+			}
+			if(raopGroup->state != RAOP_GROUP_STATE_STREAMING && raopGroup->state != RAOP_GROUP_STATE_DRAINING) {
+				return;
+			}
+		}
+	}
+}
+
+void raopGroupCheckAllSent(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	struct timespec progress;
+	struct timespec end;
+	struct timespec remaining;
+	struct timespec drainTime;
+	uint32_t i;
+
+	/* Check if all packets are read and sent */
+	if(raopGroup->state != RAOP_GROUP_STATE_STREAMING || !raopGroup->isEndOfFile) {
+		return;
+	}
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(device->isActive && device->packetIndex != raopGroup->packetCount) {
+			return;
+		}
+	}
+	raopGroupReportSkew(raopGroup);
+
+	/* Wait for buffered audio to be played (end of last packet minus progress made so far, both including start time) */
+	raopGroup->state = RAOP_GROUP_STATE_DRAINING;
+	if(raopGroup->progressClient == NULL || !raopClientGetProgress(raopGroup->progressClient, &progress) || clock_gettime(CLOCK_MONOTONIC, &drainTime) != 0) {
+		raopGroupHandleDrainTimer(raopGroup, EVENT_LOOP_TIMER);
+		return;
+	}
+	raopGroupGetPacketDelta(raopGroup, raopGroup->packetCount, &end);
+	timespecAdd(&end, &raopGroup->startTime);
+	if(raopGroupIsBefore(&progress, &end)) {
+		timespecSubtract(&end, &progress, &remaining);
+		timespecAdd(&drainTime, &remaining);
+	}
+	eventLoopSetTimer(raopGroup->drainTimer, &drainTime);
+}
+
+void raopGroupStopDevices(RAOPGroup *raopGroup, bool flush) {
+	RAOPGroupDevice *device;
+	uint32_t i;
+
+	/* Report timing if stopped before all packets are sent */
+	if(raopGroup->state == RAOP_GROUP_STATE_STREAMING) {
+		raopGroupReportSkew(raopGroup);
+	}
+
+	/* Stop reading and sending audio */
+	raopGroup->state = RAOP_GROUP_STATE_STOPPING;
+	eventLoopSetTimer(raopGroup->readTimer, NULL);
+	eventLoopSetTimer(raopGroup->drainTimer, NULL);
+	eventLoopSetTimer(raopGroup->keepAliveTimer, NULL);
+	raopGroupSetStopTimer(raopGroup);
+
+	/* Stop all devices (including the ones which failed, they might still be connected) */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		device->isActive = false;
+		device->isRecovering = false;
+		device->isReconnecting = false;
+		eventLoopSetTimer(device->recoveryTimer, NULL);
+		raopGroupRemoveStream(device);
+		if(!raopClientStopPlaying(device->raopClient, flush)) {
+			logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot stop playing on device [%s]", raopClientGetHostName(device->raopClient));
+		}
+		if(raopClientGetState(device->raopClient) == RAOP_CLIENT_STATE_FAILED && device->isConnectionAdded) {
+			eventLoopRemoveDescriptor(raopGroup->eventLoop, raopClientGetDescriptor(device->raopClient));
+			device->isConnectionAdded = false;
+		}
+
+		raopGroupReportSkipped(device);
+		raopGroupReportRecoveries(device);
+	}
+}
+
+void raopGroupFinishFile(RAOPGroup *raopGroup) {
+	uint32_t i;
+
+	/* Devices keep streaming (without audio), until the next file is played or the sessions are ended */
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		raopGroupReportSkipped(&raopGroup->devices[i]);
+		raopGroupReportRecoveries(&raopGroup->devices[i]);
+	}
+	raopGroup->state = RAOP_GROUP_STATE_IDLE;
+	eventLoopStop(raopGroup->eventLoop);
+}
+
+void raopGroupReportRecoveries(RAOPGroupDevice *device) {
+	if(device->recoveryCount > 0) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Device [%s] recovered %" PRIu32 " time(s) from a lost connection (gap %" PRIu32 " ms in total, longest %" PRIu32 " ms)", raopClientGetHostName(device->raopClient), device->recoveryCount, device->totalGap, device->maxGap);
+		device->recoveryCount = 0;
+		device->totalGap = 0;
+		device->maxGap = 0;
+	}
+}
+
+void raopGroupReportSkipped(RAOPGroupDevice *device) {
+	if(device->skippedPackets > 0) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Device [%s] skipped %" PRIu32 " audio packet(s)", raopClientGetHostName(device->raopClient), device->skippedPackets);
+		device->skippedPackets = 0;
+	}
+}
+
+void raopGroupCheckFinished(RAOPGroup *raopGroup) {
+	RAOPClientState state;
+	uint32_t i;
+
+	/* Finished when all sessions are torn down (or failed) */
+	if(raopGroup->state != RAOP_GROUP_STATE_STOPPING) {
+		return;
+	}
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		state = raopClientGetState(raopGroup->devices[i].raopClient);
+		if(state != RAOP_CLIENT_STATE_IDLE && state != RAOP_CLIENT_STATE_FAILED) {
+			return;
+		}
+	}
+	raopGroup->state = RAOP_GROUP_STATE_IDLE;
+	eventLoopSetTimer(raopGroup->stopTimer, NULL);
+	eventLoopStop(raopGroup->eventLoop);
+}
+
+bool raopGroupIsBefore(const struct timespec *time1, const struct timespec *time2) {
+	return time1->tv_sec < time2->tv_sec || (time1->tv_sec == time2->tv_sec && time1->tv_nsec < time2->tv_nsec);
+}
+
+bool raopGroupGetProgress(RAOPGroup *raopGroup, struct timespec *progress) {
+	struct timespec totalProgress;
+
+	/* Progress does not change while paused */
+	if(raopGroup->isPaused) {
+		timespecCopy(&totalProgress, &raopGroup->pausedProgress);
+	} else if(raopGroup->progressClient == NULL || !raopClientGetProgress(raopGroup->progressClient, &totalProgress)) {
+		return false;
+	}
+
+	/* Progress of files played without gap is counted from the start of the first file, make it relative to the file playing */
+	if(!raopGroupIsBefore(&totalProgress, &raopGroup->fileOffset)) {
+		timespecSubtract(&totalProgress, &raopGroup->fileOffset, progress);
+	} else if(!raopGroupIsBefore(&totalProgress, &raopGroup->previousFileOffset)) {
+		timespecSubtract(&totalProgress, &raopGroup->previousFileOffset, progress);
+	} else {
+		timespecCopy(progress, &totalProgress);
+	}
+
+	return true;
+}
+
+bool raopGroupQueueM4AFile(RAOPGroup *raopGroup, M4AFile *m4aFile) {
+
+	/* Validate state (a file can only be queued while packets are still read) */
+	if((raopGroup->state != RAOP_GROUP_STATE_HANDSHAKE && raopGroup->state != RAOP_GROUP_STATE_STREAMING) || raopGroup->isEndOfFile) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Cannot queue next file, group is not reading a file (next file is played after current file)");
+		return false;
+	}
+	if(raopGroup->nextM4AFile != NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot queue next file, another file is queued already");
+		return false;
+	}
+
+	/* Audio format should match the session and packets should fit in the packet buffer */
+	if(m4aFileGetTimescale(m4aFile) != raopGroup->timescale || m4aFileGetLargestSampleSize(m4aFile) > raopGroup->maxPacketSize) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Cannot queue next file, its audio format differs (next file is played after current file)");
+		return false;
+	}
+	raopGroup->nextM4AFile = m4aFile;
+
+	return true;
+}
+
+bool raopGroupIsPlaying(RAOPGroup *raopGroup) {
+	return raopGroup->state != RAOP_GROUP_STATE_IDLE;
+}
+
+bool raopGroupIsM4AFileQueued(RAOPGroup *raopGroup) {
+	return raopGroup->nextM4AFile != NULL;
+}
+
+bool raopGroupPausePlaying(RAOPGroup *raopGroup) {
+
+	/* Let the event loop pause the devices (only async-signal-safe functions are used here) */
+	raopGroup->isPauseRequested = 1;
+	eventLoopWakeup(raopGroup->eventLoop);
+
+	return true;
+}
+
+bool raopGroupResumePlaying(RAOPGroup *raopGroup) {
+
+	/* Let the event loop resume the devices (idem) */
+	raopGroup->isPauseRequested = 0;
+	eventLoopWakeup(raopGroup->eventLoop);
+
+	return true;
+}
+
+bool raopGroupSeekPlaying(RAOPGroup *raopGroup, const struct timespec *position) {
+
+	/* Validate input (position is kept in milliseconds) */
+	if(position->tv_sec < 0 || position->tv_sec > GROUP_MAX_SEEK_SECONDS) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot seek to %ld seconds, position is out of range (maximum %d seconds)", (long)position->tv_sec, GROUP_MAX_SEEK_SECONDS);
+		return false;
+	}
+
+	/* Let the event loop seek (idem) */
+	raopGroup->seekPosition = (sig_atomic_t)(position->tv_sec * 1000 + position->tv_nsec / ONE_MILLISECOND_IN_NANO_SECONDS);
+	raopGroup->isSeekRequested = 1;
+	eventLoopWakeup(raopGroup->eventLoop);
+
+	return true;
+}
+
+bool raopGroupSetVolume(RAOPGroup *raopGroup, float volume) {
+
+	/* Let the event loop change the volume of the devices (idem) */
+	if(volume < 0.0f) {
+		volume = 0.0f;
+	}
+	if(volume > GROUP_VOLUME_MAX / 10.0f) {
+		volume = GROUP_VOLUME_MAX / 10.0f;
+	}
+	raopGroup->requestedVolume = (sig_atomic_t)(volume * 10.0f + 0.5f);
+	raopGroup->isVolumeRequested = 1;
+	eventLoopWakeup(raopGroup->eventLoop);
+
+	return true;
+}
+
+float raopGroupGetVolume(RAOPGroup *raopGroup) {
+	return (float)raopGroup->requestedVolume / 10.0f;
+}
+
+bool raopGroupSetVolumeInterval(RAOPGroup *raopGroup, uint32_t volumeInterval) {
+	raopGroup->volumeInterval = volumeInterval;
+
+	return true;
+}
+
+bool raopGroupIsPaused(RAOPGroup *raopGroup) {
+	return raopGroup->isPauseRequested != 0;
+}
+
+bool raopGroupStopPlaying(RAOPGroup *raopGroup) {
+
+	/* Let the event loop stop the devices (only async-signal-safe functions are used here) */
+	raopGroup->isStopRequested = 1;
+	eventLoopWakeup(raopGroup->eventLoop);
+
+	return true;
+}
+
+bool raopGroupEndSessions(RAOPGroup *raopGroup) {
+
+	/* Validate state */
+	if(raopGroup->state != RAOP_GROUP_STATE_IDLE) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot end sessions, group is still playing");
+		return false;
+	}
+
+	/* Tear down kept sessions (nothing to flush) and handle devices until all sessions are ended */
+	raopGroupStopDevices(raopGroup, false);
+	raopGroupCheckFinished(raopGroup);
+	if(raopGroup->state == RAOP_GROUP_STATE_IDLE) {
+		return true;
+	}
+	return eventLoopRun(raopGroup->eventLoop);
+}
+
+bool raopGroupWait(RAOPGroup *raopGroup) {
+
+	/* Nothing to wait for if not playing */
+	if(raopGroup->state == RAOP_GROUP_STATE_IDLE) {
+		return true;
+	}
+
+	/* The calling thread sends the audio, apply real-time mode to it (once) */
+	if(!raopGroup->isRealTimeApplied) {
+		raopGroupApplyRealTime(raopGroup);
+		raopGroup->isRealTimeApplied = true;
+	}
+
+	/* Handle all devices until playing has ended on all of them */
+	return eventLoopRun(raopGroup->eventLoop);
+}
+
+void raopGroupReportSkew(RAOPGroup *raopGroup) {
+	RAOPGroupDevice *device;
+	RTPStreamStatistics statistics;
+	EventLoopLatency latency;
+	uint32_t minAverageSendDelay;
+	uint32_t maxAverageSendDelay;
+	int32_t minClockDrift;
+	int32_t maxClockDrift;
+	uint32_t reportCount;
+	uint32_t i;
+
+	/* Report timing of every device (send delay only known for UDP transport, playing position error only for TCP) */
+	reportCount = 0;
+	minAverageSendDelay = UINT32_MAX;
+	maxAverageSendDelay = 0;
+	minClockDrift = INT32_MAX;
+	maxClockDrift = INT32_MIN;
+	for(i = 0; i < raopGroup->deviceCount; i++) {
+		device = &raopGroup->devices[i];
+		if(!raopClientGetStatistics(device->raopClient, &statistics)) {
+			continue;
+		}
+		if(raopGroup->transport == RTP_TRANSPORT_TCP) {
+			logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Device [%s]: clock drift %" PRIi32 " ppm (compensated, playing position error at most %" PRIu32 " us)", raopClientGetHostName(device->raopClient), statistics.clockDrift, statistics.maxPlayingError);
+		} else if(statistics.sentPackets > 0) {
+			logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Device [%s]: average send delay %" PRIu32 " us (maximum %" PRIu32 " us), clock drift %" PRIi32 " ppm", raopClientGetHostName(device->raopClient), statistics.averageSendDelay, statistics.maxSendDelay, statistics.clockDrift);
+		} else {
+			continue;
+		}
+		if(statistics.averageSendDelay < minAverageSendDelay) {
+			minAverageSendDelay = statistics.averageSendDelay;
+		}
+		if(statistics.averageSendDelay > maxAverageSendDelay) {
+			maxAverageSendDelay = statistics.averageSendDelay;
+		}
+		if(statistics.clockDrift < minClockDrift) {
+			minClockDrift = statistics.clockDrift;
+		}
+		if(statistics.clockDrift > maxClockDrift) {
+			maxClockDrift = statistics.clockDrift;
+		}
+		reportCount++;
+	}
+
+	/* Latency of handling timers shows how well the thread sending audio is scheduled */
+	eventLoopGetTimerLatency(raopGroup->eventLoop, &latency);
+	if(latency.count > 0) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Timer latency with %s scheduling (%" PRIu32 " timers): median %" PRIu32 " us, 90%% %" PRIu32 " us, 99%% %" PRIu32 " us, maximum %" PRIu32 " us", raopGroupGetSchedulingName(raopGroup), latency.count, latency.median, latency.percentile90, latency.percentile99, latency.max);
+	}
+
+	/* Spread is the difference between the best and worst device (with TCP every device is paced by its own clock). The send delay is measured locally, it shows how far apart the packets are sent, not how far apart the devices play. */
+	if(reportCount > 1 && raopGroup->transport == RTP_TRANSPORT_TCP) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Inter-device relative clock drift %" PRIi32 " ppm", maxClockDrift - minClockDrift);
+	} else if(reportCount > 1) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Inter-device average send delay spread %" PRIu32 " us, relative clock drift %" PRIi32 " ppm", maxAverageSendDelay - minAverageSendDelay, maxClockDrift - minClockDrift);
+	}
+}
+
+void raopGroupApplyRealTime(RAOPGroup *raopGroup) {
+	struct sched_param schedulingParameters;
+	cpu_set_t cpuSet;
+	uint32_t i;
+
+	/* Only when requested */
+	if(raopGroup->schedulingPolicy == SCHED_OTHER) {
+		return;
+	}
+
+	/* Lock the buffers used while sending (not all memory, allocations elsewhere should not run into RLIMIT_MEMLOCK) and touch the stack, so handlers never wait for a page */
+	if(raopGroupLockPacketBuffer(raopGroup)) {
+		raopGroup->isMemoryLocked = true;
+		for(i = 0; i < raopGroup->deviceCount; i++) {
+			raopClientSetMemoryLocked(raopGroup->devices[i].raopClient, true);
+		}
+		raopGroupPrefaultStack();
+	}
+
+	/* Pin to CPU (before raising the priority, so the thread does not migrate while running real-time) */
+	if(raopGroup->cpu != -1) {
+		CPU_ZERO(&cpuSet);
+		CPU_SET(raopGroup->cpu, &cpuSet);
+		if(sched_setaffinity(0, sizeof(cpu_set_t), &cpuSet) != 0) {
+			logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot pin to CPU %d (errno = %d). Continuing on any CPU.", raopGroup->cpu, errno);
+			raopGroup->cpu = -1;
+		}
+	}
+
+	/* Set real-time scheduling for the calling thread (needs CAP_SYS_NICE or a sufficient RLIMIT_RTPRIO) */
+	memset(&schedulingParameters, 0, sizeof(struct sched_param));
+	schedulingParameters.sched_priority = raopGroup->schedulingPriority;
+	if(sched_setscheduler(0, raopGroup->schedulingPolicy, &schedulingParameters) != 0) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot set real-time scheduling (errno = %d, needs CAP_SYS_NICE or RLIMIT_RTPRIO). Continuing with normal scheduling.", errno);
+		raopGroup->schedulingPolicy = SCHED_OTHER;
+		raopGroup->schedulingPriority = 0;
+	}
+
+	/* Write info to log */
+	if(raopGroup->cpu != -1) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Real-time mode: %s scheduling (priority %d), pinned to CPU %d, memory %s", raopGroupGetSchedulingName(raopGroup), raopGroup->schedulingPriority, raopGroup->cpu, raopGroup->isMemoryLocked ? "locked" : "not locked");
+	} else {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Real-time mode: %s scheduling (priority %d), on any CPU, memory %s", raopGroupGetSchedulingName(raopGroup), raopGroup->schedulingPriority, raopGroup->isMemoryLocked ? "locked" : "not locked");
+	}
+}
+
+const char *raopGroupGetSchedulingName(RAOPGroup *raopGroup) {
+	if(raopGroup->schedulingPolicy == SCHED_FIFO) {
+		return "FIFO";
+	} else if(raopGroup->schedulingPolicy == SCHED_RR) {
+		return "round-robin";
+	}
+	return "normal";
+}
+
+bool raopGroupLockPacketBuffer(RAOPGroup *raopGroup) {
+
+	/* A packet buffer which cannot be locked is used unlocked */
+	if(raopGroup->packetBuffer == NULL) {
+		return true;
+	}
+	if(mlock(raopGroup->packetBuffer, GROUP_PACKET_COUNT * raopGroup->maxPacketSize) != 0) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot lock packet buffer (%lu bytes) for real-time mode (errno = %d, check RLIMIT_MEMLOCK). Continuing without locking memory.", (unsigned long)(GROUP_PACKET_COUNT * raopGroup->maxPacketSize), errno);
+		return false;
+	}
+
+	return true;
+}
+
+void raopGroupPrefaultStack(void) {
+	uint8_t stack[GROUP_PREFAULT_STACK_SIZE];
+	volatile uint8_t *page;
+	size_t index;
+
+	/* Touch every page of the stack area (written through a volatile pointer, so the writes are not optimized away) */
+	page = stack;
+	for(index = 0; index < GROUP_PREFAULT_STACK_SIZE; index += 1024) {
+		page[index] = 0;
+	}
+}
+
+bool raopGroupClose(RAOPGroup **raopGroup) {
+	bool result;
+	uint32_t i;
+
+	/* Close all opened/allocated resource. Continu if a failure occurs, but remember failure for final result. */
+	result = true;
+	if(*raopGroup != NULL) {
+		if((*raopGroup)->eventLoop != NULL) {
+			if(!eventLoopClose(&(*raopGroup)->eventLoop)) {	/* Also removes all timers */
+				result = false;
+			}
+		}
+		for(i = 0; i < (*raopGroup)->deviceCount; i++) {
+			if(!raopClientCloseConnection(&(*raopGroup)->devices[i].raopClient)) {
+				result = false;
+			}
+		}
+		if((*raopGroup)->isMemoryLocked && (*raopGroup)->packetBuffer != NULL) {
+			munlock((*raopGroup)->packetBuffer, GROUP_PACKET_COUNT * (*raopGroup)->maxPacketSize);
+		}
+		if(!bufferFree(&(*raopGroup)->packetBuffer)) {
+			result = false;
+		}
+		if(!bufferFree(raopGroup)) {
+			result = false;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,309 @@
+/*
+ * File: raopgroup.h
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef	__RAOPGROUP_H__
+#define	__RAOPGROUP_H__
+
+#include <time.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include "m4afile.h"
+#include "raopclient.h"
+
+/* Maximum number of AirTunes devices within a group */
+#define	MAX_GROUP_DEVICES	8
+
+/* Type definition for RAOPGroup */
+typedef struct RAOPGroupStruct RAOPGroup;
+
+/*
+ * Function: raopGroupCreate
+ * Returns: RAOP Group structure
+ *
+ * Remarks:
+ * A RAOP Group plays a single M4AFile on multiple AirTunes devices. The file is parsed and read only once, every
+ * audio packet read is handed to all devices. All devices are handled by a single event loop (see raopGroupWait), so
+ * no thread is needed per device.
+ */
+RAOPGroup *raopGroupCreate();
+
+/*
+ * Function: raopGroupAddDevice
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	hostName - name of host
+ *	portName - name of port
+ *	password - password (optional)
+ *	latencyOffset - offset (in milliseconds) added to the latency of the device (see raopClientSetLatencyOffset)
+ * Returns: a boolean specifying if the device is added successfully
+ *
+ * Remarks:
+ * A RAOP Client is opened for the device (see raopClientOpenConnection).
+ */
+bool raopGroupAddDevice(RAOPGroup *raopGroup, const char *hostName, const char *portName, const char *password, int32_t latencyOffset);
+
+/*
+ * Function: raopGroupSetTransport
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	transport - transport (TCP/UDP) used for sending audio packets to all devices
+ * Returns: a boolean specifying if the transport is set successfully
+ */
+bool raopGroupSetTransport(RAOPGroup *raopGroup, RTPTransport transport);
+
+/*
+ * Function: raopGroupSetEncryption
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	isEncrypted - boolean specifying if the audio packets to all devices are encrypted (see raopClientSetEncryption)
+ * Returns: a boolean specifying if the encryption is set successfully
+ */
+bool raopGroupSetEncryption(RAOPGroup *raopGroup, bool isEncrypted);
+
+/*
+ * Function: raopGroupSetRecovery
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	isRecoveryEnabled - reconnect devices which lose their connection while playing (default: false)
+ * Returns: a boolean specifying if recovery is set successfully
+ *
+ * Remarks:
+ * A device whose RTSP or audio connection breaks (or stalls) is reconnected with increasing delays (see
+ * raopClientReconnect) and does the handshake again, authenticating right away. While other devices keep playing, the
+ * recovered device joins them at the packet due. If no device is left playing, playing holds at the position reached
+ * and restarts from there (using the packets kept) once a device is recovered. The gap of every recovery is logged and
+ * the number of recoveries is reported when playing ends.
+ */
+bool raopGroupSetRecovery(RAOPGroup *raopGroup, bool isRecoveryEnabled);
+
+/*
+ * Function: raopGroupSetRealTime
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	schedulingPolicy - real-time scheduling policy (SCHED_FIFO or SCHED_RR)
+ *	priority - real-time priority (within the range of the scheduling policy, see sched_get_priority_max)
+ *	cpu - number of the CPU to pin the thread to (-1 for any CPU)
+ * Returns: a boolean specifying if real-time mode is set successfully
+ *
+ * Remarks:
+ * Real-time mode is applied to the thread calling raopGroupWait (the thread sending the audio), the first time it
+ * waits. The buffers used while sending (the packet buffer and the buffers of the audio streams) are locked in memory
+ * and the stack is pre-faulted, so handlers do not wait for pages. A part which fails for lack of privileges (CAP_SYS_NICE, RLIMIT_RTPRIO or RLIMIT_MEMLOCK) is
+ * skipped with a warning and playing continues. Without real-time mode normal scheduling is used. In both modes the
+ * latency of handling timers (median, 90th and 99th percentile) is logged when a file is played.
+ */
+bool raopGroupSetRealTime(RAOPGroup *raopGroup, int schedulingPolicy, int priority, int cpu);
+
+/*
+ * Function: raopGroupPlayM4AFile
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	m4aFile - M4AFile to play
+ *	startTime - time within file from which playing starts (offset from beginning of file)
+ * Returns: a boolean specifying if the group could start playing successfully
+ *
+ * Remarks:
+ * Only starts the handshake with all devices, the handshakes are continued (and the audio is sent) by raopGroupWait.
+ * Devices which cannot be prepared for playing are skipped, the group only fails if no device is left.
+ * A device which is too slow to keep up with the other devices will skip packets instead of stalling the other devices.
+ * All devices share a single reference time and the same RTP timestamps, so (with the UDP transport) the sync
+ * packets of all devices refer to the same frame at the same time and the devices play in sync. The spread of send
+ * delay and clock drift between the devices is reported when playing ends.
+ * Sessions are kept when a file is played completely. Playing a next file on the same group only flushes the devices
+ * (unless the audio format differs), which avoids the full handshake and the new audio connection per file. The kept
+ * sessions are ended using raopGroupEndSessions. After raopGroupStopPlaying no (next) file can be played anymore.
+ */
+bool raopGroupPlayM4AFile(RAOPGroup *raopGroup, M4AFile *m4aFile, struct timespec *startTime);
+
+/*
+ * Function: raopGroupQueueM4AFile
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	m4aFile - M4AFile (already parsed) to play directly after the file being played
+ * Returns: a boolean specifying if the file is queued successfully
+ *
+ * Remarks:
+ * The first packet of the queued file is read directly after the last packet of the file being played and is sent
+ * within the same RTP stream, so there is no handshake and no silence in between. Only possible while the group
+ * is reading packets, for a file with the same audio format (otherwise the file should be played using
+ * raopGroupPlayM4AFile after the current file is played). At most one file can be queued, raopGroupWait returns
+ * when the group continued with the queued file (so the next file can be opened and queued).
+ * The caller should keep the M4AFile open until the group continued with another file or stopped playing.
+ */
+bool raopGroupQueueM4AFile(RAOPGroup *raopGroup, M4AFile *m4aFile);
+
+/*
+ * Function: raopGroupIsPlaying
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if the group is playing (including handshake and devices playing buffered audio)
+ */
+bool raopGroupIsPlaying(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupIsM4AFileQueued
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if a file is queued which the group did not continue with (yet)
+ *
+ * Remarks:
+ * A queued file is not played anymore if the group stopped playing (it stays queued until raopGroupPlayM4AFile).
+ */
+bool raopGroupIsM4AFileQueued(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupGetProgress
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	progress - time played so far (within the file playing)
+ * Returns: a boolean specifying if the progress could be retrieved successfully
+ */
+bool raopGroupGetProgress(RAOPGroup *raopGroup, struct timespec *progress);
+
+/*
+ * Function: raopGroupPausePlaying
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if the group could pause playing successfully
+ *
+ * Remarks:
+ * Only requests the event loop to pause (like raopGroupStopPlaying), so it can be called from another thread or from a
+ * signal handler. The audio buffered by the devices is flushed, but the sessions and audio connections are kept. The
+ * packets read ahead are kept as well, so resuming starts at the packet being played when pausing without reading
+ * the file again. raopGroupWait keeps running while paused.
+ */
+bool raopGroupPausePlaying(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupResumePlaying
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if the group could resume playing successfully
+ *
+ * Remarks:
+ * Only requests the event loop to resume (idem). Every device only needs to answer a RECORD command (no new
+ * handshake), so audio is heard again after the latency of the devices.
+ */
+bool raopGroupResumePlaying(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupSeekPlaying
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	position - time within the file being read from which playing continues (offset from beginning of file, millisecond precision)
+ * Returns: a boolean specifying if the group could seek successfully
+ *
+ * Remarks:
+ * Only requests the event loop to seek (idem). The devices are flushed within their sessions and the file is positioned
+ * using its seek index (see m4aFileSetSampleOffset), so no new handshake or parsing is needed. Progress is reported
+ * from the new position onwards. When paused, playing continues at the new position on resume.
+ */
+bool raopGroupSeekPlaying(RAOPGroup *raopGroup, const struct timespec *position);
+
+/*
+ * Function: raopGroupSetVolume
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	volume - volume as range from 0.0 (muted) to maximum 30.0 (see raopClientSetVolume)
+ * Returns: a boolean specifying if the group could set the volume successfully
+ *
+ * Remarks:
+ * Only requests the event loop to change the volume (idem), the caller never waits for the devices. Volume changes are
+ * sent at most once per interval (see raopGroupSetVolumeInterval), requests arriving meanwhile are coalesced so only
+ * the latest volume is sent. If no file is playing, the volume is used when playing starts.
+ */
+bool raopGroupSetVolume(RAOPGroup *raopGroup, float volume);
+
+/*
+ * Function: raopGroupGetVolume
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: the volume requested last (or the default volume), as range from 0.0 (muted) to maximum 30.0
+ */
+float raopGroupGetVolume(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupSetVolumeInterval
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ *	volumeInterval - minimum time (in milliseconds) between volume changes sent to the devices (default: 200)
+ * Returns: a boolean specifying if the interval could be set successfully
+ */
+bool raopGroupSetVolumeInterval(RAOPGroup *raopGroup, uint32_t volumeInterval);
+
+/*
+ * Function: raopGroupIsPaused
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if pausing is requested (and not resumed yet)
+ */
+bool raopGroupIsPaused(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupStopPlaying
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if the group could stop playing successfully
+ *
+ * Remarks:
+ * Only requests the event loop to stop playing (the audio buffered by the devices is flushed), so it can be called from
+ * another thread or from a signal handler. The sessions are torn down by raopGroupWait, which returns afterwards.
+ */
+bool raopGroupStopPlaying(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupWait
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if the wait ended successfully
+ *
+ * Remarks:
+ * Runs the event loop handling the RTSP sessions and audio of all devices until all devices have played the file,
+ * the group continued with a queued file (see raopGroupQueueM4AFile) or the group is stopped (see raopGroupStopPlaying).
+ * Use raopGroupIsPlaying to find out if playing ended. Audio packets are sent non-blocking: for the UDP transport a timer
+ * expires when a packet is due, for the TCP transport sending continues when the audio connection becomes writable.
+ */
+bool raopGroupWait(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupEndSessions
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if the sessions are ended successfully
+ *
+ * Remarks:
+ * Tears down the sessions kept after playing a file (see raopGroupPlayM4AFile) and waits until all devices answered.
+ * Should be called after the last file is played (ie when raopGroupWait returned) and before raopGroupClose.
+ */
+bool raopGroupEndSessions(RAOPGroup *raopGroup);
+
+/*
+ * Function: raopGroupClose
+ * Parameters:
+ *	raopGroup - already created RAOP Group (as returned by raopGroupCreate)
+ * Returns: a boolean specifying if the group is closed successfully
+ *
+ * Remarks:
+ * This function will make the RAOP Group pointer NULL, so a closed group cannot be reused.
+ */
+bool raopGroupClose(RAOPGroup **raopGroup);
+
+#endif	/* __RAOPGROUP_H__ */
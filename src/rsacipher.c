@@ -0,0 +1,296 @@
+/*
+ * File: rsacipher.c
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include "rsacipher.h"
+#include "log.h"
+#include "utils.h"
+
+/* Values for SHA-1 (used for OAEP padding) */
+#define	SHA1_DIGEST_SIZE		20
+#define	SHA1_BLOCK_SIZE			64
+#define	SHA1_MAX_MESSAGE_SIZE		(RSA_MAX_MODULUS_SIZE + 4)
+
+/* Values for the big numbers (little endian array of 32 bit limbs) */
+#define	RSA_MAX_LIMB_COUNT		(RSA_MAX_MODULUS_SIZE / 4)
+#define	RSA_PUBLIC_EXPONENT_BITS	16	/* Public exponent 65537 is 2^16 + 1 */
+
+/* Logging component name */
+static const char *LOG_COMPONENT_NAME = "rsacipher.c";
+
+/* Declare internal functions */
+static void rsaCipherPadMessage(size_t modulusSize, const uint8_t *message, size_t messageSize, const uint8_t *seed, uint8_t *paddedMessage);
+static void rsaCipherMaskBuffer(const uint8_t *seed, size_t seedSize, uint8_t *buffer, size_t bufferSize);
+static void rsaCipherMultiplyModulo(const uint32_t *value1, const uint32_t *value2, const uint32_t *modulus, size_t limbCount, uint32_t *result);
+static void rsaCipherReadNumber(const uint8_t *buffer, size_t bufferSize, uint32_t *value, size_t limbCount);
+static void rsaCipherWriteNumber(const uint32_t *value, size_t limbCount, uint8_t *buffer, size_t bufferSize);
+static void rsaCipherCalculateSHA1(const uint8_t *message, size_t messageSize, uint8_t *digest);
+static void rsaCipherProcessSHA1Block(uint32_t *hash, const uint8_t *block);
+static uint32_t rsaCipherRotateLeft(uint32_t value, int count);
+
+bool rsaCipherEncrypt(const uint8_t *modulus, size_t modulusSize, const uint8_t *message, size_t messageSize, uint8_t *encrypted) {
+	uint8_t seed[SHA1_DIGEST_SIZE];
+	uint8_t paddedMessage[RSA_MAX_MODULUS_SIZE];
+	uint32_t modulusValue[RSA_MAX_LIMB_COUNT];
+	uint32_t messageValue[RSA_MAX_LIMB_COUNT];
+	uint32_t resultValue[RSA_MAX_LIMB_COUNT];
+	size_t limbCount;
+	int index;
+
+	/* Validate sizes */
+	if(modulusSize > RSA_MAX_MODULUS_SIZE || modulusSize < RSA_OAEP_PADDING_SIZE || modulus[0] == 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Unsupported RSA modulus (%lu bytes)", (unsigned long)modulusSize);
+		return false;
+	}
+	if(messageSize > modulusSize - RSA_OAEP_PADDING_SIZE) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Message of %lu bytes is too large for RSA modulus of %lu bytes", (unsigned long)messageSize, (unsigned long)modulusSize);
+		return false;
+	}
+
+	/* Pad message using a random seed (the padded message starts with 0, so it is smaller than the modulus) */
+	if(!getRandomBytes(seed, SHA1_DIGEST_SIZE)) {
+		return false;
+	}
+	rsaCipherPadMessage(modulusSize, message, messageSize, seed, paddedMessage);
+
+	/* Calculate padded message ^ 65537 mod modulus (square 16 times, then multiply once more) */
+	limbCount = (modulusSize + 3) / 4;
+	rsaCipherReadNumber(modulus, modulusSize, modulusValue, limbCount);
+	rsaCipherReadNumber(paddedMessage, modulusSize, messageValue, limbCount);
+	memcpy(resultValue, messageValue, limbCount * sizeof(uint32_t));
+	for(index = 0; index < RSA_PUBLIC_EXPONENT_BITS; index++) {
+		rsaCipherMultiplyModulo(resultValue, resultValue, modulusValue, limbCount, resultValue);
+	}
+	rsaCipherMultiplyModulo(resultValue, messageValue, modulusValue, limbCount, resultValue);
+	rsaCipherWriteNumber(resultValue, limbCount, encrypted, modulusSize);
+
+	/* Clear the (padded) message */
+	memset(paddedMessage, 0, sizeof(paddedMessage));
+	memset(messageValue, 0, sizeof(messageValue));
+
+	return true;
+}
+
+void rsaCipherPadMessage(size_t modulusSize, const uint8_t *message, size_t messageSize, const uint8_t *seed, uint8_t *paddedMessage) {
+	uint8_t *maskedSeed;
+	uint8_t *dataBlock;
+	size_t dataBlockSize;
+
+	/* Padded message is 0, masked seed and masked data block (hash of empty label, zeros, 1 and message) */
+	maskedSeed = paddedMessage + 1;
+	dataBlock = maskedSeed + SHA1_DIGEST_SIZE;
+	dataBlockSize = modulusSize - SHA1_DIGEST_SIZE - 1;
+	paddedMessage[0] = 0x00;
+	memcpy(maskedSeed, seed, SHA1_DIGEST_SIZE);
+	rsaCipherCalculateSHA1(NULL, 0, dataBlock);
+	memset(dataBlock + SHA1_DIGEST_SIZE, 0, dataBlockSize - SHA1_DIGEST_SIZE - messageSize - 1);
+	dataBlock[dataBlockSize - messageSize - 1] = 0x01;
+	memcpy(dataBlock + dataBlockSize - messageSize, message, messageSize);
+
+	/* Mask data block using the seed and mask the seed using the masked data block */
+	rsaCipherMaskBuffer(seed, SHA1_DIGEST_SIZE, dataBlock, dataBlockSize);
+	rsaCipherMaskBuffer(dataBlock, dataBlockSize, maskedSeed, SHA1_DIGEST_SIZE);
+}
+
+void rsaCipherMaskBuffer(const uint8_t *seed, size_t seedSize, uint8_t *buffer, size_t bufferSize) {
+	uint8_t counterSeed[SHA1_MAX_MESSAGE_SIZE];
+	uint8_t digest[SHA1_DIGEST_SIZE];
+	uint32_t counter;
+	size_t index;
+
+	/* Mask generation function MGF1: xor buffer with SHA-1 digests of seed followed by a (big endian) counter */
+	memcpy(counterSeed, seed, seedSize);
+	for(counter = 0, index = 0; index < bufferSize; counter++) {
+		counterSeed[seedSize] = (uint8_t)(counter >> 24);
+		counterSeed[seedSize + 1] = (uint8_t)(counter >> 16);
+		counterSeed[seedSize + 2] = (uint8_t)(counter >> 8);
+		counterSeed[seedSize + 3] = (uint8_t)counter;
+		rsaCipherCalculateSHA1(counterSeed, seedSize + 4, digest);
+		for(; index < bufferSize && index < (counter + 1) * SHA1_DIGEST_SIZE; index++) {
+			buffer[index] ^= digest[index % SHA1_DIGEST_SIZE];
+		}
+	}
+}
+
+void rsaCipherMultiplyModulo(const uint32_t *value1, const uint32_t *value2, const uint32_t *modulus, size_t limbCount, uint32_t *result) {
+	uint32_t product[2 * RSA_MAX_LIMB_COUNT];
+	uint32_t remainder[RSA_MAX_LIMB_COUNT + 1];
+	uint64_t sum;
+	uint64_t difference;
+	size_t index1;
+	size_t index2;
+	size_t bitIndex;
+	bool isLess;
+
+	/* Multiply (schoolbook) */
+	memset(product, 0, 2 * limbCount * sizeof(uint32_t));
+	for(index1 = 0; index1 < limbCount; index1++) {
+		sum = 0;
+		for(index2 = 0; index2 < limbCount; index2++) {
+			sum += (uint64_t)value1[index1] * value2[index2] + product[index1 + index2];
+			product[index1 + index2] = (uint32_t)sum;
+			sum >>= 32;
+		}
+		product[index1 + limbCount] = (uint32_t)sum;
+	}
+
+	/* Reduce bit by bit (shift in next bit of product, subtract modulus when remainder is not less than it) */
+	memset(remainder, 0, (limbCount + 1) * sizeof(uint32_t));
+	bitIndex = 2 * limbCount * 32;
+	while(bitIndex > 0) {
+		bitIndex--;
+		for(index1 = limbCount; index1 > 0; index1--) {
+			remainder[index1] = (remainder[index1] << 1) | (remainder[index1 - 1] >> 31);
+		}
+		remainder[0] = (remainder[0] << 1) | ((product[bitIndex / 32] >> (bitIndex % 32)) & 1);
+		isLess = remainder[limbCount] == 0;
+		for(index1 = limbCount; isLess && index1 > 0; index1--) {
+			if(remainder[index1 - 1] != modulus[index1 - 1]) {
+				isLess = remainder[index1 - 1] < modulus[index1 - 1];
+				break;
+			}
+		}
+		if(index1 == 0) {
+			isLess = false;	/* Equal to modulus */
+		}
+		if(!isLess) {
+			difference = 0;
+			for(index1 = 0; index1 < limbCount; index1++) {
+				difference = (uint64_t)remainder[index1] - modulus[index1] - difference;
+				remainder[index1] = (uint32_t)difference;
+				difference = (difference >> 32) & 1;	/* Borrow */
+			}
+			remainder[limbCount] -= (uint32_t)difference;
+		}
+	}
+	memcpy(result, remainder, limbCount * sizeof(uint32_t));
+}
+
+void rsaCipherReadNumber(const uint8_t *buffer, size_t bufferSize, uint32_t *value, size_t limbCount) {
+	size_t index;
+
+	/* Read big endian bytes into little endian limbs */
+	memset(value, 0, limbCount * sizeof(uint32_t));
+	for(index = 0; index < bufferSize; index++) {
+		value[index / 4] |= (uint32_t)buffer[bufferSize - 1 - index] << (8 * (index % 4));
+	}
+}
+
+void rsaCipherWriteNumber(const uint32_t *value, size_t limbCount, uint8_t *buffer, size_t bufferSize) {
+	size_t index;
+
+	/* Write little endian limbs as big endian bytes (bytes beyond the limbs are 0) */
+	for(index = 0; index < bufferSize; index++) {
+		buffer[bufferSize - 1 - index] = index / 4 < limbCount ? (uint8_t)(value[index / 4] >> (8 * (index % 4))) : 0;
+	}
+}
+
+void rsaCipherCalculateSHA1(const uint8_t *message, size_t messageSize, uint8_t *digest) {
+	uint32_t hash[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+	uint8_t block[SHA1_BLOCK_SIZE];
+	uint64_t bitCount;
+	size_t remainingSize;
+	int index;
+
+	/* Process whole blocks */
+	remainingSize = messageSize;
+	while(remainingSize >= SHA1_BLOCK_SIZE) {
+		rsaCipherProcessSHA1Block(hash, message);
+		message += SHA1_BLOCK_SIZE;
+		remainingSize -= SHA1_BLOCK_SIZE;
+	}
+
+	/* Pad last block(s) with 0x80, zeros and the message size in bits (big endian) */
+	memset(block, 0, SHA1_BLOCK_SIZE);
+	if(remainingSize > 0) {
+		memcpy(block, message, remainingSize);
+	}
+	block[remainingSize] = 0x80;
+	if(remainingSize >= SHA1_BLOCK_SIZE - 8) {
+		rsaCipherProcessSHA1Block(hash, block);
+		memset(block, 0, SHA1_BLOCK_SIZE);
+	}
+	bitCount = (uint64_t)messageSize * 8;
+	for(index = 0; index < 8; index++) {
+		block[SHA1_BLOCK_SIZE - 1 - index] = (uint8_t)(bitCount >> (8 * index));
+	}
+	rsaCipherProcessSHA1Block(hash, block);
+
+	/* Write digest (big endian) */
+	for(index = 0; index < SHA1_DIGEST_SIZE; index++) {
+		digest[index] = (uint8_t)(hash[index / 4] >> (24 - 8 * (index % 4)));
+	}
+}
+
+void rsaCipherProcessSHA1Block(uint32_t *hash, const uint8_t *block) {
+	uint32_t words[80];
+	uint32_t a, b, c, d, e;
+	uint32_t function;
+	uint32_t constant;
+	uint32_t temp;
+	int index;
+
+	/* Read block and extend it into 80 words */
+	for(index = 0; index < 16; index++) {
+		words[index] = ((uint32_t)block[4 * index] << 24) | ((uint32_t)block[4 * index + 1] << 16) | ((uint32_t)block[4 * index + 2] << 8) | (uint32_t)block[4 * index + 3];
+	}
+	for(index = 16; index < 80; index++) {
+		words[index] = rsaCipherRotateLeft(words[index - 3] ^ words[index - 8] ^ words[index - 14] ^ words[index - 16], 1);
+	}
+
+	/* Perform the 80 rounds */
+	a = hash[0];
+	b = hash[1];
+	c = hash[2];
+	d = hash[3];
+	e = hash[4];
+	for(index = 0; index < 80; index++) {
+		if(index < 20) {
+			function = (b & c) | (~b & d);
+			constant = 0x5a827999;
+		} else if(index < 40) {
+			function = b ^ c ^ d;
+			constant = 0x6ed9eba1;
+		} else if(index < 60) {
+			function = (b & c) | (b & d) | (c & d);
+			constant = 0x8f1bbcdc;
+		} else {
+			function = b ^ c ^ d;
+			constant = 0xca62c1d6;
+		}
+		temp = rsaCipherRotateLeft(a, 5) + function + e + constant + words[index];
+		e = d;
+		d = c;
+		c = rsaCipherRotateLeft(b, 30);
+		b = a;
+		a = temp;
+	}
+	hash[0] += a;
+	hash[1] += b;
+	hash[2] += c;
+	hash[3] += d;
+	hash[4] += e;
+}
+
+uint32_t rsaCipherRotateLeft(uint32_t value, int count) {
+	return (value << count) | (value >> (32 - count));
+}
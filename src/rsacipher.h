@@ -0,0 +1,50 @@
+/*
+ * File: rsacipher.h
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef	__RSACIPHER_H__
+#define	__RSACIPHER_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* Largest modulus supported (4096 bit) and room needed for the OAEP padding (SHA-1) */
+#define	RSA_MAX_MODULUS_SIZE		512
+#define	RSA_OAEP_PADDING_SIZE		42
+
+/*
+ * Function: rsaCipherEncrypt
+ * Parameters:
+ *	modulus - modulus of the public key (big endian, most significant byte not 0)
+ *	modulusSize - size (in bytes) of the modulus (at most RSA_MAX_MODULUS_SIZE)
+ *	message - message to encrypt
+ *	messageSize - size (in bytes) of the message (at most modulusSize - RSA_OAEP_PADDING_SIZE)
+ *	encrypted - buffer to write the encrypted message to (modulusSize bytes)
+ * Returns: a boolean specifying if the message is encrypted successfully
+ *
+ * Remarks:
+ * The message is padded using OAEP with SHA-1 (PKCS #1 v2.1, RSAES-OAEP) and encrypted with public exponent 65537.
+ * Meant for encrypting a (short) session key once, so a straightforward (slow) implementation is used.
+ */
+bool rsaCipherEncrypt(const uint8_t *modulus, size_t modulusSize, const uint8_t *message, size_t messageSize, uint8_t *encrypted);
+
+#endif	/* __RSACIPHER_H__ */
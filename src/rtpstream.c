@@ -0,0 +1,992 @@
+/*
+ * File: rtpstream.c
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "rtpstream.h"
+#include "network.h"
+#include "log.h"
+#include "buffer.h"
+#include "utils.h"
+#include "aescipher.h"
+
+/* Sizes of the packet headers */
+#define	TCP_HEADER_SIZE			16
+#define	UDP_HEADER_SIZE			12
+#define	MAX_HEADER_SIZE			TCP_HEADER_SIZE
+#define	RESEND_HEADER_SIZE		4
+#define	SYNC_PACKET_SIZE		20
+#define	TIMING_PACKET_SIZE		32
+#define	RESEND_REQUEST_PACKET_SIZE	8
+#define	MAX_CONTROL_PACKET_SIZE		64
+
+/* Values within the packet headers */
+#define	TCP_HEADER_MAGIC		0x24
+#define	RTP_HEADER_VERSION		0x80
+#define	RTP_HEADER_EXTENSION		0x10
+#define	RTP_HEADER_MARKER		0x80
+#define	RTP_PAYLOAD_TYPE_AUDIO		0x60
+#define	RTP_PAYLOAD_TYPE_TIMING_REQUEST	0x52
+#define	RTP_PAYLOAD_TYPE_TIMING_REPLY	0x53
+#define	RTP_PAYLOAD_TYPE_SYNC		0x54
+#define	RTP_PAYLOAD_TYPE_RESEND_REQUEST	0x55
+#define	RTP_PAYLOAD_TYPE_RESEND_REPLY	0x56
+#define	RTP_PAYLOAD_TYPE_MASK		0x7f
+#define	RTP_CONTROL_SEQUENCE_NUMBER	0x0007
+
+/* Values for timing */
+#define	NTP_EPOCH_OFFSET		0x83aa7e80UL	/* Seconds between 1900 (NTP epoch) and 1970 */
+#define	ONE_SECOND_IN_NANO_SECONDS	1000000000LL
+#define	MIN_CLOCK_DRIFT_SECONDS		10	/* Minimum time between timing requests used for calculating clock drift */
+#define	MAX_NUMBER_STRING_SIZE		11
+
+/* Values for the audio connection: the send buffer (TCP only) is sized to hold RTP_SEND_BUFFER_MILLISECONDS of audio at the measured drain rate */
+#define	RTP_AUDIO_TYPE_OF_SERVICE	0xb8	/* DSCP EF (expedited forwarding) */
+#define	RTP_SEND_BUFFER_MILLISECONDS	250
+#define	RTP_MIN_SEND_BUFFER_SIZE	8192
+#define	RTP_MAX_SEND_BUFFER_SIZE	1048576
+#define	RTP_DRAIN_MEASURE_MILLISECONDS	1000
+#define	RTP_NOMINAL_BYTES_PER_FRAME	4	/* Uncompressed 16 bit stereo, used until drain rate is measured */
+
+/* Values for measuring the playing rate of the AirTunes device (TCP only): drained bytes are converted into frames using the ends of recently sent packets */
+#define	RTP_PACKET_END_COUNT		128	/* Number of packet ends kept (a power of 2, more than fit in the largest send buffer) */
+#define	RTP_DRIFT_SETTLE_SECONDS	5	/* Audio drained after (re)starting before measuring (the AirTunes device fills its buffer first) */
+#define	RTP_MAX_PLAYING_DRIFT		1000	/* In ppm, a larger drift is a measuring error (the AirTunes device is not pacing the stream) */
+
+/* Number of packets kept for answering resend requests (a power of 2, ~12 seconds of audio with 4096 frames per packet at 44.1kHz) */
+#define	RESEND_PACKET_COUNT		128
+
+/* Type definition for the RTP stream */
+struct RTPStreamStruct {
+
+	/* Connections for audio, control and timing */
+	RTPTransport transport;
+	NetworkConnection *audioConnection;
+	NetworkConnection *controlConnection;
+	NetworkConnection *timingConnection;
+
+	/* RTP information */
+	uint16_t sequenceNumber;
+	uint32_t timestamp;
+	uint32_t ssrc;
+	uint32_t timescale;
+	uint32_t latency;			/* In frames */
+	uint32_t nextSyncTimestamp;
+	bool isFirstPacket;
+	struct timespec referenceTime;		/* Absolute time at which referenceTimestamp is due */
+	uint32_t referenceTimestamp;
+
+	/* Header of packet being sent (payload is sent from the buffer of the caller) */
+	uint8_t header[MAX_HEADER_SIZE];
+	size_t headerSize;
+	bool isSendingPacket;			/* Packet is partially sent */
+	size_t sentSize;			/* Number of bytes of header and payload sent so far */
+
+	/* Encryption of payload (optional), the payload is encrypted into a buffer of maxPayloadSize bytes */
+	AESCipher *aesCipher;
+	uint8_t *encryptedPayload;
+	uint32_t maxPayloadSize;
+
+	/* Drain rate of audio connection (TCP only) */
+	uint64_t totalSentSize;			/* Number of bytes sent since connecting */
+	uint64_t drainStartSize;		/* Number of bytes received by the AirTunes device at start of measurement */
+	struct timespec drainStartTime;
+	uint32_t drainRate;			/* In bytes per second (0 if not measured yet) */
+	int sendBufferSize;
+
+	/* Playing rate of the AirTunes device (TCP only), slot is selected by sequence number */
+	uint64_t packetEndSizes[RTP_PACKET_END_COUNT];		/* Value of totalSentSize at the end of the packet */
+	uint32_t packetEndTimestamps[RTP_PACKET_END_COUNT];	/* Timestamp of the frame following the packet */
+	uint32_t packetEndCount;		/* Number of packets sent since (re)starting (at most RTP_PACKET_END_COUNT) */
+	uint32_t segmentTimestamp;		/* Timestamp of the first packet sent since (re)starting */
+	bool hasDrainSample;
+	struct timespec drainSampleTime;
+	uint32_t drainSampleTimestamp;		/* Timestamp of the frame being drained at drainSampleTime */
+	uint64_t drainedFrames;			/* Frames drained during the measured intervals */
+	uint64_t drainedMicroSeconds;		/* Duration (reference clock) of the measured intervals */
+
+	/* Recently sent packets (UDP only), slot is selected by sequence number. Each slot has room for resend header, RTP header and payload. */
+	uint8_t *resendBuffer;
+	size_t resendSlotSize;
+	uint16_t resendSequenceNumbers[RESEND_PACKET_COUNT];
+	size_t resendPacketSizes[RESEND_PACKET_COUNT];	/* 0 means slot is empty */
+
+	/* Buffers used while streaming are locked in memory (see rtpStreamLockMemory) */
+	bool isMemoryLocked;
+
+	/* Statistics */
+	RTPStreamStatistics statistics;
+	uint64_t totalSendDelay;		/* In microseconds */
+	uint64_t totalEncryptionTime;		/* In nanoseconds */
+	uint64_t totalEncryptedSize;		/* In bytes */
+	bool hasFirstClockOffset;
+	int64_t firstClockOffset;		/* Difference (in nanoseconds) between reference clock and clock of AirTunes device at first timing request */
+	struct timespec firstClockOffsetTime;
+};
+
+/* Logging component name */
+static const char *LOG_COMPONENT_NAME = "rtpstream.c";
+
+/* Declare internal functions */
+static bool rtpStreamSendSync(RTPStream *rtpStream);
+static bool rtpStreamPrepareHeader(RTPStream *rtpStream, uint32_t payloadSize);
+static void rtpStreamEncryptPayload(RTPStream *rtpStream, uint8_t *payload, uint32_t payloadSize);
+static bool rtpStreamLockBuffer(RTPStream *rtpStream, uint8_t *buffer, size_t bufferSize, const char *purpose);
+static void rtpStreamUnlockBuffer(RTPStream *rtpStream, uint8_t *buffer, size_t bufferSize);
+static bool rtpStreamKeepPacket(RTPStream *rtpStream, uint8_t *header, size_t headerSize, uint8_t *payload, size_t payloadSize);
+static bool rtpStreamResendPackets(RTPStream *rtpStream, uint16_t sequenceNumber, uint16_t count);
+static void rtpStreamUpdateSendDelay(RTPStream *rtpStream);
+static bool rtpStreamSetSendBufferSize(RTPStream *rtpStream, uint32_t drainRate);
+static void rtpStreamUpdateDrainRate(RTPStream *rtpStream);
+static void rtpStreamUpdatePlayingDrift(RTPStream *rtpStream, const struct timespec *currentTime, uint64_t drainedSize);
+static void rtpStreamUpdateClockDrift(RTPStream *rtpStream, uint8_t *deviceTime, const struct timespec *receiveTime);
+static uint16_t rtpStreamReadUnsignedShort(uint8_t *buffer);
+static uint32_t rtpStreamReadUnsignedLong(uint8_t *buffer);
+static uint32_t rtpStreamGetTimestampAt(RTPStream *rtpStream, const struct timespec *time);
+static void rtpStreamWriteNTPTime(uint8_t *buffer, const struct timespec *time);
+static void rtpStreamWriteUnsignedShort(uint8_t *buffer, uint16_t value);
+static void rtpStreamWriteUnsignedLong(uint8_t *buffer, uint32_t value);
+
+RTPStream *rtpStreamCreate(RTPTransport transport, uint32_t timescale, const struct timespec *latency, uint32_t maxPayloadSize) {
+	RTPStream *rtpStream;
+	uint32_t randomValue;
+
+	/* Create RTP stream structure */
+	if(!bufferAllocate(&rtpStream, sizeof(RTPStream), "RTP stream")) {
+		return NULL;
+	}
+
+	/* Initialize structure */
+	rtpStream->transport = transport;
+	rtpStream->audioConnection = NULL;
+	rtpStream->controlConnection = NULL;
+	rtpStream->timingConnection = NULL;
+	rtpStream->timescale = timescale;
+	rtpStream->latency = (uint32_t)(latency->tv_sec * timescale + (uint64_t)latency->tv_nsec * timescale / ONE_SECOND_IN_NANO_SECONDS);
+	rtpStream->isFirstPacket = true;
+	timespecInitialize(&rtpStream->referenceTime);
+	rtpStream->headerSize = 0;
+	rtpStream->isSendingPacket = false;
+	rtpStream->sentSize = 0;
+	rtpStream->aesCipher = NULL;
+	rtpStream->encryptedPayload = NULL;
+	rtpStream->maxPayloadSize = maxPayloadSize;
+	rtpStream->totalSentSize = 0;
+	rtpStream->drainStartSize = 0;
+	timespecInitialize(&rtpStream->drainStartTime);
+	rtpStream->drainRate = 0;
+	rtpStream->sendBufferSize = 0;
+	rtpStream->packetEndCount = 0;
+	rtpStream->segmentTimestamp = 0;
+	rtpStream->hasDrainSample = false;
+	timespecInitialize(&rtpStream->drainSampleTime);
+	rtpStream->drainSampleTimestamp = 0;
+	rtpStream->drainedFrames = 0;
+	rtpStream->drainedMicroSeconds = 0;
+	rtpStream->resendBuffer = NULL;
+	rtpStream->resendSlotSize = RESEND_HEADER_SIZE + UDP_HEADER_SIZE + maxPayloadSize;
+	memset(rtpStream->resendPacketSizes, 0, sizeof(rtpStream->resendPacketSizes));
+	rtpStream->isMemoryLocked = false;
+	memset(&rtpStream->statistics, 0, sizeof(RTPStreamStatistics));
+	rtpStream->totalSendDelay = 0;
+	rtpStream->totalEncryptionTime = 0;
+	rtpStream->totalEncryptedSize = 0;
+	rtpStream->hasFirstClockOffset = false;
+
+	/* Choose (pseudo)random initial values for sequence number, timestamp and SSRC */
+	if(!getRandomNumber(&randomValue)) {
+		rtpStreamClose(&rtpStream);
+		return NULL;
+	}
+	rtpStream->sequenceNumber = (uint16_t)randomValue;
+	if(!getRandomNumber(&rtpStream->timestamp) || !getRandomNumber(&rtpStream->ssrc)) {
+		rtpStreamClose(&rtpStream);
+		return NULL;
+	}
+	rtpStream->referenceTimestamp = rtpStream->timestamp;
+	rtpStream->nextSyncTimestamp = rtpStream->timestamp;
+
+	/* Create buffer for keeping recently sent packets (all slots at once, so no allocations are needed while streaming) */
+	if(transport == RTP_TRANSPORT_UDP) {
+		if(!bufferAllocate(&rtpStream->resendBuffer, RESEND_PACKET_COUNT * rtpStream->resendSlotSize, "resend buffer")) {
+			rtpStreamClose(&rtpStream);
+			return NULL;
+		}
+	}
+
+	return rtpStream;
+}
+
+RTPTransport rtpStreamGetTransport(RTPStream *rtpStream) {
+	return rtpStream->transport;
+}
+
+bool rtpStreamOpenControlPorts(RTPStream *rtpStream, const char *localAddressName) {
+
+	/* Only UDP transport has control and timing ports */
+	if(rtpStream->transport != RTP_TRANSPORT_UDP) {
+		return true;
+	}
+
+	/* Open (unconnected) UDP connections on ports chosen by the system */
+	rtpStream->controlConnection = networkOpenConnection(localAddressName, "0", UDP_CONNECTION, false);
+	if(rtpStream->controlConnection == NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open control port on local address [%s]", localAddressName);
+		return false;
+	}
+	rtpStream->timingConnection = networkOpenConnection(localAddressName, "0", UDP_CONNECTION, false);
+	if(rtpStream->timingConnection == NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open timing port on local address [%s]", localAddressName);
+		return false;
+	}
+
+	return true;
+}
+
+bool rtpStreamGetControlPort(RTPStream *rtpStream, uint16_t *controlPort) {
+	if(rtpStream->controlConnection == NULL) {
+		return false;
+	}
+	return networkGetLocalPort(rtpStream->controlConnection, controlPort);
+}
+
+bool rtpStreamGetTimingPort(RTPStream *rtpStream, uint16_t *timingPort) {
+	if(rtpStream->timingConnection == NULL) {
+		return false;
+	}
+	return networkGetLocalPort(rtpStream->timingConnection, timingPort);
+}
+
+bool rtpStreamConnect(RTPStream *rtpStream, const char *hostName, uint16_t serverPort, uint16_t controlPort, uint16_t timingPort) {
+	char portNumberString[MAX_NUMBER_STRING_SIZE];
+
+	/* Open connection to server for audio */
+	if(snprintf(portNumberString, MAX_NUMBER_STRING_SIZE, "%" PRIu16, serverPort) < 1) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create string for server port number");
+		return false;
+	}
+	rtpStream->audioConnection = networkOpenConnection(hostName, portNumberString, rtpStream->transport == RTP_TRANSPORT_UDP ? UDP_CONNECTION : TCP_CONNECTION, true);
+	if(rtpStream->audioConnection == NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open audio connection to server [%s] on port [%s]", hostName, portNumberString);
+		return false;
+	}
+
+	/* Mark audio as low latency traffic */
+	if(!networkSetTypeOfService(rtpStream->audioConnection, RTP_AUDIO_TYPE_OF_SERVICE)) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot set type of service of audio connection to server [%s], continuing without", hostName);
+	}
+
+	/* TCP transport only needs its send buffer limited (sized for the nominal rate until the drain rate is measured) */
+	if(rtpStream->transport != RTP_TRANSPORT_UDP) {
+		if(!networkSetNoDelay(rtpStream->audioConnection) || !rtpStreamSetSendBufferSize(rtpStream, rtpStream->timescale * RTP_NOMINAL_BYTES_PER_FRAME)) {
+			return false;
+		}
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Audio connection to server [%s]: TCP_NODELAY, type of service 0x%02x, send buffer %d bytes", hostName, RTP_AUDIO_TYPE_OF_SERVICE, rtpStream->sendBufferSize);
+		return true;
+	}
+
+	/* Set destination of control and timing packets */
+	if(snprintf(portNumberString, MAX_NUMBER_STRING_SIZE, "%" PRIu16, controlPort) < 1 || !networkSetRemoteAddress(rtpStream->controlConnection, hostName, portNumberString)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set control port [%" PRIu16 "] of server [%s]", controlPort, hostName);
+		return false;
+	}
+	if(snprintf(portNumberString, MAX_NUMBER_STRING_SIZE, "%" PRIu16, timingPort) < 1 || !networkSetRemoteAddress(rtpStream->timingConnection, hostName, portNumberString)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot set timing port [%" PRIu16 "] of server [%s]", timingPort, hostName);
+		return false;
+	}
+
+	return true;
+}
+
+int rtpStreamGetAudioDescriptor(RTPStream *rtpStream) {
+	return rtpStream->audioConnection != NULL ? networkGetDescriptor(rtpStream->audioConnection) : -1;
+}
+
+int rtpStreamGetControlDescriptor(RTPStream *rtpStream) {
+	return rtpStream->controlConnection != NULL ? networkGetDescriptor(rtpStream->controlConnection) : -1;
+}
+
+int rtpStreamGetTimingDescriptor(RTPStream *rtpStream) {
+	return rtpStream->timingConnection != NULL ? networkGetDescriptor(rtpStream->timingConnection) : -1;
+}
+
+void rtpStreamSetTimestamp(RTPStream *rtpStream, uint32_t timestamp) {
+	rtpStream->timestamp = timestamp;
+	rtpStream->referenceTimestamp = timestamp;
+	rtpStream->nextSyncTimestamp = timestamp;
+}
+
+bool rtpStreamSetEncryption(RTPStream *rtpStream, const uint8_t *key, const uint8_t *iv) {
+
+	/* Create cipher and buffer for the encrypted payload (replacing earlier ones) */
+	aesCipherClose(&rtpStream->aesCipher);
+	rtpStreamUnlockBuffer(rtpStream, rtpStream->encryptedPayload, rtpStream->maxPayloadSize);
+	bufferFree(&rtpStream->encryptedPayload);
+	rtpStream->aesCipher = aesCipherCreate(key, iv);
+	if(rtpStream->aesCipher == NULL) {
+		return false;
+	}
+	if(!bufferAllocate(&rtpStream->encryptedPayload, rtpStream->maxPayloadSize, "encrypted payload")) {
+		aesCipherClose(&rtpStream->aesCipher);
+		return false;
+	}
+	rtpStreamLockBuffer(rtpStream, rtpStream->encryptedPayload, rtpStream->maxPayloadSize, "encrypted payload");
+
+	return true;
+}
+
+bool rtpStreamLockMemory(RTPStream *rtpStream) {
+	bool result;
+
+	/* Lock the buffers allocated so far, buffers allocated later are locked when allocated */
+	rtpStream->isMemoryLocked = true;
+	result = true;
+	if(rtpStream->resendBuffer != NULL && !rtpStreamLockBuffer(rtpStream, rtpStream->resendBuffer, RESEND_PACKET_COUNT * rtpStream->resendSlotSize, "resend buffer")) {
+		result = false;
+	}
+	if(rtpStream->encryptedPayload != NULL && !rtpStreamLockBuffer(rtpStream, rtpStream->encryptedPayload, rtpStream->maxPayloadSize, "encrypted payload")) {
+		result = false;
+	}
+
+	return result;
+}
+
+bool rtpStreamLockBuffer(RTPStream *rtpStream, uint8_t *buffer, size_t bufferSize, const char *purpose) {
+
+	/* Only when requested, a buffer which cannot be locked is used unlocked */
+	if(!rtpStream->isMemoryLocked) {
+		return true;
+	}
+	if(mlock(buffer, bufferSize) != 0) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Cannot lock %s (%lu bytes) in memory (errno = %d, check RLIMIT_MEMLOCK). Continuing without locking it.", purpose, (unsigned long)bufferSize, errno);
+		return false;
+	}
+
+	return true;
+}
+
+void rtpStreamUnlockBuffer(RTPStream *rtpStream, uint8_t *buffer, size_t bufferSize) {
+	if(rtpStream->isMemoryLocked && buffer != NULL) {
+		munlock(buffer, bufferSize);
+	}
+}
+
+const char *rtpStreamGetEncryptionImplementation(RTPStream *rtpStream) {
+	if(rtpStream->aesCipher == NULL) {
+		return NULL;
+	}
+	return aesCipherGetImplementation(rtpStream->aesCipher);
+}
+
+bool rtpStreamRestart(RTPStream *rtpStream, uint32_t maxPayloadSize) {
+	rtpStream->isFirstPacket = true;
+
+	/* The AirTunes device fills its buffer again, measuring the playing rate continues once it is filled */
+	rtpStream->packetEndCount = 0;
+	rtpStream->hasDrainSample = false;
+
+	/* Start measuring the drain rate again (a measurement spanning a pause or flush would be far too low) */
+	timespecInitialize(&rtpStream->drainStartTime);
+	rtpStream->drainStartSize = 0;
+
+	/* Packets sent before are flushed, so they will not be requested anymore (enlarge slots if needed) */
+	memset(rtpStream->resendPacketSizes, 0, sizeof(rtpStream->resendPacketSizes));
+	if(rtpStream->transport == RTP_TRANSPORT_UDP && RESEND_HEADER_SIZE + UDP_HEADER_SIZE + maxPayloadSize > rtpStream->resendSlotSize) {
+		rtpStreamUnlockBuffer(rtpStream, rtpStream->resendBuffer, RESEND_PACKET_COUNT * rtpStream->resendSlotSize);
+		rtpStream->resendSlotSize = RESEND_HEADER_SIZE + UDP_HEADER_SIZE + maxPayloadSize;
+		if(!bufferFree(&rtpStream->resendBuffer) || !bufferAllocate(&rtpStream->resendBuffer, RESEND_PACKET_COUNT * rtpStream->resendSlotSize, "resend buffer")) {
+			return false;
+		}
+		rtpStreamLockBuffer(rtpStream, rtpStream->resendBuffer, RESEND_PACKET_COUNT * rtpStream->resendSlotSize, "resend buffer");
+	}
+
+	/* Enlarge buffer for encrypted payload if needed */
+	if(maxPayloadSize > rtpStream->maxPayloadSize) {
+		rtpStreamUnlockBuffer(rtpStream, rtpStream->encryptedPayload, rtpStream->maxPayloadSize);
+		rtpStream->maxPayloadSize = maxPayloadSize;
+		if(rtpStream->aesCipher != NULL) {
+			if(!bufferFree(&rtpStream->encryptedPayload) || !bufferAllocate(&rtpStream->encryptedPayload, rtpStream->maxPayloadSize, "encrypted payload")) {
+				return false;
+			}
+			rtpStreamLockBuffer(rtpStream, rtpStream->encryptedPayload, rtpStream->maxPayloadSize, "encrypted payload");
+		}
+	}
+
+	return true;
+}
+
+uint16_t rtpStreamGetSequenceNumber(RTPStream *rtpStream) {
+	return rtpStream->sequenceNumber;
+}
+
+uint32_t rtpStreamGetTimestamp(RTPStream *rtpStream) {
+	return rtpStream->timestamp;
+}
+
+void rtpStreamSetReferenceTime(RTPStream *rtpStream, const struct timespec *referenceTime) {
+	timespecCopy(&rtpStream->referenceTime, referenceTime);
+	rtpStream->referenceTimestamp = rtpStream->timestamp;
+	rtpStream->nextSyncTimestamp = rtpStream->timestamp;
+}
+
+void rtpStreamGetPacketTime(RTPStream *rtpStream, struct timespec *packetTime) {
+	uint32_t frames;
+	struct timespec delta;
+
+	/* Calculate time of next packet relative to reference time (the unsigned subtraction handles wrap around) */
+	frames = rtpStream->timestamp - rtpStream->referenceTimestamp;
+	delta.tv_sec = frames / rtpStream->timescale;
+	delta.tv_nsec = (long)((uint64_t)(frames % rtpStream->timescale) * ONE_SECOND_IN_NANO_SECONDS / rtpStream->timescale);
+	timespecCopy(packetTime, &rtpStream->referenceTime);
+	timespecAdd(packetTime, &delta);
+}
+
+bool rtpStreamSendPayload(RTPStream *rtpStream, uint8_t *payload, uint32_t payloadSize, uint32_t frameCount, bool *isSent) {
+	size_t sentSize;
+	NetworkSendResult result;
+	uint32_t slotIndex;
+
+	/* Prepare header of a new packet (a partially sent packet is continued) */
+	if(!rtpStream->isSendingPacket) {
+		if(!rtpStreamPrepareHeader(rtpStream, payloadSize)) {
+			return false;
+		}
+		if(rtpStream->aesCipher != NULL) {
+			rtpStreamEncryptPayload(rtpStream, payload, payloadSize);
+		}
+		rtpStream->isSendingPacket = true;
+		rtpStream->sentSize = 0;
+	}
+
+	/* Encrypted payload is sent (and kept for resending) instead */
+	if(rtpStream->aesCipher != NULL) {
+		payload = rtpStream->encryptedPayload;
+	}
+
+	/* Send remaining part of header and payload */
+	if(rtpStream->sentSize < rtpStream->headerSize) {
+		result = networkTrySendMessageParts(rtpStream->audioConnection, rtpStream->header + rtpStream->sentSize, rtpStream->headerSize - rtpStream->sentSize, payload, payloadSize, &sentSize);
+	} else {
+		result = networkTrySendMessageParts(rtpStream->audioConnection, NULL, 0, payload + (rtpStream->sentSize - rtpStream->headerSize), payloadSize - (rtpStream->sentSize - rtpStream->headerSize), &sentSize);
+	}
+	if(result == NETWORK_SEND_FAILED) {
+		rtpStream->isSendingPacket = false;
+		return false;
+	}
+	rtpStream->sentSize += sentSize;
+	rtpStream->totalSentSize += sentSize;
+	if(result == NETWORK_SEND_WOULD_BLOCK) {
+		*isSent = false;
+		return true;
+	}
+	rtpStream->isSendingPacket = false;
+
+	/* Keep packet for answering resend requests */
+	if(rtpStream->transport == RTP_TRANSPORT_UDP) {
+		if(!rtpStreamKeepPacket(rtpStream, rtpStream->header, rtpStream->headerSize, payload, payloadSize)) {
+			return false;
+		}
+		rtpStreamUpdateSendDelay(rtpStream);
+	} else {
+
+		/* Keep end of packet for converting drained bytes into frames */
+		slotIndex = rtpStream->sequenceNumber & (RTP_PACKET_END_COUNT - 1);
+		if(rtpStream->packetEndCount == 0) {
+			rtpStream->segmentTimestamp = rtpStream->timestamp;
+		}
+		rtpStream->packetEndSizes[slotIndex] = rtpStream->totalSentSize;
+		rtpStream->packetEndTimestamps[slotIndex] = rtpStream->timestamp + frameCount;
+		if(rtpStream->packetEndCount < RTP_PACKET_END_COUNT) {
+			rtpStream->packetEndCount++;
+		}
+		rtpStreamUpdateDrainRate(rtpStream);
+	}
+
+	/* Update RTP information */
+	rtpStream->sequenceNumber++;
+	rtpStream->timestamp += frameCount;
+	rtpStream->isFirstPacket = false;
+	*isSent = true;
+
+	return true;
+}
+
+void rtpStreamEncryptPayload(RTPStream *rtpStream, uint8_t *payload, uint32_t payloadSize) {
+	struct timespec startTime;
+	struct timespec endTime;
+	struct timespec elapsedTime;
+
+	/* Encrypt payload and measure the time it takes (to compare the cost with sending unencrypted) */
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	aesCipherEncrypt(rtpStream->aesCipher, payload, rtpStream->encryptedPayload, payloadSize);
+	clock_gettime(CLOCK_MONOTONIC, &endTime);
+	timespecSubtract(&endTime, &startTime, &elapsedTime);
+
+	/* Update statistics */
+	rtpStream->totalEncryptionTime += (uint64_t)elapsedTime.tv_sec * ONE_SECOND_IN_NANO_SECONDS + elapsedTime.tv_nsec;
+	rtpStream->totalEncryptedSize += payloadSize;
+	rtpStream->statistics.encryptedPackets++;
+	rtpStream->statistics.averageEncryptionTime = (uint32_t)(rtpStream->totalEncryptionTime / rtpStream->statistics.encryptedPackets);
+	if(rtpStream->totalEncryptionTime > 0) {
+		rtpStream->statistics.encryptionRate = (uint32_t)(rtpStream->totalEncryptedSize * 1000 / rtpStream->totalEncryptionTime);
+	}
+}
+
+bool rtpStreamSetSendBufferSize(RTPStream *rtpStream, uint32_t drainRate) {
+	uint64_t sendBufferSize;
+
+	/* Hold RTP_SEND_BUFFER_MILLISECONDS of audio, so stopping is fast and a stalled device is noticed early */
+	sendBufferSize = (uint64_t)drainRate * RTP_SEND_BUFFER_MILLISECONDS / 1000;
+	if(sendBufferSize < RTP_MIN_SEND_BUFFER_SIZE) {
+		sendBufferSize = RTP_MIN_SEND_BUFFER_SIZE;
+	} else if(sendBufferSize > RTP_MAX_SEND_BUFFER_SIZE) {
+		sendBufferSize = RTP_MAX_SEND_BUFFER_SIZE;
+	}
+
+	return networkSetSendBufferSize(rtpStream->audioConnection, (int)sendBufferSize, &rtpStream->sendBufferSize);
+}
+
+void rtpStreamUpdateDrainRate(RTPStream *rtpStream) {
+	struct timespec currentTime;
+	struct timespec elapsedTime;
+	uint64_t elapsedMilliseconds;
+	uint64_t drainedSize;
+	uint32_t drainRate;
+	int queuedSize;
+	int previousSendBufferSize;
+	char hostName[MAX_ADDR_STRING_LENGTH];
+
+	/* Bytes received by the AirTunes device are the bytes sent minus the bytes still queued (unacknowledged) */
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0 || !networkGetSendQueueSize(rtpStream->audioConnection, &queuedSize)) {
+		return;
+	}
+	drainedSize = rtpStream->totalSentSize - (uint64_t)queuedSize;
+
+	/* Start measuring or wait until enough time has passed */
+	if(rtpStream->drainStartTime.tv_sec == 0 && rtpStream->drainStartTime.tv_nsec == 0) {
+		timespecCopy(&rtpStream->drainStartTime, &currentTime);
+		rtpStream->drainStartSize = drainedSize;
+		return;
+	}
+	timespecSubtract(&currentTime, &rtpStream->drainStartTime, &elapsedTime);
+	elapsedMilliseconds = (uint64_t)elapsedTime.tv_sec * 1000 + elapsedTime.tv_nsec / 1000000;
+	if(elapsedMilliseconds < RTP_DRAIN_MEASURE_MILLISECONDS) {
+		return;
+	}
+	drainRate = (uint32_t)((drainedSize - rtpStream->drainStartSize) * 1000 / elapsedMilliseconds);
+	timespecCopy(&rtpStream->drainStartTime, &currentTime);
+	rtpStream->drainStartSize = drainedSize;
+	rtpStreamUpdatePlayingDrift(rtpStream, &currentTime, drainedSize);
+
+	/* Resize send buffer only if the drain rate changed significantly (more than 25%) */
+	if(rtpStream->drainRate != 0 && drainRate > rtpStream->drainRate - rtpStream->drainRate / 4 && drainRate < rtpStream->drainRate + rtpStream->drainRate / 4) {
+		return;
+	}
+	rtpStream->drainRate = drainRate;
+	previousSendBufferSize = rtpStream->sendBufferSize;
+	if(!rtpStreamSetSendBufferSize(rtpStream, drainRate)) {
+		return;
+	}
+
+	/* Write info to log */
+	if(rtpStream->sendBufferSize != previousSendBufferSize && networkGetRemoteAddressName(rtpStream->audioConnection, hostName, MAX_ADDR_STRING_LENGTH)) {
+		logWrite(LOG_LEVEL_INFO, LOG_COMPONENT_NAME, "Audio connection to server [%s] drains %" PRIu32 " bytes/s, send buffer resized from %d to %d bytes", hostName, drainRate, previousSendBufferSize, rtpStream->sendBufferSize);
+	}
+}
+
+bool rtpStreamPrepareHeader(RTPStream *rtpStream, uint32_t payloadSize) {
+	uint8_t *header;
+
+	/* Set header of audio packet (sent together with payload) */
+	header = rtpStream->header;
+	if(rtpStream->transport == RTP_TRANSPORT_UDP) {
+
+		/* Send sync packet before first packet and once every second */
+		if(rtpStream->isFirstPacket || (int32_t)(rtpStream->timestamp - rtpStream->nextSyncTimestamp) >= 0) {
+			if(!rtpStreamSendSync(rtpStream)) {
+				return false;
+			}
+			rtpStream->nextSyncTimestamp = rtpStream->timestamp + rtpStream->timescale;
+		}
+
+		rtpStream->headerSize = UDP_HEADER_SIZE;
+		header[0] = RTP_HEADER_VERSION;
+		header[1] = RTP_PAYLOAD_TYPE_AUDIO | (rtpStream->isFirstPacket ? RTP_HEADER_MARKER : 0x00);
+		rtpStreamWriteUnsignedShort(header + 2, rtpStream->sequenceNumber);
+		rtpStreamWriteUnsignedLong(header + 4, rtpStream->timestamp);
+		rtpStreamWriteUnsignedLong(header + 8, rtpStream->ssrc);
+	} else {
+		rtpStream->headerSize = TCP_HEADER_SIZE;
+		memset(header, 0, TCP_HEADER_SIZE);
+		header[0] = TCP_HEADER_MAGIC;
+		rtpStreamWriteUnsignedShort(header + 2, (uint16_t)(payloadSize + TCP_HEADER_SIZE - 4));
+		header[4] = 0xf0;
+		header[5] = 0xff;
+		rtpStreamWriteUnsignedShort(header + 6, rtpStream->sequenceNumber);
+		rtpStreamWriteUnsignedLong(header + 8, rtpStream->timestamp);
+	}
+
+	return true;
+}
+
+bool rtpStreamSendSync(RTPStream *rtpStream) {
+	uint8_t syncPacket[SYNC_PACKET_SIZE];
+	struct timespec currentTime;
+	uint32_t currentTimestamp;
+
+	/* Get current time and the timestamp being due at this time */
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve clock value for sync packet (errno = %d)", errno);
+		return false;
+	}
+	currentTimestamp = rtpStreamGetTimestampAt(rtpStream, &currentTime);
+
+	/* Fill sync packet: the timestamp being played now (ie taking latency into account), the current time and the current timestamp */
+	syncPacket[0] = RTP_HEADER_VERSION | (rtpStream->isFirstPacket ? RTP_HEADER_EXTENSION : 0x00);
+	syncPacket[1] = RTP_PAYLOAD_TYPE_SYNC | RTP_HEADER_MARKER;
+	rtpStreamWriteUnsignedShort(syncPacket + 2, RTP_CONTROL_SEQUENCE_NUMBER);
+	rtpStreamWriteUnsignedLong(syncPacket + 4, currentTimestamp - rtpStream->latency);
+	rtpStreamWriteNTPTime(syncPacket + 8, &currentTime);
+	rtpStreamWriteUnsignedLong(syncPacket + 16, currentTimestamp);
+
+	/* Send packet */
+	return networkSendMessage(rtpStream->controlConnection, syncPacket, SYNC_PACKET_SIZE);
+}
+
+bool rtpStreamHandleTimingPacket(RTPStream *rtpStream) {
+	uint8_t timingPacket[MAX_CONTROL_PACKET_SIZE];
+	size_t timingPacketSize;
+	struct timespec currentTime;
+
+	/* Receive timing request (and keep time of receipt) */
+	if(!networkReceiveMessage(rtpStream->timingConnection, timingPacket, MAX_CONTROL_PACKET_SIZE, &timingPacketSize)) {
+		return false;
+	}
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve clock value for timing packet (errno = %d)", errno);
+		return false;
+	}
+	if(timingPacketSize != TIMING_PACKET_SIZE || (timingPacket[1] & RTP_PAYLOAD_TYPE_MASK) != RTP_PAYLOAD_TYPE_TIMING_REQUEST) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Unknown packet (%lu bytes, type 0x%02x) received on timing port. Ignoring it.", (unsigned long)timingPacketSize, (int)timingPacket[1]);
+		return true;
+	}
+
+	/* Keep track of clock drift of the AirTunes device (using its send time) */
+	rtpStreamUpdateClockDrift(rtpStream, timingPacket + 24, &currentTime);
+
+	/* Create timing reply: origin time is send time of request, followed by time of receipt and time of sending the reply */
+	timingPacket[1] = RTP_PAYLOAD_TYPE_TIMING_REPLY | RTP_HEADER_MARKER;
+	memcpy(timingPacket + 8, timingPacket + 24, 8);
+	rtpStreamWriteNTPTime(timingPacket + 16, &currentTime);
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot retrieve clock value for timing packet (errno = %d)", errno);
+		return false;
+	}
+	rtpStreamWriteNTPTime(timingPacket + 24, &currentTime);
+
+	/* Send reply */
+	return networkSendMessage(rtpStream->timingConnection, timingPacket, TIMING_PACKET_SIZE);
+}
+
+bool rtpStreamHandleControlPacket(RTPStream *rtpStream) {
+	uint8_t controlPacket[MAX_CONTROL_PACKET_SIZE];
+	size_t controlPacketSize;
+
+	/* Receive control packet */
+	if(!networkReceiveMessage(rtpStream->controlConnection, controlPacket, MAX_CONTROL_PACKET_SIZE, &controlPacketSize)) {
+		return false;
+	}
+
+	/* Only resend requests are expected on the control port */
+	if(controlPacketSize < RESEND_REQUEST_PACKET_SIZE || (controlPacket[1] & RTP_PAYLOAD_TYPE_MASK) != RTP_PAYLOAD_TYPE_RESEND_REQUEST) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Unknown packet (%lu bytes) received on control port. Ignoring it.", (unsigned long)controlPacketSize);
+		return true;
+	}
+
+	/* Resend request contains first missed sequence number and number of missed packets */
+	return rtpStreamResendPackets(rtpStream, rtpStreamReadUnsignedShort(controlPacket + 4), rtpStreamReadUnsignedShort(controlPacket + 6));
+}
+
+bool rtpStreamKeepPacket(RTPStream *rtpStream, uint8_t *header, size_t headerSize, uint8_t *payload, size_t payloadSize) {
+	uint32_t slotIndex;
+	uint8_t *slot;
+
+	/* Copy packet into slot (behind the resend header) */
+	slotIndex = rtpStream->sequenceNumber & (RESEND_PACKET_COUNT - 1);
+	slot = rtpStream->resendBuffer + slotIndex * rtpStream->resendSlotSize;
+	memcpy(slot + RESEND_HEADER_SIZE, header, headerSize);
+	memcpy(slot + RESEND_HEADER_SIZE + headerSize, payload, payloadSize);
+	rtpStream->resendSequenceNumbers[slotIndex] = rtpStream->sequenceNumber;
+	rtpStream->resendPacketSizes[slotIndex] = RESEND_HEADER_SIZE + headerSize + payloadSize;
+	rtpStream->statistics.sentPackets++;
+
+	return true;
+}
+
+bool rtpStreamResendPackets(RTPStream *rtpStream, uint16_t sequenceNumber, uint16_t count) {
+	uint32_t slotIndex;
+	uint8_t *slot;
+	bool result;
+
+	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Resend request received for %" PRIu16 " packet(s) starting at sequence number %" PRIu16, count, sequenceNumber);
+
+	/* At most RESEND_PACKET_COUNT packets are kept, a larger count (from the network) cannot be answered anyway */
+	if(count > RESEND_PACKET_COUNT) {
+		logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Resend request for %" PRIu16 " packet(s) limited to %d packets", count, RESEND_PACKET_COUNT);
+		count = RESEND_PACKET_COUNT;
+	}
+
+	/* Resend every requested packet which is still available */
+	result = true;
+	rtpStream->statistics.lostPackets += count;
+	while(count > 0 && result) {
+		slotIndex = sequenceNumber & (RESEND_PACKET_COUNT - 1);
+		slot = rtpStream->resendBuffer + slotIndex * rtpStream->resendSlotSize;
+		if(rtpStream->resendPacketSizes[slotIndex] == 0 || rtpStream->resendSequenceNumbers[slotIndex] != sequenceNumber) {
+			logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Packet with sequence number %" PRIu16 " is not available anymore for resending", sequenceNumber);
+			rtpStream->statistics.unavailablePackets++;
+		} else {
+
+			/* Resend header is followed by the original packet */
+			slot[0] = RTP_HEADER_VERSION;
+			slot[1] = RTP_PAYLOAD_TYPE_RESEND_REPLY | RTP_HEADER_MARKER;
+			rtpStreamWriteUnsignedShort(slot + 2, sequenceNumber);
+			if(networkSendMessage(rtpStream->controlConnection, slot, rtpStream->resendPacketSizes[slotIndex])) {
+				rtpStream->statistics.resentPackets++;
+			} else {
+				result = false;
+			}
+		}
+		sequenceNumber++;
+		count--;
+	}
+
+	return result;
+}
+
+void rtpStreamUpdatePlayingDrift(RTPStream *rtpStream, const struct timespec *currentTime, uint64_t drainedSize) {
+	uint32_t slotIndex;
+	uint32_t nextSlotIndex;
+	uint32_t packetIndex;
+	uint32_t drainedTimestamp;
+	uint32_t frames;
+	struct timespec elapsedTime;
+	int64_t expectedFrames;
+	int64_t playingError;
+	int32_t clockDrift;
+	bool isDriftKnown;
+
+	/* Everything sent is drained, so the AirTunes device is waiting for audio instead of pacing the stream (interval is left out) */
+	nextSlotIndex = rtpStream->sequenceNumber & (RTP_PACKET_END_COUNT - 1);
+	if(rtpStream->packetEndCount == 0 || drainedSize >= rtpStream->packetEndSizes[nextSlotIndex]) {
+		rtpStream->hasDrainSample = false;
+		return;
+	}
+
+	/* Find the packet being drained (the one following the newest packet drained completely) */
+	packetIndex = 1;
+	slotIndex = (nextSlotIndex - 1) & (RTP_PACKET_END_COUNT - 1);
+	while(packetIndex < rtpStream->packetEndCount && rtpStream->packetEndSizes[slotIndex] > drainedSize) {
+		nextSlotIndex = slotIndex;
+		slotIndex = (slotIndex - 1) & (RTP_PACKET_END_COUNT - 1);
+		packetIndex++;
+	}
+	if(packetIndex >= rtpStream->packetEndCount) {
+		return;
+	}
+	drainedTimestamp = rtpStream->packetEndTimestamps[slotIndex] + (uint32_t)((drainedSize - rtpStream->packetEndSizes[slotIndex]) * (rtpStream->packetEndTimestamps[nextSlotIndex] - rtpStream->packetEndTimestamps[slotIndex]) / (rtpStream->packetEndSizes[nextSlotIndex] - rtpStream->packetEndSizes[slotIndex]));
+
+	/* Start measuring once the buffer of the AirTunes device is filled (then it drains at the rate it plays) */
+	if(drainedTimestamp - rtpStream->segmentTimestamp < RTP_DRIFT_SETTLE_SECONDS * rtpStream->timescale) {
+		return;
+	}
+	if(!rtpStream->hasDrainSample) {
+		timespecCopy(&rtpStream->drainSampleTime, currentTime);
+		rtpStream->drainSampleTimestamp = drainedTimestamp;
+		rtpStream->hasDrainSample = true;
+		return;
+	}
+	timespecSubtract(currentTime, &rtpStream->drainSampleTime, &elapsedTime);
+	frames = drainedTimestamp - rtpStream->drainSampleTimestamp;
+	timespecCopy(&rtpStream->drainSampleTime, currentTime);
+	rtpStream->drainSampleTimestamp = drainedTimestamp;
+
+	/* Add interval to the measured ones (intervals while paused, (re)starting or not pacing are left out) */
+	isDriftKnown = rtpStream->drainedMicroSeconds >= MIN_CLOCK_DRIFT_SECONDS * 1000000;
+	rtpStream->drainedFrames += frames;
+	rtpStream->drainedMicroSeconds += (uint64_t)elapsedTime.tv_sec * 1000000 + elapsedTime.tv_nsec / 1000;
+	if(rtpStream->drainedMicroSeconds < MIN_CLOCK_DRIFT_SECONDS * 1000000) {
+		return;
+	}
+
+	/* Position predicted with the drift known so far differs from the position measured by the error made (reported as bound) */
+	expectedFrames = (int64_t)(rtpStream->drainedMicroSeconds * rtpStream->timescale / 1000000);
+	playingError = (int64_t)rtpStream->drainedFrames - (expectedFrames + expectedFrames * rtpStream->statistics.clockDrift / 1000000);
+	if(playingError < 0) {
+		playingError = -playingError;
+	}
+	playingError = playingError * 1000000 / rtpStream->timescale;
+	if(isDriftKnown && playingError > rtpStream->statistics.maxPlayingError) {
+		rtpStream->statistics.maxPlayingError = (uint32_t)playingError;
+	}
+
+	/* Drift is the difference between frames played and frames due (a device clock running fast plays more frames) */
+	clockDrift = (int32_t)(((int64_t)rtpStream->drainedFrames - expectedFrames) * 1000000 / expectedFrames);
+	if(clockDrift >= -RTP_MAX_PLAYING_DRIFT && clockDrift <= RTP_MAX_PLAYING_DRIFT) {
+		rtpStream->statistics.clockDrift = clockDrift;
+	}
+}
+
+int32_t rtpStreamGetPlayingDrift(RTPStream *rtpStream) {
+
+	/* Only a TCP stream is paced by the AirTunes device, with UDP it follows the reference clock (see rtpStreamSendSync) */
+	return rtpStream->transport == RTP_TRANSPORT_TCP ? rtpStream->statistics.clockDrift : 0;
+}
+
+void rtpStreamUpdateSendDelay(RTPStream *rtpStream) {
+	struct timespec currentTime;
+	struct timespec packetTime;
+	int64_t sendDelay;
+
+	/* Calculate how late the (just sent) packet is */
+	if(clock_gettime(CLOCK_MONOTONIC, &currentTime) != 0) {
+		return;
+	}
+	rtpStreamGetPacketTime(rtpStream, &packetTime);
+	sendDelay = ((int64_t)(currentTime.tv_sec - packetTime.tv_sec) * ONE_SECOND_IN_NANO_SECONDS + (currentTime.tv_nsec - packetTime.tv_nsec)) / 1000;
+	if(sendDelay < 0) {
+		sendDelay = 0;
+	}
+
+	/* Update statistics (sentPackets is already updated) */
+	rtpStream->totalSendDelay += (uint64_t)sendDelay;
+	rtpStream->statistics.averageSendDelay = (uint32_t)(rtpStream->totalSendDelay / rtpStream->statistics.sentPackets);
+	if(sendDelay > rtpStream->statistics.maxSendDelay) {
+		rtpStream->statistics.maxSendDelay = (uint32_t)sendDelay;
+	}
+}
+
+void rtpStreamUpdateClockDrift(RTPStream *rtpStream, uint8_t *deviceTime, const struct timespec *receiveTime) {
+	int64_t clockOffset;
+	int64_t elapsedTime;
+
+	/* Calculate difference between both clocks (including network delay, which is assumed to be constant over time) */
+	clockOffset = (int64_t)receiveTime->tv_sec * ONE_SECOND_IN_NANO_SECONDS + receiveTime->tv_nsec;
+	clockOffset -= (int64_t)rtpStreamReadUnsignedLong(deviceTime) * ONE_SECOND_IN_NANO_SECONDS;
+	clockOffset -= (int64_t)(((uint64_t)rtpStreamReadUnsignedLong(deviceTime + 4) * ONE_SECOND_IN_NANO_SECONDS) >> 32);
+
+	/* Drift is the change in difference over time (a device clock running fast decreases the difference) */
+	if(!rtpStream->hasFirstClockOffset) {
+		rtpStream->firstClockOffset = clockOffset;
+		timespecCopy(&rtpStream->firstClockOffsetTime, receiveTime);
+		rtpStream->hasFirstClockOffset = true;
+	} else {
+		elapsedTime = (int64_t)(receiveTime->tv_sec - rtpStream->firstClockOffsetTime.tv_sec) * ONE_SECOND_IN_NANO_SECONDS + (receiveTime->tv_nsec - rtpStream->firstClockOffsetTime.tv_nsec);
+		if(elapsedTime >= MIN_CLOCK_DRIFT_SECONDS * ONE_SECOND_IN_NANO_SECONDS) {
+			rtpStream->statistics.clockDrift = (int32_t)((rtpStream->firstClockOffset - clockOffset) * 1000 / (elapsedTime / 1000));
+		}
+	}
+}
+
+void rtpStreamGetStatistics(RTPStream *rtpStream, RTPStreamStatistics *statistics) {
+	memcpy(statistics, &rtpStream->statistics, sizeof(RTPStreamStatistics));
+}
+
+uint32_t rtpStreamGetTimestampAt(RTPStream *rtpStream, const struct timespec *time) {
+	int64_t nanoSeconds;
+
+	/* Calculate (signed) time difference with reference time and convert it into frames */
+	nanoSeconds = (int64_t)(time->tv_sec - rtpStream->referenceTime.tv_sec) * ONE_SECOND_IN_NANO_SECONDS + (time->tv_nsec - rtpStream->referenceTime.tv_nsec);
+	return rtpStream->referenceTimestamp + (uint32_t)(nanoSeconds * rtpStream->timescale / ONE_SECOND_IN_NANO_SECONDS);
+}
+
+void rtpStreamWriteNTPTime(uint8_t *buffer, const struct timespec *time) {
+	/* NTP time consists of seconds since 1900 and a 32-bit binary fraction of a second */
+	rtpStreamWriteUnsignedLong(buffer, (uint32_t)(time->tv_sec + NTP_EPOCH_OFFSET));
+	rtpStreamWriteUnsignedLong(buffer + 4, (uint32_t)(((uint64_t)time->tv_nsec << 32) / ONE_SECOND_IN_NANO_SECONDS));
+}
+
+uint16_t rtpStreamReadUnsignedShort(uint8_t *buffer) {
+	/* Read value in network byte order */
+	return (uint16_t)((buffer[0] << 8) | buffer[1]);
+}
+
+uint32_t rtpStreamReadUnsignedLong(uint8_t *buffer) {
+	/* Read value in network byte order */
+	return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | (uint32_t)buffer[3];
+}
+
+void rtpStreamWriteUnsignedShort(uint8_t *buffer, uint16_t value) {
+	/* Write value in network byte order */
+	buffer[0] = (uint8_t)(value >> 8);
+	buffer[1] = (uint8_t)value;
+}
+
+void rtpStreamWriteUnsignedLong(uint8_t *buffer, uint32_t value) {
+	/* Write value in network byte order */
+	buffer[0] = (uint8_t)(value >> 24);
+	buffer[1] = (uint8_t)(value >> 16);
+	buffer[2] = (uint8_t)(value >> 8);
+	buffer[3] = (uint8_t)value;
+}
+
+bool rtpStreamClose(RTPStream **rtpStream) {
+	bool result;
+
+	/* Close all opened/allocated resource. Continu if a failure occurs, but remember failure for final result. */
+	result = true;
+	if(*rtpStream != NULL) {
+		if((*rtpStream)->audioConnection != NULL) {
+			if(!networkCloseConnection(&(*rtpStream)->audioConnection)) {
+				result = false;
+			}
+		}
+		if((*rtpStream)->controlConnection != NULL) {
+			if(!networkCloseConnection(&(*rtpStream)->controlConnection)) {
+				result = false;
+			}
+		}
+		if((*rtpStream)->timingConnection != NULL) {
+			if(!networkCloseConnection(&(*rtpStream)->timingConnection)) {
+				result = false;
+			}
+		}
+		rtpStreamUnlockBuffer(*rtpStream, (*rtpStream)->resendBuffer, RESEND_PACKET_COUNT * (*rtpStream)->resendSlotSize);
+		if(!bufferFree(&(*rtpStream)->resendBuffer)) {
+			result = false;
+		}
+		if(!aesCipherClose(&(*rtpStream)->aesCipher)) {
+			result = false;
+		}
+		rtpStreamUnlockBuffer(*rtpStream, (*rtpStream)->encryptedPayload, (*rtpStream)->maxPayloadSize);
+		if(!bufferFree(&(*rtpStream)->encryptedPayload)) {
+			result = false;
+		}
+		if(!bufferFree(rtpStream)) {
+			result = false;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,318 @@
+/*
+ * File: rtpstream.h
+ *
+ * Copyright (C) 2013 Erik Stel <erik.stel@gmail.com>
+ *
+ * This file is part of light-play.
+ *
+ * light-play is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * light-play is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with light-play.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef	__RTPSTREAM_H__
+#define	__RTPSTREAM_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+/* Type definition for RTPStream */
+typedef struct RTPStreamStruct RTPStream;
+
+/* Type definition for audio transports */
+typedef enum {
+	RTP_TRANSPORT_TCP = 0,
+	RTP_TRANSPORT_UDP = 1
+} RTPTransport;
+
+/* Type definition for statistics of sent packets (only known for UDP transport) */
+typedef struct {
+	uint32_t sentPackets;		/* Number of audio packets sent */
+	uint32_t lostPackets;		/* Number of audio packets reported missing by the AirTunes device */
+	uint32_t resentPackets;		/* Number of audio packets resent */
+	uint32_t unavailablePackets;	/* Number of audio packets which could not be resent (not kept anymore) */
+	uint32_t averageSendDelay;	/* Average time (in microseconds) between packets being due and being sent */
+	uint32_t maxSendDelay;		/* Maximum time (in microseconds) between a packet being due and being sent */
+	int32_t clockDrift;		/* Drift (in ppm) of the clock of the AirTunes device relative to the reference clock (0 if not known yet, measured using timing requests for UDP and drained frames for TCP) */
+	uint32_t maxPlayingError;	/* Maximum difference (in microseconds) between the playing position predicted using clockDrift and the one measured (TCP only) */
+	uint32_t encryptedPackets;	/* Number of audio packets encrypted (0 if encryption is not used) */
+	uint32_t averageEncryptionTime;	/* Average time (in nanoseconds) spent encrypting the payload of a packet */
+	uint32_t encryptionRate;	/* Rate (in MB/s) at which payloads are encrypted */
+} RTPStreamStatistics;
+
+/*
+ * Function: rtpStreamCreate
+ * Parameters:
+ *	transport - transport (TCP/UDP) used for sending audio packets
+ *	timescale - number of frames per second
+ *	latency - time between a frame being sent and the frame being played by the AirTunes device
+ *	maxPayloadSize - size (in bytes) of the largest payload which will be sent
+ * Returns: RTPStream structure
+ *
+ * Remarks:
+ * The initial sequence number and timestamp are chosen randomly (as prescribed by RTP).
+ */
+RTPStream *rtpStreamCreate(RTPTransport transport, uint32_t timescale, const struct timespec *latency, uint32_t maxPayloadSize);
+
+/*
+ * Function: rtpStreamGetTransport
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: the transport used by the RTP Stream
+ */
+RTPTransport rtpStreamGetTransport(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamOpenControlPorts
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	localAddressName - local address (IP address) to bind the control and timing ports to
+ * Returns: a boolean specifying if the control and timing ports are opened successfully
+ *
+ * Remarks:
+ * Only needed for the UDP transport. The control port is used for sending sync packets (and receiving resend requests).
+ * The timing port is used for answering timing requests of the AirTunes device. The ports are chosen by the system.
+ */
+bool rtpStreamOpenControlPorts(RTPStream *rtpStream, const char *localAddressName);
+
+/*
+ * Function: rtpStreamGetControlPort
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	controlPort - local port number of the control port
+ * Returns: a boolean specifying if the port number is retrieved successfully
+ */
+bool rtpStreamGetControlPort(RTPStream *rtpStream, uint16_t *controlPort);
+
+/*
+ * Function: rtpStreamGetTimingPort
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	timingPort - local port number of the timing port
+ * Returns: a boolean specifying if the port number is retrieved successfully
+ */
+bool rtpStreamGetTimingPort(RTPStream *rtpStream, uint16_t *timingPort);
+
+/*
+ * Function: rtpStreamConnect
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	hostName - name of host
+ *	serverPort - port of the AirTunes device for audio packets
+ *	controlPort - port of the AirTunes device for control packets (only used for UDP transport)
+ *	timingPort - port of the AirTunes device for timing packets (only used for UDP transport)
+ * Returns: a boolean specifying if the RTP Stream is connected successfully
+ *
+ * Remarks:
+ * All connections of the RTP Stream are non-blocking. For the UDP transport incoming control and timing packets should
+ * be handled by the caller (see rtpStreamHandleControlPacket and rtpStreamHandleTimingPacket).
+ */
+bool rtpStreamConnect(RTPStream *rtpStream, const char *hostName, uint16_t serverPort, uint16_t controlPort, uint16_t timingPort);
+
+/*
+ * Function: rtpStreamGetAudioDescriptor
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: the descriptor of the audio connection (-1 if not connected)
+ */
+int rtpStreamGetAudioDescriptor(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamGetControlDescriptor
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: the descriptor of the control port (-1 if not opened)
+ */
+int rtpStreamGetControlDescriptor(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamGetTimingDescriptor
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: the descriptor of the timing port (-1 if not opened)
+ */
+int rtpStreamGetTimingDescriptor(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamHandleControlPacket
+ * Parameters:
+ *	rtpStream - already connected RTP Stream (see rtpStreamConnect)
+ * Returns: a boolean specifying if the control packet is handled successfully
+ *
+ * Remarks:
+ * Should be called when the control port is readable. Resend requests of the AirTunes device are answered.
+ */
+bool rtpStreamHandleControlPacket(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamHandleTimingPacket
+ * Parameters:
+ *	rtpStream - already connected RTP Stream (see rtpStreamConnect)
+ * Returns: a boolean specifying if the timing packet is handled successfully
+ *
+ * Remarks:
+ * Should be called when the timing port is readable. Timing requests of the AirTunes device are answered.
+ */
+bool rtpStreamHandleTimingPacket(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamSetTimestamp
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	timestamp - (RTP) timestamp of the first frame of the next packet to be sent
+ *
+ * Remarks:
+ * Used to align the timestamps of multiple RTP Streams playing the same audio. Should be set before any packet is sent.
+ */
+void rtpStreamSetTimestamp(RTPStream *rtpStream, uint32_t timestamp);
+
+/*
+ * Function: rtpStreamSetEncryption
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	key - AES key (AES_KEY_SIZE bytes) as announced to the AirTunes device
+ *	iv - AES initialization vector (AES_IV_SIZE bytes) as announced to the AirTunes device
+ * Returns: a boolean specifying if encryption is set successfully
+ *
+ * Remarks:
+ * From now on the payload of every packet is encrypted (AES-128 in CBC mode, see aesCipherEncrypt) before it is sent.
+ * The payload is encrypted into a buffer of the RTP Stream (allocated here), so the payload of the caller is not
+ * changed and no memory is allocated while streaming. Should be set before any packet is sent.
+ */
+bool rtpStreamSetEncryption(RTPStream *rtpStream, const uint8_t *key, const uint8_t *iv);
+
+/*
+ * Function: rtpStreamGetEncryptionImplementation
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: name of the AES implementation used for encrypting (see aesCipherGetImplementation), NULL if not encrypted
+ */
+const char *rtpStreamGetEncryptionImplementation(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamLockMemory
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: a boolean specifying if all buffers used while streaming are locked successfully
+ *
+ * Remarks:
+ * Locks the buffer for resending packets and the buffer for the encrypted payload in memory, so sending a packet never
+ * waits for a page. Buffers (re)allocated afterwards are locked as well. A buffer which cannot be locked (for example
+ * because of RLIMIT_MEMLOCK) is used unlocked, a warning is logged.
+ */
+bool rtpStreamLockMemory(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamRestart
+ * Parameters:
+ *	rtpStream - already connected RTP Stream (see rtpStreamConnect)
+ *	maxPayloadSize - size (in bytes) of the largest payload which will be sent from now on
+ * Returns: a boolean specifying if the RTP Stream is restarted successfully
+ *
+ * Remarks:
+ * The next packet is sent as the first packet of the stream (for the UDP transport it is marked and preceded by an
+ * initial sync packet). Used after the AirTunes device is flushed, to continue with other audio on the same connection.
+ * Packets sent before the restart are not resent anymore.
+ */
+bool rtpStreamRestart(RTPStream *rtpStream, uint32_t maxPayloadSize);
+
+/*
+ * Function: rtpStreamGetSequenceNumber
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: the sequence number of the next packet to be sent
+ */
+uint16_t rtpStreamGetSequenceNumber(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamGetTimestamp
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: the (RTP) timestamp of the first frame of the next packet to be sent
+ */
+uint32_t rtpStreamGetTimestamp(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamSetReferenceTime
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	referenceTime - absolute time (CLOCK_MONOTONIC) at which the next packet to be sent is due
+ *
+ * Remarks:
+ * The reference time is used to calculate when packets are due (see rtpStreamGetPacketTime) and to fill in the sync packets.
+ */
+void rtpStreamSetReferenceTime(RTPStream *rtpStream, const struct timespec *referenceTime);
+
+/*
+ * Function: rtpStreamGetPacketTime
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	packetTime - absolute time (CLOCK_MONOTONIC) at which the next packet to be sent is due
+ */
+void rtpStreamGetPacketTime(RTPStream *rtpStream, struct timespec *packetTime);
+
+/*
+ * Function: rtpStreamSendPayload
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	payload - buffer containing the payload (not changed, so it can be shared between RTP Streams)
+ *	payloadSize - size (in bytes) of the payload (not larger than maxPayloadSize)
+ *	frameCount - number of frames in the payload
+ *	isSent - boolean specifying if the packet is sent completely
+ * Returns: a boolean specifying if sending did not fail
+ *
+ * Remarks:
+ * The RTP header is sent together with the payload and the sequence number and timestamp are incremented afterwards.
+ * Sending does not wait: if the audio connection cannot accept the (full) packet, isSent is false and the function
+ * should be called again with the same payload when the audio connection is writable. The payload should not be
+ * changed meanwhile.
+ * For the UDP transport a sync packet is sent on the control port before the first packet and every second afterwards.
+ * Also for the UDP transport a copy of the most recent packets is kept for answering resend requests of the AirTunes device.
+ * If encryption is set (see rtpStreamSetEncryption) the payload is encrypted once, when the packet is started.
+ */
+bool rtpStreamSendPayload(RTPStream *rtpStream, uint8_t *payload, uint32_t payloadSize, uint32_t frameCount, bool *isSent);
+
+/*
+ * Function: rtpStreamGetPlayingDrift
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: the drift (in ppm) of the rate at which the AirTunes device plays relative to the reference clock (0 if not known yet)
+ *
+ * Remarks:
+ * Only a TCP stream is paced by the AirTunes device. Its clock drift is measured from the frames drained by the audio
+ * connection, once the device has filled its buffer. With UDP the device follows the reference clock (using the sync
+ * packets), so 0 is returned. A positive drift means the device plays faster than the reference clock.
+ */
+int32_t rtpStreamGetPlayingDrift(RTPStream *rtpStream);
+
+/*
+ * Function: rtpStreamGetStatistics
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ *	statistics - statistics of packets sent (and resent) so far
+ */
+void rtpStreamGetStatistics(RTPStream *rtpStream, RTPStreamStatistics *statistics);
+
+/*
+ * Function: rtpStreamClose
+ * Parameters:
+ *	rtpStream - already created RTP Stream (as returned by rtpStreamCreate)
+ * Returns: a boolean specifying if the RTP Stream is closed successfully
+ *
+ * Remarks:
+ * This function will make the RTP Stream pointer NULL, so a closed stream cannot be reused.
+ */
+bool rtpStreamClose(RTPStream **rtpStream);
+
+#endif	/* __RTPSTREAM_H__ */
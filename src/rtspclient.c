@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stdio.h>
+#include <errno.h>
 #include "md5/md5.h"
 #include "rtspclient.h"
 #include "network.h"
@@ -40,6 +42,18 @@
 #define	DIGEST_STRING_SIZE		(DIGEST_SIZE + DIGEST_SIZE)
 #define	MAX_NUMBER_STRING_SIZE		11
 #define	MAX_HEXNUMBER_STRING_SIZE	9
+#define	MAX_TRANSPORT_STRING_SIZE	128
+#define	MAX_SESSION_FIELD_STRING_SIZE	(MAX_HEXNUMBER_STRING_SIZE + 11)	/* "Session: <hexnumber>\r\n" */
+#define	MAX_TRANSPORT_FIELD_STRING_SIZE	(MAX_TRANSPORT_STRING_SIZE + 13)	/* "Transport: <transport>\r\n" */
+#define	MAX_RTP_INFO_STRING_SIZE	32
+#define	MAX_PENDING_REQUESTS		4
+#define	MAX_CACHED_AUTHENTICATIONS	8
+#define	MAX_AUTHENTICATION_LINE_SIZE	(MAX_URL_STRING_SIZE + MAX_REALM_SIZE + MAX_NONCE_SIZE + 3)
+#define	AUTHENTICATION_FIELD_SEPARATOR	'\t'
+
+/* Header fields which do not change (formatted as sent) */
+#define	RANGE_FIELD_STRING		"Range: npt=0-\r\n"
+#define	RANGE_FIELD_STRING_SIZE		15
 
 /* Relevant RTSP Response values */
 #define RTSP_RESPONSE_LOW_BANDWIDTH		453
@@ -59,17 +73,47 @@ struct RTSPClientStruct {
 
 	/* Session information */
 	uint32_t sessionId;
+	char sessionField[MAX_SESSION_FIELD_STRING_SIZE];	/* Session header field (formatted once session is setup) */
+	size_t sessionFieldSize;
 	uint32_t sequenceNumber;
+	RTSPRequestMethod pendingRequestMethods[MAX_PENDING_REQUESTS];	/* Requests sent (in order), awaiting their response */
+	uint32_t pendingSequenceNumbers[MAX_PENDING_REQUESTS];
+	bool pendingAuthenticationRetries[MAX_PENDING_REQUESTS];	/* Request is resent with authentication (per pending request) */
+	int pendingRequestCount;
 	bool needAuthentication;
+	bool isAuthenticationRetry;		/* Next request sent is a resend with authentication */
 	char realm[MAX_REALM_SIZE];
 	uint32_t realmSize;
 	char nonce[MAX_NONCE_SIZE];
 	uint32_t nonceSize;
+	char ha1String[DIGEST_STRING_SIZE];	/* HA1 of Digest (computed once per realm and password) */
+	bool hasHA1;
+	bool isAuthenticationCached;
+
+	/* Audio stream information */
+	char transportField[MAX_TRANSPORT_FIELD_STRING_SIZE];	/* Transport header field (formatted when transport is set) */
+	size_t transportFieldSize;
+	uint16_t rtpSequenceNumber;
+	uint32_t rtpTimestamp;
 };
 
+/* Type definition for the authentication of a device (kept across sessions to authenticate right away) */
+typedef struct {
+	char url[MAX_URL_STRING_SIZE];	/* Identifies the device */
+	char realm[MAX_REALM_SIZE];
+	uint32_t realmSize;
+	char nonce[MAX_NONCE_SIZE];
+	uint32_t nonceSize;
+} AuthenticationCacheEntry;
+
 /* Logging component name */
 static const char *LOG_COMPONENT_NAME = "rtspclient.c";
 
+/* Authentication of devices accepted before (oldest entry is replaced when full) */
+static AuthenticationCacheEntry authenticationCache[MAX_CACHED_AUTHENTICATIONS];
+static int authenticationCacheCount = 0;
+static int authenticationCacheNextIndex = 0;
+
 /* Type definition for header field suppliers */
 typedef struct {
 	RTSPRequestMethod requestMethod;
@@ -77,11 +121,14 @@ typedef struct {
 } HeaderFieldsSupplier;
 
 /* Declare internal functions */
-static bool rtspClientSendRequest(RTSPClient *rtspClient, RTSPRequestMethod requestMethod, RAOPClient *raopClient, bool (*raopClientContentSupplier)(RAOPClient *raopClient, RTSPRequest *rtspRequest));
+static void rtspClientRestoreAuthentication(RTSPClient *rtspClient);
+static void rtspClientCacheAuthentication(RTSPClient *rtspClient);
+static void rtspClientDigestToString(uint8_t *digest, char *digestString);
 static bool rtspClientAddAuthenticationFields(RTSPClient *rtspClient);
+static bool rtspClientParseAuthentication(char *line, AuthenticationCacheEntry *entry);
 static bool rtspClientAddHeaderFields(RTSPClient *rtspClient, RTSPRequestMethod requestMethod);
-static bool rtspClientReceiveResponse(RTSPClient *rtspClient);
 static bool rtspClientClientGeneralHeaderFieldsSupplier(RTSPClient *rtspClient);
+static bool rtspClientRTPInfoHeaderFieldsSupplier(RTSPClient *rtspClient);
 static bool rtspClientOptionsHeaderFieldsSupplier(RTSPClient *rtspClient);
 static bool rtspClientAnnounceHeaderFieldsSupplier(RTSPClient *rtspClient);
 static bool rtspClientSetupHeaderFieldsSupplier(RTSPClient *rtspClient);
@@ -110,9 +157,11 @@ RTSPClient *rtspClientOpenConnection(const char *hostName, const char *portName,
 		return NULL;
 	}
 
-	/* Initialize request/response */
+	/* Initialize request/response (and other resources which are freed when closing) */
 	rtspClient->rtspRequest = NULL;
 	rtspClient->rtspResponse = NULL;
+	rtspClient->url = NULL;
+	rtspClient->password = NULL;
 
 	/* Open the TCP connection */
 	rtspClient->networkConnection = networkOpenConnection(hostName, portName, TCP_CONNECTION, true);
@@ -122,6 +171,12 @@ RTSPClient *rtspClientOpenConnection(const char *hostName, const char *portName,
 		return NULL;
 	}
 
+	/* Send pipelined requests right away (instead of waiting for the acknowledgement of the previous request) */
+	if(!networkSetNoDelay(rtspClient->networkConnection)) {
+		rtspClientCloseConnection(&rtspClient);
+		return NULL;
+	}
+
 	/* Set client URL */
 	if(!bufferAllocate(&rtspClient->url, MAX_URL_STRING_SIZE, "URL for RTSP client")) {
 		rtspClientCloseConnection(&rtspClient);
@@ -145,94 +200,91 @@ RTSPClient *rtspClientOpenConnection(const char *hostName, const char *portName,
 
 	/* Initialize session information */
 	rtspClient->sessionId = 0;
+	rtspClient->sessionFieldSize = 0;
 	rtspClient->sequenceNumber = 0;	/* Will be increased before first send */
+	rtspClient->pendingRequestCount = 0;
 	rtspClient->needAuthentication = false;
+	rtspClient->isAuthenticationRetry = false;
 	rtspClient->realmSize = 0;
 	rtspClient->nonceSize = 0;
+	rtspClient->hasHA1 = false;
+	rtspClient->isAuthenticationCached = false;
 
-	return rtspClient;
-}
-
-bool rtspClientGetLocalAddressName(RTSPClient *rtspClient, char *addressName, int maxAddressNameSize) {
-        return networkGetLocalAddressName(rtspClient->networkConnection, addressName, maxAddressNameSize);
-}
-
-bool rtspClientGetRemoteAddressName(RTSPClient *rtspClient, char *addressName, int maxAddressNameSize) {
-        return networkGetRemoteAddressName(rtspClient->networkConnection, addressName, maxAddressNameSize);
-}
-
-bool rtspClientSendCommand(RTSPClient *rtspClient, RTSPRequestMethod requestMethod, RAOPClient *raopClient, bool (*raopClientContentSupplier)(RAOPClient *raopClient, RTSPRequest *rtspRequest)) {
-	uint32_t uint32Value;
-	int16_t int16Value;
-
-	/* Send request */
-	if(!rtspClientSendRequest(rtspClient, requestMethod, raopClient, raopClientContentSupplier)) {
-		return false;
+	/* Authenticate right away if the device required authentication in an earlier session */
+	if(rtspClient->password != NULL) {
+		rtspClientRestoreAuthentication(rtspClient);
 	}
 
-	/* Receive response (check returned status code) */
-	if(!rtspClientReceiveResponse(rtspClient)) {
-		return false;
-	}
+	/* Initialize audio stream information */
+	rtspClientSetTransport(rtspClient, RTSP_CLIENT_DEFAULT_TRANSPORT);
+	rtspClient->rtpSequenceNumber = 0;
+	rtspClient->rtpTimestamp = 0;
 
-	/* Repeat request/response if authentication is required */
-	if(rtspClient->needAuthentication) {
-		
-		/* If no password is present, fail */
-		if(rtspClient->password == NULL) {
-			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "No password specified, but a password is required.");
-			return false;
-		}
+	return rtspClient;
+}
 
-		/* Send request */
-		if(!rtspClientSendRequest(rtspClient, requestMethod, raopClient, raopClientContentSupplier)) {
-			return false;
-		}
+bool rtspClientReconnect(RTSPClient *rtspClient) {
 
-		/* Receive response (check returned status code) */
-		if(!rtspClientReceiveResponse(rtspClient)) {
+	/* Forget requests and session of the lost connection (authentication is kept) */
+	rtspClient->sessionId = 0;
+	rtspClient->sessionFieldSize = 0;
+	rtspClient->pendingRequestCount = 0;
+	rtspClient->needAuthentication = false;
+	rtspClient->isAuthenticationRetry = false;
+	if(rtspClient->rtspResponse != NULL) {
+		if(!rtspResponseFree(&rtspClient->rtspResponse)) {
 			return false;
 		}
+	}
 
-		/* Still need authentication? */
-		if(rtspClient->needAuthentication) {
-			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Invalid password specified.");
-			return false;
-		}
+	/* Start connecting to the address of the lost connection */
+	return networkReconnect(rtspClient->networkConnection);
+}
 
+bool rtspClientFinishConnect(RTSPClient *rtspClient) {
+	if(!networkFinishConnect(rtspClient->networkConnection)) {
+		return false;
 	}
 
-	/* Check CSeq in response (should always be present) */
-	if(!rtspResponseGetSequenceNumber(rtspClient->rtspResponse, &uint32Value)) {
+	/* Send pipelined requests right away (see rtspClientOpenConnection) */
+	return networkSetNoDelay(rtspClient->networkConnection);
+}
+
+bool rtspClientSetTransport(RTSPClient *rtspClient, const char *transport) {
+	if(strlen(transport) >= MAX_TRANSPORT_STRING_SIZE) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Transport value \"%s\" is too long.", transport);
 		return false;
 	}
-	if(uint32Value != rtspClient->sequenceNumber) {
-		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "The CSeq value read from RTSP response (%" PRIu32 ") is unequal to send CSeq value (%" PRIu32 ")", uint32Value, rtspClient->sequenceNumber);
-	}
+	rtspClient->transportFieldSize = sprintf(rtspClient->transportField, "Transport: %s\r\n", transport);
 
-	/* Check method specific content */
-	if(requestMethod == RTSP_METHOD_SETUP) {
+	return true;
+}
 
-		/* Check Session */
-		if(!rtspResponseGetSession(rtspClient->rtspResponse, &uint32Value)) {
-			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Response for SETUP command did not provide a valid value for \"Session\"");
-			return false;
-		}
-		rtspClient->sessionId = uint32Value;
+void rtspClientSetRTPInfo(RTSPClient *rtspClient, uint16_t sequenceNumber, uint32_t timestamp) {
+	rtspClient->rtpSequenceNumber = sequenceNumber;
+	rtspClient->rtpTimestamp = timestamp;
+}
 
-		/* Check Transport:server_port */
-		if(!rtspResponseGetServerPort(rtspClient->rtspResponse, &int16Value)) {
-			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Response for SETUP command did not provide a valid value for \"Transport:server_port\"");
-			return false;
-		}
-		raopClientSetAudioPort(raopClient, int16Value);
-	}
+int rtspClientGetDescriptor(RTSPClient *rtspClient) {
+	return networkGetDescriptor(rtspClient->networkConnection);
+}
 
-	return true;
+bool rtspClientGetLocalAddressName(RTSPClient *rtspClient, char *addressName, int maxAddressNameSize) {
+        return networkGetLocalAddressName(rtspClient->networkConnection, addressName, maxAddressNameSize);
+}
+
+bool rtspClientGetRemoteAddressName(RTSPClient *rtspClient, char *addressName, int maxAddressNameSize) {
+        return networkGetRemoteAddressName(rtspClient->networkConnection, addressName, maxAddressNameSize);
 }
 
 bool rtspClientSendRequest(RTSPClient *rtspClient, RTSPRequestMethod requestMethod, RAOPClient *raopClient, bool (*raopClientContentSupplier)(RAOPClient *raopClient, RTSPRequest *rtspRequest)) {
 
+	/* Validate number of pipelined requests */
+	if(rtspClient->pendingRequestCount == MAX_PENDING_REQUESTS) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot send RTSP request, too many requests are awaiting their response");
+		return false;
+	}
+
 	/* Create or reset RTSP request */
 	if(rtspClient->rtspRequest == NULL) {
 		rtspClient->rtspRequest = rtspRequestCreate(requestMethod);
@@ -262,41 +314,104 @@ bool rtspClientSendRequest(RTSPClient *rtspClient, RTSPRequestMethod requestMeth
 		return false;
 	}
 
+	/* Keep request for matching its response */
+	rtspClient->pendingRequestMethods[rtspClient->pendingRequestCount] = requestMethod;
+	rtspClient->pendingSequenceNumbers[rtspClient->pendingRequestCount] = rtspClient->sequenceNumber;
+	rtspClient->pendingAuthenticationRetries[rtspClient->pendingRequestCount] = rtspClient->isAuthenticationRetry;
+	rtspClient->pendingRequestCount++;
+	rtspClient->isAuthenticationRetry = false;
+
 	return true;
 }
 
-/* TODO: change this into something more readable/maintainable */
+void rtspClientRestoreAuthentication(RTSPClient *rtspClient) {
+	int index;
+
+	/* Find device (by its url) */
+	index = 0;
+	while(index < authenticationCacheCount && strcmp(authenticationCache[index].url, rtspClient->url) != 0) {
+		index++;
+	}
+	if(index == authenticationCacheCount) {
+		return;
+	}
+
+	/* Copy authentication information (a stale nonce will be answered with a new challenge) */
+	memcpy(rtspClient->realm, authenticationCache[index].realm, authenticationCache[index].realmSize);
+	rtspClient->realmSize = authenticationCache[index].realmSize;
+	memcpy(rtspClient->nonce, authenticationCache[index].nonce, authenticationCache[index].nonceSize);
+	rtspClient->nonceSize = authenticationCache[index].nonceSize;
+	rtspClient->isAuthenticationCached = true;
+	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Using authentication of earlier session for %s", rtspClient->url);
+}
+
+void rtspClientCacheAuthentication(RTSPClient *rtspClient) {
+	int index;
+
+	/* Find device (by its url) or take a new (or the oldest) entry */
+	index = 0;
+	while(index < authenticationCacheCount && strcmp(authenticationCache[index].url, rtspClient->url) != 0) {
+		index++;
+	}
+	if(index == authenticationCacheCount) {
+		index = authenticationCacheNextIndex;
+		authenticationCacheNextIndex = (authenticationCacheNextIndex + 1) % MAX_CACHED_AUTHENTICATIONS;
+		if(authenticationCacheCount < MAX_CACHED_AUTHENTICATIONS) {
+			authenticationCacheCount++;
+		}
+		strcpy(authenticationCache[index].url, rtspClient->url);
+	}
+
+	/* Copy authentication information */
+	memcpy(authenticationCache[index].realm, rtspClient->realm, rtspClient->realmSize);
+	authenticationCache[index].realmSize = rtspClient->realmSize;
+	memcpy(authenticationCache[index].nonce, rtspClient->nonce, rtspClient->nonceSize);
+	authenticationCache[index].nonceSize = rtspClient->nonceSize;
+	rtspClient->isAuthenticationCached = true;
+}
+
+void rtspClientDigestToString(uint8_t *digest, char *digestString) {
+	static const char HEX_DIGITS[] = "0123456789ABCDEF";
+	int index;
+
+	/* Write digest as hex string (without '\0') */
+	for(index = 0; index < DIGEST_SIZE; index++) {
+		digestString[index * 2] = HEX_DIGITS[digest[index] >> 4];
+		digestString[index * 2 + 1] = HEX_DIGITS[digest[index] & 0x0f];
+	}
+}
+
 bool rtspClientAddAuthenticationFields(RTSPClient *rtspClient) {
 	MD5_CTX md5Context;
 	uint8_t ha1[DIGEST_SIZE];
-	char ha1String[DIGEST_STRING_SIZE];
 	uint8_t ha2[DIGEST_SIZE];
 	char ha2String[DIGEST_STRING_SIZE];
 	uint8_t response[DIGEST_SIZE];
 	char responseString[DIGEST_STRING_SIZE];
 	char authenticationValue[MAX_AUTHENTICATION_BUFFER_SIZE];
-	int index;
 
 	/* Get authentication information (from session or last response) */
 	if(rtspClient->realmSize == 0 || rtspClient->nonceSize == 0) {
 		if(!rtspResponseGetAuthenticationResponse(rtspClient->rtspResponse, rtspClient->realm, MAX_REALM_SIZE, &rtspClient->realmSize, rtspClient->nonce, MAX_NONCE_SIZE, &rtspClient->nonceSize)) {
 			return false;
 		}
+		rtspClient->hasHA1 = false;
 	}
 
 	/* Perform Digest algorithm: */
 	/* HA1 = MD5(username: realm : password); HA2 = MD5(method:digestURI); response = MD5(HA1:nonce:HA2); */ 
 
-	/* Create HA1 */
-	MD5_Init(&md5Context);
-	MD5_Update(&md5Context, "iTunes", 6);
-	MD5_Update(&md5Context, ":", 1);
-	MD5_Update(&md5Context, rtspClient->realm, rtspClient->realmSize);
-	MD5_Update(&md5Context, ":", 1);
-	MD5_Update(&md5Context, rtspClient->password, strlen(rtspClient->password));
-	MD5_Final(ha1, &md5Context);
-	for(index = 0; index < DIGEST_SIZE; index++) {
-		sprintf(&ha1String[index * 2], "%02X", (int)ha1[index]);
+	/* Create HA1 (only once, it does not depend on the request) */
+	if(!rtspClient->hasHA1) {
+		MD5_Init(&md5Context);
+		MD5_Update(&md5Context, "iTunes", 6);
+		MD5_Update(&md5Context, ":", 1);
+		MD5_Update(&md5Context, rtspClient->realm, rtspClient->realmSize);
+		MD5_Update(&md5Context, ":", 1);
+		MD5_Update(&md5Context, rtspClient->password, strlen(rtspClient->password));
+		MD5_Final(ha1, &md5Context);
+		rtspClientDigestToString(ha1, rtspClient->ha1String);
+		rtspClient->hasHA1 = true;
 	}
 
 	/* Create HA2 */
@@ -305,28 +420,24 @@ bool rtspClientAddAuthenticationFields(RTSPClient *rtspClient) {
 	MD5_Update(&md5Context, ":", 1);
 	MD5_Update(&md5Context, rtspClient->url, strlen(rtspClient->url));
 	MD5_Final(ha2, &md5Context);
-	for(index = 0; index < DIGEST_SIZE; index++) {
-		sprintf(&ha2String[index * 2], "%02X", (int)ha2[index]);
-	}
+	rtspClientDigestToString(ha2, ha2String);
 
 	/* Create response */
 	MD5_Init(&md5Context);
-	MD5_Update(&md5Context, ha1String, DIGEST_STRING_SIZE);
+	MD5_Update(&md5Context, rtspClient->ha1String, DIGEST_STRING_SIZE);
 	MD5_Update(&md5Context, ":", 1);
 	MD5_Update(&md5Context, rtspClient->nonce, rtspClient->nonceSize);
 	MD5_Update(&md5Context, ":", 1);
 	MD5_Update(&md5Context, ha2String, DIGEST_STRING_SIZE);
 	MD5_Final(response, &md5Context);
-	for(index = 0; index < DIGEST_SIZE; index++) {
-		sprintf(&responseString[index * 2], "%02X", (int)response[index]);
-	}
+	rtspClientDigestToString(response, responseString);
 
 	/* Add response */
 	snprintf(authenticationValue, MAX_AUTHENTICATION_BUFFER_SIZE, "Digest username=\"iTunes\", realm=\"%.*s\", nonce=\"%.*s\", uri=\"%s\", response=\"%.*s\"",
 		rtspClient->realmSize, rtspClient->realm,
 		rtspClient->nonceSize, rtspClient->nonce,
 		rtspClient->url,
-		32, responseString);
+		DIGEST_STRING_SIZE, responseString);
 	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "Authorization", authenticationValue)) {
 		return false;
 	}
@@ -376,6 +487,21 @@ bool rtspClientClientGeneralHeaderFieldsSupplier(RTSPClient *rtspClient) {
 	return true;
 }
 
+bool rtspClientRTPInfoHeaderFieldsSupplier(RTSPClient *rtspClient) {
+	char rtpInfoString[MAX_RTP_INFO_STRING_SIZE];
+
+	/* Add RTP-Info header field */
+	if(snprintf(rtpInfoString, MAX_RTP_INFO_STRING_SIZE, "seq=%" PRIu16 ";rtptime=%" PRIu32, rtspClient->rtpSequenceNumber, rtspClient->rtpTimestamp) < 1) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create string for RTP-Info field");
+		return false;
+	}
+	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "RTP-Info", rtpInfoString)) {
+		return false;
+	}
+
+	return true;
+}
+
 bool rtspClientOptionsHeaderFieldsSupplier(RTSPClient *rtspClient) {
 
 	/* Add general header fields */
@@ -404,7 +530,7 @@ bool rtspClientSetupHeaderFieldsSupplier(RTSPClient *rtspClient) {
 	}
 
 	/* Add SETUP specific header fields */
-	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "Transport", "RTP/AVP/TCP;unicast;interleaved=0-1;mode=record")) {
+	if(!rtspRequestAddHeaderFields(rtspClient->rtspRequest, rtspClient->transportField, rtspClient->transportFieldSize)) {
 		return false;
 	}
 
@@ -412,25 +538,19 @@ bool rtspClientSetupHeaderFieldsSupplier(RTSPClient *rtspClient) {
 }
 
 bool rtspClientRecordHeaderFieldsSupplier(RTSPClient *rtspClient) {
-	char sessionIdString[MAX_HEXNUMBER_STRING_SIZE];
-
 	/* Add general header fields */
 	if(!rtspClientClientGeneralHeaderFieldsSupplier(rtspClient)) {
 		return false;
 	}
 
 	/* Add RECORD specific header fields */
-	if(snprintf(sessionIdString, MAX_HEXNUMBER_STRING_SIZE, "%" PRIX32, rtspClient->sessionId) < 1) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create string for Session field");
+	if(!rtspRequestAddHeaderFields(rtspClient->rtspRequest, rtspClient->sessionField, rtspClient->sessionFieldSize)) {
 		return false;
 	}
-	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "Session", sessionIdString)) {
+	if(!rtspRequestAddHeaderFields(rtspClient->rtspRequest, RANGE_FIELD_STRING, RANGE_FIELD_STRING_SIZE)) {
 		return false;
 	}
-	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "Range", "npt=0-")) {
-		return false;
-	}
-	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "RTP-Info", "seq=0;rtptime=0")) {
+	if(!rtspClientRTPInfoHeaderFieldsSupplier(rtspClient)) {
 		return false;
 	}
 
@@ -448,22 +568,16 @@ bool rtspClientSetParameterHeaderFieldsSupplier(RTSPClient *rtspClient) {
 }
 
 bool rtspClientFlushHeaderFieldsSupplier(RTSPClient *rtspClient) {
-	char sessionIdString[MAX_HEXNUMBER_STRING_SIZE];
-
 	/* Add general header fields */
 	if(!rtspClientClientGeneralHeaderFieldsSupplier(rtspClient)) {
 		return false;
 	}
 
 	/* Add FLUSH specific header fields */
-	if(snprintf(sessionIdString, MAX_HEXNUMBER_STRING_SIZE, "%" PRIX32, rtspClient->sessionId) < 1) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create string for Session field");
-		return false;
-	}
-	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "Session", sessionIdString)) {
+	if(!rtspRequestAddHeaderFields(rtspClient->rtspRequest, rtspClient->sessionField, rtspClient->sessionFieldSize)) {
 		return false;
 	}
-	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "RTP-Info", "seq=0;rtptime=0")) {
+	if(!rtspClientRTPInfoHeaderFieldsSupplier(rtspClient)) {
 		return false;
 	}
 
@@ -471,27 +585,20 @@ bool rtspClientFlushHeaderFieldsSupplier(RTSPClient *rtspClient) {
 }
 
 bool rtspClientTeardownHeaderFieldsSupplier(RTSPClient *rtspClient) {
-	char sessionIdString[MAX_HEXNUMBER_STRING_SIZE];
-
 	/* Add general header fields */
 	if(!rtspClientClientGeneralHeaderFieldsSupplier(rtspClient)) {
 		return false;
 	}
 
 	/* Add TEARDOWN specific header fields */
-	if(snprintf(sessionIdString, MAX_HEXNUMBER_STRING_SIZE, "%" PRIX32, rtspClient->sessionId) < 1) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create string for Session field");
-		return false;
-	}
-	if(!rtspRequestAddHeaderField(rtspClient->rtspRequest, "Session", sessionIdString)) {
+	if(!rtspRequestAddHeaderFields(rtspClient->rtspRequest, rtspClient->sessionField, rtspClient->sessionFieldSize)) {
 		return false;
 	}
 
 	return true;
 }
 
-bool rtspClientReceiveResponse(RTSPClient *rtspClient) {
-	int16_t int16Value;
+bool rtspClientReceiveResponse(RTSPClient *rtspClient, bool *isComplete) {
 
 	/* Create RTSP Response if needed */
 	if(rtspClient->rtspResponse == NULL) {
@@ -501,12 +608,51 @@ bool rtspClientReceiveResponse(RTSPClient *rtspClient) {
 		}
 	}
 
-	/* Receive RTSP Response */
-	if(!rtspResponseReceive(rtspClient->rtspResponse, rtspClient->networkConnection)) {
+	/* Receive (part of) RTSP Response */
+	return rtspResponseReceive(rtspClient->rtspResponse, rtspClient->networkConnection, isComplete);
+}
+
+bool rtspClientIsNextResponseComplete(RTSPClient *rtspClient) {
+	return rtspClient->rtspResponse != NULL && rtspResponseIsNextComplete(rtspClient->rtspResponse);
+}
+
+bool rtspClientIsAwaitingResponse(RTSPClient *rtspClient) {
+	return rtspClient->pendingRequestCount > 0;
+}
+
+bool rtspClientHandleResponse(RTSPClient *rtspClient, RTSPRequestMethod *requestMethod, RAOPClient *raopClient, bool *needResend) {
+	uint32_t uint32Value;
+	uint16_t uint16Value;
+	int16_t int16Value;
+	int index;
+	bool isAuthenticationRetry;
+
+	/* Find request with the CSeq of the response (should always be present, otherwise assume the oldest request is answered) */
+	if(rtspClient->pendingRequestCount == 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP response received, but no request is awaiting its response");
+		return false;
+	}
+	uint32Value = rtspClient->pendingSequenceNumbers[0];
+	if(!rtspResponseGetSequenceNumber(rtspClient->rtspResponse, &uint32Value)) {
 		return false;
 	}
+	index = 0;
+	while(index < rtspClient->pendingRequestCount && rtspClient->pendingSequenceNumbers[index] != uint32Value) {
+		index++;
+	}
+	if(index == rtspClient->pendingRequestCount) {
+		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "The CSeq value read from RTSP response (%" PRIu32 ") is unequal to send CSeq value (%" PRIu32 ")", uint32Value, rtspClient->pendingSequenceNumbers[0]);
+		index = 0;
+	}
+	*requestMethod = rtspClient->pendingRequestMethods[index];
+	isAuthenticationRetry = rtspClient->pendingAuthenticationRetries[index];
+	rtspClient->pendingRequestCount--;
+	memmove(&rtspClient->pendingRequestMethods[index], &rtspClient->pendingRequestMethods[index + 1], (rtspClient->pendingRequestCount - index) * sizeof(RTSPRequestMethod));
+	memmove(&rtspClient->pendingSequenceNumbers[index], &rtspClient->pendingSequenceNumbers[index + 1], (rtspClient->pendingRequestCount - index) * sizeof(uint32_t));
+	memmove(&rtspClient->pendingAuthenticationRetries[index], &rtspClient->pendingAuthenticationRetries[index + 1], (rtspClient->pendingRequestCount - index) * sizeof(bool));
 
 	/* Check return code */
+	*needResend = false;
 	if(!rtspResponseGetStatus(rtspClient->rtspResponse, &int16Value)) {
 		return false;
 	}
@@ -520,12 +666,162 @@ bool rtspClientReceiveResponse(RTSPClient *rtspClient) {
 				return false;
 			}
 			rtspClient->needAuthentication = true;
+
+			/* Use the (new) challenge of this response when resending */
+			rtspClient->realmSize = 0;
+			rtspClient->nonceSize = 0;
+			rtspClient->isAuthenticationCached = false;
+		}
+	}
+
+	/* Repeat request if authentication is required */
+	if(rtspClient->needAuthentication) {
+
+		/* If no password is present, fail */
+		if(rtspClient->password == NULL) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "No password specified, but a password is required.");
+			return false;
+		}
+
+		/* Still need authentication after resending this request with authentication? */
+		if(isAuthenticationRetry) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Invalid password specified.");
+			return false;
 		}
+		rtspClient->isAuthenticationRetry = true;
+		*needResend = true;
+
+		return true;
+	}
+
+	/* Remember accepted authentication for next sessions with this device */
+	if(rtspClient->realmSize > 0 && !rtspClient->isAuthenticationCached) {
+		rtspClientCacheAuthentication(rtspClient);
 	}
 
+	/* Check method specific content */
+	if(*requestMethod == RTSP_METHOD_SETUP) {
+
+		/* Check Session */
+		if(!rtspResponseGetSession(rtspClient->rtspResponse, &uint32Value)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Response for SETUP command did not provide a valid value for \"Session\"");
+			return false;
+		}
+		rtspClient->sessionId = uint32Value;
+		rtspClient->sessionFieldSize = sprintf(rtspClient->sessionField, "Session: %" PRIX32 "\r\n", rtspClient->sessionId);
+
+		/* Check Transport:server_port */
+		if(!rtspResponseGetServerPort(rtspClient->rtspResponse, &uint16Value)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Response for SETUP command did not provide a valid value for \"Transport:server_port\"");
+			return false;
+		}
+		raopClientSetAudioPort(raopClient, uint16Value);
+
+		/* Check Transport:control_port and Transport:timing_port (only present for UDP transport) */
+		if(rtspResponseGetControlPort(rtspClient->rtspResponse, &uint16Value)) {
+			raopClientSetControlPort(raopClient, uint16Value);
+		}
+		if(rtspResponseGetTimingPort(rtspClient->rtspResponse, &uint16Value)) {
+			raopClientSetTimingPort(raopClient, uint16Value);
+		}
+	}
+
+	return true;
+}
+
+bool rtspClientLoadAuthentications(const char *fileName) {
+	FILE *file;
+	char line[MAX_AUTHENTICATION_LINE_SIZE + 2];	/* Including '\n' and '\0' */
+	AuthenticationCacheEntry entry;
+
+	/* Open file (it does not exist before the first save) */
+	file = fopen(fileName, "r");
+	if(file == NULL) {
+		if(errno == ENOENT) {
+			return true;
+		}
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open authentication file \"%s\" (errno = %d).", fileName, errno);
+		return false;
+	}
+
+	/* Read a device per line ("<url>\t<realm>\t<nonce>"), skipping invalid lines */
+	while(authenticationCacheCount < MAX_CACHED_AUTHENTICATIONS && fgets(line, sizeof(line), file) != NULL) {
+		if(rtspClientParseAuthentication(line, &entry)) {
+			authenticationCache[authenticationCacheCount] = entry;
+			authenticationCacheCount++;
+		} else {
+			logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "Invalid line in authentication file \"%s\" (skipping it).", fileName);
+		}
+	}
+	authenticationCacheNextIndex = authenticationCacheCount % MAX_CACHED_AUTHENTICATIONS;
+	fclose(file);
+
 	return true;
 }
 
+bool rtspClientParseAuthentication(char *line, AuthenticationCacheEntry *entry) {
+	char *fields[3];
+	size_t fieldSizes[3];
+	char *fieldEnd;
+	int index;
+
+	/* Split line in fields */
+	for(index = 0; index < 3; index++) {
+		fields[index] = line;
+		fieldEnd = strchr(line, index < 2 ? AUTHENTICATION_FIELD_SEPARATOR : '\n');
+		if(fieldEnd == NULL) {
+			return false;
+		}
+		fieldSizes[index] = fieldEnd - line;
+		line = fieldEnd + 1;
+	}
+
+	/* Copy fields */
+	if(fieldSizes[0] == 0 || fieldSizes[0] >= MAX_URL_STRING_SIZE || fieldSizes[1] == 0 || fieldSizes[1] > MAX_REALM_SIZE || fieldSizes[2] == 0 || fieldSizes[2] > MAX_NONCE_SIZE) {
+		return false;
+	}
+	memcpy(entry->url, fields[0], fieldSizes[0]);
+	entry->url[fieldSizes[0]] = '\0';
+	memcpy(entry->realm, fields[1], fieldSizes[1]);
+	entry->realmSize = fieldSizes[1];
+	memcpy(entry->nonce, fields[2], fieldSizes[2]);
+	entry->nonceSize = fieldSizes[2];
+
+	return true;
+}
+
+bool rtspClientSaveAuthentications(const char *fileName) {
+	FILE *file;
+	int index;
+	bool result;
+
+	/* Create file */
+	file = fopen(fileName, "w");
+	if(file == NULL) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot create authentication file \"%s\" (errno = %d).", fileName, errno);
+		return false;
+	}
+
+	/* Write a device per line */
+	result = true;
+	for(index = 0; index < authenticationCacheCount; index++) {
+		if(fprintf(file, "%s%c%.*s%c%.*s\n",
+			authenticationCache[index].url, AUTHENTICATION_FIELD_SEPARATOR,
+			(int)authenticationCache[index].realmSize, authenticationCache[index].realm, AUTHENTICATION_FIELD_SEPARATOR,
+			(int)authenticationCache[index].nonceSize, authenticationCache[index].nonce) < 0) {
+			result = false;
+		}
+	}
+	if(fclose(file) != 0) {
+		result = false;
+	}
+	if(!result) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot write authentication file \"%s\".", fileName);
+	}
+
+	return result;
+}
+
 bool rtspClientCloseConnection(RTSPClient **rtspClient) {
 	bool result;
 
@@ -29,6 +29,9 @@
 #include "rtsprequest.h"
 #include "rtspresponse.h"
 
+/* Default transport (audio over TCP), used for SETUP unless another transport is set */
+#define	RTSP_CLIENT_DEFAULT_TRANSPORT	"RTP/AVP/TCP;unicast;interleaved=0-1;mode=record"
+
 typedef struct RTSPClientStruct RTSPClient;
 
 /*
@@ -45,18 +48,120 @@ typedef struct RTSPClientStruct RTSPClient;
 RTSPClient *rtspClientOpenConnection(const char *hostName, const char *portName, const char *password);
 
 /*
- * Function: rtspClientSendCommand
+ * Function: rtspClientReconnect
+ * Parameters:
+ *      rtspClient - already open RTSP client connection (as returned by openConnection) whose connection is lost
+ * Returns: a boolean specifying if connecting is started successfully
+ *
+ * Remarks:
+ * The pending requests and the session are forgotten, the authentication is kept. A new connection to the address of the
+ * lost connection is started without waiting for it (see networkReconnect). Once the descriptor (see rtspClientGetDescriptor)
+ * becomes writable, rtspClientFinishConnect tells if the connection is made.
+ */
+bool rtspClientReconnect(RTSPClient *rtspClient);
+
+/*
+ * Function: rtspClientFinishConnect
+ * Parameters:
+ *      rtspClient - RTSP client connection being connected (see rtspClientReconnect)
+ * Returns: a boolean specifying if the connection is made
+ */
+bool rtspClientFinishConnect(RTSPClient *rtspClient);
+
+/*
+ * Function: rtspClientSendRequest
  * Parameters:
  *      rtspClient - already open RTSP client connection (as returned by openConnection)
  *      requestMethod - method of the command to send
  *	raopClient - RAOP client
  *	raopClientContentSupplier - content supplier (from RAOP client) for the command to send (might be NULL)
- * Returns: a boolean specifying if the command was sent successfully
+ * Returns: a boolean specifying if the request was sent successfully
+ *
+ * Remarks:
+ * If no special content is required, raopClientContentSupplier can be set to NULL. The request is sent without waiting
+ * for the response. The response should be received when the RTSP connection becomes readable (see rtspClientGetDescriptor
+ * and rtspClientReceiveResponse) and then handled by rtspClientHandleResponse. Independent requests can be pipelined:
+ * a request can be sent before the responses of the requests sent earlier are received (up to a small maximum of pending
+ * requests).
+ */
+bool rtspClientSendRequest(RTSPClient *rtspClient, RTSPRequestMethod requestMethod, RAOPClient *raopClient, bool (*raopClientContentSupplier)(RAOPClient *raopClient, RTSPRequest *rtspRequest));
+
+/*
+ * Function: rtspClientReceiveResponse
+ * Parameters:
+ *      rtspClient - already open RTSP client connection (as returned by openConnection)
+ *	isComplete - boolean specifying if the full response is received
+ * Returns: a boolean specifying if the response was received successfully
  *
  * Remarks:
- * If no special content is required, raopClientContentSupplier can be set to NULL.
+ * Only receives the data available on the RTSP connection, so it should be called (again) when the RTSP connection is
+ * readable, until the response is complete.
  */
-bool rtspClientSendCommand(RTSPClient *rtspClient, RTSPRequestMethod requestMethod, RAOPClient *raopClient, bool (*raopClientContentSupplier)(RAOPClient *raopClient, RTSPRequest *rtspRequest));
+bool rtspClientReceiveResponse(RTSPClient *rtspClient, bool *isComplete);
+
+/*
+ * Function: rtspClientIsNextResponseComplete
+ * Parameters:
+ *      rtspClient - already open RTSP client connection (as returned by openConnection)
+ * Returns: a boolean specifying if the next response is received already (together with the response just received)
+ *
+ * Remarks:
+ * Responses of pipelined requests might be received together. The RTSP connection does not become readable for the
+ * next response in that case, so it should be received (and handled) right after the current response.
+ */
+bool rtspClientIsNextResponseComplete(RTSPClient *rtspClient);
+
+/*
+ * Function: rtspClientIsAwaitingResponse
+ * Parameters:
+ *      rtspClient - already open RTSP client connection (as returned by openConnection)
+ * Returns: a boolean specifying if a response is still expected for one or more of the requests sent
+ */
+bool rtspClientIsAwaitingResponse(RTSPClient *rtspClient);
+
+/*
+ * Function: rtspClientHandleResponse
+ * Parameters:
+ *      rtspClient - already open RTSP client connection (as returned by openConnection)
+ *      requestMethod - method of the command the (complete) response belongs to
+ *	raopClient - RAOP client
+ *	needResend - boolean specifying if the request should be sent again (because authentication is required)
+ * Returns: a boolean specifying if the response is successful
+ *
+ * Remarks:
+ * The response is matched to the pending request with the same CSeq value, the method of this request is returned in
+ * requestMethod. For the SETUP command the ports of the AirTunes device are set in the RAOP client.
+ */
+bool rtspClientHandleResponse(RTSPClient *rtspClient, RTSPRequestMethod *requestMethod, RAOPClient *raopClient, bool *needResend);
+
+/*
+ * Function: rtspClientGetDescriptor
+ * Parameters:
+ *      rtspClient - already open RTSP client connection (as returned by openConnection)
+ * Returns: the descriptor of the (non-blocking) RTSP connection
+ */
+int rtspClientGetDescriptor(RTSPClient *rtspClient);
+
+/*
+ * Function: rtspClientSetTransport
+ * Parameters:
+ *      rtspClient - already open RTSP client connection (as returned by openConnection)
+ *      transport - value of the Transport header field sent with the SETUP command
+ * Returns: a boolean specifying if the transport was set successfully
+ */
+bool rtspClientSetTransport(RTSPClient *rtspClient, const char *transport);
+
+/*
+ * Function: rtspClientSetRTPInfo
+ * Parameters:
+ *      rtspClient - already open RTSP client connection (as returned by openConnection)
+ *      sequenceNumber - RTP sequence number of the first audio packet (to be) sent
+ *      timestamp - RTP timestamp of the first audio packet (to be) sent
+ *
+ * Remarks:
+ * The values are sent in the RTP-Info header field of the RECORD and FLUSH commands.
+ */
+void rtspClientSetRTPInfo(RTSPClient *rtspClient, uint16_t sequenceNumber, uint32_t timestamp);
 
 /*
  * Function: rtspClientGetLocalAddressName
@@ -78,6 +183,29 @@ bool rtspClientGetLocalAddressName(RTSPClient *rtspClient, char *addressName, in
  */
 bool rtspClientGetRemoteAddressName(RTSPClient *rtspClient, char *addressName, int maxAddressNameSize);
 
+/*
+ * Function: rtspClientLoadAuthentications
+ * Parameters:
+ *	fileName - name of file with authentication of devices (as written by rtspClientSaveAuthentications)
+ * Returns: a boolean specifying if the file was read successfully (a missing file is not a failure)
+ *
+ * Remarks:
+ * Devices which required authentication in an earlier run are sent their credentials right away (without first
+ * receiving a challenge). Should be called before opening connections.
+ */
+bool rtspClientLoadAuthentications(const char *fileName);
+
+/*
+ * Function: rtspClientSaveAuthentications
+ * Parameters:
+ *	fileName - name of file to write authentication of devices into
+ * Returns: a boolean specifying if the file was written successfully
+ *
+ * Remarks:
+ * The file contains the realm and nonce of the Digest authentication accepted per device (not the password).
+ */
+bool rtspClientSaveAuthentications(const char *fileName);
+
 /*
  * Function: rtspClientCloseConnection
  * Parameters:
@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include "rtsprequest.h"
 #include "log.h"
@@ -28,6 +29,8 @@
 /* Buffer size */
 #define	HEADER_BUFFER_INITIAL_SIZE	1024
 #define HEADER_BUFFER_INCREMENT_SIZE	512
+#define	CONTENT_BUFFER_INITIAL_SIZE	256
+#define	CONTENT_BUFFER_INCREMENT_SIZE	256
 
 /* Max length of a number */
 #define	MAX_NUMBER_STRING_SIZE		11
@@ -39,14 +42,24 @@
 #define MAX_EXTRA_URL_STRING_SIZE	10
 #define MAX_URL_STRING_SIZE		(MAX_ADDR_STRING_LENGTH + MAX_EXTRA_URL_STRING_SIZE)
 
+/* Size of command line ("<command> <url> RTSP/1.0\r\n" including '\0') */
+#define	MAX_COMMAND_LINE_STRING_SIZE	(MAX_COMMAND_STRING_SIZE + MAX_URL_STRING_SIZE + 13)
+
+/* Parts of a request when sending (command line, header fields, empty line and content) */
+#define	REQUEST_PART_COUNT		4
+#define	EMPTY_LINE_STRING		"\r\n"
+#define	EMPTY_LINE_STRING_SIZE		2
+
 /* Type definition for the RTSP request */
 struct RTSPRequestStruct {
 	RTSPRequestMethod requestMethod;
+	char commandBuffer[MAX_COMMAND_LINE_STRING_SIZE];
 	uint8_t *headerBuffer;
 	size_t headerBufferSize;
 	size_t maxHeaderBufferSize;
 	uint8_t *contentBuffer;
 	size_t contentBufferSize;
+	size_t maxContentBufferSize;
 };
 
 /* Names of methods */
@@ -63,6 +76,9 @@ char *METHOD_NAMES[] = {
 /* Logging component name */
 static const char *LOG_COMPONENT_NAME = "rtsprequest.c";
 
+/* Declare internal functions */
+static bool rtspRequestMakeHeaderRoom(RTSPRequest *rtspRequest, size_t requiredSize);
+
 RTSPRequest *rtspRequestCreate(RTSPRequestMethod requestMethod) {
 	RTSPRequest *rtspRequest;
 
@@ -78,6 +94,7 @@ RTSPRequest *rtspRequestCreate(RTSPRequestMethod requestMethod) {
 	rtspRequest->maxHeaderBufferSize = 0;
 	rtspRequest->contentBuffer = NULL;
 	rtspRequest->contentBufferSize = 0;
+	rtspRequest->maxContentBufferSize = 0;
 
 	return rtspRequest;
 }
@@ -102,77 +119,87 @@ const char *rtspRequestGetMethodName(RTSPRequest *rtspRequest) {
 }
 
 bool rtspRequestSend(RTSPRequest *rtspRequest, char *url, NetworkConnection *networkConnection) {
-	uint8_t *requestBuffer;
-	size_t maxRequestBufferSize;
+	struct iovec requestParts[REQUEST_PART_COUNT];
 	int charsWritten;
 
-	/* Create buffer for full request (optimizer will get rid of all the individual constants) */
-	maxRequestBufferSize = 12			/* "%s %s RTSP/1.0\r\n" printable characters */
-		+ MAX_COMMAND_STRING_SIZE		/* command (first "%s" above) */
-		+ MAX_URL_STRING_SIZE			/* url (second "%s" above) */
-		+ rtspRequest->headerBufferSize - 1	/* header (excluding the terminating '\0') */
-		+ 2					/* CR/LF */
-		+ rtspRequest->contentBufferSize;	/* content */
-	if(!bufferAllocate(&requestBuffer, maxRequestBufferSize, "RTSP request buffer")) {
-		return false;
-	}
-
-	/* Write command */
-	charsWritten = snprintf((char *)requestBuffer, maxRequestBufferSize, "%s %s RTSP/1.0\r\n", METHOD_NAMES[rtspRequest->requestMethod], rtspRequest->requestMethod == RTSP_METHOD_OPTIONS ? "*" : url);
-	if(charsWritten < 0) {
+	/* Write command (into the request itself, no buffer is allocated for sending) */
+	charsWritten = snprintf(rtspRequest->commandBuffer, MAX_COMMAND_LINE_STRING_SIZE, "%s %s RTSP/1.0\r\n", METHOD_NAMES[rtspRequest->requestMethod], rtspRequest->requestMethod == RTSP_METHOD_OPTIONS ? "*" : url);
+	if(charsWritten < 0 || charsWritten >= MAX_COMMAND_LINE_STRING_SIZE) {
 		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot write command to request buffer.");
-		bufferFree(&requestBuffer);
 		return false;
 	}
 
-	/* Validate if amount of buffer is still enough (see explanation above for the following calculation) */
-	if(charsWritten + rtspRequest->headerBufferSize - 1 + 2 + rtspRequest->contentBufferSize > maxRequestBufferSize) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Request buffer is not big enough to hold header and content.");
-		bufferFree(&requestBuffer);
+	/* Send command, header fields, header/content separator and content as a single message (without copying them together) */
+	requestParts[0].iov_base = rtspRequest->commandBuffer;
+	requestParts[0].iov_len = charsWritten;
+	requestParts[1].iov_base = rtspRequest->headerBuffer;
+	requestParts[1].iov_len = rtspRequest->headerBufferSize > 0 ? rtspRequest->headerBufferSize - 1 : 0;	/* No need for '\0' so -1 */
+	requestParts[2].iov_base = EMPTY_LINE_STRING;
+	requestParts[2].iov_len = EMPTY_LINE_STRING_SIZE;
+	requestParts[3].iov_base = rtspRequest->contentBuffer;
+	requestParts[3].iov_len = rtspRequest->contentBufferSize;
+	if(!networkSendMessageVector(networkConnection, requestParts, REQUEST_PART_COUNT)) {
 		return false;
 	}
 
-	/* Write header fields */
-	if(rtspRequest->headerBuffer != NULL) {
-		memcpy(requestBuffer + charsWritten, rtspRequest->headerBuffer, rtspRequest->headerBufferSize - 1);	/* No need for '\0' so -1 */
-		charsWritten += rtspRequest->headerBufferSize - 1;
-	}
+	/* Write info from this message */
+	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Sent out RTSP request:\n%.*s%.*s%s%.*s", charsWritten, rtspRequest->commandBuffer,
+		(int)(rtspRequest->headerBufferSize > 0 ? rtspRequest->headerBufferSize - 1 : 0), rtspRequest->headerBuffer != NULL ? (char *)rtspRequest->headerBuffer : "",
+		EMPTY_LINE_STRING,
+		(int)rtspRequest->contentBufferSize, rtspRequest->contentBuffer != NULL ? (char *)rtspRequest->contentBuffer : "");
 
-	/* Write header/content separator (length validation done above) */
-	requestBuffer[charsWritten] = '\r';
-	charsWritten++;
-	requestBuffer[charsWritten] = '\n';
-	charsWritten++;
+	return true;
+}
 
-	/* Write content */
-	if(rtspRequest->contentBuffer != NULL) {
-		memcpy(requestBuffer + charsWritten, rtspRequest->contentBuffer, rtspRequest->contentBufferSize);
-		charsWritten += rtspRequest->contentBufferSize;
-	}
+bool rtspRequestAddHeaderField(RTSPRequest *rtspRequest, const char *fieldName, const char *fieldValue) {
+	size_t fieldNameLength;
+	size_t fieldValueLength;
+	uint8_t *field;
 
-	/* Send out request */
-	if(!networkSendMessage(networkConnection, requestBuffer, charsWritten)) {
-		bufferFree(&requestBuffer);
+	/* Make room for field name and value. Add 4 bytes for ": " and "\r\n". */
+	fieldNameLength = strlen(fieldName);
+	fieldValueLength = strlen(fieldValue);
+	if(!rtspRequestMakeHeaderRoom(rtspRequest, fieldNameLength + fieldValueLength + 4)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot allocate memory to add field \"%s\" to RTSP Request header.", fieldName);
 		return false;
 	}
 
-	/* Write info from this message */
-	logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Sent out RTSP request:\n%.*s", charsWritten, requestBuffer);
+	/* Add field name and value to buffer */
+	/* Offset (headerBufferSize - 1) to overwrite existing '\0' byte. A new '\0' byte will be added at the end. */
+	field = rtspRequest->headerBuffer + rtspRequest->headerBufferSize - 1;
+	memcpy(field, fieldName, fieldNameLength);
+	field += fieldNameLength;
+	memcpy(field, ": ", 2);
+	field += 2;
+	memcpy(field, fieldValue, fieldValueLength);
+	field += fieldValueLength;
+	memcpy(field, "\r\n", 3);	/* Including '\0' */
 
-	/* Free up resources */
-	if(!bufferFree(&requestBuffer)) {
+	/* Update buffer data */
+	rtspRequest->headerBufferSize += fieldNameLength + fieldValueLength + 4;
+
+	return true;
+}
+
+bool rtspRequestAddHeaderFields(RTSPRequest *rtspRequest, const char *headerFields, size_t headerFieldsSize) {
+
+	/* Make room for the header fields */
+	if(!rtspRequestMakeHeaderRoom(rtspRequest, headerFieldsSize)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot allocate memory to add fields \"%.*s\" to RTSP Request header.", (int)headerFieldsSize, headerFields);
 		return false;
 	}
 
+	/* Add header fields to buffer (overwriting existing '\0' byte and adding a new one) */
+	memcpy(rtspRequest->headerBuffer + rtspRequest->headerBufferSize - 1, headerFields, headerFieldsSize);
+	rtspRequest->headerBufferSize += headerFieldsSize;
+	rtspRequest->headerBuffer[rtspRequest->headerBufferSize - 1] = '\0';
+
 	return true;
 }
 
-bool rtspRequestAddHeaderField(RTSPRequest *rtspRequest, const char *fieldName, const char *fieldValue) {
-	size_t fieldNameLength;
-	size_t fieldValueLength;
-	int charsWritten;
+bool rtspRequestMakeHeaderRoom(RTSPRequest *rtspRequest, size_t requiredSize) {
 
-	/* Allocate initial buffer if required */
+	/* Allocate initial buffer if required (the buffer is kept for all requests) */
 	if(rtspRequest->headerBuffer == NULL) {
 		rtspRequest->maxHeaderBufferSize = HEADER_BUFFER_INITIAL_SIZE;
 		if(!bufferAllocate(&rtspRequest->headerBuffer, rtspRequest->maxHeaderBufferSize, "RTSP request header buffer")) {
@@ -182,28 +209,13 @@ bool rtspRequestAddHeaderField(RTSPRequest *rtspRequest, const char *fieldName,
 		rtspRequest->headerBufferSize = 1;	/* The '\0' byte */
 	}
 
-	/* Decide if enough space is available in buffer and add space if necessary. Add 4 bytes for ": " and "\r\n". */
-	fieldNameLength = strlen(fieldName);
-	fieldValueLength = strlen(fieldValue);
-	if(!bufferMakeRoom(&rtspRequest->headerBuffer, &rtspRequest->maxHeaderBufferSize, rtspRequest->headerBufferSize, fieldNameLength + fieldValueLength + 4, HEADER_BUFFER_INCREMENT_SIZE)) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot allocate memory to add field \"%s\" to RTSP Request header.", fieldName);
+	/* Decide if enough space is available in buffer and add space if necessary */
+	if(!bufferMakeRoom(&rtspRequest->headerBuffer, &rtspRequest->maxHeaderBufferSize, rtspRequest->headerBufferSize, requiredSize, HEADER_BUFFER_INCREMENT_SIZE)) {
 		bufferFree(&rtspRequest->headerBuffer);
-		rtspRequest->headerBuffer = NULL;
 		rtspRequest->headerBufferSize = 0;
 		return false;
 	}
 
-	/* Add field name and value to buffer */
-	/* Offet (headerBufferSize - 1) to overwrite existing '\0' byte. A new '\0' byte will be added at the end. */
-	charsWritten = snprintf((char *)rtspRequest->headerBuffer + rtspRequest->headerBufferSize - 1, rtspRequest->maxHeaderBufferSize - (rtspRequest->headerBufferSize - 1), "%s: %s\r\n", fieldName, fieldValue);
-	if(charsWritten != fieldNameLength + fieldValueLength + 4) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot add field \"%s\" to RTSP Request header.", fieldName);
-		return false;
-	}
-
-	/* Update buffer data */
-	rtspRequest->headerBufferSize += charsWritten;
-
 	return true;
 }
 
@@ -221,15 +233,15 @@ bool rtspRequestSetContent(RTSPRequest *rtspRequest, uint8_t *content, size_t co
 		return false;
 	}
 
-	/* Free any existing buffer */
-	if(rtspRequest->contentBuffer != NULL) {
-		if(!bufferFree(&rtspRequest->contentBuffer)) {
+	/* Allocate buffer if required (the buffer is kept for all requests) */
+	if(rtspRequest->contentBuffer == NULL) {
+		rtspRequest->maxContentBufferSize = CONTENT_BUFFER_INITIAL_SIZE;
+		if(!bufferAllocate(&rtspRequest->contentBuffer, rtspRequest->maxContentBufferSize, "RTSP request content buffer")) {
 			return false;
 		}
 	}
-
-	/* Allocate buffer */
-	if(!bufferAllocate(&rtspRequest->contentBuffer, contentSize, "RTSP request content buffer")) {
+	if(!bufferMakeRoom(&rtspRequest->contentBuffer, &rtspRequest->maxContentBufferSize, 0, contentSize, CONTENT_BUFFER_INCREMENT_SIZE)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot allocate memory for content of RTSP Request.");
 		return false;
 	}
 
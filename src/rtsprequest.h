@@ -72,6 +72,9 @@ const char *rtspRequestGetMethodName(RTSPRequest *rtspRequest);
  *	url - URL parameter of request
  *	networkConnection - network-connection the request-message is sent over
  * Returns: a boolean specifying if the message is sent successfully
+ *
+ * Remarks:
+ * The command line, header fields and content are sent as a single message without copying them into a separate buffer.
  */
 bool rtspRequestSend(RTSPRequest *rtspRequest, char *url, NetworkConnection *networkConnection);
 
@@ -85,6 +88,19 @@ bool rtspRequestSend(RTSPRequest *rtspRequest, char *url, NetworkConnection *net
  */
 bool rtspRequestAddHeaderField(RTSPRequest *rtspRequest, const char *fieldName, const char *fieldValue);
 
+/*
+ * Function: rtspRequestAddHeaderFields
+ * Parameters:
+ *	rtspRequest - already created RTSP Request (as returned by rtspRequestCreate)
+ *	headerFields - header fields already formatted (each as "<name>: <value>\r\n")
+ *	headerFieldsSize - size of the formatted header fields (as number of characters, no '\0' needed)
+ * Returns: a boolean specifying if the header fields are added successfully
+ *
+ * Remarks:
+ * Useful for header fields which do not change between requests, these can be formatted once.
+ */
+bool rtspRequestAddHeaderFields(RTSPRequest *rtspRequest, const char *headerFields, size_t headerFieldsSize);
+
 /*
  * Function: rtspRequestSetContent
  * Parameters:
@@ -93,6 +109,9 @@ bool rtspRequestAddHeaderField(RTSPRequest *rtspRequest, const char *fieldName,
  *      contentSize - size of the content (as number of bytes)
  *      contentType - type of content as MIME-type
  * Returns: a boolean specifying if the content is set successfully
+ *
+ * Remarks:
+ * The content is copied into a buffer which is kept for subsequent requests (see rtspRequestReset).
  */
 bool rtspRequestSetContent(RTSPRequest *rtspRequest, uint8_t *content, size_t contentSize, char *contentType);
 
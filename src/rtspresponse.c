@@ -20,8 +20,8 @@
  */
 
 #include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include "rtspresponse.h"
 #include "log.h"
@@ -30,26 +30,75 @@
 /* Buffer size */
 #define	RESPONSE_BUFFER_INITIAL_SIZE	1024
 #define RESPONSE_BUFFER_INCREMENT_SIZE	512
+#define	MAX_RESPONSE_SIZE		65536
 
 /* Characters and strings in response */
 #define	NEWLINE_CHARACTER		((uint8_t)'\n')
+#define	RETURN_CHARACTER		((uint8_t)'\r')
+#define	SPACE_CHARACTER			((uint8_t)' ')
+#define	TAB_CHARACTER			((uint8_t)'\t')
+#define	KEY_SEPARATOR_CHARACTER		((uint8_t)':')
 #define	SUBKEY_SEPARATOR_CHARACTER	((uint8_t)';')
-#define SUBKEY_ASSIGNMENT_STRING	((uint8_t *)"=")
-#define SUBKEY_ASSIGNMENT_STRING_SIZE	1
-#define KEY_SEPARATOR_STRING		((uint8_t *)": ")
-#define KEY_SEPARATOR_STRING_SIZE	2
+#define	SUBKEY_ASSIGNMENT_CHARACTER	((uint8_t)'=')
+#define	HEADER_END_STRING		((uint8_t *)"\r\n\r\n")
+#define	HEADER_END_STRING_SIZE		4
+#define	STATUS_PREFIX_SIZE		9	/* "RTSP/<digit>.<digit><space>" */
+#define	MAX_STATUS_VALUE		999
+
+/* Header fields used from a response (other fields are skipped when parsing the header) */
+typedef enum {
+	RTSP_RESPONSE_FIELD_CSEQ = 0,
+	RTSP_RESPONSE_FIELD_SESSION = 1,
+	RTSP_RESPONSE_FIELD_TRANSPORT = 2,
+	RTSP_RESPONSE_FIELD_WWW_AUTHENTICATE = 3,
+	RTSP_RESPONSE_FIELD_CONTENT_LENGTH = 4,
+	RTSP_RESPONSE_FIELD_COUNT = 5
+} RTSPResponseField;
+
+/* Names of the header fields used (in order of RTSPResponseField, compared case insensitive) */
+static const char *headerFieldNames[RTSP_RESPONSE_FIELD_COUNT] = {
+	"CSeq",
+	"Session",
+	"Transport",
+	"WWW-Authenticate",
+	"Content-Length"
+};
+
+/* Type definition for the location of a header field value (within the response buffer) */
+typedef struct {
+	size_t valueOffset;
+	size_t valueSize;
+	bool isPresent;
+} RTSPResponseFieldValue;
+
+/* Type definition for the framing of a response (header ending with an empty line, followed by Content-Length bytes) */
+typedef struct {
+	size_t scannedSize;		/* Bytes checked for the end of the header */
+	size_t headerSize;		/* Size of header including the empty line (0 if not received completely) */
+	size_t contentLength;
+	int16_t status;
+	RTSPResponseFieldValue fieldValues[RTSP_RESPONSE_FIELD_COUNT];	/* Parsed once when the header is received */
+} RTSPResponseFrame;
 
 /* Type definition for the RTSP request */
 struct RTSPResponseStruct {
 	uint8_t *responseBuffer;
 	size_t responseBufferSize;
 	size_t maxResponseBufferSize;
+	size_t nextResponseSize;	/* Bytes received after the complete response (start of next response) */
+	RTSPResponseFrame frame;
+	bool isComplete;
 };
 
 /* Logging component name */
 static const char *LOG_COMPONENT_NAME = "rtspresponse.c";
 
-static uint8_t *rtspResponseFindValueForKey(RTSPResponse *rtspResponse, const char *key, const char *subkey);
+static bool rtspResponseGetTransportPort(RTSPResponse *rtspResponse, const char *portName, uint16_t *port);
+static void rtspResponseInitializeFrame(RTSPResponseFrame *frame);
+static bool rtspResponseFindFrame(uint8_t *buffer, size_t bufferSize, RTSPResponseFrame *frame, bool *isComplete);
+static bool rtspResponseParseHeader(uint8_t *buffer, RTSPResponseFrame *frame);
+static bool rtspResponseParseNumber(uint8_t *value, size_t valueSize, int base, uint32_t maxNumber, uint32_t *number);
+static bool rtspResponseGetFieldValue(RTSPResponse *rtspResponse, RTSPResponseField field, uint8_t **value, size_t *valueSize);
 
 RTSPResponse *rtspResponseCreate() {
 	RTSPResponse *rtspResponse;
@@ -63,12 +112,17 @@ RTSPResponse *rtspResponseCreate() {
 	rtspResponse->responseBuffer = NULL;
 	rtspResponse->responseBufferSize = 0;
 	rtspResponse->maxResponseBufferSize = 0;
+	rtspResponse->nextResponseSize = 0;
+	rtspResponseInitializeFrame(&rtspResponse->frame);
+	rtspResponse->isComplete = false;
 
 	return rtspResponse;
 }
 
-bool rtspResponseReceive(RTSPResponse *rtspResponse, NetworkConnection *networkConnection) {
+bool rtspResponseReceive(RTSPResponse *rtspResponse, NetworkConnection *networkConnection, bool *isComplete) {
 	size_t receivedMessageSize;
+	size_t requiredSize;
+	size_t responseSize;
 
 	/* Allocate buffer (if needed) */
 	if(rtspResponse->responseBuffer == NULL) {
@@ -77,25 +131,58 @@ bool rtspResponseReceive(RTSPResponse *rtspResponse, NetworkConnection *networkC
 			return false;
 		}
 	}
-	rtspResponse->responseBufferSize = 0;
 
-	/* Receive messages (multiple if initial buffer was not big enough) */
-	do {
-		if(!bufferMakeRoom(&rtspResponse->responseBuffer, &rtspResponse->maxResponseBufferSize, rtspResponse->responseBufferSize, RESPONSE_BUFFER_INCREMENT_SIZE, RESPONSE_BUFFER_INCREMENT_SIZE)) {
+	/* Start a new response if the previous one is complete (keeping the part of the next response received already) */
+	if(rtspResponse->isComplete) {
+		memmove(rtspResponse->responseBuffer, rtspResponse->responseBuffer + rtspResponse->responseBufferSize, rtspResponse->nextResponseSize);
+		rtspResponse->responseBufferSize = rtspResponse->nextResponseSize;
+		rtspResponse->nextResponseSize = 0;
+		rtspResponse->isComplete = false;
+		rtspResponseInitializeFrame(&rtspResponse->frame);
+	}
+
+	/* Receive the data available (a response might arrive in multiple parts), unless it was received together with the previous response */
+	if(!rtspResponseFindFrame(rtspResponse->responseBuffer, rtspResponse->responseBufferSize, &rtspResponse->frame, &rtspResponse->isComplete)) {
+		return false;
+	}
+	if(!rtspResponse->isComplete) {
+
+		/* Make room for the full content once its length is known (to receive it without growing the buffer repeatedly) */
+		if(rtspResponse->frame.headerSize > 0) {
+			requiredSize = rtspResponse->frame.headerSize + rtspResponse->frame.contentLength - rtspResponse->responseBufferSize;
+		} else {
+			requiredSize = RESPONSE_BUFFER_INCREMENT_SIZE;
+		}
+		if(!bufferMakeRoom(&rtspResponse->responseBuffer, &rtspResponse->maxResponseBufferSize, rtspResponse->responseBufferSize, requiredSize, RESPONSE_BUFFER_INCREMENT_SIZE)) {
 			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot allocate memory to add extra content to receive message.");
 			bufferFree(&rtspResponse->responseBuffer);
 			rtspResponse->responseBufferSize = 0;
 			return false;
 		}
-		if(!networkReceiveMessage(networkConnection, rtspResponse->responseBuffer + rtspResponse->responseBufferSize, rtspResponse->maxResponseBufferSize, &receivedMessageSize)) {
+		if(!networkReceiveMessage(networkConnection, rtspResponse->responseBuffer + rtspResponse->responseBufferSize, rtspResponse->maxResponseBufferSize - rtspResponse->responseBufferSize, &receivedMessageSize)) {
+			return false;
+		}
+		if(receivedMessageSize == 0) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Connection closed before RTSP response was complete.");
 			return false;
 		}
 		rtspResponse->responseBufferSize += receivedMessageSize;
 
-		/* Repeat reading messages if a full buffer is read and more data is available on a TCP connection (UDP packets are lost) */
-	} while(rtspResponse->responseBufferSize == rtspResponse->maxResponseBufferSize
-			&& networkGetConnectionType(networkConnection) == TCP_CONNECTION
-			&& networkIsMessageAvailable(networkConnection));
+		/* Check if full response is received */
+		if(!rtspResponseFindFrame(rtspResponse->responseBuffer, rtspResponse->responseBufferSize, &rtspResponse->frame, &rtspResponse->isComplete)) {
+			return false;
+		}
+		if(!rtspResponse->isComplete) {
+			*isComplete = false;
+			return true;
+		}
+	}
+
+	/* Keep bytes of next response apart (a server might answer pipelined requests in a single message) */
+	responseSize = rtspResponse->frame.headerSize + rtspResponse->frame.contentLength;
+	rtspResponse->nextResponseSize = rtspResponse->responseBufferSize - responseSize;
+	rtspResponse->responseBufferSize = responseSize;
+	*isComplete = true;
 
 	/* Write info from this message */
         logWrite(LOG_LEVEL_DEBUG, LOG_COMPONENT_NAME, "Received RTSP response:\n%.*s", (int)rtspResponse->responseBufferSize, rtspResponse->responseBuffer);
@@ -103,43 +190,200 @@ bool rtspResponseReceive(RTSPResponse *rtspResponse, NetworkConnection *networkC
 	return true;
 }
 
-bool rtspResponseGetStatus(RTSPResponse *rtspResponse, int16_t *status) {
-	int16_t intValue;
+bool rtspResponseIsNextComplete(RTSPResponse *rtspResponse) {
+	RTSPResponseFrame frame;
+	bool isComplete;
 
-	/* Check buffer for presence of status info */
-	if(rtspResponse->responseBuffer == NULL || rtspResponse->responseBufferSize < 12) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP Response does not contain (enough) buffer content to retrieve status.");
+	/* Check the bytes received after the current response */
+	if(!rtspResponse->isComplete || rtspResponse->nextResponseSize == 0) {
 		return false;
 	}
+	rtspResponseInitializeFrame(&frame);
+	if(!rtspResponseFindFrame(rtspResponse->responseBuffer + rtspResponse->responseBufferSize, rtspResponse->nextResponseSize, &frame, &isComplete)) {
+		return true;	/* Let receiving report the invalid response */
+	}
+
+	return isComplete;
+}
 
-	/* Check protocol value */
-	if(memcmp(rtspResponse->responseBuffer, "RTSP/", 5) != 0 || !isdigit(rtspResponse->responseBuffer[5]) || rtspResponse->responseBuffer[6] != '.' || !isdigit(rtspResponse->responseBuffer[7]) || rtspResponse->responseBuffer[8] != ' ') {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP Response does not contain correct protocol name and version. Expected \"RTSP/<digit>.<digit><space>\" found \"%.*s\"", 9, rtspResponse->responseBuffer);
+void rtspResponseInitializeFrame(RTSPResponseFrame *frame) {
+	frame->scannedSize = 0;
+	frame->headerSize = 0;
+	frame->contentLength = 0;
+}
+
+bool rtspResponseFindFrame(uint8_t *buffer, size_t bufferSize, RTSPResponseFrame *frame, bool *isComplete) {
+	uint8_t *headerEnd;
+
+	/* Find the empty line ending the header (only in bytes not scanned before, the line might start in bytes scanned before) */
+	if(frame->headerSize == 0) {
+		headerEnd = buffer + frame->scannedSize;
+		while(headerEnd + HEADER_END_STRING_SIZE <= buffer + bufferSize && memcmp(headerEnd, HEADER_END_STRING, HEADER_END_STRING_SIZE) != 0) {
+			headerEnd++;
+		}
+		if(headerEnd + HEADER_END_STRING_SIZE > buffer + bufferSize) {
+			if(bufferSize > MAX_RESPONSE_SIZE) {
+				logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP response header is too long (more than %d bytes without end of header).", MAX_RESPONSE_SIZE);
+				return false;
+			}
+			frame->scannedSize = headerEnd - buffer;
+			*isComplete = false;
+			return true;
+		}
+		frame->headerSize = headerEnd + HEADER_END_STRING_SIZE - buffer;
+
+		/* Parse status line and header fields once (header is followed by content, if present) */
+		if(!rtspResponseParseHeader(buffer, frame)) {
+			return false;
+		}
+		if(frame->headerSize + frame->contentLength > MAX_RESPONSE_SIZE) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP response is too long (%zu bytes of content).", frame->contentLength);
+			return false;
+		}
+	}
+
+	/* Full response is received once all content is present */
+	*isComplete = frame->headerSize + frame->contentLength <= bufferSize;
+
+	return true;
+}
+
+bool rtspResponseParseHeader(uint8_t *buffer, RTSPResponseFrame *frame) {
+	uint8_t *headerEnd;
+	uint8_t *line;
+	uint8_t *lineEnd;
+	uint8_t *nameEnd;
+	uint8_t *value;
+	uint8_t *valueEnd;
+	uint32_t uint32Value;
+	int index;
+
+	/* Check protocol value of status line */
+	headerEnd = buffer + frame->headerSize;
+	lineEnd = memchr(buffer, NEWLINE_CHARACTER, frame->headerSize);
+	if(lineEnd - buffer < STATUS_PREFIX_SIZE || memcmp(buffer, "RTSP/", 5) != 0 || !isdigit(buffer[5]) || buffer[6] != '.' || !isdigit(buffer[7]) || buffer[8] != ' ') {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP Response does not contain correct protocol name and version. Expected \"RTSP/<digit>.<digit><space>\" found \"%.*s\"", STATUS_PREFIX_SIZE, buffer);
 		return false;
 	}
 
 	/* Retrieve status value */
-	if(sscanf((char *)rtspResponse->responseBuffer + 9, "%" SCNi16, &intValue) != 1) {
+	if(!rtspResponseParseNumber(buffer + STATUS_PREFIX_SIZE, lineEnd - buffer - STATUS_PREFIX_SIZE, 10, MAX_STATUS_VALUE, &uint32Value)) {
 		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot read status value from RTSP response");
 		return false;
 	}
-	*status = intValue;
+	frame->status = (int16_t)uint32Value;
+
+	/* Keep location of values of the header fields used ("<name>:<optional spaces><value>", trailing spaces and return removed) */
+	for(index = 0; index < RTSP_RESPONSE_FIELD_COUNT; index++) {
+		frame->fieldValues[index].isPresent = false;
+	}
+	line = lineEnd + 1;
+	while(line < headerEnd) {
+		lineEnd = memchr(line, NEWLINE_CHARACTER, headerEnd - line);	/* Always present, header ends with an empty line */
+		nameEnd = memchr(line, KEY_SEPARATOR_CHARACTER, lineEnd - line);
+		if(nameEnd != NULL) {
+			index = 0;
+			while(index < RTSP_RESPONSE_FIELD_COUNT && (strlen(headerFieldNames[index]) != (size_t)(nameEnd - line) || strncasecmp((char *)line, headerFieldNames[index], nameEnd - line) != 0)) {
+				index++;
+			}
+			if(index < RTSP_RESPONSE_FIELD_COUNT) {
+				value = nameEnd + 1;
+				while(value < lineEnd && (*value == SPACE_CHARACTER || *value == TAB_CHARACTER)) {
+					value++;
+				}
+				valueEnd = lineEnd;
+				while(valueEnd > value && (*(valueEnd - 1) == RETURN_CHARACTER || *(valueEnd - 1) == SPACE_CHARACTER || *(valueEnd - 1) == TAB_CHARACTER)) {
+					valueEnd--;
+				}
+				frame->fieldValues[index].valueOffset = value - buffer;
+				frame->fieldValues[index].valueSize = valueEnd - value;
+				frame->fieldValues[index].isPresent = true;
+			}
+		}
+		line = lineEnd + 1;
+	}
+
+	/* Header is followed by content (if present) */
+	frame->contentLength = 0;
+	if(frame->fieldValues[RTSP_RESPONSE_FIELD_CONTENT_LENGTH].isPresent) {
+		if(!rtspResponseParseNumber(buffer + frame->fieldValues[RTSP_RESPONSE_FIELD_CONTENT_LENGTH].valueOffset, frame->fieldValues[RTSP_RESPONSE_FIELD_CONTENT_LENGTH].valueSize, 10, MAX_RESPONSE_SIZE, &uint32Value)) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP response has an invalid Content-Length value.");
+			return false;
+		}
+		frame->contentLength = uint32Value;
+	}
+
+	return true;
+}
+
+bool rtspResponseParseNumber(uint8_t *value, size_t valueSize, int base, uint32_t maxNumber, uint32_t *number) {
+	uint64_t result;
+	int digit;
+	size_t index;
+
+	/* Convert leading digits (at least one) and stop at first other character */
+	result = 0;
+	index = 0;
+	while(index < valueSize) {
+		if(isdigit(value[index])) {
+			digit = value[index] - '0';
+		} else if(base == 16 && isxdigit(value[index])) {
+			digit = tolower(value[index]) - 'a' + 10;
+		} else {
+			break;
+		}
+		result = result * base + digit;
+		if(result > maxNumber) {
+			return false;
+		}
+		index++;
+	}
+	if(index == 0) {
+		return false;
+	}
+	*number = (uint32_t)result;
+
+	return true;
+}
+
+bool rtspResponseGetFieldValue(RTSPResponse *rtspResponse, RTSPResponseField field, uint8_t **value, size_t *valueSize) {
+
+	/* Check response content */
+	if(!rtspResponse->isComplete) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "No complete RTSP Response when trying to retrieve %s value.", headerFieldNames[field]);
+		return false;
+	}
+	if(!rtspResponse->frame.fieldValues[field].isPresent) {
+		return false;
+	}
+	*value = rtspResponse->responseBuffer + rtspResponse->frame.fieldValues[field].valueOffset;
+	*valueSize = rtspResponse->frame.fieldValues[field].valueSize;
+
+	return true;
+}
+
+bool rtspResponseGetStatus(RTSPResponse *rtspResponse, int16_t *status) {
+
+	/* Check buffer for presence of status info (parsed when received) */
+	if(!rtspResponse->isComplete) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP Response is not complete, cannot retrieve status.");
+		return false;
+	}
+	*status = rtspResponse->frame.status;
 
 	return true;
 }
 
 bool rtspResponseGetSequenceNumber(RTSPResponse *rtspResponse, uint32_t *sequenceNumber) {
 	uint8_t *value;
-	uint32_t uint32Value;
+	size_t valueSize;
 
 	/* Retrieve CSeq value */
-	value = rtspResponseFindValueForKey(rtspResponse, "CSeq", NULL);
-	if(value != NULL) {
-		if(sscanf((char *)value, "%" SCNu32, &uint32Value) != 1) {
+	if(rtspResponseGetFieldValue(rtspResponse, RTSP_RESPONSE_FIELD_CSEQ, &value, &valueSize)) {
+		if(!rtspResponseParseNumber(value, valueSize, 10, UINT32_MAX, sequenceNumber)) {
 			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot read CSeq value from RTSP response");
 			return false;
 		}
-		*sequenceNumber = uint32Value;
 	} else {
 		logWrite(LOG_LEVEL_WARNING, LOG_COMPONENT_NAME, "No CSeq value in RTSP response (continuing anyway)");
 	}
@@ -148,46 +392,75 @@ bool rtspResponseGetSequenceNumber(RTSPResponse *rtspResponse, uint32_t *sequenc
 
 bool rtspResponseGetSession(RTSPResponse *rtspResponse, uint32_t *session) {
 	uint8_t *value;
-	uint32_t uint32Value;
+	size_t valueSize;
 
 	/* Retrieve Session value */
-	value = rtspResponseFindValueForKey(rtspResponse, "Session", NULL);
-	if(value == NULL) {
+	if(!rtspResponseGetFieldValue(rtspResponse, RTSP_RESPONSE_FIELD_SESSION, &value, &valueSize)) {
 		return false;
 	}
 
 	/* Convert value to integer */
-	if(sscanf((char *)value, "%" SCNx32, &uint32Value) != 1) {
+	if(!rtspResponseParseNumber(value, valueSize, 16, UINT32_MAX, session)) {
 		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot read Session value from RTSP response");
 		return false;
 	}
-	*session = uint32Value;
 
 	return true;
 }
 
-bool rtspResponseGetServerPort(RTSPResponse *rtspResponse, int16_t *serverPort) {
+bool rtspResponseGetServerPort(RTSPResponse *rtspResponse, uint16_t *serverPort) {
+	return rtspResponseGetTransportPort(rtspResponse, "server_port", serverPort);
+}
+
+bool rtspResponseGetControlPort(RTSPResponse *rtspResponse, uint16_t *controlPort) {
+	return rtspResponseGetTransportPort(rtspResponse, "control_port", controlPort);
+}
+
+bool rtspResponseGetTimingPort(RTSPResponse *rtspResponse, uint16_t *timingPort) {
+	return rtspResponseGetTransportPort(rtspResponse, "timing_port", timingPort);
+}
+
+bool rtspResponseGetTransportPort(RTSPResponse *rtspResponse, const char *portName, uint16_t *port) {
 	uint8_t *value;
-	int16_t int16Value;
+	uint8_t *valueEnd;
+	size_t valueSize;
+	size_t portNameSize;
+	uint32_t uint32Value;
 
-	/* Retrieve Transport:server_port value */
-	value = rtspResponseFindValueForKey(rtspResponse, "Transport", "server_port");
-	if(value == NULL) {
+	/* Retrieve Transport value */
+	if(!rtspResponseGetFieldValue(rtspResponse, RTSP_RESPONSE_FIELD_TRANSPORT, &value, &valueSize)) {
 		return false;
 	}
 
+	/* Find "<portName>=<value>" within the parameters of the Transport value */
+	portNameSize = strlen(portName);
+	valueEnd = value + valueSize;
+	while(value < valueEnd && !(value + portNameSize < valueEnd && memcmp(value, portName, portNameSize) == 0 && value[portNameSize] == SUBKEY_ASSIGNMENT_CHARACTER)) {
+		value = memchr(value, SUBKEY_SEPARATOR_CHARACTER, valueEnd - value);
+		if(value == NULL) {
+			return false;
+		}
+		value++;
+	}
+	if(value >= valueEnd) {
+		return false;
+	}
+	value += portNameSize + 1;
+
 	/* Convert value to integer */
-	if(sscanf((char *)value, "%" SCNi16, &int16Value) != 1) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot read Transport:server_port value from RTSP response");
+	if(!rtspResponseParseNumber(value, valueEnd - value, 10, UINT16_MAX, &uint32Value)) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot read Transport:%s value from RTSP response", portName);
 		return false;
 	}
-	*serverPort = int16Value;
+	*port = (uint16_t)uint32Value;
 
 	return true;
 }
 
 /* TODO: change this into something more readable/maintainable */
 bool rtspResponseGetAuthenticationResponse(RTSPResponse *rtspResponse, char *realmBuffer, uint32_t maxRealmBufferSize, uint32_t *realmBufferSize, char *nonceBuffer, uint32_t maxNonceBufferSize, uint32_t *nonceBufferSize) {
+	uint8_t *authenticateValue;
+	size_t authenticateValueSize;
 	char *value;
 	char *endValue;
 	char *realmValue;
@@ -198,22 +471,16 @@ bool rtspResponseGetAuthenticationResponse(RTSPResponse *rtspResponse, char *rea
 	char *tempValue;
 
 	/* Retrieve WWW-Authenticate value */
-	value = (char *)rtspResponseFindValueForKey(rtspResponse, "WWW-Authenticate", NULL);
-	if(value == NULL) {
+	if(!rtspResponseGetFieldValue(rtspResponse, RTSP_RESPONSE_FIELD_WWW_AUTHENTICATE, &authenticateValue, &authenticateValueSize)) {
 		return false;
 	}
+	value = (char *)authenticateValue;
+	endValue = value + authenticateValueSize;
 
 	/* Initialize pointers */
 	realmValue = NULL;
 	nonceValue = NULL;
 
-	/* Check field values, decide length of line containing values */
-	endValue = memchr(value, NEWLINE_CHARACTER, rtspResponse->responseBufferSize - (value - (char *)rtspResponse->responseBuffer));
-	if(endValue == NULL) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP Response has field WWW-Authenticate with unknown content %.*s", rtspResponse->responseBufferSize - (value - (char *)rtspResponse->responseBuffer), value);
-		return false;
-	}
-
 	/* Check for authentication method 'Digest' */
 	if(endValue - value < 7 || memcmp(value, "Digest ", 7) != 0) {
 		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "RTSP Response has field WWW-Authenticate with unknown method %.*s", endValue - value, value);
@@ -311,84 +578,6 @@ bool rtspResponseGetAuthenticationResponse(RTSPResponse *rtspResponse, char *rea
 	return true;
 }
 
-uint8_t *rtspResponseFindValueForKey(RTSPResponse *rtspResponse, const char *key, const char *subkey) {
-	uint8_t *valueLocation;
-	uint8_t *responseEnd;
-	size_t keySize;
-	size_t subkeySize;
-
-	/* Check response content */
-	if(rtspResponse->responseBuffer == NULL) {
-		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "No content in RTSP Response when trying to retrieve %s%s%s value.", key, subkey == NULL ? "" : ":", subkey == NULL ? "" : subkey);
-		return false;
-	}
-
-	/* Initialize local variables for searching */
-	keySize = strlen(key);
-	if(subkey != NULL) {
-		subkeySize = strlen(subkey);
-	} else {
-		subkeySize = 0;
-	}
-
-	/* Iterate over response */
-	responseEnd = rtspResponse->responseBuffer + rtspResponse->responseBufferSize;
-	valueLocation = rtspResponse->responseBuffer;
-	while(valueLocation < responseEnd) {
-
-		/* Find start of next key */
-		while(valueLocation < responseEnd && *valueLocation != NEWLINE_CHARACTER) {
-			valueLocation++;
-		}
-		while(valueLocation < responseEnd && *valueLocation == NEWLINE_CHARACTER) {
-			valueLocation++;
-		}
-
-		/* Key found? (check for presence of "<key>: <value>". Assume value is at least one position long) */
-		if(valueLocation + keySize + KEY_SEPARATOR_STRING_SIZE + 1 <= responseEnd && memcmp(valueLocation, key, keySize) == 0 && memcmp(valueLocation + keySize, KEY_SEPARATOR_STRING, KEY_SEPARATOR_STRING_SIZE) == 0) {
-
-			/* Skip key and separator */
-			valueLocation += keySize + KEY_SEPARATOR_STRING_SIZE;
-
-			/* Search for subkey? */
-			if(subkey != NULL) {
-
-				while(valueLocation < responseEnd && *valueLocation != NEWLINE_CHARACTER) {
-
-					/* Find start of next subkey */
-					while(valueLocation < responseEnd && *valueLocation != SUBKEY_SEPARATOR_CHARACTER && *valueLocation != NEWLINE_CHARACTER) {
-						valueLocation++;
-					}
-					while(valueLocation < responseEnd && *valueLocation == SUBKEY_SEPARATOR_CHARACTER) {
-						valueLocation++;
-					}
-
-					/* Subkey found? (check for presence of "<subkey>=<value>" or "<subkey>;". Assume value is at least one position long) */
-					if(valueLocation + subkeySize <= responseEnd && memcmp(valueLocation, subkey, subkeySize) == 0) {
-
-						/* Check for "<subkey>=<value>" */
-						if(valueLocation + subkeySize + SUBKEY_ASSIGNMENT_STRING_SIZE + 1 <= responseEnd && memcmp(valueLocation + subkeySize, SUBKEY_ASSIGNMENT_STRING, SUBKEY_ASSIGNMENT_STRING_SIZE) == 0) {
-							valueLocation += subkeySize + SUBKEY_ASSIGNMENT_STRING_SIZE;
-							return valueLocation;
-						}
-						/* Check for "<subkey>;" (the location of the ; will be answered) */
-						if(valueLocation + subkeySize <= responseEnd && *(valueLocation + subkeySize) == SUBKEY_SEPARATOR_CHARACTER) {
-							valueLocation += subkeySize;
-							return valueLocation;
-						}
-					}
-				}
-			} else {
-
-				/* No subkey, so found value. Answer its location */
-				return valueLocation;
-			}
-		}
-	}
-
-	return NULL;
-}
-
 bool rtspResponseFree(RTSPResponse **rtspResponse) {
 	bool result;
 
@@ -40,9 +40,28 @@ RTSPResponse *rtspResponseCreate();
  * Parameters:
  *	rtspResponse - already created RTSP Response (as returned by rtspResponseCreate)
  *	networkConnection - network-connection the request-message is received from
+ *	isComplete - boolean specifying if the full response is received
  * Returns: a boolean specifying if the message is received successfully
+ *
+ * Remarks:
+ * Only receives the data which is available, so it does not block on a non-blocking network-connection. A response
+ * can arrive in multiple parts, receive should be repeated (when more data is available) until the response is complete.
+ * Receiving after a complete response starts a new response. Bytes received after a complete response are kept for
+ * the next response (pipelined requests might be answered in a single message). If these contain the complete next
+ * response, receiving does not read from the network-connection (see rtspResponseIsNextComplete).
+ */
+bool rtspResponseReceive(RTSPResponse *rtspResponse, NetworkConnection *networkConnection, bool *isComplete);
+
+/*
+ * Function: rtspResponseIsNextComplete
+ * Parameters:
+ *	rtspResponse - already created RTSP Response (as returned by rtspResponseCreate)
+ * Returns: a boolean specifying if the next response is received completely together with the current response
+ *
+ * Remarks:
+ * The network-connection will not become readable for such a response, so it should be received right away.
  */
-bool rtspResponseReceive(RTSPResponse *rtspResponse, NetworkConnection *networkConnection);
+bool rtspResponseIsNextComplete(RTSPResponse *rtspResponse);
 
 /*
  * Function: rtspResponseGetStatus
@@ -78,7 +97,25 @@ bool rtspResponseGetSession(RTSPResponse *rtspResponse, uint32_t *session);
  *	serverPort - server-port (key Transport:server_port) retrieved from response
  * Returns: a boolean specifying if the server-port is present and extracted successfully
  */
-bool rtspResponseGetServerPort(RTSPResponse *rtspResponse, int16_t *serverPort);
+bool rtspResponseGetServerPort(RTSPResponse *rtspResponse, uint16_t *serverPort);
+
+/*
+ * Function: rtspResponseGetControlPort
+ * Parameters:
+ *	rtspResponse - already created RTSP Response (as returned by rtspResponseCreate)
+ *	controlPort - control-port (key Transport:control_port) retrieved from response
+ * Returns: a boolean specifying if the control-port is present and extracted successfully
+ */
+bool rtspResponseGetControlPort(RTSPResponse *rtspResponse, uint16_t *controlPort);
+
+/*
+ * Function: rtspResponseGetTimingPort
+ * Parameters:
+ *	rtspResponse - already created RTSP Response (as returned by rtspResponseCreate)
+ *	timingPort - timing-port (key Transport:timing_port) retrieved from response
+ * Returns: a boolean specifying if the timing-port is present and extracted successfully
+ */
+bool rtspResponseGetTimingPort(RTSPResponse *rtspResponse, uint16_t *timingPort);
 
 /*
  * Function: rtspResponseGetAuthenticationResponse
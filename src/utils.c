@@ -25,10 +25,16 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "log.h"
 #include "utils.h"
 
 #define	ONE_SECOND_IN_NANO_SECONDS	1000000000L
+#define	RANDOM_DEVICE_NAME		"/dev/urandom"
+
+/* Characters used for base64 encoding */
+static const char BASE64_CHARACTERS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 /* Logging component name */
 static const char *LOG_COMPONENT_NAME = "utils.c";
@@ -106,28 +112,66 @@ bool getRandomNumber(uint32_t *randomValue) {
 	return true;
 }
 
-/* clock_gettime is not implemented on OS X, do simple implementation here (less accurate, but usable) */
-#ifdef __MACH__
-#include <sys/time.h>
-
-int clock_gettime(int clk_id, struct timespec* tp) {
-	struct timeval now;
-	int result;
+bool getRandomBytes(uint8_t *buffer, size_t size) {
+	int descriptor;
+	ssize_t readSize;
 
-	if(clk_id != CLOCK_MONOTONIC) {
-		return EINVAL;
+	/* Read bytes from random device (retry when interrupted or on a short read) */
+	descriptor = open(RANDOM_DEVICE_NAME, O_RDONLY);
+	if(descriptor < 0) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot open %s for generating random bytes (error: %s)", RANDOM_DEVICE_NAME, strerror(errno));
+		return false;
 	}
-
-	/* Get time of day */
-	result = gettimeofday(&now, NULL);
-	if(result != 0) {
-		return result;
+	while(size > 0) {
+		readSize = read(descriptor, buffer, size);
+		if(readSize < 0 && errno == EINTR) {
+			continue;
+		}
+		if(readSize <= 0) {
+			logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot read random bytes from %s (error: %s)", RANDOM_DEVICE_NAME, readSize < 0 ? strerror(errno) : "end of file");
+			close(descriptor);
+			return false;
+		}
+		buffer += readSize;
+		size -= (size_t)readSize;
 	}
+	close(descriptor);
+
+	return true;
+}
 
-	/* Extract appropriate fields */
-	tp->tv_sec  = now.tv_sec;
-	tp->tv_nsec = now.tv_usec * 1000;
+bool base64Encode(const uint8_t *data, size_t dataSize, char *string, size_t maxStringSize) {
+	uint32_t value;
+	size_t index;
+	size_t stringSize;
+	size_t characterCount;
+
+	/* Every 3 bytes become 4 characters, a remaining 1 or 2 bytes become 2 or 3 characters (no padding) */
+	stringSize = dataSize / 3 * 4 + (dataSize % 3 == 0 ? 0 : dataSize % 3 + 1);
+	if(stringSize >= maxStringSize) {
+		logWrite(LOG_LEVEL_ERROR, LOG_COMPONENT_NAME, "Cannot base64 encode %lu bytes into buffer of %lu bytes", (unsigned long)dataSize, (unsigned long)maxStringSize);
+		return false;
+	}
+	for(index = 0; index < dataSize; index += 3) {
+		value = (uint32_t)data[index] << 16;
+		if(index + 1 < dataSize) {
+			value |= (uint32_t)data[index + 1] << 8;
+		}
+		if(index + 2 < dataSize) {
+			value |= (uint32_t)data[index + 2];
+		}
+		characterCount = dataSize - index >= 3 ? 4 : dataSize - index + 1;
+		string[0] = BASE64_CHARACTERS[(value >> 18) & 0x3f];
+		string[1] = BASE64_CHARACTERS[(value >> 12) & 0x3f];
+		if(characterCount > 2) {
+			string[2] = BASE64_CHARACTERS[(value >> 6) & 0x3f];
+		}
+		if(characterCount > 3) {
+			string[3] = BASE64_CHARACTERS[value & 0x3f];
+		}
+		string += characterCount;
+	}
+	*string = '\0';
 
-	return 0;
+	return true;
 }
-#endif	/* __MACH__ */
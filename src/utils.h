@@ -24,6 +24,8 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
 
 /*
  * Function: timespecInitialize
@@ -57,14 +59,38 @@ void timespecAdd(struct timespec *time, const struct timespec *delta);
  */
 void timespecSubtract(const struct timespec *time1, const struct timespec *time2, struct timespec *delta);
 
-/* clock_gettime is not implemented on OS X, only support for CLOCK_MONOTONIC */
-#ifdef __MACH__
-#include <sys/time.h>
-
-#define CLOCK_MONOTONIC		0
+/*
+ * Function: getRandomNumber
+ * Parameters:
+ *	randomValue - (pseudo)random value generated
+ * Returns: a boolean specifying if the random value was generated successfully
+ */
+bool getRandomNumber(uint32_t *randomValue);
 
-int clock_gettime(int clk_id, struct timespec* tp);
+/*
+ * Function: getRandomBytes
+ * Parameters:
+ *	buffer - buffer to fill with random bytes
+ *	size - number of random bytes to generate
+ * Returns: a boolean specifying if the random bytes were generated successfully
+ *
+ * Remarks:
+ * The bytes are read from the random device of the system and are suitable for keys (unlike getRandomNumber).
+ */
+bool getRandomBytes(uint8_t *buffer, size_t size);
 
-#endif	/* __MACH__ */
+/*
+ * Function: base64Encode
+ * Parameters:
+ *	data - data to encode
+ *	dataSize - size (in bytes) of the data
+ *	string - buffer to write the encoded (and '\0' terminated) string to
+ *	maxStringSize - size (in bytes) of the string buffer
+ * Returns: a boolean specifying if the data is encoded successfully (fails if the string buffer is too small)
+ *
+ * Remarks:
+ * The encoded string has no padding ('=' characters), as expected by the AirTunes device.
+ */
+bool base64Encode(const uint8_t *data, size_t dataSize, char *string, size_t maxStringSize);
 
 #endif	/* __UTILS_H__ */
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+#
+# File: seektest.py
+#
+# Test for light-play: seeking (SIGUSR2) while an audio packet is partially sent over TCP should continue playing.
+#
+# A fake AirTunes device (answering RTSP requests and reading audio at the rate it plays) is started and light-play
+# plays a generated m4a file with large packets on it. The device reads slowly, so light-play is nearly always in
+# the middle of sending a packet when it is asked to seek. The device answers FLUSH with a delay, so the partially
+# sent packet can be completed before streaming restarts. Audio should be received again after the seek.
+#
+# Usage: seektest.py <path to light-play>
+#
+
+import os, signal, socket, struct, subprocess, sys, tempfile, threading, time
+
+TIMESCALE = 44100
+FRAMES_PER_PACKET = 4096
+PACKET_SIZE = 12000		# Large packets (a packet does not fit in the small receive buffer of the device)
+DEVICE_BUFFER_FRAMES = 44100	# Device reads ahead at most one second of audio
+FLUSH_DELAY = 0.5		# Seconds the device takes to answer FLUSH
+
+def box(boxType, payload):
+	return struct.pack('>I', 8 + len(payload)) + boxType + payload
+
+def fullBox(boxType, payload):
+	return box(boxType, struct.pack('>I', 0) + payload)
+
+def writeM4AFile(fileName, seconds):
+	count = int(seconds * TIMESCALE / FRAMES_PER_PACKET)
+	stsz = fullBox(b'stsz', struct.pack('>II', 0, count) + struct.pack('>I', PACKET_SIZE) * count)
+	stts = fullBox(b'stts', struct.pack('>III', 1, count, FRAMES_PER_PACKET))
+	stsd = fullBox(b'stsd', struct.pack('>I', 1) + box(b'alac', bytes(28)))
+	mdhd = fullBox(b'mdhd', struct.pack('>IIII', 0, 0, TIMESCALE, count * FRAMES_PER_PACKET) + bytes(4))
+	moov = box(b'moov', box(b'trak', box(b'mdia', mdhd + box(b'minf', box(b'stbl', stsd + stts + stsz)))))
+	with open(fileName, 'wb') as m4aFile:
+		m4aFile.write(box(b'ftyp', b'M4A ' + bytes(4)) + moov + box(b'mdat', bytes(PACKET_SIZE * count)))
+
+def receiveExactly(connection, size):
+	data = b''
+	while len(data) < size:
+		part = connection.recv(size - len(data))
+		if not part:
+			return None
+		data += part
+	return data
+
+class FakeDevice:
+	def __init__(self):
+		self.rtspServer = socket.socket()
+		self.rtspServer.bind(('127.0.0.1', 0))
+		self.rtspServer.listen(4)
+		self.port = self.rtspServer.getsockname()[1]
+		self.flushTime = None
+		self.packetTimes = []
+		threading.Thread(target=self.acceptRTSP, daemon=True).start()
+
+	def acceptRTSP(self):
+		while True:	# Probe connection is closed right away
+			connection, _ = self.rtspServer.accept()
+			threading.Thread(target=self.handleRTSP, args=(connection,), daemon=True).start()
+
+	def handleRTSP(self, connection):
+		buffer = b''
+		while True:
+			data = connection.recv(65536)
+			if not data:
+				return
+			buffer += data
+			while b'\r\n\r\n' in buffer:
+				head, rest = buffer.split(b'\r\n\r\n', 1)
+				contentLength = 0
+				extra = ''
+				for line in head.split(b'\r\n'):
+					if line.lower().startswith(b'content-length:'):
+						contentLength = int(line.split(b':')[1])
+					if line.lower().startswith(b'cseq:'):
+						sequenceNumber = line.split(b':')[1].strip().decode()
+				if len(rest) < contentLength:
+					break
+				buffer = rest[contentLength:]
+				method = head.split(b' ')[0]
+				if method == b'SETUP':
+					audioServer = socket.socket()
+					audioServer.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 8192)
+					audioServer.bind(('127.0.0.1', 0))
+					audioServer.listen(1)
+					threading.Thread(target=self.handleAudio, args=(audioServer,), daemon=True).start()
+					extra = 'Session: 1\r\nTransport: RTP/AVP/TCP;unicast;mode=record;server_port=%d\r\n' % audioServer.getsockname()[1]
+				elif method == b'FLUSH' and self.flushTime is None:	# Only the flush for seeking (not the one for stopping)
+					time.sleep(FLUSH_DELAY)
+					self.flushTime = time.time()
+				connection.sendall(('RTSP/1.0 200 OK\r\nCSeq: %s\r\n%sAudio-Latency: 0\r\n\r\n' % (sequenceNumber, extra)).encode())
+
+	def handleAudio(self, audioServer):
+		connection, _ = audioServer.accept()
+		startTime = None
+		receivedFrames = 0
+		while True:
+			if startTime is not None and receivedFrames - (time.time() - startTime) * TIMESCALE >= DEVICE_BUFFER_FRAMES:
+				time.sleep(0.002)
+				continue
+			header = receiveExactly(connection, 4)
+			if header is None or receiveExactly(connection, (header[2] << 8) | header[3]) is None:
+				return
+			if startTime is None:
+				startTime = time.time()
+			receivedFrames += FRAMES_PER_PACKET
+			self.packetTimes.append(time.time())
+
+def main():
+	if len(sys.argv) != 2:
+		print('Usage: %s <path to light-play>' % sys.argv[0])
+		return 2
+	device = FakeDevice()
+	with tempfile.TemporaryDirectory() as directory:
+		fileName = os.path.join(directory, 'seek.m4a')
+		writeM4AFile(fileName, 60)
+		player = subprocess.Popen([sys.argv[1], '-ve', '-p', str(device.port), '127.0.0.1', fileName])
+		try:
+			time.sleep(3)
+			player.send_signal(signal.SIGUSR2)
+			time.sleep(FLUSH_DELAY + 3)
+			player.send_signal(signal.SIGINT)
+			player.wait(timeout=5)
+		except subprocess.TimeoutExpired:
+			player.kill()
+			print('FAIL: light-play did not stop')
+			return 1
+
+	# Streaming should have restarted after the device answered FLUSH (about a second of audio within two seconds)
+	if device.flushTime is None:
+		print('FAIL: device was not flushed for seeking')
+		return 1
+	packetCount = len([packetTime for packetTime in device.packetTimes if device.flushTime + 1 <= packetTime <= device.flushTime + 3])
+	if packetCount < TIMESCALE / FRAMES_PER_PACKET:
+		print('FAIL: %d audio packet(s) received after seeking' % packetCount)
+		return 1
+	print('PASS: %d audio packets received after seeking' % packetCount)
+	return 0
+
+if __name__ == '__main__':
+	sys.exit(main())